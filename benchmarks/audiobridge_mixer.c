@@ -0,0 +1,143 @@
+/*! \file    audiobridge_mixer.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Benchmark of the AudioBridge mixing kernels
+ * \details  Simple benchmark of the kernels the AudioBridge plugin uses
+ * to mix audio (see plugins/janus_audiobridge_mixer.h): for rooms with
+ * 10, 100 and 500 participants it simulates what the mixer does for each
+ * 20ms frame, i.e., summing the contributions of all participants and
+ * then computing the mix-minus for each of them, and measures how long
+ * that takes with the scalar kernels and the vectorized ones the CPU
+ * supports. Before measuring anything, it also checks that the vectorized
+ * kernels produce exactly the same output as the scalar ones, and exits
+ * with an error if that's not the case. Usage:
+ *
+\verbatim
+./benchmarks/audiobridge-mixer-bench [ticks]
+\endverbatim
+ *
+ * where \c ticks is the number of frames to mix for each room size
+ * (default 500). It can be built and run with \c make \c check-benchmarks
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../plugins/janus_audiobridge_mixer.h"
+
+/* 20ms of audio at 48kHz */
+#define BENCH_SAMPLES	960
+
+static const int bench_sizes[] = { 10, 100, 500 };
+#define BENCH_SIZES	(int)(sizeof(bench_sizes)/sizeof(bench_sizes[0]))
+
+static double bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1000000.0 + (double)ts.tv_nsec / 1000.0;
+}
+
+/* Prepare random frames for all participants, with a gain for some of them */
+static void bench_fill(opus_int16 *frames, float *gains, int participants) {
+	int i = 0, j = 0;
+	for(i=0; i<participants; i++) {
+		/* Loud enough that the mix will need saturation with many participants */
+		for(j=0; j<BENCH_SAMPLES; j++)
+			frames[i*BENCH_SAMPLES+j] = (opus_int16)((rand() % 65536) - 32768);
+		gains[i] = (i % 4 == 0) ? 0.75f : 1.0f;
+	}
+}
+
+/* Do what the mixer does for a single frame */
+static void bench_mix(const janus_audiobridge_mixer_kernels *kernels, opus_int32 *sum,
+		const opus_int16 *frames, const float *gains, opus_int16 *outs, int participants) {
+	int i = 0;
+	memset(sum, 0, BENCH_SAMPLES*sizeof(opus_int32));
+	for(i=0; i<participants; i++)
+		kernels->accumulate(sum, frames+i*BENCH_SAMPLES, BENCH_SAMPLES, gains[i]);
+	for(i=0; i<participants; i++)
+		kernels->mix_minus(outs+i*BENCH_SAMPLES, sum, frames+i*BENCH_SAMPLES, BENCH_SAMPLES, gains[i]);
+	/* The full mix, as used for recordings and RTP forwarders */
+	kernels->saturate(outs+participants*BENCH_SAMPLES, sum, BENCH_SAMPLES);
+}
+
+int main(int argc, char *argv[]) {
+	int ticks = 500;
+	if(argc > 1) {
+		ticks = atoi(argv[1]);
+		if(ticks < 1) {
+			fprintf(stderr, "Invalid number of ticks '%s'\n", argv[1]);
+			exit(1);
+		}
+	}
+	/* Check which kernels we can test */
+	const janus_audiobridge_mixer_kernels *kernels[3];
+	int num = 0;
+	kernels[num++] = &janus_audiobridge_kernels_scalar;
+#ifdef JANUS_AUDIOBRIDGE_SIMD_KERNELS
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse2"))
+		kernels[num++] = &janus_audiobridge_kernels_sse2;
+	if(__builtin_cpu_supports("avx2"))
+		kernels[num++] = &janus_audiobridge_kernels_avx2;
+#endif
+	int max = bench_sizes[BENCH_SIZES-1];
+	opus_int16 *frames = malloc(max*BENCH_SAMPLES*sizeof(opus_int16));
+	float *gains = malloc(max*sizeof(float));
+	opus_int32 *sum = malloc(BENCH_SAMPLES*sizeof(opus_int32));
+	opus_int16 *expected = malloc((max+1)*BENCH_SAMPLES*sizeof(opus_int16));
+	opus_int16 *outs = malloc((max+1)*BENCH_SAMPLES*sizeof(opus_int16));
+	if(frames == NULL || gains == NULL || sum == NULL || expected == NULL || outs == NULL) {
+		fprintf(stderr, "Memory error\n");
+		exit(1);
+	}
+	srand(42);
+	int res = 0, s = 0, k = 0, t = 0;
+	/* First of all, make sure all kernels give the same results */
+	for(s=0; s<BENCH_SIZES; s++) {
+		int participants = bench_sizes[s];
+		size_t len = (participants+1)*BENCH_SAMPLES*sizeof(opus_int16);
+		bench_fill(frames, gains, participants);
+		bench_mix(kernels[0], sum, frames, gains, expected, participants);
+		for(k=1; k<num; k++) {
+			bench_mix(kernels[k], sum, frames, gains, outs, participants);
+			if(memcmp(expected, outs, len)) {
+				fprintf(stderr, "The %s kernels don't match the scalar ones (%d participants)\n",
+					kernels[k]->name, participants);
+				res = 1;
+			}
+		}
+	}
+	if(res != 0)
+		goto done;
+	/* Now let's measure how long each of them takes */
+	printf("Mixing %d frames of %d samples per room size\n", ticks, BENCH_SAMPLES);
+	printf("%-14s", "participants");
+	for(k=0; k<num; k++)
+		printf("%14s", kernels[k]->name);
+	printf("   (average time per frame, us)\n");
+	for(s=0; s<BENCH_SIZES; s++) {
+		int participants = bench_sizes[s];
+		bench_fill(frames, gains, participants);
+		printf("%-14d", participants);
+		for(k=0; k<num; k++) {
+			/* Warm up the caches first */
+			bench_mix(kernels[k], sum, frames, gains, outs, participants);
+			double start = bench_now();
+			for(t=0; t<ticks; t++)
+				bench_mix(kernels[k], sum, frames, gains, outs, participants);
+			printf("%14.1f", (bench_now() - start) / ticks);
+		}
+		printf("\n");
+	}
+
+done:
+	free(frames);
+	free(gains);
+	free(sum);
+	free(expected);
+	free(outs);
+	return res;
+}
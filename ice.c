@@ -342,21 +342,123 @@ typedef struct janus_ice_outgoing_traffic {
 	GSource parent;
 	janus_ice_handle *handle;
 	GDestroyNotify destroy;
+	gint64 pacer_next;	/* When the pacer will need to send more packets, if it's queueing any */
 } janus_ice_outgoing_traffic;
 static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data);
 static gboolean janus_ice_outgoing_stats_handle(gpointer user_data);
 static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janus_ice_queued_packet *pkt);
+/* Pacing of outgoing video: the rate is a multiple of the estimated bandwidth, so that
+ * bursts are spread over time without adding too much delay, and packets never wait
+ * more than JANUS_ICE_PACER_MAX_DELAY, no matter what the rate is */
+#define JANUS_ICE_PACER_FACTOR		2.5
+#define JANUS_ICE_PACER_MAX_BURST	10000
+#define JANUS_ICE_PACER_MAX_DELAY	250000
+/* Maximum rate, in bits per second, to pace outgoing video at (0 means no pacing) */
+static uint32_t pacing_bitrate = 0;
+/* Upper bounds (in microseconds) of the buckets of the queueing delay histogram */
+static const gint64 janus_ice_pacer_histogram_limits[JANUS_ICE_PACER_HISTOGRAM_SIZE-1] = {
+	1000, 5000, 10000, 25000, 50000, 100000
+};
+static janus_ice_pacer *janus_ice_pacer_get(janus_ice_handle *handle) {
+	janus_ice_stream *stream = handle->stream;
+	return (stream && stream->pacer.queue) ? &stream->pacer : NULL;
+}
+static void janus_ice_pacer_update_rate(janus_ice_pacer *pacer) {
+	uint64_t rate = (uint64_t)(pacer->bwe.estimate * JANUS_ICE_PACER_FACTOR);
+	pacer->rate = (rate < pacing_bitrate) ? rate : pacing_bitrate;
+}
+static void janus_ice_pacer_enqueue(janus_ice_pacer *pacer, janus_ice_queued_packet *pkt) {
+	/* Retransmissions skip the line, as the peer is already waiting for them */
+	if(pkt->retransmission)
+		g_queue_push_head(pacer->queue, pkt);
+	else
+		g_queue_push_tail(pacer->queue, pkt);
+	pacer->queued_bytes += pkt->length;
+}
+/* Send as many queued packets as the budget allows: returns how long to wait
+ * before trying again (in microseconds), or -1 if the queue is empty */
+static gint64 janus_ice_pacer_send(janus_ice_handle *handle, janus_ice_pacer *pacer, gboolean *removed) {
+	gint64 now = janus_get_monotonic_time();
+	if(g_queue_is_empty(pacer->queue)) {
+		pacer->last_update = now;
+		return -1;
+	}
+	/* Refill the budget, but don't allow large bursts after some silence */
+	gint64 max_budget = MAX((gint64)pacer->rate * JANUS_ICE_PACER_MAX_BURST / (8*G_USEC_PER_SEC), 1500);
+	pacer->budget += (now - pacer->last_update) * pacer->rate / (8*G_USEC_PER_SEC);
+	if(pacer->budget > max_budget)
+		pacer->budget = max_budget;
+	pacer->last_update = now;
+	janus_ice_queued_packet *pkt = NULL;
+	while((pkt = g_queue_peek_head(pacer->queue)) != NULL) {
+		gint64 delay = now - pkt->added;
+		if(pacer->budget <= 0 && delay < JANUS_ICE_PACER_MAX_DELAY)
+			break;
+		if(pacer->budget <= 0)
+			pacer->overflows++;
+		g_queue_pop_head(pacer->queue);
+		pacer->queued_bytes -= pkt->length;
+		pacer->budget -= pkt->length;
+		int i = 0;
+		while(i < JANUS_ICE_PACER_HISTOGRAM_SIZE-1 && delay >= janus_ice_pacer_histogram_limits[i])
+			i++;
+		pacer->delay_histogram[i]++;
+		if(janus_ice_outgoing_traffic_handle(handle, pkt) == G_SOURCE_REMOVE)
+			*removed = TRUE;
+		if(janus_ice_pacer_get(handle) != pacer)	/* The PeerConnection went away */
+			return -1;
+	}
+	if(pkt == NULL)
+		return -1;
+	/* Wait until we have some budget again, or the first packet waited for too long */
+	gint64 wait = pacer->rate ? ((1 - pacer->budget) * 8*G_USEC_PER_SEC / pacer->rate) : JANUS_ICE_PACER_MAX_DELAY;
+	gint64 timeout = JANUS_ICE_PACER_MAX_DELAY - (now - pkt->added);
+	return MAX(MIN(wait, timeout), 0);
+}
+static gboolean janus_ice_outgoing_traffic_ready(janus_ice_outgoing_traffic *t, gint *timeout) {
+	if(g_async_queue_length(t->handle->queued_packets) > 0)
+		return TRUE;
+	if(t->pacer_next > 0) {
+		gint64 now = janus_get_monotonic_time();
+		if(now >= t->pacer_next)
+			return TRUE;
+		if(timeout)
+			*timeout = (t->pacer_next - now + 999)/1000;
+	}
+	return FALSE;
+}
 static gboolean janus_ice_outgoing_traffic_prepare(GSource *source, gint *timeout) {
 	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
-	return (g_async_queue_length(t->handle->queued_packets) > 0);
+	return janus_ice_outgoing_traffic_ready(t, timeout);
+}
+static gboolean janus_ice_outgoing_traffic_check(GSource *source) {
+	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
+	return janus_ice_outgoing_traffic_ready(t, NULL);
 }
 static gboolean janus_ice_outgoing_traffic_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
 	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
 	int ret = G_SOURCE_CONTINUE;
 	janus_ice_queued_packet *pkt = NULL;
+	janus_ice_pacer *pacer = janus_ice_pacer_get(t->handle);
 	while((pkt = g_async_queue_try_pop(t->handle->queued_packets)) != NULL) {
+		if(pacer != NULL && pkt->data != NULL && pkt->type == JANUS_ICE_PACKET_VIDEO && !pkt->control) {
+			/* This is outgoing video and we're pacing, queue it (our fake messages have no data) */
+			janus_ice_pacer_enqueue(pacer, pkt);
+			continue;
+		}
 		if(janus_ice_outgoing_traffic_handle(t->handle, pkt) == G_SOURCE_REMOVE)
 			ret = G_SOURCE_REMOVE;
+		/* The packet may have been a hangup, so check the pacer again */
+		pacer = janus_ice_pacer_get(t->handle);
+	}
+	t->pacer_next = 0;
+	if(pacer != NULL && ret != G_SOURCE_REMOVE) {
+		gboolean removed = FALSE;
+		gint64 wait = janus_ice_pacer_send(t->handle, pacer, &removed);
+		if(removed)
+			ret = G_SOURCE_REMOVE;
+		else if(wait >= 0)
+			t->pacer_next = janus_get_monotonic_time() + wait;
 	}
 	return ret;
 }
@@ -375,7 +477,7 @@ static void janus_ice_outgoing_traffic_finalize(GSource *source) {
 }
 static GSourceFuncs janus_ice_outgoing_traffic_funcs = {
 	janus_ice_outgoing_traffic_prepare,
-	NULL,	/* We don't need check */
+	janus_ice_outgoing_traffic_check,
 	janus_ice_outgoing_traffic_dispatch,
 	janus_ice_outgoing_traffic_finalize,
 	NULL, NULL
@@ -438,6 +540,17 @@ uint janus_get_twcc_period(void) {
 	return twcc_period;
 }
 
+void janus_set_pacing_bitrate(uint bitrate) {
+	pacing_bitrate = bitrate*1000;
+	if(pacing_bitrate == 0)
+		JANUS_LOG(LOG_VERB, "Disabling pacing of outgoing video\n");
+	else
+		JANUS_LOG(LOG_VERB, "Setting maximum pacing rate to %u kbps\n", bitrate);
+}
+uint janus_get_pacing_bitrate(void) {
+	return pacing_bitrate/1000;
+}
+
 
 /* RFC4588 support */
 static gboolean rfc4588_enabled = FALSE;
@@ -1471,6 +1584,9 @@ static void janus_ice_stream_free(const janus_refcount *stream_ref) {
 	stream->video_rtcp_ctx[1] = NULL;
 	g_free(stream->video_rtcp_ctx[2]);
 	stream->video_rtcp_ctx[2] = NULL;
+	if(stream->pacer.queue != NULL)
+		g_queue_free_full(stream->pacer.queue, (GDestroyNotify)janus_ice_free_queued_packet);
+	stream->pacer.queue = NULL;
 	if(stream->rtx_nacked[0])
 		g_hash_table_destroy(stream->rtx_nacked[0]);
 	stream->rtx_nacked[0] = NULL;
@@ -2752,6 +2868,9 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					return;
 				}
 				JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Got %s RTCP (%d bytes)\n", handle->handle_id, video ? "video" : "audio", buflen);
+				/* If we're pacing outgoing video, update the rate according to the feedback */
+				if(video && stream->pacer.queue != NULL && janus_rtcp_bwe_context_process(&stream->pacer.bwe, buf, buflen))
+					janus_ice_pacer_update_rate(&stream->pacer);
 
 				/* Now let's see if there are any NACKs to handle */
 				gint64 now = janus_get_monotonic_time();
@@ -3345,6 +3464,13 @@ int janus_ice_setup_local(janus_ice_handle *handle, int offer, int audio, int vi
 	stream->audio_payload_type = -1;
 	stream->video_payload_type = -1;
 	stream->video_rtx_payload_type = -1;
+	if(pacing_bitrate > 0) {
+		/* Outgoing video will be paced, start from the maximum rate until we know more */
+		stream->pacer.queue = g_queue_new();
+		janus_rtcp_bwe_context_init(&stream->pacer.bwe, pacing_bitrate, pacing_bitrate);
+		janus_ice_pacer_update_rate(&stream->pacer);
+		stream->pacer.last_update = janus_get_monotonic_time();
+	}
 	/* FIXME By default, if we're being called we're DTLS clients, but this may be changed by ICE... */
 	stream->dtls_role = offer ? JANUS_DTLS_ROLE_CLIENT : JANUS_DTLS_ROLE_ACTPASS;
 	if(audio) {
@@ -146,6 +146,12 @@ void janus_set_twcc_period(uint period);
 /*! \brief Method to get the current TWCC period (see above)
  * @returns The current TWCC period */
 uint janus_get_twcc_period(void);
+/*! \brief Method to enable or disable the pacing of outgoing video, and set the maximum pacing rate
+ * @param[in] bitrate The maximum pacing rate, in kbps (0 disables pacing) */
+void janus_set_pacing_bitrate(uint bitrate);
+/*! \brief Method to get the current maximum pacing rate (see above)
+ * @returns The current maximum pacing rate, in kbps (0 if pacing is disabled) */
+uint janus_get_pacing_bitrate(void);
 /*! \brief Method to enable or disable the RFC4588 support negotiation
  * @param[in] enabled The new timer value, in seconds */
 void janus_set_rfc4588_enabled(gboolean enabled);
@@ -270,6 +276,34 @@ enum {
 };
 
 
+/*! \brief Number of buckets in the queueing delay histogram of a pacer */
+#define JANUS_ICE_PACER_HISTOGRAM_SIZE	7
+/*! \brief Janus outgoing media pacer (leaky bucket): when pacing is enabled,
+ * outgoing video packets are queued and sent at a rate derived from the
+ * bandwidth estimated for the peer (capped by the configured maximum),
+ * rather than as soon as they're available, in order to spread large
+ * keyframes over time; audio and RTCP bypass the queue. Only accessed
+ * by the loop thread of the handle, aside from stats. */
+typedef struct janus_ice_pacer {
+	/*! \brief Video packets waiting to be sent (NULL if pacing is disabled) */
+	GQueue *queue;
+	/*! \brief Bytes currently waiting in the queue */
+	guint32 queued_bytes;
+	/*! \brief Bytes we can send right now (may be negative after a large packet) */
+	gint64 budget;
+	/*! \brief Monotonic time of when the budget was last updated */
+	gint64 last_update;
+	/*! \brief Current pacing rate, in bits per second */
+	uint32_t rate;
+	/*! \brief Bandwidth estimation for the peer, the pacing rate is derived from it */
+	janus_rtcp_bwe_context bwe;
+	/*! \brief Histogram of the time packets spent waiting before being sent */
+	guint64 delay_histogram[JANUS_ICE_PACER_HISTOGRAM_SIZE];
+	/*! \brief Packets sent out of turn, as they had been waiting for too long */
+	guint64 overflows;
+} janus_ice_pacer;
+
+
 /*! \brief Janus ICE handle */
 struct janus_ice_handle {
 	/*! \brief Opaque pointer to the core/peer session */
@@ -424,6 +458,8 @@ struct janus_ice_stream {
 	guint transport_wide_cc_feedback_count;
 	/*! \brief GLib list of transport wide cc stats in reverse received order */
 	GSList *transport_wide_received_seq_nums;
+	/*! \brief Pacer for outgoing video, if pacing is enabled */
+	janus_ice_pacer pacer;
 	/*! \brief DTLS role of the server for this stream */
 	janus_dtls_role dtls_role;
 	/*! \brief Hashing algorhitm used by the peer for the DTLS certificate (e.g., "SHA-256") */
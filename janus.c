@@ -39,6 +39,7 @@
 #include "rtcp.h"
 #include "auth.h"
 #include "record.h"
+#include "media-reactor.h"
 #include "events.h"
 
 
@@ -291,6 +292,8 @@ static json_t *janus_info(const char *transaction) {
 	json_object_set_new(info, "full-trickle", janus_ice_is_full_trickle_enabled() ? json_true() : json_false());
 	json_object_set_new(info, "rfc-4588", janus_is_rfc4588_enabled() ? json_true() : json_false());
 	json_object_set_new(info, "twcc-period", json_integer(janus_get_twcc_period()));
+	if(janus_get_pacing_bitrate() > 0)
+		json_object_set_new(info, "pacing-bitrate", json_integer(janus_get_pacing_bitrate()));
 	if(janus_ice_get_stun_server() != NULL) {
 		char server[255];
 		g_snprintf(server, 255, "%s:%"SCNu16, janus_ice_get_stun_server(), janus_ice_get_stun_port());
@@ -2706,6 +2709,24 @@ json_t *janus_admin_stream_summary(janus_ice_stream *stream) {
 	if(stream->transport_wide_cc_ext_id > 0)
 		json_object_set_new(bwe, "twcc-ext-id", json_integer(stream->transport_wide_cc_ext_id));
 	json_object_set_new(s, "bwe", bwe);
+	if(stream->pacer.queue != NULL) {
+		janus_ice_pacer *pacer = &stream->pacer;
+		json_t *p = json_object();
+		json_object_set_new(p, "rate", json_integer(pacer->rate));
+		json_object_set_new(p, "estimate", json_integer(pacer->bwe.estimate));
+		json_object_set_new(p, "queued-bytes", json_integer(pacer->queued_bytes));
+		json_object_set_new(p, "overflows", json_integer(pacer->overflows));
+		/* Queueing delay histogram, bucket names are the upper bounds */
+		static const char *buckets[JANUS_ICE_PACER_HISTOGRAM_SIZE] = {
+			"1ms", "5ms", "10ms", "25ms", "50ms", "100ms", "max"
+		};
+		json_t *h = json_object();
+		int i = 0;
+		for(i=0; i<JANUS_ICE_PACER_HISTOGRAM_SIZE; i++)
+			json_object_set_new(h, buckets[i], json_integer(pacer->delay_histogram[i]));
+		json_object_set_new(p, "delay-histogram", h);
+		json_object_set_new(s, "pacer", p);
+	}
 	json_t *components = json_array();
 	if(stream->component) {
 		json_t *c = janus_admin_component_summary(stream->component);
@@ -4323,6 +4344,16 @@ gint main(int argc, char *argv[])
 			janus_set_twcc_period(tp);
 		}
 	}
+	/* Pacing of outgoing video */
+	item = janus_config_get(config, config_media, janus_config_type_item, "pacing_bitrate");
+	if(item && item->value) {
+		int pb = atoi(item->value);
+		if(pb < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring pacing_bitrate value as it's not a positive integer\n");
+		} else {
+			janus_set_pacing_bitrate(pb);
+		}
+	}
 	/* RFC4588 support */
 	item = janus_config_get(config, config_media, janus_config_type_item, "rfc_4588");
 	if(item && item->value) {
@@ -4378,6 +4409,21 @@ gint main(int argc, char *argv[])
 	JANUS_LOG(LOG_WARN, "Data Channels support not compiled\n");
 #endif
 
+	/* Start the reactor plugins can use for the media sockets they own */
+	guint reactor_threads = 0;
+	item = janus_config_get(config, config_media, janus_config_type_item, "reactor_threads");
+	if(item && item->value) {
+		int rt = atoi(item->value);
+		if(rt < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring reactor_threads value as it's not a positive integer\n");
+		} else {
+			reactor_threads = rt;
+		}
+	}
+	if(janus_media_reactor_init(reactor_threads) < 0) {
+		exit(1);
+	}
+
 	/* Sessions */
 	sessions = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, NULL);
 	janus_mutex_init(&sessions_mutex);
@@ -4894,6 +4940,8 @@ gint main(int argc, char *argv[])
 		g_hash_table_destroy(plugins_so);
 	}
 
+	janus_media_reactor_deinit();
+
 	JANUS_LOG(LOG_INFO, "Closing event handlers:\n");
 	janus_events_deinit();
 	if(eventhandlers != NULL && g_hash_table_size(eventhandlers) > 0) {
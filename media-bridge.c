@@ -0,0 +1,272 @@
+/*! \file    media-bridge.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    In-process media bridge between plugins
+ * \details  Implementation of a simple named registry that plugins can
+ * use to hand RTP packets to each other within the same Janus instance,
+ * without going through RTP forwarders and loopback sockets. Check the
+ * documentation in media-bridge.h for more details.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <string.h>
+
+#include "media-bridge.h"
+#include "debug.h"
+#include "mutex.h"
+#include "refcount.h"
+
+/* How many packets we queue for a sink, at most, before dropping new ones */
+#define JANUS_MEDIA_BRIDGE_MAX_QUEUED	500
+
+/* A named bridge, shared by the source (if any) and all its sinks */
+typedef struct janus_media_bridge {
+	char *name;
+	/* Current source, if any */
+	janus_media_bridge_source *source;
+	/* Sinks interested in this bridge */
+	GList *sinks;
+	volatile gint sinks_count;
+	/* Whether any sink asked for a keyframe since the last time we notified the source */
+	volatile gint keyframe_needed;
+	/* How many sources and sinks reference this bridge (protected by bridges_mutex) */
+	guint users;
+	janus_mutex mutex;
+} janus_media_bridge;
+
+struct janus_media_bridge_source {
+	janus_media_bridge *bridge;
+	janus_media_bridge_keyframe_cb keyframe_cb;
+	void *user_data;
+};
+
+struct janus_media_bridge_sink {
+	janus_media_bridge *bridge;
+	janus_media_bridge_packet_cb packet_cb;
+	void *user_data;
+	/* Packets waiting to be passed to the callback by the sink thread */
+	GAsyncQueue *packets;
+	GThread *thread;
+	/* Whether we're dropping packets because the sink can't keep up */
+	volatile gint overflow;
+	volatile gint stopping;
+};
+
+/* Copy of a packet, shared by all the sinks it's queued for */
+typedef struct janus_media_bridge_queued_packet {
+	janus_media_bridge_packet packet;
+	janus_refcount ref;
+} janus_media_bridge_queued_packet;
+static janus_media_bridge_queued_packet exit_packet;
+
+static void janus_media_bridge_queued_packet_free(const janus_refcount *packet_ref) {
+	janus_media_bridge_queued_packet *qp = janus_refcount_containerof(packet_ref, janus_media_bridge_queued_packet, ref);
+	/* The buffer was allocated together with the packet */
+	g_free(qp);
+}
+
+static janus_media_bridge_queued_packet *janus_media_bridge_queued_packet_create(const janus_media_bridge_packet *packet) {
+	janus_media_bridge_queued_packet *qp = g_malloc(sizeof(janus_media_bridge_queued_packet) + packet->length);
+	qp->packet = *packet;
+	char *buffer = (char *)(qp + 1);
+	memcpy(buffer, packet->buffer, packet->length);
+	qp->packet.buffer = buffer;
+	janus_refcount_init(&qp->ref, janus_media_bridge_queued_packet_free);
+	return qp;
+}
+
+/* Thread that passes the packets queued for a sink to its callback */
+static void *janus_media_bridge_sink_thread(void *data) {
+	janus_media_bridge_sink *sink = (janus_media_bridge_sink *)data;
+	janus_media_bridge_queued_packet *qp = NULL;
+	while((qp = g_async_queue_pop(sink->packets)) != &exit_packet) {
+		/* If we're being removed, just get rid of what's left in the queue */
+		if(!g_atomic_int_get(&sink->stopping))
+			sink->packet_cb(&qp->packet, sink->user_data);
+		janus_refcount_decrease(&qp->ref);
+	}
+	return NULL;
+}
+
+static GHashTable *bridges = NULL;
+static janus_mutex bridges_mutex = JANUS_MUTEX_INITIALIZER;
+
+static void janus_media_bridge_free(janus_media_bridge *bridge) {
+	if(bridge == NULL)
+		return;
+	g_list_free(bridge->sinks);
+	janus_mutex_destroy(&bridge->mutex);
+	g_free(bridge->name);
+	g_free(bridge);
+}
+
+/* Helpers to get (and possibly create) a bridge, and release it when not needed anymore:
+ * both must be called with the bridges_mutex lock held */
+static janus_media_bridge *janus_media_bridge_get(const char *name) {
+	if(bridges == NULL)
+		bridges = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)janus_media_bridge_free);
+	janus_media_bridge *bridge = g_hash_table_lookup(bridges, name);
+	if(bridge == NULL) {
+		bridge = g_malloc0(sizeof(janus_media_bridge));
+		bridge->name = g_strdup(name);
+		janus_mutex_init(&bridge->mutex);
+		g_hash_table_insert(bridges, bridge->name, bridge);
+	}
+	bridge->users++;
+	return bridge;
+}
+
+static void janus_media_bridge_release(janus_media_bridge *bridge) {
+	bridge->users--;
+	if(bridge->users == 0)
+		g_hash_table_remove(bridges, bridge->name);
+}
+
+janus_media_bridge_source *janus_media_bridge_source_add(const char *name,
+		janus_media_bridge_keyframe_cb keyframe_cb, void *user_data) {
+	if(name == NULL)
+		return NULL;
+	janus_media_bridge_source *source = g_malloc0(sizeof(janus_media_bridge_source));
+	source->keyframe_cb = keyframe_cb;
+	source->user_data = user_data;
+	janus_mutex_lock(&bridges_mutex);
+	janus_media_bridge *bridge = janus_media_bridge_get(name);
+	source->bridge = bridge;
+	janus_mutex_lock(&bridge->mutex);
+	if(bridge->source != NULL)
+		JANUS_LOG(LOG_WARN, "[%s] Replacing existing media bridge source\n", name);
+	bridge->source = source;
+	/* Any sink that was already waiting will need a keyframe */
+	if(bridge->sinks != NULL)
+		g_atomic_int_set(&bridge->keyframe_needed, 1);
+	janus_mutex_unlock(&bridge->mutex);
+	janus_mutex_unlock(&bridges_mutex);
+	JANUS_LOG(LOG_VERB, "[%s] Added media bridge source\n", name);
+	return source;
+}
+
+gboolean janus_media_bridge_source_has_sinks(janus_media_bridge_source *source) {
+	if(source == NULL)
+		return FALSE;
+	return g_atomic_int_get(&source->bridge->sinks_count) > 0;
+}
+
+void janus_media_bridge_source_relay(janus_media_bridge_source *source, const janus_media_bridge_packet *packet) {
+	if(source == NULL || packet == NULL || packet->buffer == NULL || packet->length < 1)
+		return;
+	janus_media_bridge *bridge = source->bridge;
+	if(g_atomic_int_get(&bridge->sinks_count) == 0)
+		return;
+	janus_mutex_lock(&bridge->mutex);
+	if(bridge->source != source) {
+		/* We've been replaced by a newer source */
+		janus_mutex_unlock(&bridge->mutex);
+		return;
+	}
+	/* We make a single copy of the packet, and queue a reference to it for
+	 * each sink: sinks will process it in their own thread, which means a
+	 * slow sink can't stall the source, or the other sinks */
+	janus_media_bridge_queued_packet *qp = janus_media_bridge_queued_packet_create(packet);
+	GList *l = bridge->sinks;
+	while(l) {
+		janus_media_bridge_sink *sink = (janus_media_bridge_sink *)l->data;
+		if(g_async_queue_length(sink->packets) >= JANUS_MEDIA_BRIDGE_MAX_QUEUED) {
+			/* The sink can't keep up, drop the packet: we'll ask for a
+			 * keyframe, so that the sink can recover once it catches up */
+			if(g_atomic_int_compare_and_exchange(&sink->overflow, 0, 1))
+				JANUS_LOG(LOG_WARN, "[%s] Media bridge sink too slow, dropping packets\n", bridge->name);
+			g_atomic_int_set(&bridge->keyframe_needed, 1);
+		} else {
+			if(g_atomic_int_compare_and_exchange(&sink->overflow, 1, 0))
+				JANUS_LOG(LOG_INFO, "[%s] Media bridge sink caught up\n", bridge->name);
+			janus_refcount_increase(&qp->ref);
+			g_async_queue_push(sink->packets, qp);
+		}
+		l = l->next;
+	}
+	janus_mutex_unlock(&bridge->mutex);
+	janus_refcount_decrease(&qp->ref);
+	/* Does any sink need a keyframe? We notify the source out of the lock */
+	if(packet->video && g_atomic_int_compare_and_exchange(&bridge->keyframe_needed, 1, 0) && source->keyframe_cb)
+		source->keyframe_cb(source->user_data);
+}
+
+void janus_media_bridge_source_remove(janus_media_bridge_source *source) {
+	if(source == NULL)
+		return;
+	janus_media_bridge *bridge = source->bridge;
+	janus_mutex_lock(&bridges_mutex);
+	janus_mutex_lock(&bridge->mutex);
+	if(bridge->source == source)
+		bridge->source = NULL;
+	janus_mutex_unlock(&bridge->mutex);
+	JANUS_LOG(LOG_VERB, "[%s] Removed media bridge source\n", bridge->name);
+	janus_media_bridge_release(bridge);
+	janus_mutex_unlock(&bridges_mutex);
+	g_free(source);
+}
+
+janus_media_bridge_sink *janus_media_bridge_sink_add(const char *name,
+		janus_media_bridge_packet_cb packet_cb, void *user_data) {
+	if(name == NULL || packet_cb == NULL)
+		return NULL;
+	janus_media_bridge_sink *sink = g_malloc0(sizeof(janus_media_bridge_sink));
+	sink->packet_cb = packet_cb;
+	sink->user_data = user_data;
+	sink->packets = g_async_queue_new();
+	GError *error = NULL;
+	char tname[16];
+	g_snprintf(tname, sizeof(tname), "mbridge %s", name);
+	sink->thread = g_thread_try_new(tname, janus_media_bridge_sink_thread, sink, &error);
+	if(error != NULL) {
+		JANUS_LOG(LOG_ERR, "[%s] Got error %d (%s) trying to launch the media bridge sink thread...\n",
+			name, error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		g_async_queue_unref(sink->packets);
+		g_free(sink);
+		return NULL;
+	}
+	janus_mutex_lock(&bridges_mutex);
+	janus_media_bridge *bridge = janus_media_bridge_get(name);
+	sink->bridge = bridge;
+	janus_mutex_lock(&bridge->mutex);
+	bridge->sinks = g_list_append(bridge->sinks, sink);
+	g_atomic_int_inc(&bridge->sinks_count);
+	/* A new sink will need a keyframe to start from */
+	g_atomic_int_set(&bridge->keyframe_needed, 1);
+	janus_mutex_unlock(&bridge->mutex);
+	janus_mutex_unlock(&bridges_mutex);
+	JANUS_LOG(LOG_VERB, "[%s] Added media bridge sink\n", name);
+	return sink;
+}
+
+void janus_media_bridge_sink_request_keyframe(janus_media_bridge_sink *sink) {
+	if(sink == NULL)
+		return;
+	/* We only flag the request here: the source will be notified from its own thread */
+	g_atomic_int_set(&sink->bridge->keyframe_needed, 1);
+}
+
+void janus_media_bridge_sink_remove(janus_media_bridge_sink *sink) {
+	if(sink == NULL)
+		return;
+	janus_media_bridge *bridge = sink->bridge;
+	janus_mutex_lock(&bridges_mutex);
+	/* Once we're out of the list, the source won't queue anything for us */
+	janus_mutex_lock(&bridge->mutex);
+	bridge->sinks = g_list_remove(bridge->sinks, sink);
+	g_atomic_int_add(&bridge->sinks_count, -1);
+	janus_mutex_unlock(&bridge->mutex);
+	JANUS_LOG(LOG_VERB, "[%s] Removed media bridge sink\n", bridge->name);
+	janus_media_bridge_release(bridge);
+	janus_mutex_unlock(&bridges_mutex);
+	/* Stop the sink thread, dropping the packets it didn't process yet: joining
+	 * it also waits for any callback in progress to complete */
+	g_atomic_int_set(&sink->stopping, 1);
+	g_async_queue_push(sink->packets, &exit_packet);
+	g_thread_join(sink->thread);
+	g_async_queue_unref(sink->packets);
+	g_free(sink);
+}
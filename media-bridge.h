@@ -0,0 +1,104 @@
+/*! \file    media-bridge.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    In-process media bridge between plugins (headers)
+ * \details  Implementation of a simple named registry that plugins can
+ * use to hand RTP packets to each other within the same Janus instance,
+ * without going through RTP forwarders and loopback sockets. A plugin
+ * that generates media (e.g., a VideoRoom publisher) registers a source
+ * with a unique name, e.g., \c videoroom/1234/5678 , and then relays the
+ * packets it receives: any plugin that is interested in that media (e.g.,
+ * a Streaming mountpoint) registers a sink with the same name, and gets
+ * a callback for each packet. Sources and sinks can be added in any
+ * order: a sink added before its source exists will simply receive
+ * nothing until the source shows up.
+ *
+ * Each packet is copied once when the source relays it, and a reference
+ * to the copy is queued for each sink: every sink has a thread of its
+ * own that passes the packets to its callback, so that a slow sink can't
+ * stall the source or the other sinks. If a sink falls too far behind,
+ * new packets for it are dropped, and a keyframe is requested for when it
+ * catches up. The copy is shared, which means that sinks MUST NOT modify
+ * the buffer they receive, and must copy whatever they need to keep around
+ * after the callback returns. Sinks can also ask the source for a keyframe:
+ * the request is only flagged, and the source is notified the next time it
+ * relays a video packet, from its own thread.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef JANUS_MEDIA_BRIDGE_H
+#define JANUS_MEDIA_BRIDGE_H
+
+#include <glib.h>
+
+/*! \brief Packet relayed through the media bridge */
+typedef struct janus_media_bridge_packet {
+	/*! \brief RTP packet, payload type and SSRC as set by the source */
+	const char *buffer;
+	/*! \brief Length of the RTP packet */
+	int length;
+	/*! \brief Whether this is audio or video */
+	gboolean video;
+	/*! \brief In case of simulcast, the substream this packet belongs to (0 otherwise) */
+	int substream;
+	/*! \brief Whether this packet is (part of) a keyframe, if the source knows */
+	gboolean keyframe;
+} janus_media_bridge_packet;
+
+/*! \brief Callback sinks are notified with for each packet the source relays */
+typedef void (*janus_media_bridge_packet_cb)(const janus_media_bridge_packet *packet, void *user_data);
+/*! \brief Callback sources are notified with when a sink needs a keyframe */
+typedef void (*janus_media_bridge_keyframe_cb)(void *user_data);
+
+/*! \brief Producer side of a media bridge */
+typedef struct janus_media_bridge_source janus_media_bridge_source;
+/*! \brief Consumer side of a media bridge */
+typedef struct janus_media_bridge_sink janus_media_bridge_sink;
+
+/*! \brief Register a new source with the provided name
+ * \note If a source with the same name exists already, it is replaced:
+ * the older source will not be able to relay packets anymore, but must
+ * still be removed by its owner with janus_media_bridge_source_remove.
+ * @param[in] name Unique name of the source
+ * @param[in] keyframe_cb Callback to invoke when a sink needs a keyframe, if any
+ * @param[in] user_data Opaque pointer to pass to the keyframe callback
+ * @returns A new janus_media_bridge_source instance in case of success, NULL otherwise */
+janus_media_bridge_source *janus_media_bridge_source_add(const char *name,
+	janus_media_bridge_keyframe_cb keyframe_cb, void *user_data);
+/*! \brief Quick check to figure out whether any sink is interested in a source,
+ * which sources can use to avoid preparing packets nobody will receive
+ * @param[in] source The janus_media_bridge_source instance to check
+ * @returns TRUE if there's at least a sink, FALSE otherwise */
+gboolean janus_media_bridge_source_has_sinks(janus_media_bridge_source *source);
+/*! \brief Relay a packet to all the sinks of a source
+ * \note The packet is copied and queued for the sinks, so the buffer can be
+ * reused as soon as this returns. This must always be called from the same
+ * thread, as keyframe requests are delivered from within this method too
+ * @param[in] source The janus_media_bridge_source instance to relay the packet for
+ * @param[in] packet The packet to relay */
+void janus_media_bridge_source_relay(janus_media_bridge_source *source, const janus_media_bridge_packet *packet);
+/*! \brief Unregister and free a source
+ * @param[in] source The janus_media_bridge_source instance to remove */
+void janus_media_bridge_source_remove(janus_media_bridge_source *source);
+
+/*! \brief Register a new sink for the source with the provided name
+ * \note This starts a new thread for the sink, which the packet callback will be invoked from
+ * @param[in] name Name of the source to receive packets from
+ * @param[in] packet_cb Callback to invoke for each packet
+ * @param[in] user_data Opaque pointer to pass to the packet callback
+ * @returns A new janus_media_bridge_sink instance in case of success, NULL otherwise */
+janus_media_bridge_sink *janus_media_bridge_sink_add(const char *name,
+	janus_media_bridge_packet_cb packet_cb, void *user_data);
+/*! \brief Ask the source of a sink for a keyframe
+ * @param[in] sink The janus_media_bridge_sink instance that needs a keyframe */
+void janus_media_bridge_sink_request_keyframe(janus_media_bridge_sink *sink);
+/*! \brief Unregister and free a sink
+ * \note Once this method returns, the packet callback of the sink is
+ * guaranteed not to be invoked anymore: this means it MUST NOT be called
+ * while holding a lock that the packet callback may need too
+ * @param[in] sink The janus_media_bridge_sink instance to remove */
+void janus_media_bridge_sink_remove(janus_media_bridge_sink *sink);
+
+#endif
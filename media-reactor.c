@@ -0,0 +1,436 @@
+/*! \file    media-reactor.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Shared reactor for plugin-owned media sockets
+ * \details  Implementation of a small pool of threads that plugins can
+ * use to wait for data on the plain RTP/RTCP sockets they own, rather
+ * than spawning a thread per call that polls them. Check the
+ * documentation in media-reactor.h for more details.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#include "media-reactor.h"
+#include "debug.h"
+#include "mutex.h"
+#include "utils.h"
+
+/* Default maximum number of threads, if not configured */
+#define JANUS_MEDIA_REACTOR_DEFAULT_THREADS	4
+/* How often handlers get a tick event */
+#define JANUS_MEDIA_REACTOR_TICK			G_USEC_PER_SEC
+/* How many events we process per iteration at most */
+#define JANUS_MEDIA_REACTOR_MAX_EVENTS		64
+
+/* A thread of the pool, and the handlers pinned to it */
+typedef struct janus_media_reactor_thread {
+	guint index;
+	GThread *thread;
+	/* Pipe to wake the thread up */
+	int wakeup[2];
+	/* Map of handlers, indexed by ID */
+	GHashTable *handlers;
+	/* Handlers removed from within a callback, freed when the iteration is over */
+	GList *garbage;
+	gint64 last_tick;
+	volatile gint stop;
+#ifdef HAVE_EPOLL
+	int epoll_fd;
+#else
+	/* Map of file descriptors to watch, and the ID of their handler */
+	GHashTable *fds;
+	gboolean fds_changed;
+#endif
+	/* Held while dispatching events, and when changing handlers */
+	janus_mutex mutex;
+} janus_media_reactor_thread;
+
+struct janus_media_reactor_handler {
+	guint32 id;
+	janus_media_reactor_thread *thread;
+	janus_media_reactor_cb callback;
+	void *user_data;
+	int fds[JANUS_MEDIA_REACTOR_MAX_FDS];
+	int num_fds;
+};
+
+static janus_media_reactor_thread *reactor_threads = NULL;
+static guint reactor_threads_num = 0;
+static volatile gint reactor_next_id = 0, reactor_next_thread = 0;
+
+static void *janus_media_reactor_thread_loop(void *data);
+
+/* Handlers may change their file descriptors, or remove themselves, from
+ * within their callback, in which case the thread mutex is already held */
+static gboolean janus_media_reactor_thread_lock(janus_media_reactor_thread *t) {
+	if(t->thread == g_thread_self())
+		return FALSE;
+	janus_mutex_lock(&t->mutex);
+	return TRUE;
+}
+
+static void janus_media_reactor_thread_wakeup(janus_media_reactor_thread *t) {
+	int code = 1;
+	ssize_t res = 0;
+	do {
+		res = write(t->wakeup[1], &code, sizeof(int));
+	} while(res == -1 && errno == EINTR);
+}
+
+static gboolean janus_media_reactor_handler_has_fd(janus_media_reactor_handler *handler, int fd) {
+	int i = 0;
+	for(i=0; i<handler->num_fds; i++) {
+		if(handler->fds[i] == fd)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* Stop watching a file descriptor: must be called with the thread mutex held */
+static void janus_media_reactor_thread_unwatch(janus_media_reactor_thread *t, janus_media_reactor_handler *handler, int fd) {
+#ifdef HAVE_EPOLL
+	/* This may fail if the socket was closed already, which is fine */
+	(void)epoll_ctl(t->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#else
+	if(g_hash_table_lookup(t->fds, GINT_TO_POINTER(fd)) == GUINT_TO_POINTER(handler->id)) {
+		g_hash_table_remove(t->fds, GINT_TO_POINTER(fd));
+		t->fds_changed = TRUE;
+	}
+#endif
+}
+
+int janus_media_reactor_init(guint threads) {
+	if(reactor_threads != NULL)
+		return 0;
+	if(threads == 0) {
+		threads = g_get_num_processors();
+		if(threads > JANUS_MEDIA_REACTOR_DEFAULT_THREADS)
+			threads = JANUS_MEDIA_REACTOR_DEFAULT_THREADS;
+	}
+	JANUS_LOG(LOG_INFO, "Starting media reactor (%u threads, %s)\n", threads,
+#ifdef HAVE_EPOLL
+		"epoll"
+#else
+		"poll"
+#endif
+	);
+	reactor_threads = g_malloc0(threads * sizeof(janus_media_reactor_thread));
+	guint i = 0;
+	for(i=0; i<threads; i++) {
+		janus_media_reactor_thread *t = &reactor_threads[i];
+		t->index = i;
+		t->wakeup[0] = -1;
+		t->wakeup[1] = -1;
+		t->handlers = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_free);
+		janus_mutex_init(&t->mutex);
+#ifdef HAVE_EPOLL
+		t->epoll_fd = -1;
+#else
+		t->fds = g_hash_table_new(NULL, NULL);
+		t->fds_changed = TRUE;
+#endif
+		reactor_threads_num++;
+		if(pipe(t->wakeup) < 0) {
+			JANUS_LOG(LOG_ERR, "Error creating media reactor pipe: %d (%s)\n", errno, strerror(errno));
+			janus_media_reactor_deinit();
+			return -1;
+		}
+		fcntl(t->wakeup[0], F_SETFL, O_NONBLOCK);
+#ifdef HAVE_EPOLL
+		t->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if(t->epoll_fd < 0) {
+			JANUS_LOG(LOG_ERR, "Error creating media reactor epoll instance: %d (%s)\n", errno, strerror(errno));
+			janus_media_reactor_deinit();
+			return -1;
+		}
+		/* The wakeup pipe is the only file descriptor with a handler ID of 0 */
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.u64 = (guint64)t->wakeup[0];
+		epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, t->wakeup[0], &ev);
+#endif
+		GError *error = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "mreactor %u", i);
+		t->thread = g_thread_try_new(tname, &janus_media_reactor_thread_loop, t, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the media reactor thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			t->thread = NULL;
+			janus_media_reactor_deinit();
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void janus_media_reactor_deinit(void) {
+	if(reactor_threads == NULL)
+		return;
+	guint i = 0;
+	for(i=0; i<reactor_threads_num; i++) {
+		janus_media_reactor_thread *t = &reactor_threads[i];
+		if(t->thread != NULL) {
+			g_atomic_int_set(&t->stop, 1);
+			janus_media_reactor_thread_wakeup(t);
+			g_thread_join(t->thread);
+			t->thread = NULL;
+		}
+		if(g_hash_table_size(t->handlers) > 0)
+			JANUS_LOG(LOG_WARN, "Media reactor thread #%u still had %u handlers\n", i, g_hash_table_size(t->handlers));
+		g_hash_table_destroy(t->handlers);
+		g_list_free_full(t->garbage, (GDestroyNotify)g_free);
+#ifdef HAVE_EPOLL
+		if(t->epoll_fd > -1)
+			close(t->epoll_fd);
+#else
+		g_hash_table_destroy(t->fds);
+#endif
+		if(t->wakeup[0] > -1)
+			close(t->wakeup[0]);
+		if(t->wakeup[1] > -1)
+			close(t->wakeup[1]);
+		janus_mutex_destroy(&t->mutex);
+	}
+	g_free(reactor_threads);
+	reactor_threads = NULL;
+	reactor_threads_num = 0;
+}
+
+janus_media_reactor_handler *janus_media_reactor_handler_add(janus_media_reactor_cb callback, void *user_data) {
+	if(reactor_threads == NULL || callback == NULL)
+		return NULL;
+	janus_media_reactor_handler *handler = g_malloc0(sizeof(janus_media_reactor_handler));
+	/* ID 0 is reserved to the wakeup pipe */
+	do {
+		handler->id = (guint32)g_atomic_int_add(&reactor_next_id, 1) + 1;
+	} while(handler->id == 0);
+	handler->callback = callback;
+	handler->user_data = user_data;
+	/* Handlers are spread on the threads in a round robin fashion */
+	guint index = (guint)g_atomic_int_add(&reactor_next_thread, 1) % reactor_threads_num;
+	janus_media_reactor_thread *t = &reactor_threads[index];
+	handler->thread = t;
+	gboolean locked = janus_media_reactor_thread_lock(t);
+	g_hash_table_insert(t->handlers, GUINT_TO_POINTER(handler->id), handler);
+	if(locked)
+		janus_mutex_unlock(&t->mutex);
+	return handler;
+}
+
+int janus_media_reactor_handler_watch(janus_media_reactor_handler *handler, const int *fds, int num) {
+	if(handler == NULL || (fds == NULL && num > 0) || num > JANUS_MEDIA_REACTOR_MAX_FDS)
+		return -1;
+	janus_media_reactor_thread *t = handler->thread;
+	gboolean locked = janus_media_reactor_thread_lock(t);
+	/* Stop watching the file descriptors that are not in the list anymore */
+	int i = 0, j = 0;
+	for(i=0; i<handler->num_fds; i++) {
+		gboolean keep = FALSE;
+		for(j=0; j<num; j++) {
+			if(fds[j] == handler->fds[i]) {
+				keep = TRUE;
+				break;
+			}
+		}
+		if(!keep)
+			janus_media_reactor_thread_unwatch(t, handler, handler->fds[i]);
+	}
+	/* Watch the new ones (or refresh the existing ones) */
+	int count = 0;
+	for(i=0; i<num; i++) {
+		int fd = fds[i];
+		if(fd < 0)
+			continue;
+		gboolean dup = FALSE;
+		for(j=0; j<count; j++) {
+			if(handler->fds[j] == fd) {
+				dup = TRUE;
+				break;
+			}
+		}
+		if(dup)
+			continue;
+#ifdef HAVE_EPOLL
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.u64 = ((guint64)handler->id << 32) | (guint32)fd;
+		if(epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			/* If the file descriptor is there already, just update it */
+			if(errno != EEXIST || epoll_ctl(t->epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+				JANUS_LOG(LOG_ERR, "Error adding file descriptor %d to the media reactor: %d (%s)\n",
+					fd, errno, strerror(errno));
+				continue;
+			}
+		}
+#else
+		g_hash_table_insert(t->fds, GINT_TO_POINTER(fd), GUINT_TO_POINTER(handler->id));
+		t->fds_changed = TRUE;
+#endif
+		handler->fds[count++] = fd;
+	}
+	handler->num_fds = count;
+#ifndef HAVE_EPOLL
+	/* Make sure the thread polls the new list */
+	if(t->fds_changed && locked)
+		janus_media_reactor_thread_wakeup(t);
+#endif
+	if(locked)
+		janus_mutex_unlock(&t->mutex);
+	return 0;
+}
+
+void janus_media_reactor_handler_remove(janus_media_reactor_handler *handler) {
+	if(handler == NULL)
+		return;
+	janus_media_reactor_thread *t = handler->thread;
+	gboolean locked = janus_media_reactor_thread_lock(t);
+	int i = 0;
+	for(i=0; i<handler->num_fds; i++)
+		janus_media_reactor_thread_unwatch(t, handler, handler->fds[i]);
+	handler->num_fds = 0;
+	g_hash_table_steal(t->handlers, GUINT_TO_POINTER(handler->id));
+	if(locked) {
+		/* The thread is not dispatching anything, we can get rid of the handler now */
+		janus_mutex_unlock(&t->mutex);
+		g_free(handler);
+	} else {
+		/* We're in a callback: events for this handler may still be in the
+		 * current batch, so we'll only free it when the iteration is over */
+		t->garbage = g_list_prepend(t->garbage, handler);
+	}
+}
+
+/* Pass an event to the handler it belongs to, if it's still interested in it */
+static void janus_media_reactor_thread_dispatch(janus_media_reactor_thread *t, guint32 id, int fd, janus_media_reactor_event event) {
+	janus_media_reactor_handler *handler = g_hash_table_lookup(t->handlers, GUINT_TO_POINTER(id));
+	if(handler == NULL || !janus_media_reactor_handler_has_fd(handler, fd))
+		return;
+	handler->callback(handler, fd, event, handler->user_data);
+}
+
+/* Thread waiting for events on the file descriptors of its handlers */
+static void *janus_media_reactor_thread_loop(void *data) {
+	janus_media_reactor_thread *t = (janus_media_reactor_thread *)data;
+	JANUS_LOG(LOG_VERB, "Joining media reactor thread #%u\n", t->index);
+#ifdef HAVE_EPOLL
+	struct epoll_event events[JANUS_MEDIA_REACTOR_MAX_EVENTS];
+#else
+	struct pollfd *fds = NULL;
+	guint32 *ids = NULL;
+	int size = 0;
+#endif
+	int num = 0, i = 0, code = 0;
+	t->last_tick = janus_get_monotonic_time();
+	while(!g_atomic_int_get(&t->stop)) {
+		/* Wait at most until the next tick */
+		gint64 now = janus_get_monotonic_time();
+		int timeout = (t->last_tick + JANUS_MEDIA_REACTOR_TICK - now)/1000;
+		if(timeout < 0)
+			timeout = 0;
+#ifdef HAVE_EPOLL
+		num = epoll_wait(t->epoll_fd, events, JANUS_MEDIA_REACTOR_MAX_EVENTS, timeout);
+#else
+		janus_mutex_lock(&t->mutex);
+		if(t->fds_changed) {
+			/* Rebuild the list of file descriptors to poll */
+			t->fds_changed = FALSE;
+			size = g_hash_table_size(t->fds) + 1;
+			fds = g_realloc(fds, size * sizeof(struct pollfd));
+			ids = g_realloc(ids, size * sizeof(guint32));
+			fds[0].fd = t->wakeup[0];
+			fds[0].events = POLLIN;
+			ids[0] = 0;
+			int n = 1;
+			GHashTableIter iter;
+			gpointer key, value;
+			g_hash_table_iter_init(&iter, t->fds);
+			while(g_hash_table_iter_next(&iter, &key, &value)) {
+				fds[n].fd = GPOINTER_TO_INT(key);
+				fds[n].events = POLLIN;
+				ids[n] = GPOINTER_TO_UINT(value);
+				n++;
+			}
+		}
+		janus_mutex_unlock(&t->mutex);
+		for(i=0; i<size; i++)
+			fds[i].revents = 0;
+		num = poll(fds, size, timeout);
+#endif
+		if(num < 0) {
+			if(errno == EINTR)
+				continue;
+			JANUS_LOG(LOG_ERR, "Error waiting for events in media reactor thread #%u: %d (%s)\n",
+				t->index, errno, strerror(errno));
+			break;
+		}
+		janus_mutex_lock(&t->mutex);
+#ifdef HAVE_EPOLL
+		for(i=0; i<num; i++) {
+			guint32 id = (guint32)(events[i].data.u64 >> 32);
+			int fd = (int)(events[i].data.u64 & 0xFFFFFFFF);
+			if(id == 0) {
+				/* Just a wakeup */
+				while(read(t->wakeup[0], &code, sizeof(int)) > 0);
+				continue;
+			}
+			janus_media_reactor_thread_dispatch(t, id, fd,
+				(events[i].events & (EPOLLERR | EPOLLHUP)) ?
+					janus_media_reactor_event_error : janus_media_reactor_event_read);
+		}
+#else
+		for(i=0; i<size && num > 0; i++) {
+			if(fds[i].revents == 0)
+				continue;
+			num--;
+			if(ids[i] == 0) {
+				/* Just a wakeup */
+				while(read(t->wakeup[0], &code, sizeof(int)) > 0);
+				continue;
+			}
+			if(fds[i].revents & POLLNVAL)
+				continue;
+			janus_media_reactor_thread_dispatch(t, ids[i], fds[i].fd,
+				(fds[i].revents & (POLLERR | POLLHUP)) ?
+					janus_media_reactor_event_error : janus_media_reactor_event_read);
+		}
+#endif
+		/* Is it time for a tick? */
+		now = janus_get_monotonic_time();
+		if(now - t->last_tick >= JANUS_MEDIA_REACTOR_TICK) {
+			t->last_tick = now;
+			GList *handlers = g_hash_table_get_values(t->handlers), *l = handlers;
+			while(l) {
+				janus_media_reactor_handler *handler = (janus_media_reactor_handler *)l->data;
+				/* Make sure a previous callback didn't remove this handler */
+				if(g_hash_table_lookup(t->handlers, GUINT_TO_POINTER(handler->id)) == handler)
+					handler->callback(handler, -1, janus_media_reactor_event_tick, handler->user_data);
+				l = l->next;
+			}
+			g_list_free(handlers);
+		}
+		/* Get rid of the handlers that were removed in the meanwhile */
+		g_list_free_full(t->garbage, (GDestroyNotify)g_free);
+		t->garbage = NULL;
+		janus_mutex_unlock(&t->mutex);
+	}
+#ifndef HAVE_EPOLL
+	g_free(fds);
+	g_free(ids);
+#endif
+	JANUS_LOG(LOG_VERB, "Leaving media reactor thread #%u\n", t->index);
+	return NULL;
+}
@@ -0,0 +1,87 @@
+/*! \file    media-reactor.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Shared reactor for plugin-owned media sockets (headers)
+ * \details  Implementation of a small pool of threads that plugins can
+ * use to wait for data on the plain RTP/RTCP sockets they own, rather
+ * than spawning a thread per call that polls them. This is what the
+ * SIP, NoSIP and SIPre plugins use to relay media from their peers: a
+ * plugin adds a handler, specifying a callback and an opaque pointer,
+ * and then tells the reactor which file descriptors the handler is
+ * interested in. Each handler is pinned to one of the threads of the
+ * pool, which means its callback is never invoked concurrently, and
+ * can safely access per-call state without any locking.
+ *
+ * The callback is invoked when a file descriptor has data to read, when
+ * an error occurs on a file descriptor, and roughly once per second in
+ * any case (the "tick" event), so that plugins can check whether the
+ * call is over even when no media is flowing. Handlers can change the
+ * file descriptors they're interested in, and remove themselves, from
+ * within their own callback too.
+ *
+ * On Linux the threads use epoll, while on other platforms they fall
+ * back to a poll on all the file descriptors of their handlers. The
+ * size of the pool is configured in the \c media section of the Janus
+ * configuration file (\c reactor_threads ).
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef JANUS_MEDIA_REACTOR_H
+#define JANUS_MEDIA_REACTOR_H
+
+#include <glib.h>
+
+/*! \brief Maximum number of file descriptors a single handler can watch */
+#define JANUS_MEDIA_REACTOR_MAX_FDS	8
+
+/*! \brief Events handlers are notified about */
+typedef enum janus_media_reactor_event {
+	/*! \brief There's data to read on the file descriptor */
+	janus_media_reactor_event_read = 0,
+	/*! \brief An error occurred on the file descriptor (e.g., POLLERR or POLLHUP) */
+	janus_media_reactor_event_error,
+	/*! \brief Periodic event (about once per second, no file descriptor) */
+	janus_media_reactor_event_tick
+} janus_media_reactor_event;
+
+/*! \brief Handler added to the reactor */
+typedef struct janus_media_reactor_handler janus_media_reactor_handler;
+/*! \brief Callback handlers are notified with
+ * @param[in] handler The janus_media_reactor_handler instance the event is for
+ * @param[in] fd The file descriptor the event is for (-1 for ticks)
+ * @param[in] event The event type
+ * @param[in] user_data The opaque pointer provided when adding the handler */
+typedef void (*janus_media_reactor_cb)(janus_media_reactor_handler *handler, int fd,
+	janus_media_reactor_event event, void *user_data);
+
+/*! \brief Start the reactor
+ * @param[in] threads How many threads to use (0 means one per core, up to 4)
+ * @returns 0 in case of success, a negative integer otherwise */
+int janus_media_reactor_init(guint threads);
+/*! \brief Stop the reactor
+ * \note Handlers that plugins didn't remove are freed too */
+void janus_media_reactor_deinit(void);
+
+/*! \brief Add a new handler to the reactor
+ * @param[in] callback Callback to invoke for events on the handler
+ * @param[in] user_data Opaque pointer to pass to the callback
+ * @returns A new janus_media_reactor_handler instance in case of success, NULL otherwise */
+janus_media_reactor_handler *janus_media_reactor_handler_add(janus_media_reactor_cb callback, void *user_data);
+/*! \brief Set the file descriptors a handler is interested in, replacing
+ * the ones that were set before: negative file descriptors are ignored
+ * \note A file descriptor must be removed from the handler (or the handler
+ * removed) before it's closed, as the number may be reused for new sockets
+ * @param[in] handler The janus_media_reactor_handler instance to update
+ * @param[in] fds Array of file descriptors to watch
+ * @param[in] num Number of items in the array
+ * @returns 0 in case of success, a negative integer otherwise */
+int janus_media_reactor_handler_watch(janus_media_reactor_handler *handler, const int *fds, int num);
+/*! \brief Remove and free a handler
+ * \note Once this method returns, the callback of the handler is guaranteed
+ * not to be invoked anymore: this can be called from within the callback too
+ * @param[in] handler The janus_media_reactor_handler instance to remove */
+void janus_media_reactor_handler_remove(janus_media_reactor_handler *handler);
+
+#endif
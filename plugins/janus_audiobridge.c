@@ -37,8 +37,18 @@ room-<unique room ID>: {
 	audiolevel_event = true|false (whether to emit event to other users or not, default=false)
 	audio_active_packets = 100 (number of packets with audio level, default=100, 2 seconds)
 	audio_level_average = 25 (average value of audio level, 127=muted, 0='too loud', default=25)
+	max_speakers = 0 (only mix the N loudest participants, according to the audio
+		levels they send: requires audiolevel_ext, 0=mix everybody, default=0)
+	mixer_threads = 1 (how many threads to split the mix-minus work across, which
+		may help in very large rooms, up to the number of cores, default=1)
+	notify_window = 0 (time window in milliseconds in which participants joining
+		and leaving are merged in a single event for each participant, rather
+		than notified one by one; 0 disables batching, default=0)
 	record = true|false (whether this room should be recorded, default=false)
 	record_file =	/path/to/recording.wav (where to save the recording)
+	shared_mix = true|false (whether participants that are not contributing any audio,
+		e.g., because they're muted or silent, should all be sent the same
+		encoded mix, rather than encoding it once per participant, default=false)
 
 		[The following lines are only needed if you want the mixed audio
 		to be automatically forwarded via plain RTP to an external component
@@ -116,8 +126,12 @@ room-<unique room ID>: {
 	"audiolevel_event" : true|false (whether to emit event to other users or not),
 	"audio_active_packets" : 100 (number of packets with audio level, default=100, 2 seconds),
 	"audio_level_average" : 25 (average value of audio level, 127=muted, 0='too loud', default=25),
+	"max_speakers" : <number of loudest participants to mix, according to the audio levels they send; requires audiolevel_ext, 0=mix everybody, default=0>,
+	"mixer_threads" : <number of threads to split the mix-minus work across, which may help in very large rooms, up to the number of cores, default=1>,
+	"notify_window" : <time window in milliseconds participants joining and leaving are batched in, 0=notify right away, default=0>,
 	"record" : <true|false, whether to record the room or not, default=false>,
 	"record_file" : "</path/to/the/recording.wav, optional>",
+	"shared_mix" : <true|false, whether participants not contributing audio should share the same encoded mix, default=false>
 }
 \endverbatim
  *
@@ -293,15 +307,19 @@ room-<unique room ID>: {
  *
 \verbatim
 {
-	"request" : "list"
+	"request" : "list",
+	"offset" : <number of rooms to skip, to paginate the list; optional, default=0>,
+	"limit" : <maximum number of rooms to return; optional, default=0 (no limit)>
 }
 \endverbatim
  *
- * A successful request will produce a list of rooms in a \c success response:
+ * A successful request will produce a list of rooms in a \c success response,
+ * sorted by room ID, where \c total is the number of public rooms available:
  *
 \verbatim
 {
 	"audiobridge" : "success",
+	"total" : <number of public rooms>,
 	"rooms" : [		// Array of room objects
 		{	// Room #1
 			"room" : <unique numeric ID>,
@@ -315,6 +333,35 @@ room-<unique room ID>: {
 	]
 }
 \endverbatim
+ *
+ * When the \c list request is sent via Admin API, each room object will
+ * also contain a \c mixer object with some info on the performance of
+ * the room mixer, i.e., which mixing kernels are in use ( \c scalar ,
+ * \c sse2 or \c avx2 , depending on what the CPU supports), how many
+ * frames were mixed so far ( \c ticks ), and the last, average and
+ * maximum time (in microseconds) it took to mix a 20ms frame, including
+ * the mix-minus for all participants ( \c last_mix_time , \c avg_mix_time
+ * and \c max_mix_time ), together with how many threads share the
+ * mixing work ( \c threads ) and how many times mixing a frame took
+ * longer than 20ms ( \c deadline_misses ), which is a sign the room
+ * is overloaded. For rooms with \c shared_mix enabled, the
+ * \c shared_participants property also tells how many participants got
+ * the shared encoded mix in the last frame, while for rooms with
+ * \c max_speakers set \c mixed_speakers tells how many participants
+ * were actually decoded and mixed. A \c clock object also shows how
+ * the mixer thread is being woken up ( \c timer ), and how late (in
+ * microseconds) it was compared to when the frame was due ( \c jitter_last ,
+ * \c jitter_avg and \c jitter_max ).
+ *
+ * In rooms created with \c notify_window set to a positive value,
+ * participants joining, setting up their PeerConnection, leaving or being
+ * kicked are not notified to the other participants right away: all the
+ * changes that happen within that many milliseconds are merged instead in
+ * a single \c event for each participant, where \c participants is an
+ * array of participant objects (in the same format as \c joined events),
+ * while \c leaving and \c kicked are arrays of participant IDs. Only the
+ * properties for which there are changes are included, and changes that
+ * happened before a participant joined are never sent to them.
  *
  * To get a list of the participants in a specific room, instead, you
  * can make use of the \c listparticipants request, which has to be
@@ -323,17 +370,22 @@ room-<unique room ID>: {
 \verbatim
 {
 	"request" : "listparticipants",
-	"room" : <unique numeric ID of the room>
+	"room" : <unique numeric ID of the room>,
+	"unmuted_only" : <true|false, whether only participants that are not muted should be returned; optional, default=false>,
+	"offset" : <number of participants to skip, to paginate the list; optional, default=0>,
+	"limit" : <maximum number of participants to return; optional, default=0 (no limit)>
 }
 \endverbatim
  *
  * A successful request will produce a list of participants in a
- * \c participants response:
+ * \c participants response, sorted by participant ID, where \c total
+ * is the number of participants matching the request before pagination:
  *
 \verbatim
 {
 	"audiobridge" : "participants",
 	"room" : <unique numeric ID of the room>,
+	"total" : <number of participants>,
 	"participants" : [		// Array of participant objects
 		{	// Participant #1
 			"id" : <unique numeric ID of the participant>,
@@ -446,7 +498,10 @@ room-<unique room ID>: {
 			"ssrc" : <SSRC this forwarder is using, if any>,
 			"ptype" : <payload type this forwarder is using, if any>,
 			"srtp" : <true|false, whether the RTP stream is encrypted>,
-			"always_on" : <true|false, whether this forwarder works even when no participant is in or not>
+			"always_on" : <true|false, whether this forwarder works even when no participant is in or not>,
+			"packets" : <packets sent by this forwarder so far>,
+			"bytes" : <bytes sent by this forwarder so far>,
+			"errors" : <packets this forwarder failed to send so far>
 		},
 		// Other forwarders
 	]
@@ -665,6 +720,7 @@ room-<unique room ID>: {
 #include "../sdp-utils.h"
 #include "../utils.h"
 #include "../ip-utils.h"
+#include "janus_audiobridge_mixer.h"
 
 
 /* Plugin information */
@@ -752,6 +808,10 @@ static struct janus_json_parameter create_parameters[] = {
 	{"audiolevel_event", JANUS_JSON_BOOL, 0},
 	{"audio_active_packets", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"audio_level_average", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"max_speakers", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"mixer_threads", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"notify_window", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"shared_mix", JANUS_JSON_BOOL, 0},
 	{"room", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 static struct janus_json_parameter edit_parameters[] = {
@@ -786,6 +846,16 @@ static struct janus_json_parameter mute_parameters[] = {
 static struct janus_json_parameter room_parameters[] = {
 	{"room", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
 };
+static struct janus_json_parameter list_parameters[] = {
+	{"offset", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"limit", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
+static struct janus_json_parameter listparticipants_parameters[] = {
+	{"room", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
+	{"unmuted_only", JANUS_JSON_BOOL, 0},
+	{"offset", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"limit", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
 static struct janus_json_parameter join_parameters[] = {
 	{"room", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
 	{"display", JSON_STRING, 0},
@@ -849,6 +919,21 @@ static GAsyncQueue *messages = NULL;
 static janus_audiobridge_message exit_message;
 
 
+/* Mixer settings */
+#define DEFAULT_PREBUFFERING	6
+/* Decoded frames we can buffer for each participant: must be more than
+ * twice the prebuffering, as that's when we start dropping old frames */
+#define JITTER_BUFFER_FRAMES	16
+/* Mixed frames that can be waiting for the participant thread to encode them */
+#define MIXED_FRAMES	8
+
+
+/* Opus settings */
+#define	BUFFER_SAMPLES	8000
+#define	OPUS_SAMPLES	960
+#define DEFAULT_COMPLEXITY	4
+
+
 /* Structs */
 typedef struct janus_audiobridge_room {
 	guint64 room_id;			/* Unique room ID */
@@ -861,9 +946,19 @@ typedef struct janus_audiobridge_room {
 	gboolean audiolevel_event;	/* Whether to emit event to other users about audiolevel */
 	int audio_active_packets;	/* amount of packets with audio level for checkup */
 	int audio_level_average;	/* average audio level */
+	int max_speakers;			/* If not 0, only the N loudest participants are mixed (and decoded) */
+	int mixer_threads;			/* How many threads to split the mixing work across, in large rooms */
+	guint notify_window;		/* Time window (ms) participants joining and leaving are batched in (0 if disabled) */
+	GList *notify_pending;		/* Participant list changes waiting to be notified, if batching */
+	guint64 notify_seq;			/* Sequence number of the latest participant list change */
+	gint64 notify_deadline;		/* When the mixer thread should notify the pending changes */
+	json_t *participants_list;	/* Cached listparticipants array, sorted by ID (protected by the room mutex) */
+	volatile gint participants_changed;	/* Whether the cached list of participants needs to be rebuilt */
 	gboolean record;			/* Whether this room has to be recorded or not */
 	gchar *record_file;			/* Path of the recording file */
 	FILE *recording;			/* File to record the room into */
+	gboolean shared_mix;		/* Whether participants not contributing audio should share the same encoded mix */
+	OpusEncoder *shared_encoders[2][11];	/* Encoders for the shared mix (indexed by FEC and complexity) */
 	gint64 record_lastupdate;	/* Time when we last updated the wav header */
 	gboolean destroy;			/* Value to flag the room for destruction */
 	GHashTable *participants;	/* Map of participants */
@@ -877,10 +972,22 @@ typedef struct janus_audiobridge_room {
 	OpusEncoder *rtp_encoder;	/* Opus encoder instance to use for all RTP forwarders */
 	janus_mutex rtp_mutex;		/* Mutex to lock the RTP forwarders list */
 	int rtp_udp_sock;			/* UDP socket to use to forward RTP packets */
+	/* Mixer statistics */
+	janus_media_clock *clock;	/* Clock the mixer thread uses to pace itself */
+	guint64 mix_ticks;			/* How many frames the mixer prepared so far */
+	gint64 mix_time_last;		/* How long it took to mix the last frame (us) */
+	gint64 mix_time_avg;		/* Moving average of the time needed to mix a frame (us) */
+	gint64 mix_time_max;		/* Maximum time needed to mix a frame so far (us) */
+	guint mix_shared_last;		/* How many participants got the shared mix in the last frame */
+	guint mix_speakers_last;	/* How many participants were selected for mixing in the last frame */
+	guint64 mix_deadline_misses;	/* How many times mixing a frame took longer than the frame itself */
 	janus_refcount ref;			/* Reference counter for this room */
 } janus_audiobridge_room;
 static GHashTable *rooms;
 static janus_mutex rooms_mutex = JANUS_MUTEX_INITIALIZER;
+/* Cached list of public rooms (static properties only), sorted by ID: both are protected by rooms_mutex */
+static json_t *rooms_list = NULL;
+static gboolean rooms_list_changed = TRUE;
 static char *admin_key = NULL;
 static gboolean lock_rtpfwd = FALSE;
 
@@ -897,10 +1004,58 @@ typedef struct janus_audiobridge_session {
 static GHashTable *sessions;
 static janus_mutex sessions_mutex = JANUS_MUTEX_INITIALIZER;
 
+/* Opus frame of the full room mix, encoded once and shared by all the
+ * participants that are not contributing audio (see shared_mix) */
+typedef struct janus_audiobridge_encoded_frame {
+	unsigned char *payload;
+	gint length;
+	janus_refcount ref;
+} janus_audiobridge_encoded_frame;
+
+static void janus_audiobridge_encoded_frame_free(const janus_refcount *frame_ref) {
+	janus_audiobridge_encoded_frame *frame = janus_refcount_containerof(frame_ref, janus_audiobridge_encoded_frame, ref);
+	g_free(frame->payload);
+	g_free(frame);
+}
+
+/* Decoded audio frame from a participant, waiting to be mixed */
+typedef struct janus_audiobridge_buffered_frame {
+	opus_int16 samples[OPUS_SAMPLES];
+	gint length;
+	uint32_t timestamp;
+	uint16_t seq_number;
+	gboolean silence;
+	gboolean filled;
+} janus_audiobridge_buffered_frame;
+
+/* Jitter buffer for the incoming audio of a participant: a ring of
+ * preallocated frames indexed by sequence number, so that we never need
+ * to allocate (or sort) anything while packets come and go */
+typedef struct janus_audiobridge_jitter_buffer {
+	janus_audiobridge_buffered_frame frames[JITTER_BUFFER_FRAMES];
+	gboolean started;		/* Whether we got any frame yet */
+	uint16_t head;			/* Sequence number of the next frame the mixer expects */
+	guint depth;			/* How many frames are currently buffered */
+	guint64 late;			/* How many packets arrived too late to be mixed */
+	guint64 dropped;		/* How many frames were dropped because too many were queued */
+	guint64 truncated;		/* How many frames were longer than 20ms, and so only partially mixed */
+} janus_audiobridge_jitter_buffer;
+
+/* Mixed audio frame, waiting to be encoded in the participant thread */
+typedef struct janus_audiobridge_mixed_frame {
+	opus_int16 samples[OPUS_SAMPLES];
+	gint length;			/* We set the number of samples here, not the data length */
+	uint32_t ssrc;
+	uint32_t timestamp;
+	uint16_t seq_number;
+	janus_audiobridge_encoded_frame *encoded;	/* If set, the mix was already encoded (see shared_mix) */
+} janus_audiobridge_mixed_frame;
+
 typedef struct janus_audiobridge_participant {
 	janus_audiobridge_session *session;
 	janus_audiobridge_room *room;	/* Room */
 	guint64 user_id;		/* Unique ID in the room */
+	guint64 notify_seq;		/* Latest participant list change in the room when this participant joined */
 	gchar *display;			/* Display name (opaque value, only meaningful to application) */
 	gboolean prebuffering;	/* Whether this participant needs pre-buffering of a few packets (just joined) */
 	volatile gint active;	/* Whether this participant can receive media at all */
@@ -910,8 +1065,13 @@ typedef struct janus_audiobridge_participant {
 	int volume_gain;		/* Gain to apply to the input audio (in percentage) */
 	int opus_complexity;	/* Complexity to use in the encoder (by default, DEFAULT_COMPLEXITY) */
 	/* RTP stuff */
-	GList *inbuf;			/* Incoming audio from this participant, as an ordered list of packets */
-	GAsyncQueue *outbuf;	/* Mixed audio for this participant */
+	janus_audiobridge_jitter_buffer jitter;	/* Incoming audio from this participant, decoded and ordered by sequence number */
+	janus_audiobridge_mixed_frame outbuf[MIXED_FRAMES];	/* Mixed audio for this participant, as a ring of frames */
+	volatile gint outbuf_head;	/* Next mixed frame the participant thread will encode */
+	volatile gint outbuf_tail;	/* Next mixed frame the mixer will fill */
+	guint64 outbuf_dropped;	/* How many mixed frames we dropped because the encoder was lagging behind */
+	janus_mutex outbuf_mutex;	/* Mutex for the mixed audio ring */
+	janus_condition outbuf_cond;	/* Condition to wake the participant thread up when there's mixed audio */
 	gint64 last_drop;		/* When we last dropped a packet because the imcoming queue was full */
 	janus_mutex qmutex;		/* Incoming queue mutex */
 	int opus_pt;			/* Opus payload type */
@@ -920,6 +1080,11 @@ typedef struct janus_audiobridge_participant {
 	int audio_active_packets;	/* Participant's number of audio packets to accumulate */
 	int audio_dBov_sum;	    /* Participant's accumulated dBov value for audio level */
 	gboolean talking;		/* Whether this participant is currently talking (uses audio levels extension) */
+	int level_avg;			/* Smoothed audio level, used to rank speakers when max_speakers is set */
+	gint64 level_updated;	/* When we last got an audio level from this participant */
+	volatile gint selected;	/* Whether this participant is among the speakers to mix (and so decode) */
+	gboolean picked;		/* Used by the mixer thread when selecting the loudest speakers */
+	gboolean skipped;		/* Whether we skipped decoding some packets, and so the decoder state is stale */
 	janus_rtp_switching_context context;	/* Needed in case the participant changes room */
 	/* Opus stuff */
 	OpusEncoder *encoder;		/* Opus encoder instance */
@@ -970,23 +1135,16 @@ static void janus_audiobridge_participant_free(const janus_refcount *participant
 		opus_encoder_destroy(participant->encoder);
 	if(participant->decoder)
 		opus_decoder_destroy(participant->decoder);
-	while(participant->inbuf) {
-		GList *first = g_list_first(participant->inbuf);
-		janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-		participant->inbuf = g_list_remove_link(participant->inbuf, first);
-		if(pkt)
-			g_free(pkt->data);
-		g_free(pkt);
-	}
-	if(participant->outbuf != NULL) {
-		while(g_async_queue_length(participant->outbuf) > 0) {
-			janus_audiobridge_rtp_relay_packet *pkt = g_async_queue_pop(participant->outbuf);
-			if(pkt)
-				g_free(pkt->data);
-			g_free(pkt);
-		}
-		g_async_queue_unref(participant->outbuf);
+	/* Get rid of the shared frames the participant thread didn't send */
+	while(participant->outbuf_head != participant->outbuf_tail) {
+		janus_audiobridge_mixed_frame *mixed = &participant->outbuf[(guint)participant->outbuf_head % MIXED_FRAMES];
+		if(mixed->encoded)
+			janus_refcount_decrease(&mixed->encoded->ref);
+		mixed->encoded = NULL;
+		participant->outbuf_head++;
 	}
+	janus_mutex_destroy(&participant->outbuf_mutex);
+	janus_condition_destroy(&participant->outbuf_cond);
 	g_free(participant);
 }
 
@@ -1017,6 +1175,38 @@ static void janus_audiobridge_room_destroy(janus_audiobridge_room *audiobridge)
 	janus_refcount_decrease(&audiobridge->ref);
 }
 
+/* Change in the list of participants, when notifications are batched */
+typedef struct janus_audiobridge_notification {
+	guint64 seq;		/* Sequence number of this change */
+	guint64 id;			/* Participant this change is about */
+	const char *type;	/* Property this change goes in ("participants", "leaving" or "kicked") */
+	json_t *info;		/* Participant object or ID, depending on the type */
+} janus_audiobridge_notification;
+static void janus_audiobridge_notification_free(janus_audiobridge_notification *n) {
+	if(n == NULL)
+		return;
+	json_decref(n->info);
+	g_free(n);
+}
+/* Batched event ready to be sent to a participant: events are prepared by the
+ * mixer thread with the room mutex held, but sent by a separate thread */
+typedef struct janus_audiobridge_notification_event {
+	janus_audiobridge_session *session;	/* Session to send the event to */
+	guint64 user_id;	/* Participant the session belongs to */
+	json_t *event;		/* Event to send */
+} janus_audiobridge_notification_event;
+static GAsyncQueue *notifications = NULL;
+static janus_audiobridge_notification_event exit_notification;
+static GThread *notifier_thread;
+static void *janus_audiobridge_notifier(void *data);
+static void janus_audiobridge_notification_event_free(janus_audiobridge_notification_event *ne) {
+	if(ne == NULL || ne == &exit_notification)
+		return;
+	janus_refcount_decrease(&ne->session->ref);
+	json_decref(ne->event);
+	g_free(ne);
+}
+
 static void janus_audiobridge_room_free(const janus_refcount *audiobridge_ref) {
 	janus_audiobridge_room *audiobridge = janus_refcount_containerof(audiobridge_ref, janus_audiobridge_room, ref);
 	/* This room can be destroyed, free all the resources */
@@ -1030,7 +1220,18 @@ static void janus_audiobridge_room_free(const janus_refcount *audiobridge_ref) {
 		close(audiobridge->rtp_udp_sock);
 	if(audiobridge->rtp_encoder)
 		opus_encoder_destroy(audiobridge->rtp_encoder);
+	janus_media_clock_destroy(audiobridge->clock);
+	int i = 0, j = 0;
+	for(i=0; i<2; i++) {
+		for(j=0; j<11; j++) {
+			if(audiobridge->shared_encoders[i][j])
+				opus_encoder_destroy(audiobridge->shared_encoders[i][j]);
+		}
+	}
 	g_hash_table_destroy(audiobridge->rtp_forwarders);
+	g_list_free_full(audiobridge->notify_pending, (GDestroyNotify)janus_audiobridge_notification_free);
+	if(audiobridge->participants_list)
+		json_decref(audiobridge->participants_list);
 	g_free(audiobridge);
 }
 
@@ -1069,7 +1270,82 @@ typedef struct janus_audiobridge_rtp_forwarder {
 	gboolean is_srtp;
 	srtp_t srtp_ctx;
 	srtp_policy_t srtp_policy;
+	/* Statistics (only updated with rtp_mutex held) */
+	guint64 packets, bytes, errors;
 } janus_audiobridge_rtp_forwarder;
+/* Mixed packets for the RTP forwarders of a room are queued in a batch (each
+ * with its own RTP header, but all sharing the same encoded payload) and then
+ * sent all at once, with a single sendmmsg() call when available */
+#define JANUS_AUDIOBRIDGE_FORWARDERS_BATCH	16
+typedef struct janus_audiobridge_forwarders_batch {
+	int fd;			/* Socket to send the packets on */
+	guint count;	/* Number of packets currently in the batch */
+	char *payload;	/* Encoded payload shared by all packets */
+	size_t length;	/* Length of the encoded payload */
+	janus_audiobridge_rtp_forwarder *forwarders[JANUS_AUDIOBRIDGE_FORWARDERS_BATCH];
+	janus_rtp_header headers[JANUS_AUDIOBRIDGE_FORWARDERS_BATCH];
+} janus_audiobridge_forwarders_batch;
+static void janus_audiobridge_forwarders_batch_flush(janus_audiobridge_forwarders_batch *batch, guint64 room_id) {
+	if(batch->count == 0)
+		return;
+	struct iovec iov[JANUS_AUDIOBRIDGE_FORWARDERS_BATCH][2];
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[JANUS_AUDIOBRIDGE_FORWARDERS_BATCH];
+#else
+	struct { struct msghdr msg_hdr; } msgs[JANUS_AUDIOBRIDGE_FORWARDERS_BATCH];
+#endif
+	guint i = 0;
+	for(i=0; i<batch->count; i++) {
+		janus_audiobridge_rtp_forwarder *forwarder = batch->forwarders[i];
+		struct msghdr *msg = &msgs[i].msg_hdr;
+		memset(msg, 0, sizeof(*msg));
+		if(forwarder->serv_addr.sin_family == AF_INET) {
+			msg->msg_name = &forwarder->serv_addr;
+			msg->msg_namelen = sizeof(forwarder->serv_addr);
+		} else {
+			msg->msg_name = &forwarder->serv_addr6;
+			msg->msg_namelen = sizeof(forwarder->serv_addr6);
+		}
+		iov[i][0].iov_base = &batch->headers[i];
+		iov[i][0].iov_len = sizeof(janus_rtp_header);
+		iov[i][1].iov_base = batch->payload;
+		iov[i][1].iov_len = batch->length;
+		msg->msg_iov = iov[i];
+		msg->msg_iovlen = 2;
+	}
+#ifdef HAVE_SENDMMSG
+	guint sent = 0;
+	while(sent < batch->count) {
+		int res = sendmmsg(batch->fd, &msgs[sent], batch->count-sent, 0);
+		if(res < 1) {
+			/* The first packet we tried to send failed: skip it and go on with the others */
+			JANUS_LOG(LOG_HUGE, "Error forwarding mixed RTP packet for room %"SCNu64"... %s (len=%zu)...\n",
+				room_id, strerror(errno), sizeof(janus_rtp_header)+batch->length);
+			batch->forwarders[sent]->errors++;
+			sent++;
+			continue;
+		}
+		for(i=sent; i<sent+res; i++) {
+			batch->forwarders[i]->packets++;
+			batch->forwarders[i]->bytes += msgs[i].msg_len;
+		}
+		sent += res;
+	}
+#else
+	for(i=0; i<batch->count; i++) {
+		ssize_t res = sendmsg(batch->fd, &msgs[i].msg_hdr, 0);
+		if(res < 0) {
+			JANUS_LOG(LOG_HUGE, "Error forwarding mixed RTP packet for room %"SCNu64"... %s (len=%zu)...\n",
+				room_id, strerror(errno), sizeof(janus_rtp_header)+batch->length);
+			batch->forwarders[i]->errors++;
+		} else {
+			batch->forwarders[i]->packets++;
+			batch->forwarders[i]->bytes += res;
+		}
+	}
+#endif
+	batch->count = 0;
+}
 static guint32 janus_audiobridge_rtp_forwarder_add_helper(janus_audiobridge_room *room,
 		const gchar *host, uint16_t port, uint32_t ssrc, int pt,
 		int srtp_suite, const char *srtp_crypto,
@@ -1151,23 +1427,146 @@ static guint32 janus_audiobridge_rtp_forwarder_add_helper(janus_audiobridge_room
 }
 
 
-/* Helper to sort incoming RTP packets by sequence numbers */
-static gint janus_audiobridge_rtp_sort(gconstpointer a, gconstpointer b) {
-	janus_audiobridge_rtp_relay_packet *pkt1 = (janus_audiobridge_rtp_relay_packet *)a;
-	janus_audiobridge_rtp_relay_packet *pkt2 = (janus_audiobridge_rtp_relay_packet *)b;
-	if(pkt1->seq_number < 100 && pkt2->seq_number > 65000) {
-		/* Sequence number was probably reset, pkt2 is older */
-		return 1;
-	} else if(pkt2->seq_number < 100 && pkt1->seq_number > 65000) {
-		/* Sequence number was probably reset, pkt1 is older */
-		return -1;
+/* Helpers to handle the jitter buffer of a participant: they all expect the
+ * participant's qmutex to be locked, and frames returned by peek/pop are
+ * only valid until the mutex is released */
+static void janus_audiobridge_jitter_buffer_push(janus_audiobridge_jitter_buffer *jb,
+		uint16_t seq_number, uint32_t timestamp, opus_int16 *pcm, int length, gboolean silence) {
+	if(!jb->started) {
+		jb->started = TRUE;
+		jb->head = seq_number;
 	}
-	/* Simply compare timestamps */
-	if(pkt1->seq_number < pkt2->seq_number)
-		return -1;
-	else if(pkt1->seq_number > pkt2->seq_number)
-		return 1;
-	return 0;
+	int16_t offset = (int16_t)(seq_number - jb->head);
+	if(offset < 0) {
+		/* The mixer moved past this frame already */
+		jb->late++;
+		return;
+	}
+	int i = 0;
+	if(offset >= JITTER_BUFFER_FRAMES) {
+		/* Too far ahead: make room by dropping the oldest frames */
+		uint16_t head = seq_number - (JITTER_BUFFER_FRAMES-1);
+		for(i=0; i<JITTER_BUFFER_FRAMES; i++) {
+			janus_audiobridge_buffered_frame *frame = &jb->frames[i];
+			if(frame->filled && (int16_t)(frame->seq_number - head) < 0) {
+				frame->filled = FALSE;
+				jb->depth--;
+				jb->dropped++;
+			}
+		}
+		jb->head = head;
+	}
+	janus_audiobridge_buffered_frame *frame = &jb->frames[seq_number % JITTER_BUFFER_FRAMES];
+	if(frame->filled) {
+		if(frame->seq_number == seq_number)	/* Duplicate */
+			return;
+		jb->depth--;
+	}
+	/* The mixer works on 20ms frames: anything beyond that is not mixed */
+	int samples = MIN(length, OPUS_SAMPLES);
+	if(length > OPUS_SAMPLES)
+		jb->truncated++;
+	if(samples > 0)
+		memcpy(frame->samples, pcm, samples*sizeof(opus_int16));
+	if(samples < OPUS_SAMPLES)
+		memset(frame->samples + MAX(samples, 0), 0, (OPUS_SAMPLES - MAX(samples, 0))*sizeof(opus_int16));
+	frame->length = length;
+	frame->timestamp = timestamp;
+	frame->seq_number = seq_number;
+	frame->silence = silence;
+	frame->filled = TRUE;
+	jb->depth++;
+}
+
+static janus_audiobridge_buffered_frame *janus_audiobridge_jitter_buffer_peek(janus_audiobridge_jitter_buffer *jb) {
+	if(jb->depth == 0)
+		return NULL;
+	/* Return the oldest frame we have, even if there are holes before that */
+	int i = 0;
+	for(i=0; i<JITTER_BUFFER_FRAMES; i++) {
+		uint16_t seq_number = jb->head + i;
+		janus_audiobridge_buffered_frame *frame = &jb->frames[seq_number % JITTER_BUFFER_FRAMES];
+		if(frame->filled && frame->seq_number == seq_number)
+			return frame;
+	}
+	return NULL;
+}
+
+static janus_audiobridge_buffered_frame *janus_audiobridge_jitter_buffer_pop(janus_audiobridge_jitter_buffer *jb) {
+	janus_audiobridge_buffered_frame *frame = janus_audiobridge_jitter_buffer_peek(jb);
+	if(frame == NULL)
+		return NULL;
+	frame->filled = FALSE;
+	jb->depth--;
+	jb->head = frame->seq_number + 1;
+	return frame;
+}
+
+static void janus_audiobridge_jitter_buffer_reset(janus_audiobridge_jitter_buffer *jb) {
+	int i = 0;
+	for(i=0; i<JITTER_BUFFER_FRAMES; i++)
+		jb->frames[i].filled = FALSE;
+	jb->depth = 0;
+	jb->started = FALSE;
+}
+
+/* Helper to hand a mixed frame to the participant thread: if an encoded frame
+ * is provided, the reference we got is released when the frame is sent */
+static void janus_audiobridge_participant_queue_mix(janus_audiobridge_participant *participant,
+		opus_int16 *samples, int length, janus_audiobridge_encoded_frame *encoded,
+		uint32_t ssrc, uint32_t timestamp, uint16_t seq_number) {
+	janus_mutex_lock(&participant->outbuf_mutex);
+	if((guint)(participant->outbuf_tail - g_atomic_int_get(&participant->outbuf_head)) >= MIXED_FRAMES) {
+		/* The participant thread is lagging behind, drop this frame */
+		participant->outbuf_dropped++;
+		janus_mutex_unlock(&participant->outbuf_mutex);
+		if(encoded)
+			janus_refcount_decrease(&encoded->ref);
+		return;
+	}
+	janus_audiobridge_mixed_frame *mixed = &participant->outbuf[(guint)participant->outbuf_tail % MIXED_FRAMES];
+	if(encoded == NULL)
+		memcpy(mixed->samples, samples, length*sizeof(opus_int16));
+	mixed->encoded = encoded;
+	mixed->length = length;
+	mixed->ssrc = ssrc;
+	mixed->timestamp = timestamp;
+	mixed->seq_number = seq_number;
+	g_atomic_int_inc(&participant->outbuf_tail);
+	janus_condition_signal(&participant->outbuf_cond);
+	janus_mutex_unlock(&participant->outbuf_mutex);
+}
+
+/* Helper to wait for the next mixed frame in the participant thread: the
+ * frame must be released with janus_audiobridge_participant_release_mix */
+static janus_audiobridge_mixed_frame *janus_audiobridge_participant_wait_mix(janus_audiobridge_participant *participant, gint64 timeout) {
+	janus_mutex_lock(&participant->outbuf_mutex);
+	if(g_atomic_int_get(&participant->outbuf_tail) == participant->outbuf_head) {
+#ifndef USE_PTHREAD_MUTEX
+		gint64 wakeup = janus_get_monotonic_time() + timeout;
+		janus_condition_wait_until(&participant->outbuf_cond, &participant->outbuf_mutex, wakeup);
+#else
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		gint64 when = (gint64)now.tv_sec*G_USEC_PER_SEC + now.tv_usec + timeout;
+		struct timespec wakeup;
+		wakeup.tv_sec = when/G_USEC_PER_SEC;
+		wakeup.tv_nsec = (when%G_USEC_PER_SEC)*1000;
+		janus_condition_timedwait(&participant->outbuf_cond, &participant->outbuf_mutex, &wakeup);
+#endif
+	}
+	janus_audiobridge_mixed_frame *mixed = NULL;
+	if(g_atomic_int_get(&participant->outbuf_tail) != participant->outbuf_head)
+		mixed = &participant->outbuf[(guint)participant->outbuf_head % MIXED_FRAMES];
+	janus_mutex_unlock(&participant->outbuf_mutex);
+	return mixed;
+}
+
+static void janus_audiobridge_participant_release_mix(janus_audiobridge_participant *participant, janus_audiobridge_mixed_frame *mixed) {
+	if(mixed->encoded)
+		janus_refcount_decrease(&mixed->encoded->ref);
+	mixed->encoded = NULL;
+	g_atomic_int_inc(&participant->outbuf_head);
 }
 
 /* Helper struct to generate and parse WAVE headers */
@@ -1188,14 +1587,20 @@ typedef struct wav_header {
 } wav_header;
 
 
-/* Mixer settings */
-#define DEFAULT_PREBUFFERING	6
-
+/* Kernels we'll use in the mixers (selected in janus_audiobridge_init) */
+static const janus_audiobridge_mixer_kernels *mixer_kernels = &janus_audiobridge_kernels_scalar;
 
-/* Opus settings */
-#define	BUFFER_SAMPLES	8000
-#define	OPUS_SAMPLES	960
-#define DEFAULT_COMPLEXITY	4
+static void janus_audiobridge_mixer_kernels_select(void) {
+	mixer_kernels = &janus_audiobridge_kernels_scalar;
+#ifdef JANUS_AUDIOBRIDGE_SIMD_KERNELS
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		mixer_kernels = &janus_audiobridge_kernels_avx2;
+	else if(__builtin_cpu_supports("sse2"))
+		mixer_kernels = &janus_audiobridge_kernels_sse2;
+#endif
+	JANUS_LOG(LOG_INFO, "AudioBridge mixer will use %s kernels\n", mixer_kernels->name);
+}
 
 
 /* Error codes */
@@ -1264,6 +1669,97 @@ static int janus_audiobridge_create_opus_encoder_if_needed(janus_audiobridge_roo
 	return 0;
 }
 
+/* Helper to pick the loudest participants to mix, when max_speakers is set:
+ * participants that don't send audio levels can't be ranked, so they're
+ * always mixed. Only ever called by the mixer thread */
+#define SPEAKER_LEVEL_TIMEOUT	200000
+#define SPEAKER_HYSTERESIS		3
+static guint janus_audiobridge_select_speakers(janus_audiobridge_room *audiobridge, GList *participants) {
+	gint64 now = janus_get_monotonic_time();
+	int picked = 0;
+	while(picked < audiobridge->max_speakers) {
+		janus_audiobridge_participant *loudest = NULL;
+		int loudest_level = 127;
+		GList *ps = participants;
+		while(ps) {
+			janus_audiobridge_participant *p = (janus_audiobridge_participant *)ps->data;
+			ps = ps->next;
+			if(p->picked || p->extmap_id == 0 || p->muted || !g_atomic_int_get(&p->active))
+				continue;
+			/* Participants that stopped sending audio levels (e.g., DTX) are silent */
+			int level = (now - p->level_updated > SPEAKER_LEVEL_TIMEOUT) ? 127 : p->level_avg;
+			/* Favour who's already being mixed, to avoid switching back and forth */
+			if(g_atomic_int_get(&p->selected) && level < 127)
+				level = MAX(0, level - SPEAKER_HYSTERESIS);
+			if(level < loudest_level) {
+				loudest = p;
+				loudest_level = level;
+			}
+		}
+		if(loudest == NULL)
+			break;
+		loudest->picked = TRUE;
+		picked++;
+	}
+	guint selected = 0;
+	GList *ps = participants;
+	while(ps) {
+		janus_audiobridge_participant *p = (janus_audiobridge_participant *)ps->data;
+		gboolean mix = p->picked || p->extmap_id == 0;
+		g_atomic_int_set(&p->selected, mix ? 1 : 0);
+		if(mix && !p->muted)
+			selected++;
+		p->picked = FALSE;
+		ps = ps->next;
+	}
+	return selected;
+}
+
+/* Helper to encode the full room mix once for all the participants with the
+ * same FEC and complexity settings: only ever called by the mixer thread */
+static janus_audiobridge_encoded_frame *janus_audiobridge_encode_shared_mix(janus_audiobridge_room *audiobridge,
+		gboolean fec, int complexity, opus_int16 *mix, int samples) {
+	if(complexity < 1 || complexity > 10)
+		complexity = DEFAULT_COMPLEXITY;
+	OpusEncoder *encoder = audiobridge->shared_encoders[fec ? 1 : 0][complexity];
+	if(encoder == NULL) {
+		int error = 0;
+		encoder = opus_encoder_create(audiobridge->sampling_rate, 1, OPUS_APPLICATION_VOIP, &error);
+		if(error != OPUS_OK) {
+			JANUS_LOG(LOG_ERR, "Error creating Opus encoder for the shared mix (room %"SCNu64")\n", audiobridge->room_id);
+			return NULL;
+		}
+		if(audiobridge->sampling_rate == 8000) {
+			opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_NARROWBAND));
+		} else if(audiobridge->sampling_rate == 12000) {
+			opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_MEDIUMBAND));
+		} else if(audiobridge->sampling_rate == 16000) {
+			opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_WIDEBAND));
+		} else if(audiobridge->sampling_rate == 24000) {
+			opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_SUPERWIDEBAND));
+		} else if(audiobridge->sampling_rate == 48000) {
+			opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_FULLBAND));
+		} else {
+			opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_WIDEBAND));
+		}
+		opus_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(fec));
+		opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(complexity));
+		audiobridge->shared_encoders[fec ? 1 : 0][complexity] = encoder;
+	}
+	unsigned char buffer[1500];
+	opus_int32 length = opus_encode(encoder, mix, samples, buffer, 1500-12);
+	if(length < 0) {
+		JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error encoding the shared Opus frame: %d (%s)\n", length, opus_strerror(length));
+		return NULL;
+	}
+	janus_audiobridge_encoded_frame *frame = g_malloc(sizeof(janus_audiobridge_encoded_frame));
+	frame->payload = g_malloc(length);
+	memcpy(frame->payload, buffer, length);
+	frame->length = length;
+	janus_refcount_init(&frame->ref, janus_audiobridge_encoded_frame_free);
+	return frame;
+}
+
 static int janus_audiobridge_create_static_rtp_forwarder(janus_config_category *cat, janus_audiobridge_room *audiobridge) {
 	guint32 forwarder_id = 0;
 	janus_config_item *forwarder_id_item = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_id");
@@ -1411,9 +1907,13 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 	if(config != NULL)
 		janus_config_print(config);
 
+	/* Check which mixing kernels we can use on this machine */
+	janus_audiobridge_mixer_kernels_select();
+
 	rooms = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, (GDestroyNotify)janus_audiobridge_room_destroy);
 	sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_audiobridge_session_destroy);
 	messages = g_async_queue_new_full((GDestroyNotify) janus_audiobridge_message_free);
+	notifications = g_async_queue_new_full((GDestroyNotify) janus_audiobridge_notification_event_free);
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	gateway = callback;
 
@@ -1456,6 +1956,10 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 			janus_config_item *pin = janus_config_get(config, cat, janus_config_type_item, "pin");
 			janus_config_item *record = janus_config_get(config, cat, janus_config_type_item, "record");
 			janus_config_item *recfile = janus_config_get(config, cat, janus_config_type_item, "record_file");
+			janus_config_item *shared_mix = janus_config_get(config, cat, janus_config_type_item, "shared_mix");
+			janus_config_item *max_speakers = janus_config_get(config, cat, janus_config_type_item, "max_speakers");
+			janus_config_item *mixer_threads = janus_config_get(config, cat, janus_config_type_item, "mixer_threads");
+			janus_config_item *notify_window = janus_config_get(config, cat, janus_config_type_item, "notify_window");
 			if(sampling == NULL || sampling->value == NULL) {
 				JANUS_LOG(LOG_ERR, "Can't add the audio room, missing mandatory information...\n");
 				cl = cl->next;
@@ -1524,6 +2028,30 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 				audiobridge->record = TRUE;
 			if(recfile && recfile->value)
 				audiobridge->record_file = g_strdup(recfile->value);
+			audiobridge->shared_mix = shared_mix && shared_mix->value && janus_is_true(shared_mix->value);
+			if(max_speakers != NULL && max_speakers->value != NULL) {
+				if(!audiobridge->audiolevel_ext) {
+					JANUS_LOG(LOG_WARN, "max_speakers needs audiolevel_ext, mixing everybody in room %"SCNu64"\n", audiobridge->room_id);
+				} else if(atoi(max_speakers->value) >= 0) {
+					audiobridge->max_speakers = atoi(max_speakers->value);
+				} else {
+					JANUS_LOG(LOG_WARN, "Invalid max_speakers value provided, mixing everybody\n");
+				}
+			}
+			audiobridge->mixer_threads = 1;
+			if(mixer_threads != NULL && mixer_threads->value != NULL) {
+				if(atoi(mixer_threads->value) > (int)g_get_num_processors()) {
+					audiobridge->mixer_threads = g_get_num_processors();
+					JANUS_LOG(LOG_WARN, "Too many mixer_threads (%d), limiting to the number of cores (%d)\n",
+						atoi(mixer_threads->value), audiobridge->mixer_threads);
+				} else if(atoi(mixer_threads->value) > 0) {
+					audiobridge->mixer_threads = atoi(mixer_threads->value);
+				} else {
+					JANUS_LOG(LOG_WARN, "Invalid mixer_threads value provided, using default: 1\n");
+				}
+			}
+			if(notify_window != NULL && notify_window->value != NULL && atoi(notify_window->value) > 0)
+				audiobridge->notify_window = atoi(notify_window->value);
 			audiobridge->recording = NULL;
 			audiobridge->destroy = 0;
 			audiobridge->participants = g_hash_table_new_full(g_int64_hash, g_int64_equal,
@@ -1560,6 +2088,7 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 			} else {
 				janus_mutex_lock(&rooms_mutex);
 				g_hash_table_insert(rooms, janus_uint64_dup(audiobridge->room_id), audiobridge);
+				rooms_list_changed = TRUE;
 				janus_mutex_unlock(&rooms_mutex);
 			}
 			cl = cl->next;
@@ -1591,6 +2120,14 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 		janus_config_destroy(config);
 		return -1;
 	}
+	/* Launch the thread that will send the batched participant list changes */
+	notifier_thread = g_thread_try_new("audiobridge notifier", janus_audiobridge_notifier, NULL, &error);
+	if(error != NULL) {
+		g_atomic_int_set(&initialized, 0);
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the AudioBridge notifier thread...\n", error->code, error->message ? error->message : "??");
+		janus_config_destroy(config);
+		return -1;
+	}
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_AUDIOBRIDGE_NAME);
 	return 0;
 }
@@ -1605,6 +2142,11 @@ void janus_audiobridge_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+	g_async_queue_push(notifications, &exit_notification);
+	if(notifier_thread != NULL) {
+		g_thread_join(notifier_thread);
+		notifier_thread = NULL;
+	}
 	/* FIXME We should destroy the sessions cleanly */
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
@@ -1613,9 +2155,15 @@ void janus_audiobridge_destroy(void) {
 	janus_mutex_lock(&rooms_mutex);
 	g_hash_table_destroy(rooms);
 	rooms = NULL;
+	if(rooms_list)
+		json_decref(rooms_list);
+	rooms_list = NULL;
+	rooms_list_changed = TRUE;
 	janus_mutex_unlock(&rooms_mutex);
 	g_async_queue_unref(messages);
 	messages = NULL;
+	g_async_queue_unref(notifications);
+	notifications = NULL;
 
 	janus_config_destroy(config);
 	g_free(admin_key);
@@ -1704,6 +2252,177 @@ void janus_audiobridge_destroy_session(janus_plugin_session *handle, int *error)
 	return;
 }
 
+/* Flag the cached list of participants of a room as outdated */
+static void janus_audiobridge_participants_changed(janus_audiobridge_room *audiobridge) {
+	if(audiobridge != NULL)
+		g_atomic_int_set(&audiobridge->participants_changed, 1);
+}
+
+/* Cached lists for the list and listparticipants requests: both are only
+ * rebuilt when something changed, and are sorted by ID so that they can be
+ * paginated. Entries are shared with whoever is using the cache, which means
+ * they must never be modified: a new list is created when needed instead */
+static gint janus_audiobridge_compare_ids(gconstpointer a, gconstpointer b) {
+	guint64 first = *((const guint64 *)a), second = *((const guint64 *)b);
+	return first < second ? -1 : (first > second ? 1 : 0);
+}
+
+/* Must be called with the room mutex held: returns a new reference */
+static json_t *janus_audiobridge_participants_list(janus_audiobridge_room *audiobridge) {
+	if(audiobridge->participants_list == NULL || g_atomic_int_compare_and_exchange(&audiobridge->participants_changed, 1, 0)) {
+		if(audiobridge->participants_list)
+			json_decref(audiobridge->participants_list);
+		audiobridge->participants_list = json_array();
+		GList *ids = g_list_sort(g_hash_table_get_keys(audiobridge->participants), janus_audiobridge_compare_ids), *l = ids;
+		while(l) {
+			janus_audiobridge_participant *p = g_hash_table_lookup(audiobridge->participants, l->data);
+			l = l->next;
+			json_t *pl = json_object();
+			json_object_set_new(pl, "id", json_integer(p->user_id));
+			if(p->display)
+				json_object_set_new(pl, "display", json_string(p->display));
+			json_object_set_new(pl, "setup", g_atomic_int_get(&p->session->started) ? json_true() : json_false());
+			json_object_set_new(pl, "muted", p->muted ? json_true() : json_false());
+			if(p->extmap_id > 0)
+				json_object_set_new(pl, "talking", p->talking ? json_true() : json_false());
+			json_array_append_new(audiobridge->participants_list, pl);
+		}
+		g_list_free(ids);
+	}
+	return json_incref(audiobridge->participants_list);
+}
+
+/* Must be called with rooms_mutex held: returns a new reference */
+static json_t *janus_audiobridge_rooms_list(void) {
+	if(rooms_list == NULL || rooms_list_changed) {
+		if(rooms_list)
+			json_decref(rooms_list);
+		rooms_list = json_array();
+		rooms_list_changed = FALSE;
+		GList *ids = g_list_sort(g_hash_table_get_keys(rooms), janus_audiobridge_compare_ids), *l = ids;
+		while(l) {
+			janus_audiobridge_room *room = g_hash_table_lookup(rooms, l->data);
+			l = l->next;
+			if(room->is_private || g_atomic_int_get(&room->destroyed))
+				continue;
+			json_t *rl = json_object();
+			json_object_set_new(rl, "room", json_integer(room->room_id));
+			json_object_set_new(rl, "description", json_string(room->room_name));
+			json_object_set_new(rl, "sampling_rate", json_integer(room->sampling_rate));
+			json_object_set_new(rl, "pin_required", room->room_pin ? json_true() : json_false());
+			json_object_set_new(rl, "record", room->record ? json_true() : json_false());
+			json_array_append_new(rooms_list, rl);
+		}
+		g_list_free(ids);
+	}
+	return json_incref(rooms_list);
+}
+
+/* Helpers to batch participants joining and leaving: all changes in the room
+ * notify_window are merged in a single event for each participant, which the
+ * mixer thread prepares when the window expires and then hands to the notifier
+ * thread, so that it never has to push events itself. All these helpers must
+ * be called with the room mutex held */
+static json_t *janus_audiobridge_notification_build(janus_audiobridge_room *audiobridge, guint64 exclude, guint64 after) {
+	json_t *event = NULL;
+	GList *l = audiobridge->notify_pending;
+	while(l) {
+		janus_audiobridge_notification *n = (janus_audiobridge_notification *)l->data;
+		l = l->next;
+		/* Skip changes about the recipient itself, or that it knows about already */
+		if(n->id == exclude || n->seq <= after)
+			continue;
+		if(event == NULL) {
+			event = json_object();
+			json_object_set_new(event, "audiobridge", json_string("event"));
+			json_object_set_new(event, "room", json_integer(audiobridge->room_id));
+		}
+		json_t *list = json_object_get(event, n->type);
+		if(list == NULL) {
+			list = json_array();
+			json_object_set_new(event, n->type, list);
+		}
+		json_array_append(list, n->info);
+	}
+	return event;
+}
+
+static void janus_audiobridge_notification_flush(janus_audiobridge_room *audiobridge) {
+	if(audiobridge->notify_pending == NULL)
+		return;
+	guint64 first = ((janus_audiobridge_notification *)audiobridge->notify_pending->data)->seq;
+	/* Most participants will get the same event: only those the changes are
+	 * about, or that joined in the meanwhile, need one of their own */
+	GHashTable *ids = g_hash_table_new(g_int64_hash, g_int64_equal);
+	GList *l = audiobridge->notify_pending;
+	while(l) {
+		janus_audiobridge_notification *n = (janus_audiobridge_notification *)l->data;
+		g_hash_table_add(ids, &n->id);
+		l = l->next;
+	}
+	json_t *shared = NULL;
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, audiobridge->participants);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_audiobridge_participant *p = value;
+		if(p == NULL || p->session == NULL)
+			continue;
+		json_t *event = NULL;
+		if(p->notify_seq < first && !g_hash_table_contains(ids, &p->user_id)) {
+			if(shared == NULL)
+				shared = janus_audiobridge_notification_build(audiobridge, 0, 0);
+			event = json_incref(shared);
+		} else {
+			event = janus_audiobridge_notification_build(audiobridge, p->user_id, p->notify_seq);
+		}
+		if(event == NULL)
+			continue;
+		janus_audiobridge_notification_event *ne = g_malloc(sizeof(janus_audiobridge_notification_event));
+		janus_refcount_increase(&p->session->ref);
+		ne->session = p->session;
+		ne->user_id = p->user_id;
+		ne->event = event;
+		g_async_queue_push(notifications, ne);
+	}
+	if(shared != NULL)
+		json_decref(shared);
+	g_hash_table_destroy(ids);
+	g_list_free_full(audiobridge->notify_pending, (GDestroyNotify)janus_audiobridge_notification_free);
+	audiobridge->notify_pending = NULL;
+}
+
+/* Returns FALSE if the room doesn't batch notifications, in which case the caller should notify right away */
+static gboolean janus_audiobridge_notification_add(janus_audiobridge_room *audiobridge, guint64 id, const char *type, json_t *info) {
+	if(audiobridge == NULL || audiobridge->notify_window == 0 || info == NULL)
+		return FALSE;
+	/* The window starts with the first change, even if it's superseded later */
+	gboolean first = (audiobridge->notify_pending == NULL);
+	/* A new change supersedes the previous ones about the same participant,
+	 * except for participants leaving after being kicked */
+	GList *l = audiobridge->notify_pending;
+	while(l) {
+		janus_audiobridge_notification *n = (janus_audiobridge_notification *)l->data;
+		GList *next = l->next;
+		if(n->id == id && !strcasecmp(n->type, "kicked") && !strcasecmp(type, "leaving"))
+			return TRUE;
+		if(n->id == id) {
+			audiobridge->notify_pending = g_list_delete_link(audiobridge->notify_pending, l);
+			janus_audiobridge_notification_free(n);
+		}
+		l = next;
+	}
+	if(first)
+		audiobridge->notify_deadline = janus_get_monotonic_time() + (gint64)audiobridge->notify_window*1000;
+	janus_audiobridge_notification *n = g_malloc0(sizeof(janus_audiobridge_notification));
+	n->seq = ++audiobridge->notify_seq;
+	n->id = id;
+	n->type = type;
+	n->info = json_incref(info);
+	audiobridge->notify_pending = g_list_append(audiobridge->notify_pending, n);
+	return TRUE;
+}
+
 static void janus_audiobridge_notify_participants(janus_audiobridge_participant *participant, json_t *msg) {
 	/* participant->room->participants_mutex has to be locked. */
 	GHashTableIter iter;
@@ -1748,13 +2467,15 @@ json_t *janus_audiobridge_query_session(janus_plugin_session *handle) {
 		json_object_set_new(info, "muted", participant->muted ? json_true() : json_false());
 		json_object_set_new(info, "active", g_atomic_int_get(&participant->active) ? json_true() : json_false());
 		json_object_set_new(info, "pre-buffering", participant->prebuffering ? json_true() : json_false());
-		if(participant->inbuf) {
-			janus_mutex_lock(&participant->qmutex);
-			json_object_set_new(info, "queue-in", json_integer(g_list_length(participant->inbuf)));
-			janus_mutex_unlock(&participant->qmutex);
-		}
-		if(participant->outbuf)
-			json_object_set_new(info, "queue-out", json_integer(g_async_queue_length(participant->outbuf)));
+		janus_mutex_lock(&participant->qmutex);
+		json_object_set_new(info, "queue-in", json_integer(participant->jitter.depth));
+		json_object_set_new(info, "late-packets", json_integer(participant->jitter.late));
+		json_object_set_new(info, "dropped-packets", json_integer(participant->jitter.dropped));
+		json_object_set_new(info, "truncated-packets", json_integer(participant->jitter.truncated));
+		janus_mutex_unlock(&participant->qmutex);
+		json_object_set_new(info, "queue-out", json_integer((guint)(g_atomic_int_get(&participant->outbuf_tail) -
+			g_atomic_int_get(&participant->outbuf_head))));
+		json_object_set_new(info, "dropped-mixes", json_integer(participant->outbuf_dropped));
 		if(participant->last_drop > 0)
 			json_object_set_new(info, "last-drop", json_integer(participant->last_drop));
 		if(participant->arc && participant->arc->filename)
@@ -1817,6 +2538,10 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		json_t *audio_level_average = json_object_get(root, "audio_level_average");
 		json_t *record = json_object_get(root, "record");
 		json_t *recfile = json_object_get(root, "record_file");
+		json_t *shared_mix = json_object_get(root, "shared_mix");
+		json_t *max_speakers = json_object_get(root, "max_speakers");
+		json_t *mixer_threads = json_object_get(root, "mixer_threads");
+		json_t *notify_window = json_object_get(root, "notify_window");
 		json_t *permanent = json_object_get(root, "permanent");
 		if(allowed) {
 			/* Make sure the "allowed" array only contains strings */
@@ -1838,6 +2563,13 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 				goto prepare_response;
 			}
 		}
+		if(mixer_threads && json_integer_value(mixer_threads) > (json_int_t)g_get_num_processors()) {
+			/* We don't want rooms to spawn more helper threads than we have cores */
+			JANUS_LOG(LOG_ERR, "Invalid element (mixer_threads can't be more than %u)\n", g_get_num_processors());
+			error_code = JANUS_AUDIOBRIDGE_ERROR_INVALID_ELEMENT;
+			g_snprintf(error_cause, 512, "Invalid element (mixer_threads can't be more than %u)", g_get_num_processors());
+			goto prepare_response;
+		}
 		gboolean save = permanent ? json_is_true(permanent) : FALSE;
 		if(save && config == NULL) {
 			JANUS_LOG(LOG_ERR, "No configuration file, can't create permanent room\n");
@@ -1930,6 +2662,18 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			audiobridge->record = TRUE;
 		if(recfile)
 			audiobridge->record_file = g_strdup(json_string_value(recfile));
+		audiobridge->shared_mix = shared_mix ? json_is_true(shared_mix) : FALSE;
+		if(max_speakers) {
+			if(!audiobridge->audiolevel_ext) {
+				JANUS_LOG(LOG_WARN, "max_speakers needs audiolevel_ext, mixing everybody in room %"SCNu64"\n", audiobridge->room_id);
+			} else {
+				audiobridge->max_speakers = json_integer_value(max_speakers);
+			}
+		}
+		audiobridge->mixer_threads = 1;
+		if(mixer_threads && json_integer_value(mixer_threads) > 0)
+			audiobridge->mixer_threads = json_integer_value(mixer_threads);
+		audiobridge->notify_window = json_integer_value(notify_window);
 		audiobridge->recording = NULL;
 		audiobridge->destroy = 0;
 		audiobridge->participants = g_hash_table_new_full(g_int64_hash, g_int64_equal,
@@ -1955,6 +2699,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		janus_mutex_init(&audiobridge->rtp_mutex);
 		janus_refcount_init(&audiobridge->ref, janus_audiobridge_room_free);
 		g_hash_table_insert(rooms, janus_uint64_dup(audiobridge->room_id), audiobridge);
+		rooms_list_changed = TRUE;
 		JANUS_LOG(LOG_VERB, "Created audiobridge: %"SCNu64" (%s, %s, secret: %s, pin: %s)\n",
 			audiobridge->room_id, audiobridge->room_name,
 			audiobridge->is_private ? "private" : "public",
@@ -1972,6 +2717,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			g_snprintf(error_cause, 512, "Got error %d (%s) trying to launch the mixer thread", error->code, error->message ? error->message : "??");
 			janus_refcount_decrease(&audiobridge->ref);
 			g_hash_table_remove(rooms, &audiobridge->room_id);
+			rooms_list_changed = TRUE;
 			janus_mutex_unlock(&rooms_mutex);
 			goto prepare_response;
 		}
@@ -2006,11 +2752,25 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 					g_snprintf(value, BUFSIZ, "%d", audiobridge->audio_level_average);
 					janus_config_add(config, c, janus_config_item_create("audio_level_average", value));
 				}
+				if(audiobridge->max_speakers > 0) {
+					g_snprintf(value, BUFSIZ, "%d", audiobridge->max_speakers);
+					janus_config_add(config, c, janus_config_item_create("max_speakers", value));
+				}
 			}
 			if(audiobridge->record_file) {
 				janus_config_add(config, c, janus_config_item_create("record", "yes"));
 				janus_config_add(config, c, janus_config_item_create("record_file", audiobridge->record_file));
 			}
+			if(audiobridge->shared_mix)
+				janus_config_add(config, c, janus_config_item_create("shared_mix", "yes"));
+			if(audiobridge->mixer_threads > 1) {
+				g_snprintf(value, BUFSIZ, "%d", audiobridge->mixer_threads);
+				janus_config_add(config, c, janus_config_item_create("mixer_threads", value));
+			}
+			if(audiobridge->notify_window > 0) {
+				g_snprintf(value, BUFSIZ, "%u", audiobridge->notify_window);
+				janus_config_add(config, c, janus_config_item_create("notify_window", value));
+			}
 			/* Save modified configuration */
 			if(janus_config_save(config, config_folder, JANUS_AUDIOBRIDGE_PACKAGE) < 0)
 				save = FALSE;	/* This will notify the user the room is not permanent */
@@ -2124,11 +2884,25 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 					g_snprintf(value, BUFSIZ, "%d", audiobridge->audio_level_average);
 					janus_config_add(config, c, janus_config_item_create("audio_level_average", value));
 				}
+				if(audiobridge->max_speakers > 0) {
+					g_snprintf(value, BUFSIZ, "%d", audiobridge->max_speakers);
+					janus_config_add(config, c, janus_config_item_create("max_speakers", value));
+				}
 			}
 			if(audiobridge->record_file) {
 				janus_config_add(config, c, janus_config_item_create("record", "yes"));
 				janus_config_add(config, c, janus_config_item_create("record_file", audiobridge->record_file));
 			}
+			if(audiobridge->shared_mix)
+				janus_config_add(config, c, janus_config_item_create("shared_mix", "yes"));
+			if(audiobridge->mixer_threads > 1) {
+				g_snprintf(value, BUFSIZ, "%d", audiobridge->mixer_threads);
+				janus_config_add(config, c, janus_config_item_create("mixer_threads", value));
+			}
+			if(audiobridge->notify_window > 0) {
+				g_snprintf(value, BUFSIZ, "%u", audiobridge->notify_window);
+				janus_config_add(config, c, janus_config_item_create("notify_window", value));
+			}
 			/* Save modified configuration */
 			if(janus_config_save(config, config_folder, JANUS_AUDIOBRIDGE_PACKAGE) < 0)
 				save = FALSE;	/* This will notify the user the room changes are not permanent */
@@ -2146,6 +2920,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			json_object_set_new(info, "room", json_integer(room_id));
 			gateway->notify_event(&janus_audiobridge_plugin, session ? session->handle : NULL, info);
 		}
+		rooms_list_changed = TRUE;
 		janus_mutex_unlock(&audiobridge->mutex);
 		janus_mutex_unlock(&rooms_mutex);
 		/* Done */
@@ -2189,6 +2964,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		/* Remove room */
 		janus_refcount_increase(&audiobridge->ref);
 		g_hash_table_remove(rooms, &room_id);
+		rooms_list_changed = TRUE;
 		if(save) {
 			/* This change is permanent: save to the configuration file too
 			 * FIXME: We should check if anything fails... */
@@ -2224,18 +3000,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 				/* Get rid of queued packets */
 				janus_mutex_lock(&p->qmutex);
 				g_atomic_int_set(&p->active, 0);
-				while(p->inbuf) {
-					GList *first = g_list_first(p->inbuf);
-					janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-					p->inbuf = g_list_remove_link(p->inbuf, first);
-					first = NULL;
-					if(pkt == NULL)
-						continue;
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-				}
+				janus_audiobridge_jitter_buffer_reset(&p->jitter);
 				janus_mutex_unlock(&p->qmutex);
 				/* Request a WebRTC hangup */
 				gateway->close_pc(p->session->handle);
@@ -2261,37 +3026,52 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "list")) {
 		/* List all rooms (but private ones) and their details (except for the secret, of course...) */
+		JANUS_VALIDATE_JSON_OBJECT(root, list_parameters,
+			error_code, error_cause, TRUE,
+			JANUS_AUDIOBRIDGE_ERROR_MISSING_ELEMENT, JANUS_AUDIOBRIDGE_ERROR_INVALID_ELEMENT);
+		if(error_code != 0)
+			goto prepare_response;
+		size_t offset = json_integer_value(json_object_get(root, "offset"));
+		size_t limit = json_integer_value(json_object_get(root, "limit"));
 		json_t *list = json_array();
 		JANUS_LOG(LOG_VERB, "Request for the list for all video rooms\n");
 		janus_mutex_lock(&rooms_mutex);
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, rooms);
-		while(g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_audiobridge_room *room = value;
-			if(!room || g_atomic_int_get(&room->destroyed))
-				continue;
-			janus_refcount_increase(&room->ref);
-			if(room->is_private) {
-				/* Skip private room */
-				janus_mutex_unlock(&room->mutex);
-				JANUS_LOG(LOG_VERB, "Skipping private room '%s'\n", room->room_name);
-				janus_refcount_decrease(&room->ref);
+		/* The static properties come from the cached list, we only add the dynamic ones */
+		json_t *cached = janus_audiobridge_rooms_list();
+		size_t i = 0, total = json_array_size(cached);
+		for(i=offset; i<total && (limit == 0 || json_array_size(list) < limit); i++) {
+			json_t *rl = json_array_get(cached, i);
+			guint64 room_id = json_integer_value(json_object_get(rl, "room"));
+			janus_audiobridge_room *room = g_hash_table_lookup(rooms, &room_id);
+			if(room == NULL || g_atomic_int_get(&room->destroyed))
 				continue;
-			}
-			json_t *rl = json_object();
-			json_object_set_new(rl, "room", json_integer(room->room_id));
-			json_object_set_new(rl, "description", json_string(room->room_name));
-			json_object_set_new(rl, "sampling_rate", json_integer(room->sampling_rate));
-			json_object_set_new(rl, "pin_required", room->room_pin ? json_true() : json_false());
-			json_object_set_new(rl, "record", room->record ? json_true() : json_false());
+			rl = json_copy(rl);
 			json_object_set_new(rl, "num_participants", json_integer(g_hash_table_size(room->participants)));
+			if(session == NULL) {
+				/* This request came from the Admin API, add some info on the mixer performance too */
+				json_t *mixer = json_object();
+				json_object_set_new(mixer, "kernels", json_string(mixer_kernels->name));
+				json_object_set_new(mixer, "ticks", json_integer(room->mix_ticks));
+				json_object_set_new(mixer, "last_mix_time", json_integer(room->mix_time_last));
+				json_object_set_new(mixer, "avg_mix_time", json_integer(room->mix_time_avg));
+				json_object_set_new(mixer, "max_mix_time", json_integer(room->mix_time_max));
+				json_object_set_new(mixer, "threads", json_integer(room->mixer_threads));
+				json_object_set_new(mixer, "deadline_misses", json_integer(room->mix_deadline_misses));
+				if(room->shared_mix)
+					json_object_set_new(mixer, "shared_participants", json_integer(room->mix_shared_last));
+				if(room->max_speakers > 0)
+					json_object_set_new(mixer, "mixed_speakers", json_integer(room->mix_speakers_last));
+				if(room->clock)
+					json_object_set_new(mixer, "clock", janus_media_clock_stats(room->clock));
+				json_object_set_new(rl, "mixer", mixer);
+			}
 			json_array_append_new(list, rl);
-			janus_refcount_decrease(&room->ref);
 		}
 		janus_mutex_unlock(&rooms_mutex);
+		json_decref(cached);
 		response = json_object();
 		json_object_set_new(response, "audiobridge", json_string("success"));
+		json_object_set_new(response, "total", json_integer(total));
 		json_object_set_new(response, "list", list);
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "exists")) {
@@ -2472,23 +3252,12 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		}
 
 		participant->muted = muted;
+		janus_audiobridge_participants_changed(audiobridge);
 		if(participant->muted) {
 			JANUS_LOG(LOG_VERB, "Setting muted property: %s (room %"SCNu64", user %"SCNu64")\n", participant->muted ? "true" : "false", participant->room->room_id, participant->user_id);
 			/* Clear the queued packets waiting to be handled */
 			janus_mutex_lock(&participant->qmutex);
-			while(participant->inbuf) {
-				GList *first = g_list_first(participant->inbuf);
-				janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-				participant->inbuf = g_list_remove_link(participant->inbuf, first);
-				first = NULL;
-				if(pkt == NULL)
-					continue;
-				if(pkt->data)
-					g_free(pkt->data);
-				pkt->data = NULL;
-				g_free(pkt);
-				pkt = NULL;
-			}
+			janus_audiobridge_jitter_buffer_reset(&participant->jitter);
 			janus_mutex_unlock(&participant->qmutex);
 		}
 
@@ -2584,11 +3353,14 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		json_object_set_new(event, "audiobridge", json_string("event"));
 		json_object_set_new(event, "room", json_integer(room_id));
 		json_object_set_new(event, "kicked", json_integer(user_id));
+		gboolean batched = janus_audiobridge_notification_add(audiobridge, user_id, "kicked", json_object_get(event, "kicked"));
 		GHashTableIter iter;
 		gpointer value;
 		g_hash_table_iter_init(&iter, audiobridge->participants);
 		while (g_hash_table_iter_next(&iter, NULL, &value)) {
 			janus_audiobridge_participant *p = value;
+			if(batched && p != participant)
+				continue;	/* The kicked participant is the only one we notify right away */
 			JANUS_LOG(LOG_VERB, "Notifying participant %"SCNu64" (%s)\n", p->user_id, p->display ? p->display : "??");
 			int ret = gateway->push_event(p->session->handle, &janus_audiobridge_plugin, NULL, event, NULL);
 			JANUS_LOG(LOG_VERB, "  >> %d (%s)\n", ret, janus_get_api_error(ret));
@@ -2615,7 +3387,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "listparticipants")) {
 		/* List all participants in a room */
-		JANUS_VALIDATE_JSON_OBJECT(root, room_parameters,
+		JANUS_VALIDATE_JSON_OBJECT(root, listparticipants_parameters,
 			error_code, error_cause, TRUE,
 			JANUS_AUDIOBRIDGE_ERROR_MISSING_ELEMENT, JANUS_AUDIOBRIDGE_ERROR_INVALID_ELEMENT);
 		if(error_code != 0)
@@ -2632,28 +3404,31 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			goto prepare_response;
 		}
 		janus_refcount_increase(&audiobridge->ref);
-		/* Return a list of all participants */
+		janus_mutex_unlock(&rooms_mutex);
+		gboolean unmuted_only = json_is_true(json_object_get(root, "unmuted_only"));
+		size_t offset = json_integer_value(json_object_get(root, "offset"));
+		size_t limit = json_integer_value(json_object_get(root, "limit"));
+		/* Get the cached list of all participants: we only hold
+		 * the room mutex as long as needed to rebuild it, if anything changed */
+		janus_mutex_lock(&audiobridge->mutex);
+		json_t *cached = janus_audiobridge_participants_list(audiobridge);
+		janus_mutex_unlock(&audiobridge->mutex);
+		janus_refcount_decrease(&audiobridge->ref);
 		json_t *list = json_array();
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, audiobridge->participants);
-		while (!g_atomic_int_get(&audiobridge->destroyed) && g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_audiobridge_participant *p = value;
-			json_t *pl = json_object();
-			json_object_set_new(pl, "id", json_integer(p->user_id));
-			if(p->display)
-				json_object_set_new(pl, "display", json_string(p->display));
-			json_object_set_new(pl, "setup", g_atomic_int_get(&p->session->started) ? json_true() : json_false());
-			json_object_set_new(pl, "muted", p->muted ? json_true() : json_false());
-			if(p->extmap_id > 0)
-				json_object_set_new(pl, "talking", p->talking ? json_true() : json_false());
-			json_array_append_new(list, pl);
+		size_t i = 0, total = 0;
+		for(i=0; i<json_array_size(cached); i++) {
+			json_t *pl = json_array_get(cached, i);
+			if(unmuted_only && json_is_true(json_object_get(pl, "muted")))
+				continue;
+			if(total >= offset && (limit == 0 || json_array_size(list) < limit))
+				json_array_append(list, pl);
+			total++;
 		}
-		janus_refcount_decrease(&audiobridge->ref);
-		janus_mutex_unlock(&rooms_mutex);
+		json_decref(cached);
 		response = json_object();
 		json_object_set_new(response, "audiobridge", json_string("participants"));
 		json_object_set_new(response, "room", json_integer(room_id));
+		json_object_set_new(response, "total", json_integer(total));
 		json_object_set_new(response, "participants", list);
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "resetdecoder")) {
@@ -2940,6 +3715,9 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			if(rf->is_srtp)
 				json_object_set_new(fl, "srtp", json_true());
 			json_object_set_new(fl, "always_on", rf->always_on ? json_true() : json_false());
+			json_object_set_new(fl, "packets", json_integer(rf->packets));
+			json_object_set_new(fl, "bytes", json_integer(rf->bytes));
+			json_object_set_new(fl, "errors", json_integer(rf->errors));
 			json_array_append_new(list, fl);
 		}
 		janus_mutex_unlock(&audiobridge->rtp_mutex);
@@ -3149,10 +3927,12 @@ void janus_audiobridge_setup_media(janus_plugin_session *handle) {
 	json_object_set_new(pub, "audiobridge", json_string("event"));
 	json_object_set_new(pub, "room", json_integer(participant->room->room_id));
 	json_object_set_new(pub, "participants", list);
+	janus_audiobridge_participants_changed(audiobridge);
+	gboolean batched = janus_audiobridge_notification_add(audiobridge, participant->user_id, "participants", pl);
 	GHashTableIter iter;
 	gpointer value;
 	g_hash_table_iter_init(&iter, audiobridge->participants);
-	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+	while (!batched && g_hash_table_iter_next(&iter, NULL, &value)) {
 		janus_audiobridge_participant *p = value;
 		if(p == participant) {
 			continue;	/* Skip the new participant itself */
@@ -3196,22 +3976,18 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, cha
 		}
 		/* Decode frame (Opus -> slinear) */
 		janus_rtp_header *rtp = (janus_rtp_header *)buf;
-		janus_audiobridge_rtp_relay_packet *pkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
-		pkt->data = g_malloc0(BUFFER_SAMPLES*sizeof(opus_int16));
-		pkt->ssrc = 0;
-		pkt->timestamp = ntohl(rtp->timestamp);
-		pkt->seq_number = ntohs(rtp->seq_number);
+		uint32_t timestamp = ntohl(rtp->timestamp);
+		uint16_t seq_number = ntohs(rtp->seq_number);
 		/* We might check the audio level extension to see if this is silence */
-		pkt->silence = FALSE;
-		pkt->length = 0;
+		gboolean silence = FALSE;
+		opus_int16 pcm[BUFFER_SAMPLES];
+		int length = 0;
 
 		/* First check if probation period */
 		if(participant->probation == MIN_SEQUENTIAL) {
 			participant->probation--;
-			participant->expected_seq = pkt->seq_number + 1;
-			JANUS_LOG(LOG_VERB, "Probation started with ssrc = %"SCNu32", seq = %"SCNu16" \n", ntohl(rtp->ssrc), pkt->seq_number);
-			g_free(pkt->data);
-			g_free(pkt);
+			participant->expected_seq = seq_number + 1;
+			JANUS_LOG(LOG_VERB, "Probation started with ssrc = %"SCNu32", seq = %"SCNu16" \n", ntohl(rtp->ssrc), seq_number);
 			return;
 		} else if(participant->probation != 0) {
 			/* Decrease probation */
@@ -3219,11 +3995,9 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, cha
 			/* TODO: Reset probation if sequence number is incorrect and DSSRC also; must have a correct sequence */
 			if(!participant->probation){
 				/* Probation is ended */
-				JANUS_LOG(LOG_VERB, "Probation ended with ssrc = %"SCNu32", seq = %"SCNu16" \n", ntohl(rtp->ssrc), pkt->seq_number);
+				JANUS_LOG(LOG_VERB, "Probation ended with ssrc = %"SCNu32", seq = %"SCNu16" \n", ntohl(rtp->ssrc), seq_number);
 			}
-			participant->expected_seq = pkt->seq_number + 1;
-			g_free(pkt->data);
-			g_free(pkt);
+			participant->expected_seq = seq_number + 1;
 			return;
 		}
 
@@ -3232,7 +4006,10 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, cha
 			int level = 0;
 			if(janus_rtp_header_extension_parse_audio_level(buf, len, participant->extmap_id, &level) == 0) {
 				/* Is this silence? */
-				pkt->silence = (level == 127);
+				silence = (level == 127);
+				/* Keep track of how loud this participant is, in case we only mix the loudest ones */
+				participant->level_avg = (participant->level_avg*7 + level)/8;
+				participant->level_updated = janus_get_monotonic_time();
 				if(participant->room && participant->room->audiolevel_event) {
 					/* We also need to detect who's talking: update our monitoring stuff */
 					int audio_active_packets = participant->room ? participant->room->audio_active_packets : 100;
@@ -3255,6 +4032,8 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, cha
 						}
 						participant->audio_active_packets = 0;
 						participant->audio_dBov_sum = 0;
+						if(notify_talk_event)
+							janus_audiobridge_participants_changed(participant->room);
 						/* Only notify in case of state changes */
 						if(participant->room && notify_talk_event) {
 							janus_mutex_lock(&participant->room->mutex);
@@ -3278,34 +4057,43 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, cha
 				}
 			}
 		}
+		janus_audiobridge_room *audiobridge = participant->room;
+		if(audiobridge && audiobridge->max_speakers > 0 && !g_atomic_int_get(&participant->selected)) {
+			/* This participant is not among the loudest ones, so there's no point in decoding */
+			participant->last_timestamp = timestamp;
+			participant->expected_seq = seq_number + 1;
+			participant->skipped = TRUE;
+			return;
+		}
 		if(!g_atomic_int_compare_and_exchange(&participant->decoding, 0, 1)) {
 			/* This means we're cleaning up, so don't try to decode */
-			g_free(pkt->data);
-			g_free(pkt);
 			return;
 		}
+		if(participant->skipped) {
+			/* We didn't decode the latest packets, so start from a clean state */
+			opus_decoder_ctl(participant->decoder, OPUS_RESET_STATE);
+			participant->skipped = FALSE;
+		}
 		int plen = 0;
 		const unsigned char *payload = (const unsigned char *)janus_rtp_payload(buf, len, &plen);
 		if(!payload) {
 			g_atomic_int_set(&participant->decoding, 0);
 			JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error accessing the RTP payload\n");
-			g_free(pkt->data);
-			g_free(pkt);
 			return;
 		}
 		/* Check sequence number received, verify if it's relevant to the expected one */
-		if(pkt->seq_number == participant->expected_seq) {
+		if(seq_number == participant->expected_seq) {
 			/* Regular decode */
-			pkt->length = opus_decode(participant->decoder, payload, plen, (opus_int16 *)pkt->data, BUFFER_SAMPLES, 0);
+			length = opus_decode(participant->decoder, payload, plen, pcm, BUFFER_SAMPLES, 0);
 			/* Update last_timestamp */
-			participant->last_timestamp = pkt->timestamp;
+			participant->last_timestamp = timestamp;
 			/* Increment according to previous seq_number */
-			participant->expected_seq = pkt->seq_number + 1;
-		} else if(pkt->seq_number > participant->expected_seq) {
+			participant->expected_seq = seq_number + 1;
+		} else if(seq_number > participant->expected_seq) {
 			/* Sequence(s) losts */
-			uint16_t gap = pkt->seq_number - participant->expected_seq;
+			uint16_t gap = seq_number - participant->expected_seq;
 			JANUS_LOG(LOG_HUGE, "%"SCNu16" sequence(s) lost, sequence = %"SCNu16",  expected seq = %"SCNu16" \n",
-				gap, pkt->seq_number, participant->expected_seq);
+				gap, seq_number, participant->expected_seq);
 
 			/* Use FEC if sequence lost < DEFAULT_PREBUFFERING */
 			uint16_t start_lost_seq = participant->expected_seq;
@@ -3313,94 +4101,83 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, cha
 				uint8_t i=0;
 				for(i=1; i<=gap ; i++) {
 					int32_t output_samples;
-					janus_audiobridge_rtp_relay_packet *lost_pkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
-					lost_pkt->data = g_malloc0(BUFFER_SAMPLES*sizeof(opus_int16));
-					lost_pkt->ssrc = 0;
-					lost_pkt->timestamp = participant->last_timestamp + (i * OPUS_SAMPLES);
-					lost_pkt->seq_number = start_lost_seq++;
-					lost_pkt->silence = FALSE;
-					lost_pkt->length = 0;
+					int lost_length = 0;
 					if(i == gap) {
 						/* Attempt to decode with in-band FEC from next packet */
 						opus_decoder_ctl(participant->decoder, OPUS_GET_LAST_PACKET_DURATION(&output_samples));
-						lost_pkt->length = opus_decode(participant->decoder, payload, plen, (opus_int16 *)lost_pkt->data, output_samples, 1);
+						lost_length = opus_decode(participant->decoder, payload, plen, pcm, output_samples, 1);
 					} else {
 						opus_decoder_ctl(participant->decoder, OPUS_GET_LAST_PACKET_DURATION(&output_samples));
-						lost_pkt->length = opus_decode(participant->decoder, NULL, plen, (opus_int16 *)lost_pkt->data, output_samples, 1);
+						lost_length = opus_decode(participant->decoder, NULL, plen, pcm, output_samples, 1);
 					}
-					if(lost_pkt->length < 0) {
+					if(lost_length < 0) {
 						g_atomic_int_set(&participant->decoding, 0);
-						JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error decoding the Opus frame: %d (%s)\n", lost_pkt->length, opus_strerror(lost_pkt->length));
-						g_free(lost_pkt->data);
-						g_free(lost_pkt);
+						JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error decoding the Opus frame: %d (%s)\n", lost_length, opus_strerror(lost_length));
 						return;
 					}
 					/* Enqueue the decoded frame */
 					janus_mutex_lock(&participant->qmutex);
-					/* Insert packets sorting by sequence number */
-					participant->inbuf = g_list_insert_sorted(participant->inbuf, lost_pkt, &janus_audiobridge_rtp_sort);
+					janus_audiobridge_jitter_buffer_push(&participant->jitter, start_lost_seq++,
+						participant->last_timestamp + (i * OPUS_SAMPLES), pcm, lost_length, FALSE);
 					janus_mutex_unlock(&participant->qmutex);
 				}
 			}
 			/* Then go with the regular decode (no FEC) */
-			pkt->length = opus_decode(participant->decoder, payload, plen, (opus_int16 *)pkt->data, BUFFER_SAMPLES, 0);
+			length = opus_decode(participant->decoder, payload, plen, pcm, BUFFER_SAMPLES, 0);
 			/* Increment according to previous seq_number */
-			participant->expected_seq = pkt->seq_number + 1;
+			participant->expected_seq = seq_number + 1;
 		} else {
 			/* In late sequence or sequence wrapped */
 			g_atomic_int_set(&participant->decoding, 0);
-			if((participant->expected_seq - pkt->seq_number) > MAX_MISORDER){
-				JANUS_LOG(LOG_HUGE, "SN WRAPPED seq =  %"SCNu16", expected_seq =  %"SCNu16" \n", pkt->seq_number, participant->expected_seq);
-				participant->expected_seq = pkt->seq_number + 1;
+			if((participant->expected_seq - seq_number) > MAX_MISORDER){
+				JANUS_LOG(LOG_HUGE, "SN WRAPPED seq =  %"SCNu16", expected_seq =  %"SCNu16" \n", seq_number, participant->expected_seq);
+				participant->expected_seq = seq_number + 1;
 			} else {
-				JANUS_LOG(LOG_WARN, "IN LATE SN seq =  %"SCNu16", expected_seq =  %"SCNu16" \n", pkt->seq_number, participant->expected_seq);
+				JANUS_LOG(LOG_WARN, "IN LATE SN seq =  %"SCNu16", expected_seq =  %"SCNu16" \n", seq_number, participant->expected_seq);
+				janus_mutex_lock(&participant->qmutex);
+				participant->jitter.late++;
+				janus_mutex_unlock(&participant->qmutex);
 			}
-			g_free(pkt->data);
-			g_free(pkt);
 			return;
 		}
 		g_atomic_int_set(&participant->decoding, 0);
-		if(pkt->length < 0) {
-			JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error decoding the Opus frame: %d (%s)\n", pkt->length, opus_strerror(pkt->length));
-			g_free(pkt->data);
-			g_free(pkt);
+		if(length < 0) {
+			JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error decoding the Opus frame: %d (%s)\n", length, opus_strerror(length));
 			return;
 		}
 		/* Enqueue the decoded frame */
 		janus_mutex_lock(&participant->qmutex);
-		/* Insert packets sorting by sequence number */
-		participant->inbuf = g_list_insert_sorted(participant->inbuf, pkt, &janus_audiobridge_rtp_sort);
+		janus_audiobridge_jitter_buffer_push(&participant->jitter, seq_number, timestamp, pcm, length, silence);
+		if(length > OPUS_SAMPLES && participant->jitter.truncated == 1) {
+			/* Only warn the first time, the Admin API will tell how often this happened */
+			JANUS_LOG(LOG_WARN, "Got a frame of %d samples from user %"SCNu64", only the first %d (20ms) will be mixed\n",
+				length, participant->user_id, OPUS_SAMPLES);
+		}
 		if(participant->prebuffering) {
 			/* Still pre-buffering: do we have enough packets now? */
-			if(g_list_length(participant->inbuf) > DEFAULT_PREBUFFERING) {
+			if(participant->jitter.depth > DEFAULT_PREBUFFERING) {
 				participant->prebuffering = FALSE;
 				JANUS_LOG(LOG_VERB, "Prebuffering done! Finally adding the user to the mix\n");
 			} else {
-				JANUS_LOG(LOG_VERB, "Still prebuffering (got %d packets), not adding the user to the mix yet\n", g_list_length(participant->inbuf));
+				JANUS_LOG(LOG_VERB, "Still prebuffering (got %d packets), not adding the user to the mix yet\n", participant->jitter.depth);
 			}
 		} else {
 			/* Make sure we're not queueing too many packets: if so, get rid of the older ones */
-			if(g_list_length(participant->inbuf) >= DEFAULT_PREBUFFERING*2) {
+			if(participant->jitter.depth >= DEFAULT_PREBUFFERING*2) {
 				gint64 now = janus_get_monotonic_time();
 				if(now - participant->last_drop > 5*G_USEC_PER_SEC) {
 					JANUS_LOG(LOG_VERB, "Too many packets in queue (%d > %d), removing older ones\n",
-						g_list_length(participant->inbuf), DEFAULT_PREBUFFERING*2);
+						participant->jitter.depth, DEFAULT_PREBUFFERING*2);
 					participant->last_drop = now;
 				}
-				while(g_list_length(participant->inbuf) > DEFAULT_PREBUFFERING) {
+				while(participant->jitter.depth > DEFAULT_PREBUFFERING) {
 					/* Remove this packet: it's too old */
-					GList *first = g_list_first(participant->inbuf);
-					janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
+					janus_audiobridge_buffered_frame *frame = janus_audiobridge_jitter_buffer_pop(&participant->jitter);
+					if(frame == NULL)
+						break;
 					JANUS_LOG(LOG_WARN, "list length = %d, Remove sequence = %d\n",
-						g_list_length(participant->inbuf), pkt->seq_number);
-					participant->inbuf = g_list_remove_link(participant->inbuf, first);
-					first = NULL;
-					if(pkt == NULL)
-						continue;
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
+						participant->jitter.depth, frame->seq_number);
+					participant->jitter.dropped++;
 				}
 			}
 		}
@@ -3458,10 +4235,12 @@ static void janus_audiobridge_hangup_media_internal(janus_plugin_session *handle
 		json_object_set_new(event, "room", json_integer(audiobridge->room_id));
 		json_object_set_new(event, "leaving", json_integer(participant->user_id));
 		removed = g_hash_table_remove(audiobridge->participants, &participant->user_id);
+		janus_audiobridge_participants_changed(audiobridge);
+		gboolean batched = janus_audiobridge_notification_add(audiobridge, participant->user_id, "leaving", json_object_get(event, "leaving"));
 		GHashTableIter iter;
 		gpointer value;
 		g_hash_table_iter_init(&iter, audiobridge->participants);
-		while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		while (!batched && g_hash_table_iter_next(&iter, NULL, &value)) {
 			janus_audiobridge_participant *p = value;
 			if(p == participant) {
 				continue;	/* Skip the leaving participant itself */
@@ -3510,18 +4289,7 @@ static void janus_audiobridge_hangup_media_internal(janus_plugin_session *handle
 	participant->audio_dBov_sum = 0;
 	participant->talking = FALSE;
 	/* Get rid of queued packets */
-	while(participant->inbuf) {
-		GList *first = g_list_first(participant->inbuf);
-		janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-		participant->inbuf = g_list_remove_link(participant->inbuf, first);
-		first = NULL;
-		if(pkt == NULL)
-			continue;
-		g_free(pkt->data);
-		pkt->data = NULL;
-		g_free(pkt);
-		pkt = NULL;
-	}
+	janus_audiobridge_jitter_buffer_reset(&participant->jitter);
 	participant->last_drop = 0;
 	janus_mutex_unlock(&participant->qmutex);
 	if(audiobridge != NULL) {
@@ -3534,6 +4302,25 @@ static void janus_audiobridge_hangup_media_internal(janus_plugin_session *handle
 	g_atomic_int_set(&session->hangingup, 0);
 }
 
+/* Thread to send the batched participant list changes prepared by the mixer threads */
+static void *janus_audiobridge_notifier(void *data) {
+	JANUS_LOG(LOG_VERB, "Joining AudioBridge notifier thread\n");
+	janus_audiobridge_notification_event *ne = NULL;
+	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
+		ne = g_async_queue_pop(notifications);
+		if(ne == &exit_notification)
+			break;
+		if(!g_atomic_int_get(&ne->session->destroyed)) {
+			JANUS_LOG(LOG_VERB, "Notifying participant %"SCNu64"\n", ne->user_id);
+			int ret = gateway->push_event(ne->session->handle, &janus_audiobridge_plugin, NULL, ne->event, NULL);
+			JANUS_LOG(LOG_VERB, "  >> %d (%s)\n", ret, janus_get_api_error(ret));
+		}
+		janus_audiobridge_notification_event_free(ne);
+	}
+	JANUS_LOG(LOG_VERB, "Leaving AudioBridge notifier thread\n");
+	return NULL;
+}
+
 /* Thread to handle incoming messages */
 static void *janus_audiobridge_handler(void *data) {
 	JANUS_LOG(LOG_VERB, "Joining AudioBridge handler thread\n");
@@ -3680,8 +4467,6 @@ static void *janus_audiobridge_handler(void *data) {
 				g_atomic_int_set(&participant->active, 0);
 				participant->prebuffering = TRUE;
 				participant->display = NULL;
-				participant->inbuf = NULL;
-				participant->outbuf = NULL;
 				participant->last_drop = 0;
 				participant->encoder = NULL;
 				participant->decoder = NULL;
@@ -3691,6 +4476,8 @@ static void *janus_audiobridge_handler(void *data) {
 				participant->probation = 0;
 				participant->last_timestamp = 0;
 				janus_mutex_init(&participant->qmutex);
+				janus_mutex_init(&participant->outbuf_mutex);
+				janus_condition_init(&participant->outbuf_cond);
 				participant->arc = NULL;
 				janus_mutex_init(&participant->rec_mutex);
 			}
@@ -3702,8 +4489,8 @@ static void *janus_audiobridge_handler(void *data) {
 			participant->muted = muted ? json_is_true(muted) : FALSE;	/* By default, everyone's unmuted when joining */
 			participant->volume_gain = volume;
 			participant->opus_complexity = complexity;
-			if(participant->outbuf == NULL)
-				participant->outbuf = g_async_queue_new();
+			participant->level_avg = 127;
+			g_atomic_int_set(&participant->selected, 1);
 			g_atomic_int_set(&participant->active, g_atomic_int_get(&session->started));
 			if(!g_atomic_int_get(&session->started)) {
 				/* Initialize the RTP context only if we're renegotiating */
@@ -3791,6 +4578,9 @@ static void *janus_audiobridge_handler(void *data) {
 			session->participant = participant;
 			janus_refcount_increase(&participant->ref);
 			g_hash_table_insert(audiobridge->participants, janus_uint64_dup(participant->user_id), participant);
+			janus_audiobridge_participants_changed(audiobridge);
+			/* Any pending participant list change up to now is reflected in the response already */
+			participant->notify_seq = audiobridge->notify_seq;
 			/* Notify the other participants */
 			json_t *newuser = json_object();
 			json_object_set_new(newuser, "audiobridge", json_string("joined"));
@@ -3805,10 +4595,11 @@ static void *janus_audiobridge_handler(void *data) {
 			json_object_set_new(pl, "muted", participant->muted ? json_true() : json_false());
 			json_array_append_new(newuserlist, pl);
 			json_object_set_new(newuser, "participants", newuserlist);
+			gboolean batched = janus_audiobridge_notification_add(audiobridge, participant->user_id, "participants", pl);
 			GHashTableIter iter;
 			gpointer value;
 			g_hash_table_iter_init(&iter, audiobridge->participants);
-			while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			while (!batched && g_hash_table_iter_next(&iter, NULL, &value)) {
 				janus_audiobridge_participant *p = value;
 				if(p == participant) {
 					continue;
@@ -3892,23 +4683,12 @@ static void *janus_audiobridge_handler(void *data) {
 			if(muted || display) {
 				if(muted) {
 					participant->muted = json_is_true(muted);
+					janus_audiobridge_participants_changed(participant->room);
 					JANUS_LOG(LOG_VERB, "Setting muted property: %s (room %"SCNu64", user %"SCNu64")\n", participant->muted ? "true" : "false", participant->room->room_id, participant->user_id);
 					if(participant->muted) {
 						/* Clear the queued packets waiting to be handled */
 						janus_mutex_lock(&participant->qmutex);
-						while(participant->inbuf) {
-							GList *first = g_list_first(participant->inbuf);
-							janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-							participant->inbuf = g_list_remove_link(participant->inbuf, first);
-							first = NULL;
-							if(pkt == NULL)
-								continue;
-							if(pkt->data)
-								g_free(pkt->data);
-							pkt->data = NULL;
-							g_free(pkt);
-							pkt = NULL;
-						}
+						janus_audiobridge_jitter_buffer_reset(&participant->jitter);
 						janus_mutex_unlock(&participant->qmutex);
 					}
 				}
@@ -4116,12 +4896,15 @@ static void *janus_audiobridge_handler(void *data) {
 			participant->audio_active_packets = 0;
 			participant->audio_dBov_sum = 0;
 			participant->talking = FALSE;
+			participant->level_avg = 127;
+			g_atomic_int_set(&participant->selected, 1);
 			/* Is the sampling rate of the new room the same as the one in the old room, or should we update the decoder/encoder? */
 			janus_audiobridge_room *old_audiobridge = participant->room;
 			/* Leave the old room first... */
 			janus_refcount_increase(&participant->ref);
 			janus_mutex_lock(&old_audiobridge->mutex);
 			g_hash_table_remove(old_audiobridge->participants, &participant->user_id);
+			janus_audiobridge_participants_changed(old_audiobridge);
 			if(old_audiobridge->sampling_rate != audiobridge->sampling_rate) {
 				/* Create a new one that takes into account the sampling rate we want now */
 				int error = 0;
@@ -4136,6 +4919,7 @@ static void *janus_audiobridge_handler(void *data) {
 					g_snprintf(error_cause, 512, "Error creating Opus decoder");
 					/* Join the old room again... */
 					g_hash_table_insert(audiobridge->participants, janus_uint64_dup(participant->user_id), participant);
+					janus_audiobridge_participants_changed(audiobridge);
 					janus_mutex_unlock(&old_audiobridge->mutex);
 					janus_mutex_unlock(&audiobridge->mutex);
 					janus_mutex_unlock(&rooms_mutex);
@@ -4174,6 +4958,7 @@ static void *janus_audiobridge_handler(void *data) {
 					g_snprintf(error_cause, 512, "Error creating Opus decoder");
 					/* Join the old room again... */
 					g_hash_table_insert(audiobridge->participants, janus_uint64_dup(participant->user_id), participant);
+					janus_audiobridge_participants_changed(audiobridge);
 					janus_mutex_unlock(&old_audiobridge->mutex);
 					janus_mutex_unlock(&audiobridge->mutex);
 					janus_mutex_unlock(&rooms_mutex);
@@ -4193,10 +4978,11 @@ static void *janus_audiobridge_handler(void *data) {
 			json_object_set_new(event, "audiobridge", json_string("event"));
 			json_object_set_new(event, "room", json_integer(old_audiobridge->room_id));
 			json_object_set_new(event, "leaving", json_integer(participant->user_id));
+			gboolean batched = janus_audiobridge_notification_add(old_audiobridge, participant->user_id, "leaving", json_object_get(event, "leaving"));
 			GHashTableIter iter;
 			gpointer value;
 			g_hash_table_iter_init(&iter, old_audiobridge->participants);
-			while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			while (!batched && g_hash_table_iter_next(&iter, NULL, &value)) {
 				janus_audiobridge_participant *p = value;
 				if(p == participant) {
 					continue;	/* Skip the new participant itself */
@@ -4230,6 +5016,8 @@ static void *janus_audiobridge_handler(void *data) {
 			participant->audio_active_packets = 0;
 			participant->audio_dBov_sum = 0;
 			participant->talking = FALSE;
+			participant->level_avg = 127;
+			g_atomic_int_set(&participant->selected, 1);
 			participant->volume_gain = volume;
 			if(quality) {
 				participant->opus_complexity = complexity;
@@ -4237,6 +5025,8 @@ static void *janus_audiobridge_handler(void *data) {
 					opus_encoder_ctl(participant->encoder, OPUS_SET_COMPLEXITY(participant->opus_complexity));
 			}
 			g_hash_table_insert(audiobridge->participants, janus_uint64_dup(participant->user_id), participant);
+			janus_audiobridge_participants_changed(audiobridge);
+			participant->notify_seq = audiobridge->notify_seq;
 			/* Notify the other participants */
 			json_t *newuser = json_object();
 			json_object_set_new(newuser, "audiobridge", json_string("joined"));
@@ -4250,8 +5040,9 @@ static void *janus_audiobridge_handler(void *data) {
 			json_object_set_new(pl, "muted", participant->muted ? json_true() : json_false());
 			json_array_append_new(newuserlist, pl);
 			json_object_set_new(newuser, "participants", newuserlist);
+			batched = janus_audiobridge_notification_add(audiobridge, participant->user_id, "participants", pl);
 			g_hash_table_iter_init(&iter, audiobridge->participants);
-			while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			while (!batched && g_hash_table_iter_next(&iter, NULL, &value)) {
 				janus_audiobridge_participant *p = value;
 				if(p == participant) {
 					continue;
@@ -4316,10 +5107,11 @@ static void *janus_audiobridge_handler(void *data) {
 				json_object_set_new(event, "audiobridge", json_string("event"));
 				json_object_set_new(event, "room", json_integer(audiobridge->room_id));
 				json_object_set_new(event, "leaving", json_integer(participant->user_id));
+				gboolean batched = janus_audiobridge_notification_add(audiobridge, participant->user_id, "leaving", json_object_get(event, "leaving"));
 				GHashTableIter iter;
 				gpointer value;
 				g_hash_table_iter_init(&iter, audiobridge->participants);
-				while (g_hash_table_iter_next(&iter, NULL, &value)) {
+				while (!batched && g_hash_table_iter_next(&iter, NULL, &value)) {
 					janus_audiobridge_participant *p = value;
 					if(p == participant) {
 						continue;	/* Skip the new participant itself */
@@ -4331,24 +5123,14 @@ static void *janus_audiobridge_handler(void *data) {
 				json_decref(event);
 				/* Actually leave the room... */
 				removed = g_hash_table_remove(audiobridge->participants, &participant->user_id);
+				janus_audiobridge_participants_changed(audiobridge);
 				participant->room = NULL;
 			}
 			/* Get rid of queued packets */
 			janus_mutex_lock(&participant->qmutex);
 			g_atomic_int_set(&participant->active, 0);
 			participant->prebuffering = TRUE;
-			while(participant->inbuf) {
-				GList *first = g_list_first(participant->inbuf);
-				janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-				participant->inbuf = g_list_remove_link(participant->inbuf, first);
-				first = NULL;
-				if(pkt == NULL)
-					continue;
-				g_free(pkt->data);
-				pkt->data = NULL;
-				g_free(pkt);
-				pkt = NULL;
-			}
+			janus_audiobridge_jitter_buffer_reset(&participant->jitter);
 			janus_mutex_unlock(&participant->qmutex);
 			/* Stop recording, if we were */
 			janus_mutex_lock(&participant->rec_mutex);
@@ -4515,6 +5297,188 @@ error:
 	return NULL;
 }
 
+/* State of a single mixing tick, shared by the mixer thread and its helpers */
+typedef struct janus_audiobridge_mix_tick {
+	janus_audiobridge_room *room;
+	const janus_audiobridge_mixer_kernels *kernels;
+	opus_int32 *buffer;			/* The full mix */
+	int samples;
+	uint32_t timestamp;
+	uint16_t seq_number;
+	janus_audiobridge_participant **participants;
+	guint count;
+	/* Frames of the full mix, encoded once per FEC/complexity combination */
+	janus_audiobridge_encoded_frame *shared_frames[2][11];
+	janus_mutex shared_mutex;
+	volatile gint shared_count;
+} janus_audiobridge_mix_tick;
+
+/* Prepare and queue the mix-minus for a slice of the participants of a tick:
+ * with a single mixer thread, the slice is simply the whole room */
+static void janus_audiobridge_mix_slice(janus_audiobridge_mix_tick *tick, guint slice, guint slices) {
+	janus_audiobridge_room *audiobridge = tick->room;
+	const janus_audiobridge_mixer_kernels *kernels = tick->kernels;
+	int samples = tick->samples;
+	opus_int16 outBuffer[OPUS_SAMPLES], *curBuffer = NULL;
+	guint shared_count = 0;
+	guint i = 0, first = (tick->count*slice)/slices, last = (tick->count*(slice+1))/slices;
+	for(i=first; i<last; i++) {
+		janus_audiobridge_participant *p = tick->participants[i];
+		if(!p->session || !g_atomic_int_get(&p->session->started)) {
+			janus_refcount_decrease(&p->ref);
+			continue;
+		}
+		/* The frame we get is only valid as long as we hold the lock */
+		janus_audiobridge_buffered_frame *frame = NULL;
+		janus_mutex_lock(&p->qmutex);
+		if(g_atomic_int_get(&p->active) && !p->muted && !p->prebuffering)
+			frame = janus_audiobridge_jitter_buffer_pop(&p->jitter);
+		curBuffer = (frame && !frame->silence) ? frame->samples : NULL;
+		if(curBuffer != NULL)
+			kernels->mix_minus(outBuffer, tick->buffer, curBuffer, samples, (float)p->volume_gain/100.0f);
+		janus_mutex_unlock(&p->qmutex);
+		janus_audiobridge_encoded_frame *encoded = NULL;
+		if(audiobridge->shared_mix && curBuffer == NULL) {
+			/* This participant isn't contributing anything, so it gets the full mix:
+			 * encode it only once for all the participants with the same settings */
+			int fec = p->fec ? 1 : 0;
+			int complexity = (p->opus_complexity >= 1 && p->opus_complexity <= 10) ? p->opus_complexity : DEFAULT_COMPLEXITY;
+			encoded = g_atomic_pointer_get(&tick->shared_frames[fec][complexity]);
+			if(encoded == NULL) {
+				janus_mutex_lock(&tick->shared_mutex);
+				encoded = tick->shared_frames[fec][complexity];
+				if(encoded == NULL) {
+					kernels->saturate(outBuffer, tick->buffer, samples);
+					encoded = janus_audiobridge_encode_shared_mix(audiobridge, fec, complexity, outBuffer, samples);
+					g_atomic_pointer_set(&tick->shared_frames[fec][complexity], encoded);
+				}
+				janus_mutex_unlock(&tick->shared_mutex);
+			}
+			if(encoded != NULL) {
+				janus_refcount_increase(&encoded->ref);
+				shared_count++;
+			}
+		}
+		if(curBuffer == NULL && encoded == NULL)
+			kernels->mix_minus(outBuffer, tick->buffer, NULL, samples, (float)p->volume_gain/100.0f);
+		/* Enqueue this mixed frame for encoding (or just sending) in the participant thread */
+		janus_audiobridge_participant_queue_mix(p, outBuffer, samples, encoded, audiobridge->room_id, tick->timestamp, tick->seq_number);
+		janus_refcount_decrease(&p->ref);
+	}
+	if(shared_count > 0)
+		g_atomic_int_add(&tick->shared_count, shared_count);
+}
+
+/* Pool of helper threads a mixer can split the mix-minus work with, in
+ * large rooms: the mixer wakes them up at each tick, takes care of its own
+ * slice of participants, and then waits for all of them to be done */
+typedef struct janus_audiobridge_mixer_pool {
+	guint threads;				/* Number of slices, including the one of the mixer thread */
+	GThread **workers;
+	janus_mutex mutex;
+	janus_condition start_cond;
+	janus_condition done_cond;
+	guint64 generation;			/* Incremented at each tick */
+	guint done;					/* How many helpers completed the current tick */
+	gboolean stop;
+	janus_audiobridge_mix_tick *tick;
+} janus_audiobridge_mixer_pool;
+
+typedef struct janus_audiobridge_mixer_worker {
+	janus_audiobridge_mixer_pool *pool;
+	guint slice;
+} janus_audiobridge_mixer_worker;
+
+static void *janus_audiobridge_mixer_worker_thread(void *data) {
+	janus_audiobridge_mixer_worker *worker = (janus_audiobridge_mixer_worker *)data;
+	janus_audiobridge_mixer_pool *pool = worker->pool;
+	guint64 generation = 0;
+	while(TRUE) {
+		janus_mutex_lock(&pool->mutex);
+		while(!pool->stop && pool->generation == generation)
+			janus_condition_wait(&pool->start_cond, &pool->mutex);
+		if(pool->stop) {
+			janus_mutex_unlock(&pool->mutex);
+			break;
+		}
+		generation = pool->generation;
+		janus_audiobridge_mix_tick *tick = pool->tick;
+		janus_mutex_unlock(&pool->mutex);
+		janus_audiobridge_mix_slice(tick, worker->slice, pool->threads);
+		janus_mutex_lock(&pool->mutex);
+		pool->done++;
+		if(pool->done == pool->threads-1)
+			janus_condition_signal(&pool->done_cond);
+		janus_mutex_unlock(&pool->mutex);
+	}
+	g_free(worker);
+	return NULL;
+}
+
+static janus_audiobridge_mixer_pool *janus_audiobridge_mixer_pool_create(janus_audiobridge_room *audiobridge, guint threads) {
+	janus_audiobridge_mixer_pool *pool = g_malloc0(sizeof(janus_audiobridge_mixer_pool));
+	janus_mutex_init(&pool->mutex);
+	janus_condition_init(&pool->start_cond);
+	janus_condition_init(&pool->done_cond);
+	pool->workers = g_malloc0((threads-1)*sizeof(GThread *));
+	pool->threads = 1;
+	guint i = 0;
+	for(i=1; i<threads; i++) {
+		janus_audiobridge_mixer_worker *worker = g_malloc0(sizeof(janus_audiobridge_mixer_worker));
+		worker->pool = pool;
+		worker->slice = i;
+		GError *error = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "mixer %"SCNu64"-%u", audiobridge->room_id, i);
+		pool->workers[i-1] = g_thread_try_new(tname, &janus_audiobridge_mixer_worker_thread, worker, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch a mixer helper thread, room %"SCNu64" will use %u threads\n",
+				error->code, error->message ? error->message : "??", audiobridge->room_id, pool->threads);
+			g_error_free(error);
+			g_free(worker);
+			break;
+		}
+		pool->threads++;
+	}
+	return pool;
+}
+
+static void janus_audiobridge_mixer_pool_run(janus_audiobridge_mixer_pool *pool, janus_audiobridge_mix_tick *tick) {
+	if(pool == NULL || pool->threads < 2) {
+		janus_audiobridge_mix_slice(tick, 0, 1);
+		return;
+	}
+	janus_mutex_lock(&pool->mutex);
+	pool->tick = tick;
+	pool->done = 0;
+	pool->generation++;
+	janus_condition_broadcast(&pool->start_cond);
+	janus_mutex_unlock(&pool->mutex);
+	/* Take care of our own slice, then wait for the others (barrier) */
+	janus_audiobridge_mix_slice(tick, 0, pool->threads);
+	janus_mutex_lock(&pool->mutex);
+	while(pool->done < pool->threads-1)
+		janus_condition_wait(&pool->done_cond, &pool->mutex);
+	janus_mutex_unlock(&pool->mutex);
+}
+
+static void janus_audiobridge_mixer_pool_destroy(janus_audiobridge_mixer_pool *pool) {
+	if(pool == NULL)
+		return;
+	janus_mutex_lock(&pool->mutex);
+	pool->stop = TRUE;
+	janus_condition_broadcast(&pool->start_cond);
+	janus_mutex_unlock(&pool->mutex);
+	guint i = 0;
+	for(i=0; i<pool->threads-1; i++)
+		g_thread_join(pool->workers[i]);
+	g_free(pool->workers);
+	janus_mutex_destroy(&pool->mutex);
+	janus_condition_destroy(&pool->start_cond);
+	janus_condition_destroy(&pool->done_cond);
+	g_free(pool);
+}
+
 /* Thread to mix the contributions from all participants */
 static void *janus_audiobridge_mixer_thread(void *data) {
 	JANUS_LOG(LOG_VERB, "Audio bridge thread starting...\n");
@@ -4566,11 +5530,27 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 
 	/* Buffer (we allocate assuming 48kHz, although we'll likely use less than that) */
 	int samples = audiobridge->sampling_rate/50;
-	opus_int32 buffer[OPUS_SAMPLES], sumBuffer[OPUS_SAMPLES];
+	opus_int32 buffer[OPUS_SAMPLES];
 	opus_int16 outBuffer[OPUS_SAMPLES], *curBuffer = NULL;
 	memset(buffer, 0, OPUS_SAMPLES*4);
-	memset(sumBuffer, 0, OPUS_SAMPLES*4);
 	memset(outBuffer, 0, OPUS_SAMPLES*2);
+	const janus_audiobridge_mixer_kernels *kernels = mixer_kernels;
+	gint64 mix_start = 0, mix_time = 0, last_miss_log = 0;
+
+	/* State of each tick, and helper threads to share the work with, if needed */
+	janus_audiobridge_mix_tick tick;
+	memset(&tick, 0, sizeof(tick));
+	tick.room = audiobridge;
+	tick.kernels = kernels;
+	tick.buffer = buffer;
+	tick.samples = samples;
+	janus_mutex_init(&tick.shared_mutex);
+	guint participants_size = 0;
+	janus_audiobridge_mixer_pool *pool = NULL;
+	if(audiobridge->mixer_threads > 1) {
+		pool = janus_audiobridge_mixer_pool_create(audiobridge, audiobridge->mixer_threads);
+		JANUS_LOG(LOG_VERB, "Room %"SCNu64" will split the mixing work across %u threads\n", audiobridge->room_id, pool->threads);
+	}
 
 	/* Base RTP packet, in case there are forwarders involved */
 	unsigned char *rtpbuffer = g_malloc0(1500);
@@ -4578,11 +5558,8 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 	rtph->version = 2;
 
 	/* Timer */
-	struct timeval now, before;
-	gettimeofday(&before, NULL);
-	now.tv_sec = before.tv_sec;
-	now.tv_usec = before.tv_usec;
-	time_t passed, d_s, d_us;
+	janus_media_clock *clock = janus_media_clock_create(20000);
+	audiobridge->clock = clock;
 
 	/* RTP */
 	gint16 seq = 0;
@@ -4592,27 +5569,16 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 	int i=0;
 	int count = 0, rf_count = 0, prev_count = 0;
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&audiobridge->destroyed)) {
-		/* See if it's time to prepare a frame */
-		gettimeofday(&now, NULL);
-		d_s = now.tv_sec - before.tv_sec;
-		d_us = now.tv_usec - before.tv_usec;
-		if(d_us < 0) {
-			d_us += 1000000;
-			--d_s;
-		}
-		passed = d_s*1000000 + d_us;
-		if(passed < 15000) {	/* Let's wait about 15ms at max */
-			g_usleep(5000);
-			continue;
-		}
-		/* Update the reference time */
-		before.tv_usec += 20000;
-		if(before.tv_usec > 1000000) {
-			before.tv_sec++;
-			before.tv_usec -= 1000000;
+		/* Wait until it's time to prepare a frame */
+		if(janus_media_clock_wait(clock) < 0) {
+			JANUS_LOG(LOG_ERR, "Error waiting for the media clock in room %"SCNu64"...\n", audiobridge->room_id);
+			break;
 		}
 		/* Do we need to mix at all? */
 		janus_mutex_lock_nodebug(&audiobridge->mutex);
+		/* Notify the batched participant list changes, if it's time */
+		if(audiobridge->notify_pending != NULL && janus_get_monotonic_time() >= audiobridge->notify_deadline)
+			janus_audiobridge_notification_flush(audiobridge);
 		count = g_hash_table_size(audiobridge->participants);
 		rf_count = g_hash_table_size(audiobridge->rtp_forwarders);
 		if((count+rf_count) == 0) {
@@ -4631,6 +5597,7 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 		/* Update RTP header information */
 		seq++;
 		ts += OPUS_SAMPLES;
+		mix_start = janus_get_monotonic_time();
 		/* Mix all contributions */
 		GList *participants_list = g_hash_table_get_values(audiobridge->participants);
 		/* Add a reference to all these participants, in case some leave while we're mixing */
@@ -4641,38 +5608,31 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			ps = ps->next;
 		}
 		janus_mutex_unlock_nodebug(&audiobridge->mutex);
+		/* If we only mix the loudest participants, check who they are now */
+		if(audiobridge->max_speakers > 0)
+			audiobridge->mix_speakers_last = janus_audiobridge_select_speakers(audiobridge, participants_list);
 		for(i=0; i<samples; i++)
 			buffer[i] = 0;
 		ps = participants_list;
 		while(ps) {
 			janus_audiobridge_participant *p = (janus_audiobridge_participant *)ps->data;
 			janus_mutex_lock(&p->qmutex);
-			if(!p->session || !g_atomic_int_get(&p->session->started) || !g_atomic_int_get(&p->active) || p->muted || p->prebuffering || !p->inbuf) {
+			if(!p->session || !g_atomic_int_get(&p->session->started) || !g_atomic_int_get(&p->active) || p->muted || p->prebuffering) {
 				janus_mutex_unlock(&p->qmutex);
 				ps = ps->next;
 				continue;
 			}
-			GList *peek = g_list_first(p->inbuf);
-			janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)(peek ? peek->data : NULL);
-			if(pkt != NULL && !pkt->silence) {
-				curBuffer = (opus_int16 *)pkt->data;
-				for(i=0; i<samples; i++) {
-					if(p->volume_gain == 100) {
-						buffer[i] += curBuffer[i];
-					} else {
-						buffer[i] += (curBuffer[i]*p->volume_gain)/100;
-					}
-				}
+			janus_audiobridge_buffered_frame *frame = janus_audiobridge_jitter_buffer_peek(&p->jitter);
+			if(frame != NULL && !frame->silence) {
+				curBuffer = frame->samples;
+				kernels->accumulate(buffer, curBuffer, samples, (float)p->volume_gain/100.0f);
 			}
 			janus_mutex_unlock(&p->qmutex);
 			ps = ps->next;
 		}
 		/* Are we recording the mix? (only do it if there's someone in, though...) */
 		if(audiobridge->recording != NULL && g_list_length(participants_list) > 0) {
-			for(i=0; i<samples; i++) {
-				/* FIXME Smoothen/Normalize instead of truncating? */
-				outBuffer[i] = buffer[i];
-			}
+			kernels->saturate(outBuffer, buffer, samples);
 			fwrite(outBuffer, sizeof(opus_int16), samples, audiobridge->recording);
 			/* Every 5 seconds we update the wav header */
 			gint64 now = janus_get_monotonic_time();
@@ -4694,52 +5654,29 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			}
 		}
 		/* Send proper packet to each participant (remove own contribution) */
-		ps = participants_list;
-		while(ps) {
-			janus_audiobridge_participant *p = (janus_audiobridge_participant *)ps->data;
-			if(!p->session || !g_atomic_int_get(&p->session->started)) {
-				janus_refcount_decrease(&p->ref);
-				ps = ps->next;
-				continue;
-			}
-			janus_audiobridge_rtp_relay_packet *pkt = NULL;
-			janus_mutex_lock(&p->qmutex);
-			if(g_atomic_int_get(&p->active) && !p->muted && !p->prebuffering && p->inbuf) {
-				GList *first = g_list_first(p->inbuf);
-				pkt = (janus_audiobridge_rtp_relay_packet *)(first ? first->data : NULL);
-				p->inbuf = g_list_delete_link(p->inbuf, first);
-			}
-			janus_mutex_unlock(&p->qmutex);
-			curBuffer = (opus_int16 *)((pkt && !pkt->silence) ? pkt->data : NULL);
-			for(i=0; i<samples; i++) {
-				if(p->volume_gain == 100)
-					sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]) : 0);
-				else
-					sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]*p->volume_gain)/100 : 0);
-			}
-			for(i=0; i<samples; i++)
-				/* FIXME Smoothen/Normalize instead of truncating? */
-				outBuffer[i] = sumBuffer[i];
-			/* Enqueue this mixed frame for encoding in the participant thread */
-			janus_audiobridge_rtp_relay_packet *mixedpkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
-			mixedpkt->data = g_malloc(samples*2);
-			memcpy(mixedpkt->data, outBuffer, samples*2);
-			mixedpkt->length = samples;	/* We set the number of samples here, not the data length */
-			mixedpkt->timestamp = ts;
-			mixedpkt->seq_number = seq;
-			mixedpkt->ssrc = audiobridge->room_id;
-			mixedpkt->silence = FALSE;
-			g_async_queue_push(p->outbuf, mixedpkt);
-			if(pkt) {
-				g_free(pkt->data);
-				pkt->data = NULL;
-				g_free(pkt);
-				pkt = NULL;
-			}
-			janus_refcount_decrease(&p->ref);
-			ps = ps->next;
+		guint n = g_list_length(participants_list);
+		if(n > participants_size) {
+			participants_size = n*2;
+			tick.participants = g_realloc(tick.participants, participants_size*sizeof(janus_audiobridge_participant *));
 		}
+		tick.count = 0;
+		for(ps = participants_list; ps; ps = ps->next)
+			tick.participants[tick.count++] = (janus_audiobridge_participant *)ps->data;
 		g_list_free(participants_list);
+		tick.timestamp = ts;
+		tick.seq_number = seq;
+		memset(tick.shared_frames, 0, sizeof(tick.shared_frames));
+		tick.shared_count = 0;
+		janus_audiobridge_mixer_pool_run(pool, &tick);
+		/* Get rid of the mixer references to the shared frames */
+		int fec = 0, complexity = 0;
+		for(fec=0; fec<2; fec++) {
+			for(complexity=0; complexity<11; complexity++) {
+				if(tick.shared_frames[fec][complexity] != NULL)
+					janus_refcount_decrease(&tick.shared_frames[fec][complexity]->ref);
+			}
+		}
+		audiobridge->mix_shared_last = tick.shared_count;
 		/* Forward the mixed packet as RTP to any RTP forwarder that may be listening */
 		janus_mutex_lock(&audiobridge->rtp_mutex);
 		if(g_hash_table_size(audiobridge->rtp_forwarders) > 0 && audiobridge->rtp_encoder) {
@@ -4761,13 +5698,17 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			}
 			if(go_on) {
 				/* Encode the mixed frame first*/
-				for(i=0; i<samples; i++)
-					outBuffer[i] = buffer[i];
+				kernels->saturate(outBuffer, buffer, samples);
 				opus_int32 length = opus_encode(audiobridge->rtp_encoder, outBuffer, samples, rtpbuffer+12, 1500-12);
 				if(length < 0) {
 					JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error encoding the Opus frame: %d (%s)\n", length, opus_strerror(length));
 				} else {
 					/* Then send it to everybody */
+					janus_audiobridge_forwarders_batch batch;
+					batch.fd = audiobridge->rtp_udp_sock;
+					batch.count = 0;
+					batch.payload = (char *)rtpbuffer+12;
+					batch.length = length;
 					GHashTableIter iter;
 					gpointer key, value;
 					g_hash_table_iter_init(&iter, audiobridge->rtp_forwarders);
@@ -4783,19 +5724,35 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 						rtph->seq_number = htons(forwarder->seq_number);
 						forwarder->timestamp += OPUS_SAMPLES;
 						rtph->timestamp = htonl(forwarder->timestamp);
-						/* Send RTP packet */
-						struct sockaddr *address = (forwarder->serv_addr.sin_family == AF_INET ?
-							(struct sockaddr *)&forwarder->serv_addr : (struct sockaddr *)&forwarder->serv_addr6);
-						size_t addrlen = (forwarder->serv_addr.sin_family == AF_INET ? sizeof(forwarder->serv_addr) : sizeof(forwarder->serv_addr6));
-						if(sendto(audiobridge->rtp_udp_sock, rtpbuffer, length+12, 0, address, addrlen) < 0) {
-							JANUS_LOG(LOG_HUGE, "Error forwarding mixed RTP packet for room %"SCNu64"... %s (len=%d)...\n",
-								audiobridge->room_id, strerror(errno), length+12);
-						}
+						/* Queue the RTP packet, with a copy of the header */
+						if(batch.count == JANUS_AUDIOBRIDGE_FORWARDERS_BATCH)
+							janus_audiobridge_forwarders_batch_flush(&batch, audiobridge->room_id);
+						batch.forwarders[batch.count] = forwarder;
+						memcpy(&batch.headers[batch.count], rtph, sizeof(janus_rtp_header));
+						batch.count++;
 					}
+					janus_audiobridge_forwarders_batch_flush(&batch, audiobridge->room_id);
 				}
 			}
 		}
 		janus_mutex_unlock(&audiobridge->rtp_mutex);
+		/* Update the mixer statistics */
+		mix_time = janus_get_monotonic_time() - mix_start;
+		if(mix_time > 20000) {
+			/* We took longer than a frame: this room is overloaded */
+			audiobridge->mix_deadline_misses++;
+			if(mix_start - last_miss_log >= 5*G_USEC_PER_SEC) {
+				last_miss_log = mix_start;
+				JANUS_LOG(LOG_WARN, "Mixer for room %"SCNu64" missed its deadline (%"SCNi64"us, %"SCNu64" times so far)\n",
+					audiobridge->room_id, mix_time, audiobridge->mix_deadline_misses);
+			}
+		}
+		audiobridge->mix_ticks++;
+		audiobridge->mix_time_last = mix_time;
+		audiobridge->mix_time_avg = audiobridge->mix_time_avg ?
+			(audiobridge->mix_time_avg*15 + mix_time)/16 : mix_time;
+		if(mix_time > audiobridge->mix_time_max)
+			audiobridge->mix_time_max = mix_time;
 	}
 	if(audiobridge->recording) {
 		/* Update the length in the header */
@@ -4841,6 +5798,9 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 		}
 	}
 	g_free(rtpbuffer);
+	janus_audiobridge_mixer_pool_destroy(pool);
+	g_free(tick.participants);
+	janus_mutex_destroy(&tick.shared_mutex);
 	JANUS_LOG(LOG_VERB, "Leaving mixer thread for room %"SCNu64" (%s)...\n", audiobridge->room_id, audiobridge->room_name);
 
 	janus_refcount_decrease(&audiobridge->ref);
@@ -4870,18 +5830,29 @@ static void *janus_audiobridge_participant_thread(void *data) {
 	outpkt->silence = FALSE;
 	unsigned char *payload = (unsigned char *)outpkt->data;
 
-	janus_audiobridge_rtp_relay_packet *mixedpkt = NULL;
+	janus_audiobridge_mixed_frame *mixedpkt = NULL;
 
 	/* Start working: check the outgoing queue for packets, then encode and send them */
 	while(!g_atomic_int_get(&stopping) && g_atomic_int_get(&session->destroyed) == 0) {
-		mixedpkt = g_async_queue_timeout_pop(participant->outbuf, 100000);
-		if(mixedpkt != NULL && g_atomic_int_get(&session->destroyed) == 0 && g_atomic_int_get(&session->started)) {
-			/* Encode raw frame to Opus */
-			if(g_atomic_int_get(&participant->active) && participant->encoder &&
+		mixedpkt = janus_audiobridge_participant_wait_mix(participant, 100000);
+		if(mixedpkt == NULL)
+			continue;
+		if(g_atomic_int_get(&session->destroyed) == 0 && g_atomic_int_get(&session->started)) {
+			/* Encode raw frame to Opus, unless the mixer did it for us already */
+			gboolean ready = FALSE;
+			if(mixedpkt->encoded != NULL) {
+				if(g_atomic_int_get(&participant->active) && participant->encoder) {
+					memcpy(payload+12, mixedpkt->encoded->payload, mixedpkt->encoded->length);
+					outpkt->length = mixedpkt->encoded->length;
+					ready = TRUE;
+				}
+			} else if(g_atomic_int_get(&participant->active) && participant->encoder &&
 					g_atomic_int_compare_and_exchange(&participant->encoding, 0, 1)) {
-				opus_int16 *outBuffer = (opus_int16 *)mixedpkt->data;
-				outpkt->length = opus_encode(participant->encoder, outBuffer, mixedpkt->length, payload+12, BUFFER_SAMPLES-12);
+				outpkt->length = opus_encode(participant->encoder, mixedpkt->samples, mixedpkt->length, payload+12, BUFFER_SAMPLES-12);
 				g_atomic_int_set(&participant->encoding, 0);
+				ready = TRUE;
+			}
+			if(ready) {
 				if(outpkt->length < 0) {
 					JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error encoding the Opus frame: %d (%s)\n", outpkt->length, opus_strerror(outpkt->length));
 				} else {
@@ -4899,9 +5870,8 @@ static void *janus_audiobridge_participant_thread(void *data) {
 					janus_audiobridge_relay_rtp_packet(participant->session, outpkt);
 				}
 			}
-			g_free(mixedpkt->data);
-			g_free(mixedpkt);
 		}
+		janus_audiobridge_participant_release_mix(participant, mixedpkt);
 	}
 	/* We're done, get rid of the resources */
 	g_free(outpkt->data);
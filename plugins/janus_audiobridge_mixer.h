@@ -0,0 +1,216 @@
+/*! \file   janus_audiobridge_mixer.h
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  Janus AudioBridge plugin mixing kernels (headers)
+ * \details  The AudioBridge mixer relies on a few simple kernels to sum
+ * the contributions of participants and compute the mix-minus for each of
+ * them: this file contains a scalar version of those kernels, plus SSE2
+ * and AVX2 versions the plugin picks at runtime when the CPU supports them.
+ * They're kept separate from the plugin so that they can be exercised in
+ * isolation as well, e.g., by the benchmark in the \c benchmarks folder.
+ *
+ * \ingroup plugins
+ * \ref plugins
+ */
+
+#ifndef JANUS_AUDIOBRIDGE_MIXER_H
+#define JANUS_AUDIOBRIDGE_MIXER_H
+
+#include <opus/opus_types.h>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+/* Mixing kernels: the mixer works on 32-bit accumulators, where each
+ * participant's contribution is added (after applying the volume gain, if
+ * any), and that are then converted back to 16-bit samples with saturation,
+ * either as they are (e.g., for recordings and RTP forwarders) or after
+ * removing a participant's own contribution (mix-minus). We have scalar
+ * versions of all of them, plus SSE2/AVX2 versions that we pick at runtime
+ * when the CPU supports them. Gains are applied as a float multiplication
+ * and truncated, in all versions, so that the output is the same no matter
+ * which kernels are used. */
+typedef struct janus_audiobridge_mixer_kernels {
+	const char *name;
+	/* sum[i] += in[i]*gain */
+	void (*accumulate)(opus_int32 *sum, const opus_int16 *in, int samples, float gain);
+	/* out[i] = saturate(sum[i] - in[i]*gain), where in can be NULL */
+	void (*mix_minus)(opus_int16 *out, const opus_int32 *sum, const opus_int16 *in, int samples, float gain);
+	/* out[i] = saturate(sum[i]) */
+	void (*saturate)(opus_int16 *out, const opus_int32 *sum, int samples);
+} janus_audiobridge_mixer_kernels;
+
+static inline opus_int16 janus_audiobridge_saturate_sample(opus_int32 sample) {
+	if(sample > 32767)
+		return 32767;
+	if(sample < -32768)
+		return -32768;
+	return (opus_int16)sample;
+}
+
+static void janus_audiobridge_accumulate_scalar(opus_int32 *sum, const opus_int16 *in, int samples, float gain) {
+	int i = 0;
+	if(gain == 1.0f) {
+		for(i=0; i<samples; i++)
+			sum[i] += in[i];
+	} else {
+		for(i=0; i<samples; i++)
+			sum[i] += (opus_int32)((float)in[i] * gain);
+	}
+}
+
+static void janus_audiobridge_mix_minus_scalar(opus_int16 *out, const opus_int32 *sum, const opus_int16 *in, int samples, float gain) {
+	int i = 0;
+	if(in == NULL) {
+		for(i=0; i<samples; i++)
+			out[i] = janus_audiobridge_saturate_sample(sum[i]);
+	} else if(gain == 1.0f) {
+		for(i=0; i<samples; i++)
+			out[i] = janus_audiobridge_saturate_sample(sum[i] - in[i]);
+	} else {
+		for(i=0; i<samples; i++)
+			out[i] = janus_audiobridge_saturate_sample(sum[i] - (opus_int32)((float)in[i] * gain));
+	}
+}
+
+static void janus_audiobridge_saturate_scalar(opus_int16 *out, const opus_int32 *sum, int samples) {
+	int i = 0;
+	for(i=0; i<samples; i++)
+		out[i] = janus_audiobridge_saturate_sample(sum[i]);
+}
+
+static const janus_audiobridge_mixer_kernels janus_audiobridge_kernels_scalar = {
+	"scalar",
+	janus_audiobridge_accumulate_scalar,
+	janus_audiobridge_mix_minus_scalar,
+	janus_audiobridge_saturate_scalar
+};
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define JANUS_AUDIOBRIDGE_SIMD_KERNELS
+/* SSE2 kernels: 8 samples per iteration */
+__attribute__((target("sse2")))
+static inline __m128i janus_audiobridge_gain_sse2(__m128i in32, __m128 gain) {
+	return _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(in32), gain));
+}
+
+__attribute__((target("sse2")))
+static void janus_audiobridge_accumulate_sse2(opus_int32 *sum, const opus_int16 *in, int samples, float gain) {
+	int i = 0;
+	__m128 g = _mm_set1_ps(gain);
+	for(i=0; i+8<=samples; i+=8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(in+i));
+		/* Sign-extend the 16-bit samples to 32 bits */
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+		if(gain != 1.0f) {
+			lo = janus_audiobridge_gain_sse2(lo, g);
+			hi = janus_audiobridge_gain_sse2(hi, g);
+		}
+		_mm_storeu_si128((__m128i *)(sum+i), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(sum+i)), lo));
+		_mm_storeu_si128((__m128i *)(sum+i+4), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(sum+i+4)), hi));
+	}
+	if(i < samples)
+		janus_audiobridge_accumulate_scalar(sum+i, in+i, samples-i, gain);
+}
+
+__attribute__((target("sse2")))
+static void janus_audiobridge_mix_minus_sse2(opus_int16 *out, const opus_int32 *sum, const opus_int16 *in, int samples, float gain) {
+	int i = 0;
+	__m128 g = _mm_set1_ps(gain);
+	for(i=0; i+8<=samples; i+=8) {
+		__m128i lo = _mm_loadu_si128((const __m128i *)(sum+i));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(sum+i+4));
+		if(in != NULL) {
+			__m128i s = _mm_loadu_si128((const __m128i *)(in+i));
+			__m128i slo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+			__m128i shi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+			if(gain != 1.0f) {
+				slo = janus_audiobridge_gain_sse2(slo, g);
+				shi = janus_audiobridge_gain_sse2(shi, g);
+			}
+			lo = _mm_sub_epi32(lo, slo);
+			hi = _mm_sub_epi32(hi, shi);
+		}
+		/* Pack back to 16 bits with signed saturation */
+		_mm_storeu_si128((__m128i *)(out+i), _mm_packs_epi32(lo, hi));
+	}
+	if(i < samples)
+		janus_audiobridge_mix_minus_scalar(out+i, sum+i, in ? in+i : NULL, samples-i, gain);
+}
+
+__attribute__((target("sse2")))
+static void janus_audiobridge_saturate_sse2(opus_int16 *out, const opus_int32 *sum, int samples) {
+	janus_audiobridge_mix_minus_sse2(out, sum, NULL, samples, 1.0f);
+}
+
+static const janus_audiobridge_mixer_kernels janus_audiobridge_kernels_sse2 = {
+	"sse2",
+	janus_audiobridge_accumulate_sse2,
+	janus_audiobridge_mix_minus_sse2,
+	janus_audiobridge_saturate_sse2
+};
+
+/* AVX2 kernels: 16 samples per iteration */
+__attribute__((target("avx2")))
+static inline __m256i janus_audiobridge_gain_avx2(__m256i in32, __m256 gain) {
+	return _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(in32), gain));
+}
+
+__attribute__((target("avx2")))
+static void janus_audiobridge_accumulate_avx2(opus_int32 *sum, const opus_int16 *in, int samples, float gain) {
+	int i = 0;
+	__m256 g = _mm256_set1_ps(gain);
+	for(i=0; i+16<=samples; i+=16) {
+		__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in+i)));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in+i+8)));
+		if(gain != 1.0f) {
+			lo = janus_audiobridge_gain_avx2(lo, g);
+			hi = janus_audiobridge_gain_avx2(hi, g);
+		}
+		_mm256_storeu_si256((__m256i *)(sum+i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(sum+i)), lo));
+		_mm256_storeu_si256((__m256i *)(sum+i+8), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(sum+i+8)), hi));
+	}
+	if(i < samples)
+		janus_audiobridge_accumulate_sse2(sum+i, in+i, samples-i, gain);
+}
+
+__attribute__((target("avx2")))
+static void janus_audiobridge_mix_minus_avx2(opus_int16 *out, const opus_int32 *sum, const opus_int16 *in, int samples, float gain) {
+	int i = 0;
+	__m256 g = _mm256_set1_ps(gain);
+	for(i=0; i+16<=samples; i+=16) {
+		__m256i lo = _mm256_loadu_si256((const __m256i *)(sum+i));
+		__m256i hi = _mm256_loadu_si256((const __m256i *)(sum+i+8));
+		if(in != NULL) {
+			__m256i slo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in+i)));
+			__m256i shi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in+i+8)));
+			if(gain != 1.0f) {
+				slo = janus_audiobridge_gain_avx2(slo, g);
+				shi = janus_audiobridge_gain_avx2(shi, g);
+			}
+			lo = _mm256_sub_epi32(lo, slo);
+			hi = _mm256_sub_epi32(hi, shi);
+		}
+		/* Packing works within 128-bit lanes, so we need to fix the order afterwards */
+		__m256i packed = _mm256_packs_epi32(lo, hi);
+		_mm256_storeu_si256((__m256i *)(out+i), _mm256_permute4x64_epi64(packed, 0xD8));
+	}
+	if(i < samples)
+		janus_audiobridge_mix_minus_sse2(out+i, sum+i, in ? in+i : NULL, samples-i, gain);
+}
+
+__attribute__((target("avx2")))
+static void janus_audiobridge_saturate_avx2(opus_int16 *out, const opus_int32 *sum, int samples) {
+	janus_audiobridge_mix_minus_avx2(out, sum, NULL, samples, 1.0f);
+}
+
+static const janus_audiobridge_mixer_kernels janus_audiobridge_kernels_avx2 = {
+	"avx2",
+	janus_audiobridge_accumulate_avx2,
+	janus_audiobridge_mix_minus_avx2,
+	janus_audiobridge_saturate_avx2
+};
+#endif
+
+#endif
@@ -178,6 +178,61 @@ timeCallback("resumeScheduler", null, 0);
  * compact and less verbose, and as such is preferred in cases where
  * timing and opaque arguments are not needed.
  *
+ * \section jheaps Multiple Duktape heaps and bytecode cache
+ *
+ * By default, the plugin loads the script in a single Duktape heap, which
+ * means that all the callbacks (including \c incomingRtp() and the other
+ * media related ones, when implemented) are serialized, no matter which
+ * session they're for. To make use of more cores, you can set the \c heaps
+ * property in the plugin configuration to create a pool of independent
+ * heaps, each running its own copy of the script: sessions are then pinned
+ * to one of the heaps depending on their ID, which means that all the
+ * callbacks for a specific session will always be invoked on the same heap,
+ * while callbacks for sessions pinned to different heaps can be executed
+ * at the same time. Since heaps don't share anything, \c init() and
+ * \c destroy() are invoked once per heap, and a script cannot assume it
+ * will see all sessions. Scheduled callbacks and coroutines resumed via
+ * \c pokeScheduler() are always executed on the heap that requested them.
+ *
+ * The script is only compiled once, no matter how many heaps are created:
+ * the resulting bytecode is then loaded in each heap. If you set the
+ * \c bytecode_cache property to a writable folder, the bytecode is also
+ * saved there, in a file named after the SHA-256 of the script and the
+ * Duktape version, so that the next time the same script is loaded the
+ * compilation can be skipped entirely. Notice that Duktape doesn't
+ * validate bytecode when loading it, which means the folder must not be
+ * writable by anyone you don't trust.
+ *
+ * \section jbuffers Zero-copy RTP buffers
+ *
+ * When a script implements \c incomingRtp(), each packet is copied to
+ * a JavaScript string before being passed to the script, and copied again
+ * when the script relays it via \c relayRtp(). To avoid those copies,
+ * scripts can implement \c incomingRtpBuffer(id, video, buffer) instead:
+ * when present, it's invoked in place of \c incomingRtp(), and \c buffer
+ * is an object wrapping the original packet. The object exposes the
+ * \c seq \c ts \c ssrc \c pt and \c marker properties of the RTP
+ * header, which can be read and modified, a read-only \c length property,
+ * and a \c payload property, which is a plain buffer (that can be
+ * accessed like an \c Uint8Array) mapped on the payload of the original
+ * packet, and so can be read and modified without copying it, e.g.:
+ *
+ * \verbatim
+function incomingRtpBuffer(id, video, buffer) {
+	if(!video && buffer.payload.length > 0)
+		buffer.payload[0] = 0;
+	buffer.ssrc = 1234;
+	relayRtp(peer, video, buffer);
+}
+\endverbatim
+ *
+ * As the example shows, the same object can be passed to \c relayRtp(),
+ * in which case no length is needed. Notice that the packet belongs to
+ * the C code and is only valid while \c incomingRtpBuffer() is running:
+ * accessing the header properties afterwards raises an error, and the
+ * payload will be empty, which means scripts must copy whatever they
+ * need to keep.
+ *
  * Refer to the \ref jspapi section for more information on how you
  * can register your own C functions.
  */
@@ -260,8 +315,8 @@ janus_callbacks *janus_core = NULL;
 static char *duktape_folder = NULL;
 
 /* Duktape stuff */
-duk_context *duktape_ctx = NULL;
-janus_mutex duktape_mutex = JANUS_MUTEX_INITIALIZER;
+janus_duktape_heap *duktape_heaps = NULL;
+guint duktape_heaps_num = 1;
 static const char *duktape_functions[] = {
 	"init", "destroy", "resumeScheduler",
 	"createSession", "destroySession", "querySession",
@@ -284,6 +339,7 @@ static gboolean has_get_package = FALSE;
 static char *duktape_script_package = NULL;
 static gboolean has_handle_admin_message = FALSE;
 static gboolean has_incoming_rtp = FALSE;
+static gboolean has_incoming_rtp_buffer = FALSE;
 static gboolean has_incoming_rtcp = FALSE;
 static gboolean has_incoming_data = FALSE;
 static gboolean has_slow_link = FALSE;
@@ -304,6 +360,7 @@ static void *janus_duktape_timer(void *data);
 static gboolean janus_duktape_timer_cb(void *data);
 typedef struct janus_duktape_callback {
 	guint id;
+	janus_duktape_heap *heap;
 	uint32_t ms;
 	GSource *source;
 	char *function;
@@ -316,6 +373,15 @@ static void janus_duktape_stackdump(duk_context *ctx) {
 	JANUS_LOG(LOG_HUGE, "Total in Duktape stack: %d\n", top);
 }
 
+/* Helper to get the heap a context belongs to: we store a pointer in the heap stash */
+janus_duktape_heap *janus_duktape_heap_get(duk_context *ctx) {
+	duk_push_heap_stash(ctx);
+	duk_get_prop_string(ctx, -1, "janusHeap");
+	janus_duktape_heap *dh = (janus_duktape_heap *)duk_get_pointer(ctx, -1);
+	duk_pop_2(ctx);
+	return dh ? dh : &duktape_heaps[0];
+}
+
 /* janus_duktape_session is defined in janus_duktape_data.h, but it's managed here */
 GHashTable *duktape_sessions, *duktape_ids;
 janus_mutex duktape_sessions_mutex = JANUS_MUTEX_INITIALIZER;
@@ -330,6 +396,8 @@ static void janus_duktape_session_free(const janus_refcount *session_ref) {
 	janus_duktape_session *session = janus_refcount_containerof(session_ref, janus_duktape_session, ref);
 	/* Remove the reference to the core plugin session */
 	janus_refcount_decrease(&session->handle->ref);
+	if(session->heap != NULL)
+		g_atomic_int_add(&session->heap->sessions, -1);
 	/* This session can be destroyed, free all the resources */
 	g_hash_table_remove(duktape_ids, GUINT_TO_POINTER(session->id));
 	janus_recorder_destroy(session->arc);
@@ -451,6 +519,8 @@ static duk_ret_t janus_duktape_method_readfile(duk_context *ctx) {
 
 static duk_ret_t janus_duktape_method_pokescheduler(duk_context *ctx) {
 	/* This method allows the JavaScript script to poke the scheduler and have it wake up ASAP */
+	janus_duktape_heap *dh = janus_duktape_heap_get(ctx);
+	g_atomic_int_set(&dh->resume, 1);
 	g_async_queue_push(events, GUINT_TO_POINTER(janus_duktape_event_resume));
 	duk_push_int(ctx, 0);
 	return 1;
@@ -478,6 +548,7 @@ static duk_ret_t janus_duktape_method_timecallback(duk_context *ctx) {
 	uint32_t ms = (uint32_t)duk_get_number(ctx, 2);
 	/* Create a callback instance */
 	janus_duktape_callback *cb = g_malloc0(sizeof(janus_duktape_callback));
+	cb->heap = janus_duktape_heap_get(ctx);
 	cb->function = g_strdup(function);
 	if(argument != NULL)
 		cb->argument = g_strdup(argument);
@@ -934,6 +1005,145 @@ static duk_ret_t janus_duktape_method_sendpli(duk_context *ctx) {
 	return 1;
 }
 
+/* Zero-copy RTP buffers: each context has a single object, which wraps
+ * the packet being passed to incomingRtpBuffer() and is reset afterwards */
+typedef struct janus_duktape_rtp_buffer {
+	char *buffer;
+	int length;
+} janus_duktape_rtp_buffer;
+typedef enum janus_duktape_rtp_buffer_property {
+	janus_duktape_rtp_buffer_seq = 0,
+	janus_duktape_rtp_buffer_ts,
+	janus_duktape_rtp_buffer_ssrc,
+	janus_duktape_rtp_buffer_pt,
+	janus_duktape_rtp_buffer_marker,
+	janus_duktape_rtp_buffer_length
+} janus_duktape_rtp_buffer_property;
+static const char *janus_duktape_rtp_buffer_properties[] = {
+	"seq", "ts", "ssrc", "pt", "marker", "length"
+};
+
+/* Helper to get the C wrapper of an RTP buffer object, if that's what it is */
+static janus_duktape_rtp_buffer *janus_duktape_rtp_buffer_get(duk_context *ctx, duk_idx_t idx) {
+	if(!duk_is_object(ctx, idx))
+		return NULL;
+	janus_duktape_rtp_buffer *rb = NULL;
+	if(duk_get_prop_string(ctx, idx, DUK_HIDDEN_SYMBOL("wrapper")))
+		rb = (janus_duktape_rtp_buffer *)duk_get_buffer_data(ctx, -1, NULL);
+	duk_pop(ctx);
+	return rb;
+}
+
+static duk_ret_t janus_duktape_rtp_buffer_getter(duk_context *ctx) {
+	duk_push_this(ctx);
+	janus_duktape_rtp_buffer *rb = janus_duktape_rtp_buffer_get(ctx, -1);
+	if(rb == NULL || rb->buffer == NULL) {
+		duk_push_error_object(ctx, DUK_ERR_ERROR, "RTP buffer is not valid anymore");
+		return duk_throw(ctx);
+	}
+	janus_rtp_header *rtp = (janus_rtp_header *)rb->buffer;
+	switch(duk_get_current_magic(ctx)) {
+		case janus_duktape_rtp_buffer_seq:
+			duk_push_uint(ctx, ntohs(rtp->seq_number));
+			break;
+		case janus_duktape_rtp_buffer_ts:
+			duk_push_uint(ctx, ntohl(rtp->timestamp));
+			break;
+		case janus_duktape_rtp_buffer_ssrc:
+			duk_push_uint(ctx, ntohl(rtp->ssrc));
+			break;
+		case janus_duktape_rtp_buffer_pt:
+			duk_push_uint(ctx, rtp->type);
+			break;
+		case janus_duktape_rtp_buffer_marker:
+			duk_push_boolean(ctx, rtp->markerbit);
+			break;
+		case janus_duktape_rtp_buffer_length:
+			duk_push_int(ctx, rb->length);
+			break;
+		default:
+			duk_push_undefined(ctx);
+			break;
+	}
+	return 1;
+}
+
+static duk_ret_t janus_duktape_rtp_buffer_setter(duk_context *ctx) {
+	duk_push_this(ctx);
+	janus_duktape_rtp_buffer *rb = janus_duktape_rtp_buffer_get(ctx, -1);
+	if(rb == NULL || rb->buffer == NULL) {
+		duk_push_error_object(ctx, DUK_ERR_ERROR, "RTP buffer is not valid anymore");
+		return duk_throw(ctx);
+	}
+	janus_rtp_header *rtp = (janus_rtp_header *)rb->buffer;
+	switch(duk_get_current_magic(ctx)) {
+		case janus_duktape_rtp_buffer_seq:
+			rtp->seq_number = htons((uint16_t)duk_to_uint32(ctx, 0));
+			break;
+		case janus_duktape_rtp_buffer_ts:
+			rtp->timestamp = htonl(duk_to_uint32(ctx, 0));
+			break;
+		case janus_duktape_rtp_buffer_ssrc:
+			rtp->ssrc = htonl(duk_to_uint32(ctx, 0));
+			break;
+		case janus_duktape_rtp_buffer_pt:
+			rtp->type = duk_to_uint32(ctx, 0) & 0x7F;
+			break;
+		case janus_duktape_rtp_buffer_marker:
+			rtp->markerbit = duk_to_boolean(ctx, 0) ? 1 : 0;
+			break;
+		default:
+			break;
+	}
+	return 0;
+}
+
+/* Helper to create the RTP buffer object for a context, and store it in the global stash */
+static void janus_duktape_rtp_buffer_setup(duk_context *ctx) {
+	duk_push_global_stash(ctx);
+	duk_push_object(ctx);
+	/* The C wrapper is allocated in the heap itself, so we don't need to free it */
+	janus_duktape_rtp_buffer *rb = (janus_duktape_rtp_buffer *)duk_push_fixed_buffer(ctx, sizeof(janus_duktape_rtp_buffer));
+	rb->buffer = NULL;
+	rb->length = 0;
+	duk_put_prop_string(ctx, -2, DUK_HIDDEN_SYMBOL("wrapper"));
+	uint i = 0;
+	for(i=0; i<sizeof(janus_duktape_rtp_buffer_properties)/sizeof(*janus_duktape_rtp_buffer_properties); i++) {
+		duk_push_string(ctx, janus_duktape_rtp_buffer_properties[i]);
+		duk_push_c_function(ctx, janus_duktape_rtp_buffer_getter, 0);
+		duk_set_magic(ctx, -1, i);
+		duk_uint_t flags = DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_ENUMERABLE;
+		if(i != janus_duktape_rtp_buffer_length) {
+			duk_push_c_function(ctx, janus_duktape_rtp_buffer_setter, 1);
+			duk_set_magic(ctx, -1, i);
+			flags |= DUK_DEFPROP_HAVE_SETTER;
+		}
+		/* Stack is [ ... object key getter (setter) ] */
+		duk_def_prop(ctx, (flags & DUK_DEFPROP_HAVE_SETTER) ? -4 : -3, flags);
+	}
+	/* The payload is an external buffer we map on each packet */
+	duk_push_external_buffer(ctx);
+	duk_put_prop_string(ctx, -2, "payload");
+	duk_put_prop_string(ctx, -2, "rtpBuffer");
+	duk_pop(ctx);
+}
+
+/* Helper to map the RTP buffer object of a context on a packet (or unmap it, if buf is NULL):
+ * if successful, the object is left on top of the stack */
+static void janus_duktape_rtp_buffer_map(duk_context *ctx, char *buf, int len) {
+	duk_push_global_stash(ctx);
+	duk_get_prop_string(ctx, -1, "rtpBuffer");
+	duk_remove(ctx, -2);
+	janus_duktape_rtp_buffer *rb = janus_duktape_rtp_buffer_get(ctx, -1);
+	rb->buffer = buf;
+	rb->length = buf ? len : 0;
+	int plen = 0;
+	char *payload = buf ? janus_rtp_payload(buf, len, &plen) : NULL;
+	duk_get_prop_string(ctx, -1, "payload");
+	duk_config_buffer(ctx, -1, payload, payload ? plen : 0);
+	duk_pop(ctx);
+}
+
 static duk_ret_t janus_duktape_method_relayrtp(duk_context *ctx) {
 	if(duk_get_type(ctx, 0) != DUK_TYPE_NUMBER) {
 		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
@@ -945,20 +1155,22 @@ static duk_ret_t janus_duktape_method_relayrtp(duk_context *ctx) {
 			janus_duktape_type_string(DUK_TYPE_BOOLEAN), janus_duktape_type_string(duk_get_type(ctx, 1)));
 		return duk_throw(ctx);
 	}
-	if(duk_get_type(ctx, 2) != DUK_TYPE_STRING) {
+	/* The packet may be a string, or a buffer we passed to incomingRtpBuffer() */
+	janus_duktape_rtp_buffer *rb = janus_duktape_rtp_buffer_get(ctx, 2);
+	if(rb == NULL && duk_get_type(ctx, 2) != DUK_TYPE_STRING) {
 		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
 			janus_duktape_type_string(DUK_TYPE_STRING), janus_duktape_type_string(duk_get_type(ctx, 2)));
 		return duk_throw(ctx);
 	}
-	if(duk_get_type(ctx, 3) != DUK_TYPE_NUMBER) {
+	if(rb == NULL && duk_get_type(ctx, 3) != DUK_TYPE_NUMBER) {
 		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
 			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 3)));
 		return duk_throw(ctx);
 	}
 	uint32_t id = (uint32_t)duk_get_number(ctx, 0);
 	int is_video = duk_get_boolean(ctx, 1);
-	const char *payload = duk_get_string(ctx, 2);
-	int len = (int)duk_get_number(ctx, 3);
+	const char *payload = rb ? rb->buffer : duk_get_string(ctx, 2);
+	int len = rb ? rb->length : (int)duk_get_number(ctx, 3);
 	if(payload == NULL || len < 1) {
 		JANUS_LOG(LOG_ERR, "Invalid payload\n");
 		duk_push_error_object(ctx, DUK_ERR_ERROR, "Invalid payload of declared size %d", len);
@@ -1218,6 +1430,189 @@ static duk_ret_t janus_duktape_method_stoprecording(duk_context *ctx) {
 
 
 /* Plugin implementation */
+/* Helper to read the script, and get its bytecode: if a cache folder was
+ * configured, we check if we compiled the same script already, and if not
+ * we compile it and save the result there for the next time */
+static char *janus_duktape_get_bytecode(const char *duktape_file, const char *cache_folder, size_t *bytecode_len) {
+	char *source = NULL;
+	gsize source_len = 0;
+	GError *error = NULL;
+	if(!g_file_get_contents(duktape_file, &source, &source_len, &error) || source_len < 1) {
+		JANUS_LOG(LOG_ERR, "Error loading JS script %s: %s\n", duktape_file,
+			error ? error->message : "empty file");
+		if(error != NULL)
+			g_error_free(error);
+		g_free(source);
+		return NULL;
+	}
+	char *bytecode = NULL;
+	gsize len = 0;
+	char *cache_file = NULL;
+	if(cache_folder != NULL) {
+		/* The cache is keyed by the hash of the script and the Duktape version */
+		char *hash = g_compute_checksum_for_data(G_CHECKSUM_SHA256, (const guchar *)source, source_len);
+		char name[128];
+		g_snprintf(name, sizeof(name), "%s-%ld.jsbc", hash, (long)DUK_VERSION);
+		g_free(hash);
+		cache_file = g_build_filename(cache_folder, name, NULL);
+		if(g_file_get_contents(cache_file, &bytecode, &len, NULL) && len > 0) {
+			JANUS_LOG(LOG_INFO, "Using cached bytecode for %s (%s)\n", duktape_file, cache_file);
+			g_free(cache_file);
+			g_free(source);
+			*bytecode_len = len;
+			return bytecode;
+		}
+		g_free(bytecode);
+		bytecode = NULL;
+	}
+	/* Compile the script in a temporary heap, and dump the result */
+	duk_context *ctx = duk_create_heap_default();
+	if(ctx == NULL) {
+		JANUS_LOG(LOG_ERR, "Error creating Duktape heap...\n");
+		g_free(cache_file);
+		g_free(source);
+		return NULL;
+	}
+	duk_push_string(ctx, duktape_file);
+	if(duk_pcompile_lstring_filename(ctx, 0, source, source_len) != 0) {
+		JANUS_LOG(LOG_ERR, "Error compiling JS script %s: %s\n", duktape_file, duk_safe_to_string(ctx, -1));
+		duk_destroy_heap(ctx);
+		g_free(cache_file);
+		g_free(source);
+		return NULL;
+	}
+	g_free(source);
+	duk_dump_function(ctx);
+	duk_size_t size = 0;
+	void *data = duk_get_buffer_data(ctx, -1, &size);
+	bytecode = g_malloc(size);
+	memcpy(bytecode, data, size);
+	*bytecode_len = size;
+	duk_destroy_heap(ctx);
+	if(cache_file != NULL) {
+		/* Save the bytecode for the next time */
+		if(g_mkdir_with_parents(cache_folder, 0755) < 0 ||
+				!g_file_set_contents(cache_file, bytecode, *bytecode_len, &error)) {
+			JANUS_LOG(LOG_WARN, "Couldn't save bytecode to %s: %s\n", cache_file,
+				error ? error->message : g_strerror(errno));
+			if(error != NULL)
+				g_error_free(error);
+		} else {
+			JANUS_LOG(LOG_VERB, "Saved bytecode for %s to %s\n", duktape_file, cache_file);
+		}
+		g_free(cache_file);
+	}
+	return bytecode;
+}
+
+/* Helper to create a new Duktape heap, register our functions and load the script bytecode in it */
+static int janus_duktape_heap_setup(janus_duktape_heap *dh, const char *duktape_file, const char *bytecode, size_t bytecode_len) {
+	dh->ctx = duk_create_heap_default();
+	if(dh->ctx == NULL) {
+		JANUS_LOG(LOG_ERR, "Error creating Duktape heap...\n");
+		return -1;
+	}
+	duk_context *ctx = dh->ctx;
+	duk_console_init(ctx, DUK_CONSOLE_PROXY_WRAPPER);
+	duk_module_duktape_init(ctx);
+	/* Keep track of which heap this is, so that our methods can find it */
+	duk_push_heap_stash(ctx);
+	duk_push_pointer(ctx, dh);
+	duk_put_prop_string(ctx, -2, "janusHeap");
+	duk_pop(ctx);
+
+	/* Register our functions */
+	duk_push_c_function(ctx, janus_duktape_method_getmodulesfolder, 0);
+	duk_put_global_string(ctx, "getModulesFolder");
+	duk_push_c_function(ctx, janus_duktape_method_readfile, 1);
+	duk_put_global_string(ctx, "readFile");
+	duk_push_c_function(ctx, janus_duktape_method_pokescheduler, 0);
+	duk_put_global_string(ctx, "pokeScheduler");
+	duk_push_c_function(ctx, janus_duktape_method_timecallback, 3);
+	duk_put_global_string(ctx, "timeCallback");
+	duk_push_c_function(ctx, janus_duktape_method_pushevent, 4);
+	duk_put_global_string(ctx, "pushEvent");
+	duk_push_c_function(ctx, janus_duktape_method_notifyevent, 2);
+	duk_put_global_string(ctx, "notifyEvent");
+	duk_push_c_function(ctx, janus_duktape_method_eventsisenabled, 0);
+	duk_put_global_string(ctx, "eventsIsEnabled");
+	duk_push_c_function(ctx, janus_duktape_method_closepc, 1);
+	duk_put_global_string(ctx, "closePc");
+	duk_push_c_function(ctx, janus_duktape_method_endsession, 1);
+	duk_put_global_string(ctx, "endSession");
+	duk_push_c_function(ctx, janus_duktape_method_configuremedium, 4);
+	duk_put_global_string(ctx, "configureMedium");
+	duk_push_c_function(ctx, janus_duktape_method_addrecipient, 2);
+	duk_put_global_string(ctx, "addRecipient");
+	duk_push_c_function(ctx, janus_duktape_method_removerecipient, 2);
+	duk_put_global_string(ctx, "removeRecipient");
+	duk_push_c_function(ctx, janus_duktape_method_setbitrate, 2);
+	duk_put_global_string(ctx, "setBitrate");
+	duk_push_c_function(ctx, janus_duktape_method_setplifreq, 2);
+	duk_put_global_string(ctx, "setPliFreq");
+	duk_push_c_function(ctx, janus_duktape_method_sendpli, 1);
+	duk_put_global_string(ctx, "sendPli");
+	duk_push_c_function(ctx, janus_duktape_method_relayrtp, 4);
+	duk_put_global_string(ctx, "relayRtp");
+	duk_push_c_function(ctx, janus_duktape_method_relayrtcp, 4);
+	duk_put_global_string(ctx, "relayRtcp");
+	duk_push_c_function(ctx, janus_duktape_method_relaydata, 3);
+	duk_put_global_string(ctx, "relayData");
+	duk_push_c_function(ctx, janus_duktape_method_startrecording, 13);
+	duk_put_global_string(ctx, "startRecording");
+	duk_push_c_function(ctx, janus_duktape_method_stoprecording, 4);
+	duk_put_global_string(ctx, "stopRecording");
+	duk_push_c_function(ctx, janus_duktape_method_getversion, 0);
+	duk_put_global_string(ctx, "getDuktapeVersion");
+	/* Register all extra functions, if any were added */
+	janus_duktape_register_extra_functions(ctx);
+	/* Prepare the object we'll use to pass RTP packets without copying them */
+	janus_duktape_rtp_buffer_setup(ctx);
+
+	/* Now load the script bytecode and run it */
+	void *buf = duk_push_fixed_buffer(ctx, bytecode_len);
+	memcpy(buf, bytecode, bytecode_len);
+	duk_load_function(ctx);
+	if(duk_pcall(ctx, 0) != DUK_EXEC_SUCCESS) {
+		JANUS_LOG(LOG_ERR, "Error loading JS script %s: %s\n", duktape_file, duk_safe_to_string(ctx, -1));
+		duk_destroy_heap(ctx);
+		dh->ctx = NULL;
+		return -1;
+	}
+	duk_pop(ctx);
+	/* Make sure that all the functions we need are there */
+	uint i=0;
+	for(i=0; i<duktape_funcsize; i++) {
+		duk_get_global_string(ctx, duktape_functions[i]);
+		if(duk_is_function(ctx, duk_get_top(ctx)-1) == 0) {
+			JANUS_LOG(LOG_ERR, "Function '%s' is missing in %s\n", duktape_functions[i], duktape_file);
+			duk_destroy_heap(ctx);
+			dh->ctx = NULL;
+			return -1;
+		}
+		duk_pop(ctx);
+	}
+	return 0;
+}
+
+/* Helper to destroy all the Duktape heaps we created */
+static void janus_duktape_heaps_destroy(void) {
+	if(duktape_heaps == NULL)
+		return;
+	guint i = 0;
+	for(i=0; i<duktape_heaps_num; i++) {
+		janus_duktape_heap *dh = &duktape_heaps[i];
+		janus_mutex_lock(&dh->mutex);
+		if(dh->ctx != NULL)
+			duk_destroy_heap(dh->ctx);
+		dh->ctx = NULL;
+		janus_mutex_unlock(&dh->mutex);
+		janus_mutex_destroy(&dh->mutex);
+	}
+	g_free(duktape_heaps);
+	duktape_heaps = NULL;
+}
+
 int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	if(g_atomic_int_get(&duktape_stopping)) {
 		/* Still stopping from before */
@@ -1261,109 +1656,51 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	janus_config_item *conf = janus_config_get(config, config_general, janus_config_type_item, "config");
 	if(conf && conf->value)
 		duktape_config = g_strdup(conf->value);
-	janus_config_destroy(config);
-
-	/* Initialize Duktape */
-	duktape_ctx = duk_create_heap_default();
-	if(duktape_ctx == NULL) {
-		JANUS_LOG(LOG_ERR, "Error creating Duktape heap...\n");
-		g_free(duktape_folder);
-		return -1;
+	duktape_heaps_num = 1;
+	janus_config_item *heaps = janus_config_get(config, config_general, janus_config_type_item, "heaps");
+	if(heaps && heaps->value) {
+		int num = atoi(heaps->value);
+		if(num < 1) {
+			JANUS_LOG(LOG_WARN, "Invalid number of Duktape heaps (%s), using 1\n", heaps->value);
+		} else {
+			duktape_heaps_num = num;
+		}
 	}
-	duk_console_init(duktape_ctx, DUK_CONSOLE_PROXY_WRAPPER);
-	duk_module_duktape_init(duktape_ctx);
-
-	/* Register our functions */
-	duk_push_c_function(duktape_ctx, janus_duktape_method_getmodulesfolder, 0);
-	duk_put_global_string(duktape_ctx, "getModulesFolder");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_readfile, 1);
-	duk_put_global_string(duktape_ctx, "readFile");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_pokescheduler, 0);
-	duk_put_global_string(duktape_ctx, "pokeScheduler");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_timecallback, 3);
-	duk_put_global_string(duktape_ctx, "timeCallback");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_pushevent, 4);
-	duk_put_global_string(duktape_ctx, "pushEvent");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_notifyevent, 2);
-	duk_put_global_string(duktape_ctx, "notifyEvent");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_eventsisenabled, 0);
-	duk_put_global_string(duktape_ctx, "eventsIsEnabled");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_closepc, 1);
-	duk_put_global_string(duktape_ctx, "closePc");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_endsession, 1);
-	duk_put_global_string(duktape_ctx, "endSession");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_configuremedium, 4);
-	duk_put_global_string(duktape_ctx, "configureMedium");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_addrecipient, 2);
-	duk_put_global_string(duktape_ctx, "addRecipient");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_removerecipient, 2);
-	duk_put_global_string(duktape_ctx, "removeRecipient");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_setbitrate, 2);
-	duk_put_global_string(duktape_ctx, "setBitrate");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_setplifreq, 2);
-	duk_put_global_string(duktape_ctx, "setPliFreq");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_sendpli, 1);
-	duk_put_global_string(duktape_ctx, "sendPli");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relayrtp, 4);
-	duk_put_global_string(duktape_ctx, "relayRtp");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relayrtcp, 4);
-	duk_put_global_string(duktape_ctx, "relayRtcp");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relaydata, 3);
-	duk_put_global_string(duktape_ctx, "relayData");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_startrecording, 13);
-	duk_put_global_string(duktape_ctx, "startRecording");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_stoprecording, 4);
-	duk_put_global_string(duktape_ctx, "stopRecording");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_getversion, 0);
-	duk_put_global_string(duktape_ctx, "getDuktapeVersion");
-	/* Register all extra functions, if any were added */
-	janus_duktape_register_extra_functions(duktape_ctx);
+	char *bytecode_cache = NULL;
+	janus_config_item *cache = janus_config_get(config, config_general, janus_config_type_item, "bytecode_cache");
+	if(cache && cache->value)
+		bytecode_cache = g_strdup(cache->value);
+	janus_config_destroy(config);
 
-	/* Now load the script (FIXME badly) */
-	FILE *f = fopen(duktape_file, "rb");
-	if(f == NULL) {
-		JANUS_LOG(LOG_ERR, "Error loading JS script %s: no such file\n", duktape_file);
-		duk_destroy_heap(duktape_ctx);
-		g_free(duktape_folder);
-		g_free(duktape_file);
-		return -1;
-	}
-	fseek(f, 0, SEEK_END);
-	size_t len = ftell(f);
-	if(len < 1) {
-		JANUS_LOG(LOG_ERR, "Error loading JS script %s: empty file\n", duktape_file);
-		fclose(f);
-		duk_destroy_heap(duktape_ctx);
-		g_free(duktape_folder);
-		g_free(duktape_file);
-		return -1;
-	}
-	char *buf = (char *)g_malloc0(len);
-	fseek(f, 0, SEEK_SET);
-	fread((void *)buf, 1, len, f);
-	fclose(f);
-	duk_push_lstring(duktape_ctx, (const char *)buf, (duk_size_t)len);
-	g_free(buf);
-	if(duk_peval(duktape_ctx) != 0) {
-		JANUS_LOG(LOG_ERR, "Error loading JS script %s: %s\n", duktape_file, duk_safe_to_string(duktape_ctx, -1));
-		duk_destroy_heap(duktape_ctx);
+	/* Get the bytecode of the script, compiling it only if needed */
+	size_t bytecode_len = 0;
+	char *bytecode = janus_duktape_get_bytecode(duktape_file, bytecode_cache, &bytecode_len);
+	g_free(bytecode_cache);
+	if(bytecode == NULL) {
 		g_free(duktape_folder);
 		g_free(duktape_file);
+		g_free(duktape_config);
 		return -1;
 	}
-	duk_pop(duktape_ctx);
-	/* Make sure that all the functions we need are there */
+	/* Initialize Duktape: we create as many heaps as we were asked to */
+	JANUS_LOG(LOG_VERB, "Creating %u Duktape heap(s)\n", duktape_heaps_num);
+	duktape_heaps = g_malloc0(duktape_heaps_num * sizeof(janus_duktape_heap));
 	uint i=0;
-	for(i=0; i<duktape_funcsize; i++) {
-		duk_get_global_string(duktape_ctx, duktape_functions[i]);
-		if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) == 0) {
-			JANUS_LOG(LOG_ERR, "Function '%s' is missing in %s\n", duktape_functions[i], duktape_file);
-			duk_destroy_heap(duktape_ctx);
+	for(i=0; i<duktape_heaps_num; i++) {
+		duktape_heaps[i].index = i;
+		janus_mutex_init(&duktape_heaps[i].mutex);
+		if(janus_duktape_heap_setup(&duktape_heaps[i], duktape_file, bytecode, bytecode_len) < 0) {
+			janus_duktape_heaps_destroy();
+			g_free(bytecode);
 			g_free(duktape_folder);
 			g_free(duktape_file);
+			g_free(duktape_config);
 			return -1;
 		}
 	}
+	g_free(bytecode);
+	/* All heaps load the same script, so we can check the first one */
+	duk_context *duktape_ctx = duktape_heaps[0].ctx;
 	/* Some JS functions are optional (e.g., those to directly handle RTP, RTCP and
 	 * data, as those will typically be kept at a C level, with JavaScript only dictating
 	 * the logic, or those overriding the plugin namespace and versioning information */
@@ -1391,6 +1728,9 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	duk_get_global_string(duktape_ctx, "incomingRtp");
 	if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) != 0)
 		has_incoming_rtp = TRUE;
+	duk_get_global_string(duktape_ctx, "incomingRtpBuffer");
+	if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) != 0)
+		has_incoming_rtp_buffer = TRUE;
 	duk_get_global_string(duktape_ctx, "incomingRtcp");
 	if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) != 0)
 		has_incoming_rtcp = TRUE;
@@ -1400,6 +1740,7 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	duk_get_global_string(duktape_ctx, "slowLink");
 	if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) != 0)
 		has_slow_link = TRUE;
+	duk_set_top(duktape_ctx, 0);
 
 	duktape_sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_duktape_session_destroy);
 	duktape_ids = g_hash_table_new(NULL, NULL);
@@ -1414,7 +1755,7 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 		g_atomic_int_set(&duktape_initialized, 0);
 		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Duktape scheduler thread...\n",
 			error->code, error->message ? error->message : "??");
-		duk_destroy_heap(duktape_ctx);
+		janus_duktape_heaps_destroy();
 		g_free(duktape_folder);
 		g_free(duktape_file);
 		g_free(duktape_config);
@@ -1432,7 +1773,7 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 			g_main_loop_unref(timer_loop);
 		if(timer_context != NULL)
 			g_main_context_unref(timer_context);
-		duk_destroy_heap(duktape_ctx);
+		janus_duktape_heaps_destroy();
 		g_free(duktape_folder);
 		g_free(duktape_file);
 		g_free(duktape_config);
@@ -1442,19 +1783,26 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	janus_core = callback;
 
-	/* Init the JS script, in case it's needed */
-	duk_get_global_string(duktape_ctx, "init");
-	duk_push_string(duktape_ctx, duktape_config);
-	int res = duk_pcall(duktape_ctx, 1);
+	/* Init the JS script in all heaps, in case it's needed */
+	int res = DUK_EXEC_SUCCESS;
+	for(i=0; i<duktape_heaps_num && res == DUK_EXEC_SUCCESS; i++) {
+		janus_duktape_heap *dh = &duktape_heaps[i];
+		janus_mutex_lock(&dh->mutex);
+		duk_get_global_string(dh->ctx, "init");
+		duk_push_string(dh->ctx, duktape_config);
+		res = duk_pcall(dh->ctx, 1);
+		if(res != DUK_EXEC_SUCCESS)
+			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(dh->ctx, -1));
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
+	}
 	if(res != DUK_EXEC_SUCCESS) {
 		g_atomic_int_set(&duktape_initialized, 0);
-		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(duktape_ctx, -1));
-		duk_pop(duktape_ctx);
 		if(timer_loop != NULL)
 			g_main_loop_unref(timer_loop);
 		if(timer_context != NULL)
 			g_main_context_unref(timer_context);
-		duk_destroy_heap(duktape_ctx);
+		janus_duktape_heaps_destroy();
 		g_free(duktape_folder);
 		g_free(duktape_file);
 		g_free(duktape_config);
@@ -1493,15 +1841,18 @@ void janus_duktape_destroy(void) {
 		timer_context = NULL;
 	}
 
-	/* Deinit the JS script, in case it's needed */
-	janus_mutex_lock(&duktape_mutex);
-	duk_get_global_string(duktape_ctx, "destroy");
-	int res = duk_pcall(duktape_ctx, 0);
-	if(res != DUK_EXEC_SUCCESS) {
-		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(duktape_ctx, -1));
-		duk_pop(duktape_ctx);
+	/* Deinit the JS script in all heaps, in case it's needed */
+	guint i = 0;
+	for(i=0; i<duktape_heaps_num; i++) {
+		janus_duktape_heap *dh = &duktape_heaps[i];
+		janus_mutex_lock(&dh->mutex);
+		duk_get_global_string(dh->ctx, "destroy");
+		int res = duk_pcall(dh->ctx, 0);
+		if(res != DUK_EXEC_SUCCESS)
+			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(dh->ctx, -1));
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 	}
-	janus_mutex_unlock(&duktape_mutex);
 
 	janus_mutex_lock(&duktape_sessions_mutex);
 	g_hash_table_destroy(duktape_sessions);
@@ -1512,10 +1863,7 @@ void janus_duktape_destroy(void) {
 	events = NULL;
 	janus_mutex_unlock(&duktape_sessions_mutex);
 
-	janus_mutex_lock(&duktape_mutex);
-	duk_destroy_heap(duktape_ctx);
-	duktape_ctx = NULL;
-	janus_mutex_unlock(&duktape_mutex);
+	janus_duktape_heaps_destroy();
 
 	g_free(duktape_script_version_string);
 	g_free(duktape_script_description);
@@ -1543,23 +1891,24 @@ int janus_duktape_get_version(void) {
 			/* Unless we asked already */
 			return duktape_script_version;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_heap *dh = &duktape_heaps[0];
+		janus_mutex_lock(&dh->mutex);
+		duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+		duk_context *t = duk_get_context(dh->ctx, thr_idx);
 		duk_get_global_string(t, "getVersion");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(dh->ctx);
+			janus_mutex_unlock(&dh->mutex);
 			return JANUS_DUKTAPE_VERSION;
 		}
 		duktape_script_version = (int)duk_get_number(t, -1);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		return duktape_script_version;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1574,25 +1923,26 @@ const char *janus_duktape_get_version_string(void) {
 			/* Unless we asked already */
 			return duktape_script_version_string;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_heap *dh = &duktape_heaps[0];
+		janus_mutex_lock(&dh->mutex);
+		duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+		duk_context *t = duk_get_context(dh->ctx, thr_idx);
 		duk_get_global_string(t, "getVersionString");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(dh->ctx);
+			janus_mutex_unlock(&dh->mutex);
 			return JANUS_DUKTAPE_VERSION_STRING;
 		}
 		const char *version = duk_get_string(t, -1);
 		if(version != NULL)
 			duktape_script_version_string = g_strdup(version);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		return duktape_script_version_string;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1607,25 +1957,26 @@ const char *janus_duktape_get_description(void) {
 			/* Unless we asked already */
 			return duktape_script_description;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_heap *dh = &duktape_heaps[0];
+		janus_mutex_lock(&dh->mutex);
+		duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+		duk_context *t = duk_get_context(dh->ctx, thr_idx);
 		duk_get_global_string(t, "getDescription");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(dh->ctx);
+			janus_mutex_unlock(&dh->mutex);
 			return JANUS_DUKTAPE_DESCRIPTION;
 		}
 		const char *description = duk_get_string(t, -1);
 		if(description != NULL)
 			duktape_script_description = g_strdup(description);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		return duktape_script_description;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1640,25 +1991,26 @@ const char *janus_duktape_get_name(void) {
 			/* Unless we asked already */
 			return duktape_script_name;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_heap *dh = &duktape_heaps[0];
+		janus_mutex_lock(&dh->mutex);
+		duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+		duk_context *t = duk_get_context(dh->ctx, thr_idx);
 		duk_get_global_string(t, "getName");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(dh->ctx);
+			janus_mutex_unlock(&dh->mutex);
 			return JANUS_DUKTAPE_NAME;
 		}
 		const char *name = duk_get_string(t, -1);
 		if(name != NULL)
 			duktape_script_name = g_strdup(name);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		return duktape_script_name;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1673,25 +2025,26 @@ const char *janus_duktape_get_author(void) {
 			/* Unless we asked already */
 			return duktape_script_author;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_heap *dh = &duktape_heaps[0];
+		janus_mutex_lock(&dh->mutex);
+		duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+		duk_context *t = duk_get_context(dh->ctx, thr_idx);
 		duk_get_global_string(t, "getAuthor");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(dh->ctx);
+			janus_mutex_unlock(&dh->mutex);
 			return JANUS_DUKTAPE_AUTHOR;
 		}
 		const char *author = duk_get_string(t, -1);
 		if(author != NULL)
 			duktape_script_author = g_strdup(author);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		return duktape_script_author;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1706,25 +2059,26 @@ const char *janus_duktape_get_package(void) {
 			/* Unless we asked already */
 			return duktape_script_package;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_heap *dh = &duktape_heaps[0];
+		janus_mutex_lock(&dh->mutex);
+		duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+		duk_context *t = duk_get_context(dh->ctx, thr_idx);
 		duk_get_global_string(t, "getPackage");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(dh->ctx);
+			janus_mutex_unlock(&dh->mutex);
 			return JANUS_DUKTAPE_PACKAGE;
 		}
 		const char *package = duk_get_string(t, -1);
 		if(package != NULL)
 			duktape_script_package = g_strdup(package);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		return duktape_script_package;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1757,6 +2111,9 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 	janus_duktape_session *session = (janus_duktape_session *)g_malloc0(sizeof(janus_duktape_session));
 	session->handle = handle;
 	session->id = id;
+	/* Pin the session to one of the Duktape heaps */
+	session->heap = &duktape_heaps[id % duktape_heaps_num];
+	g_atomic_int_inc(&session->heap->sessions);
 	janus_rtp_switching_context_reset(&session->rtpctx);
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
@@ -1767,9 +2124,10 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&duktape_sessions_mutex);
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_heap *dh = session->heap;
+	janus_mutex_lock(&dh->mutex);
+	duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+	duk_context *t = duk_get_context(dh->ctx, thr_idx);
 	duk_get_global_string(t, "createSession");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -1778,8 +2136,8 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(dh->ctx);
+	janus_mutex_unlock(&dh->mutex);
 
 	return;
 }
@@ -1803,9 +2161,10 @@ void janus_duktape_destroy_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&duktape_sessions_mutex);
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_heap *dh = session->heap;
+	janus_mutex_lock(&dh->mutex);
+	duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+	duk_context *t = duk_get_context(dh->ctx, thr_idx);
 	duk_get_global_string(t, "destroySession");
 	duk_push_number(t, id);
 	int res = duk_pcall(t, 1);
@@ -1814,8 +2173,8 @@ void janus_duktape_destroy_session(janus_plugin_session *handle, int *error) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(dh->ctx);
+	janus_mutex_unlock(&dh->mutex);
 
 	/* Get any rid references recipients of this sessions may have */
 	janus_mutex_lock(&session->recipients_mutex);
@@ -1853,9 +2212,10 @@ json_t *janus_duktape_query_session(janus_plugin_session *handle) {
 	janus_refcount_increase(&session->ref);
 	janus_mutex_unlock(&duktape_sessions_mutex);
 	/* Ask the JS script for information on this session */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_heap *dh = session->heap;
+	janus_mutex_lock(&dh->mutex);
+	duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+	duk_context *t = duk_get_context(dh->ctx, thr_idx);
 	duk_get_global_string(t, "querySession");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -1865,18 +2225,18 @@ json_t *janus_duktape_query_session(janus_plugin_session *handle) {
 		json_t *json = json_object();
 		json_object_set_new(json, "error", json_string(duk_safe_to_string(t, -1)));
 		duk_pop(t);
-		duk_pop(duktape_ctx);
+		duk_pop(dh->ctx);
 		janus_refcount_decrease(&session->ref);
 		return json;
 	}
 	janus_refcount_decrease(&session->ref);
 	const char *info = duk_get_string(t, -1);
 	duk_pop(t);
-	duk_pop(duktape_ctx);
+	duk_pop(dh->ctx);
 	/* We need a Jansson object */
 	json_error_t error;
 	json_t *json = json_loads(info, 0, &error);
-	janus_mutex_unlock(&duktape_mutex);
+	janus_mutex_unlock(&dh->mutex);
 	if(!json) {
 		JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s", error.line, error.text);
 		return NULL;
@@ -1910,9 +2270,10 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 	char *jsep_text = jsep ? json_dumps(jsep, JSON_INDENT(0) | JSON_PRESERVE_ORDER) : NULL;
 	json_decref(jsep);
 	/* Invoke the script function */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_heap *dh = session->heap;
+	janus_mutex_lock(&dh->mutex);
+	duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+	duk_context *t = duk_get_context(dh->ctx, thr_idx);
 	duk_get_global_string(t, "handleMessage");
 	duk_push_number(t, session->id);
 	duk_push_string(t, transaction);
@@ -1923,8 +2284,8 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		/* Something went wrong... */
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
 	}
 	janus_refcount_decrease(&session->ref);
@@ -1938,8 +2299,8 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		/* Either an error or an asynchronous response */
 		int res = (int)duk_get_number(t, 0);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		if(res < 0) {
 			/* We got an error */
 			return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
@@ -1952,8 +2313,8 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		json_error_t error;
 		json_t *json = json_loads(response, 0, &error);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		if(!json) {
 			JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 			return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
@@ -1962,8 +2323,8 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 	}
 	/* If we got here, we didn't get what we expect */
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(dh->ctx);
+	janus_mutex_unlock(&dh->mutex);
 	return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
 }
 
@@ -1972,9 +2333,10 @@ json_t *janus_duktape_handle_admin_message(json_t *message) {
 		return NULL;
 	char *message_text = json_dumps(message, JSON_INDENT(0) | JSON_PRESERVE_ORDER);
 	/* Invoke the script function */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_heap *dh = &duktape_heaps[0];
+	janus_mutex_lock(&dh->mutex);
+	duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+	duk_context *t = duk_get_context(dh->ctx, thr_idx);
 	duk_get_global_string(t, "handleAdminMessage");
 	duk_push_string(t, message_text);
 	int res = duk_pcall(t, 1);
@@ -1982,8 +2344,8 @@ json_t *janus_duktape_handle_admin_message(json_t *message) {
 		/* Something went wrong... */
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		return NULL;
 	}
 	if(message_text != NULL)
@@ -1993,8 +2355,8 @@ json_t *janus_duktape_handle_admin_message(json_t *message) {
 	json_error_t error;
 	json_t *json = json_loads(response, 0, &error);
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(dh->ctx);
+	janus_mutex_unlock(&dh->mutex);
 	if(!json) {
 		JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 		return NULL;
@@ -2024,9 +2386,10 @@ void janus_duktape_setup_media(janus_plugin_session *handle) {
 	session->pli_latest = janus_get_monotonic_time();
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_heap *dh = session->heap;
+	janus_mutex_lock(&dh->mutex);
+	duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+	duk_context *t = duk_get_context(dh->ctx, thr_idx);
 	duk_get_global_string(t, "setupMedia");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -2035,8 +2398,8 @@ void janus_duktape_setup_media(janus_plugin_session *handle) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(dh->ctx);
+	janus_mutex_unlock(&dh->mutex);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -2051,11 +2414,34 @@ void janus_duktape_incoming_rtp(janus_plugin_session *handle, int video, char *b
 	if(g_atomic_int_get(&session->destroyed) || g_atomic_int_get(&session->hangingup))
 		return;
 	/* Check if the JS script wants to handle/manipulate RTP packets itself */
-	if(has_incoming_rtp) {
+	if(has_incoming_rtp_buffer) {
+		/* Yep, and without copying them: map the context buffer object on the packet */
+		janus_duktape_heap *dh = session->heap;
+		janus_mutex_lock(&dh->mutex);
+		duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+		duk_context *t = duk_get_context(dh->ctx, thr_idx);
+		duk_get_global_string(t, "incomingRtpBuffer");
+		duk_push_number(t, session->id);
+		duk_push_boolean(t, video);
+		janus_duktape_rtp_buffer_map(t, buf, len);
+		int res = duk_pcall(t, 3);
+		if(res != DUK_EXEC_SUCCESS) {
+			/* Something went wrong... */
+			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
+		}
+		duk_pop(t);
+		/* The packet belongs to the core: the script can't access it anymore */
+		janus_duktape_rtp_buffer_map(t, NULL, 0);
+		duk_pop(t);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
+		return;
+	} else if(has_incoming_rtp) {
 		/* Yep, pass the data to the JS script and return */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_heap *dh = session->heap;
+		janus_mutex_lock(&dh->mutex);
+		duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+		duk_context *t = duk_get_context(dh->ctx, thr_idx);
 		duk_get_global_string(t, "incomingRtp");
 		duk_push_number(t, session->id);
 		duk_push_boolean(t, video);
@@ -2067,8 +2453,8 @@ void janus_duktape_incoming_rtp(janus_plugin_session *handle, int video, char *b
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		return;
 	}
 	/* Is this session allowed to send media? */
@@ -2117,9 +2503,10 @@ void janus_duktape_incoming_rtcp(janus_plugin_session *handle, int video, char *
 	/* Check if the JS script wants to handle/manipulate RTCP packets itself */
 	if(has_incoming_rtcp) {
 		/* Yep, pass the data to the JS script and return */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_heap *dh = session->heap;
+		janus_mutex_lock(&dh->mutex);
+		duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+		duk_context *t = duk_get_context(dh->ctx, thr_idx);
 		duk_get_global_string(t, "incomingRtcp");
 		duk_push_number(t, session->id);
 		duk_push_boolean(t, video);
@@ -2131,8 +2518,8 @@ void janus_duktape_incoming_rtcp(janus_plugin_session *handle, int video, char *
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		return;
 	}
 	/* If a REMB arrived, make sure we cap it to our configuration, and send it as a video RTCP */
@@ -2176,9 +2563,10 @@ void janus_duktape_incoming_data(janus_plugin_session *handle, char *label, char
 	/* Check if the JS script wants to handle/manipulate data channel packets itself */
 	if(has_incoming_data) {
 		/* Yep, pass the data to the JS script and return */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_heap *dh = session->heap;
+		janus_mutex_lock(&dh->mutex);
+		duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+		duk_context *t = duk_get_context(dh->ctx, thr_idx);
 		duk_get_global_string(t, "incomingData");
 		duk_push_number(t, session->id);
 		duk_push_lstring(t, buf, len);
@@ -2189,8 +2577,8 @@ void janus_duktape_incoming_data(janus_plugin_session *handle, char *label, char
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 		return;
 	}
 	/* Is this session allowed to send data? */
@@ -2229,9 +2617,10 @@ void janus_duktape_slow_link(janus_plugin_session *handle, int uplink, int video
 	janus_refcount_increase(&session->ref);
 	if(has_slow_link) {
 		/* Notify the JS script */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_heap *dh = session->heap;
+		janus_mutex_lock(&dh->mutex);
+		duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+		duk_context *t = duk_get_context(dh->ctx, thr_idx);
 		duk_get_global_string(t, "slowLink");
 		duk_push_number(t, session->id);
 		duk_push_boolean(t, uplink);
@@ -2242,8 +2631,8 @@ void janus_duktape_slow_link(janus_plugin_session *handle, int uplink, int video
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(dh->ctx);
+		janus_mutex_unlock(&dh->mutex);
 	}
 	janus_refcount_decrease(&session->ref);
 }
@@ -2295,9 +2684,10 @@ void janus_duktape_hangup_media(janus_plugin_session *handle) {
 	janus_mutex_unlock(&session->recipients_mutex);
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_heap *dh = session->heap;
+	janus_mutex_lock(&dh->mutex);
+	duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+	duk_context *t = duk_get_context(dh->ctx, thr_idx);
 	duk_get_global_string(t, "hangupMedia");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -2306,8 +2696,8 @@ void janus_duktape_hangup_media(janus_plugin_session *handle) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(dh->ctx);
+	janus_mutex_unlock(&dh->mutex);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -2365,17 +2755,23 @@ static void *janus_duktape_scheduler(void *data) {
 		if(event == GUINT_TO_POINTER(janus_duktape_event_exit))
 			break;
 		if(event == GUINT_TO_POINTER(janus_duktape_event_resume)) {
-			/* There are coroutines to resume */
-			janus_mutex_lock(&duktape_mutex);
-			duk_get_global_string(duktape_ctx, "resumeScheduler");
-			int res = duk_pcall(duktape_ctx, 0);
-			if(res != DUK_EXEC_SUCCESS) {
-				JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(duktape_ctx, -1));
+			/* There are coroutines to resume: check which heaps they belong to */
+			guint i = 0;
+			for(i=0; i<duktape_heaps_num; i++) {
+				janus_duktape_heap *dh = &duktape_heaps[i];
+				if(!g_atomic_int_compare_and_exchange(&dh->resume, 1, 0))
+					continue;
+				janus_mutex_lock(&dh->mutex);
+				duk_get_global_string(dh->ctx, "resumeScheduler");
+				int res = duk_pcall(dh->ctx, 0);
+				if(res != DUK_EXEC_SUCCESS) {
+					JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(dh->ctx, -1));
+				}
+				duk_pop(dh->ctx);
+				/* Print the count of elements into Duktape stack */
+				janus_duktape_stackdump(dh->ctx);
+				janus_mutex_unlock(&dh->mutex);
 			}
-			duk_pop(duktape_ctx);
-			/* Print the count of elements into Duktape stack */
-			janus_duktape_stackdump(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
 		}
 	}
 	JANUS_LOG(LOG_VERB, "Leaving Duktape scheduler thread\n");
@@ -2403,9 +2799,10 @@ static gboolean janus_duktape_timer_cb(void *data) {
 		return FALSE;
 	/* Invoke the callback with the provided argument, if available */
 	JANUS_LOG(LOG_VERB, "Invoking scheduled callback (waited %"SCNu32"ms) with ID %u\n", cb->ms, cb->id);
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_heap *dh = cb->heap;
+	janus_mutex_lock(&dh->mutex);
+	duk_idx_t thr_idx = duk_push_thread(dh->ctx);
+	duk_context *t = duk_get_context(dh->ctx, thr_idx);
 	duk_get_global_string(t, cb->function);
 	if(cb->argument) {
 		duk_push_string(t, cb->argument);
@@ -2415,8 +2812,8 @@ static gboolean janus_duktape_timer_cb(void *data) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(dh->ctx);
+	janus_mutex_unlock(&dh->mutex);
 	/* Done */
 	g_source_destroy(cb->source);
 	g_source_unref(cb->source);
@@ -43,14 +43,26 @@
 extern volatile gint duktape_initialized, duktape_stopping;
 extern janus_callbacks *janus_core;
 
-/* Duktape context: we define context and mutex as extern */
-extern duk_context *duktape_ctx;
-extern janus_mutex duktape_mutex;
+/* Duktape heaps: the plugin can run a pool of independent heaps, each
+ * with its own copy of the script and its own lock, with sessions pinned
+ * to one of them depending on their ID (only one heap by default) */
+typedef struct janus_duktape_heap {
+	guint index;						/* Index of this heap in the pool */
+	duk_context *ctx;					/* The Duktape context of this heap */
+	janus_mutex mutex;					/* Mutex to lock the heap (Duktape is not thread safe) */
+	volatile gint resume;				/* Whether the scheduler should call resumeScheduler() on this heap */
+	volatile gint sessions;				/* How many sessions are pinned to this heap */
+} janus_duktape_heap;
+extern janus_duktape_heap *duktape_heaps;
+extern guint duktape_heaps_num;
+/* Helper to get the janus_duktape_heap instance a Duktape context (or thread) belongs to */
+janus_duktape_heap *janus_duktape_heap_get(duk_context *ctx);
 
 /* Duktape session: we keep only the barebone stuff here, the rest will be in the JavaScript script */
 typedef struct janus_duktape_session {
 	janus_plugin_session *handle;		/* Pointer to the core-plugin session */
 	uint32_t id;						/* Unique session ID (will be used to correlate with the JavaScript script) */
+	janus_duktape_heap *heap;			/* Duktape heap this session is pinned to */
 	/* The following are only needed for media manipulation, feedback and routing, and may not all be used */
 	gboolean accept_audio;				/* Whether incoming audio can be accepted or must be dropped */
 	gboolean accept_video;				/* Whether incoming video can be accepted or must be dropped */
@@ -94,7 +94,8 @@
  * - \c startRecording(): start recording audio, video and or data for a user;
  * - \c stopRecording(): start recording audio, video and or data for a user;
  * - \c pokeScheduler(): notify the C code that there's a coroutine to resume;
- * - \c timeCallback(): trigger the execution of a Lua function after X milliseconds.
+ * - \c timeCallback(): trigger the execution of a Lua function after X milliseconds;
+ * - \c setSharedData(), \c getSharedData() and \c removeSharedData(): access data shared by all Lua states (see \ref luastates).
  *
  * As anticipated in the previous section, almost all these methods also
  * expect the unique session identifier to address a specific user in the
@@ -179,6 +180,72 @@ timeCallback("resumeScheduler", nil, 0)
  * compact and less verbose, and as such is preferred in cases where
  * timing and opaque arguments are not needed.
  *
+ * \section luabuffers Zero-copy RTP buffers
+ *
+ * When a script implements \c incomingRtp(), each packet is copied to
+ * a Lua string before being passed to the script, and copied again when
+ * the script relays it via \c relayRtp(). To avoid those copies, scripts
+ * can implement \c incomingRtpBuffer(id, video, buffer) instead: when
+ * present, it's invoked in place of \c incomingRtp(), and \c buffer is
+ * a lightweight object wrapping the original packet. The object exposes
+ * the \c seq \c ts \c ssrc \c pt and \c marker properties of the RTP
+ * header, which can be read and modified, the read-only \c length
+ * \c payloadOffset and \c payloadLength properties, and the following
+ * methods to access the payload:
+ *
+ * - \c buffer:byte(i): return the i-th byte of the payload (starting from 1);
+ * - \c buffer:setByte(i, value): overwrite the i-th byte of the payload;
+ * - \c buffer:payload(): return a copy of the payload as a Lua string.
+ *
+ * The same buffer can be passed to \c relayRtp(id, video, buffer), in
+ * which case no length is needed. Notice that the buffer belongs to the
+ * C code and is only valid while \c incomingRtpBuffer() is running: any
+ * attempt to access it afterwards (e.g., from a coroutine) raises an
+ * error, which means scripts must copy whatever they need to keep.
+ *
+ * \section luastates Multiple Lua states
+ *
+ * By default, the plugin loads the script in a single Lua state, which
+ * means that all the callbacks (including \c incomingRtp() and the other
+ * media related ones, when implemented) are serialized, no matter which
+ * session they're for. When scripts handle media themselves, this can
+ * quickly become a bottleneck: to address this, you can set the \c states
+ * property in the plugin configuration to create a pool of independent
+ * Lua states, each loading its own copy of the script. Sessions are
+ * then pinned to one of the states depending on their ID, which means
+ * that all the callbacks for a specific session will always be invoked
+ * on the same state, and that callbacks for sessions pinned to different
+ * states can be executed at the same time.
+ *
+ * Since states don't share anything, \c init() and \c destroy() are
+ * invoked once per state, and a script cannot assume it will see all
+ * sessions: any data that needs to be accessed across sessions pinned
+ * to different states must be stored using the following functions,
+ * which the C code exposes to all states:
+ *
+ * - \c setSharedData(key, value): store a string value with the provided key (\c nil removes it);
+ * - \c getSharedData(key): return the value stored with the provided key, or \c nil if missing;
+ * - \c removeSharedData(key): remove the value stored with the provided key, if any.
+ *
+ * Both keys and values are strings, which means structured data must
+ * be serialized (e.g., as JSON) by the script. Scheduled callbacks and
+ * coroutines resumed via \c pokeScheduler() are always executed on the
+ * same state that requested them. The CPU time spent in each state can be
+ * retrieved with a \c lua_states request via Admin API, which is handled
+ * by the C code before passing anything to \c handleAdminMessage():
+ *
+ * \verbatim
+{
+	"request" : "lua_states"
+}
+\endverbatim
+ *
+ * The response will contain a \c states array, with the \c index,
+ * number of \c sessions, number of \c calls and overall \c cpu_time
+ * (in microseconds) for each state in the pool. To keep the overhead
+ * low, the CPU time spent in media callbacks (e.g., \c incomingRtp ) is
+ * estimated by only measuring one call out of 64.
+ *
  * Refer to the \ref luapapi section for more information on how you
  * can register your own C functions.
  */
@@ -260,8 +327,11 @@ volatile gint lua_initialized = 0, lua_stopping = 0;
 janus_callbacks *janus_core = NULL;
 
 /* Lua stuff */
-lua_State *lua_state = NULL;
-janus_mutex lua_mutex = JANUS_MUTEX_INITIALIZER;
+janus_lua_state *lua_states = NULL;
+guint lua_states_num = 1;
+/* Data the script can share across states */
+static GHashTable *lua_shared_data = NULL;
+static janus_mutex lua_shared_data_mutex = JANUS_MUTEX_INITIALIZER;
 static const char *lua_functions[] = {
 	"init", "destroy", "resumeScheduler",
 	"createSession", "destroySession", "querySession",
@@ -284,6 +354,7 @@ static gboolean has_get_package = FALSE;
 static char *lua_script_package = NULL;
 static gboolean has_handle_admin_message = FALSE;
 static gboolean has_incoming_rtp = FALSE;
+static gboolean has_incoming_rtp_buffer = FALSE;
 static gboolean has_incoming_rtcp = FALSE;
 static gboolean has_incoming_data = FALSE;
 static gboolean has_slow_link = FALSE;
@@ -304,6 +375,7 @@ static void *janus_lua_timer(void *data);
 static gboolean janus_lua_timer_cb(void *data);
 typedef struct janus_lua_callback {
 	guint id;
+	janus_lua_state *state;
 	uint32_t ms;
 	GSource *source;
 	char *function;
@@ -316,6 +388,160 @@ static void janus_lua_stackdump(lua_State* l) {
     JANUS_LOG(LOG_HUGE, "Total in lua stack %d\n", top);
 }
 
+/* Helpers to manage the Lua states */
+static gint64 janus_lua_thread_cpu_time(void) {
+	struct timespec ts;
+	if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0)
+		return 0;
+	return (ts.tv_sec*G_GINT64_CONSTANT(1000000)) + (ts.tv_nsec/G_GINT64_CONSTANT(1000));
+}
+
+void janus_lua_state_lock(janus_lua_state *ls) {
+	janus_mutex_lock(&ls->mutex);
+	ls->cpu_weight = 1;
+	ls->cpu_started = janus_lua_thread_cpu_time();
+}
+
+/* Reading the thread CPU clock is a syscall, which we don't want to do for
+ * each packet: for media callbacks we only measure one call every so often,
+ * and account for the ones we skipped using what that call took */
+#define JANUS_LUA_CPU_SAMPLING	64
+void janus_lua_state_lock_media(janus_lua_state *ls) {
+	janus_mutex_lock(&ls->mutex);
+	if(ls->calls % JANUS_LUA_CPU_SAMPLING == 0) {
+		ls->cpu_weight = JANUS_LUA_CPU_SAMPLING;
+		ls->cpu_started = janus_lua_thread_cpu_time();
+	} else {
+		ls->cpu_weight = 0;
+	}
+}
+
+void janus_lua_state_unlock(janus_lua_state *ls) {
+	if(ls->cpu_weight > 0)
+		ls->cpu_time += (janus_lua_thread_cpu_time() - ls->cpu_started) * ls->cpu_weight;
+	ls->calls++;
+	janus_mutex_unlock(&ls->mutex);
+}
+
+janus_lua_state *janus_lua_state_get(lua_State *s) {
+	/* We store a pointer to our state in the registry, which is shared by all threads */
+	lua_getfield(s, LUA_REGISTRYINDEX, "janus_lua_state");
+	janus_lua_state *ls = (janus_lua_state *)lua_touserdata(s, -1);
+	lua_pop(s, 1);
+	return ls ? ls : &lua_states[0];
+}
+
+/* Zero-copy RTP buffers: each state has a single instance, which wraps
+ * the packet being passed to incomingRtpBuffer() and is reset afterwards */
+#define JANUS_LUA_RTP_BUFFER	"janus.rtpbuffer"
+typedef struct janus_lua_rtp_buffer {
+	char *buffer;
+	int length;
+} janus_lua_rtp_buffer;
+
+static janus_lua_rtp_buffer *janus_lua_rtp_buffer_check(lua_State *s, int index) {
+	janus_lua_rtp_buffer *rb = (janus_lua_rtp_buffer *)luaL_checkudata(s, index, JANUS_LUA_RTP_BUFFER);
+	if(rb->buffer == NULL)
+		luaL_error(s, "RTP buffer is not valid anymore");
+	return rb;
+}
+
+/* Helper to get the (1-based) payload index a script wants to access */
+static char *janus_lua_rtp_buffer_payload_byte(lua_State *s, janus_lua_rtp_buffer *rb) {
+	int plen = 0;
+	char *payload = janus_rtp_payload(rb->buffer, rb->length, &plen);
+	int index = luaL_checkinteger(s, 2);
+	if(payload == NULL || index < 1 || index > plen)
+		luaL_error(s, "Invalid payload index %d", index);
+	return payload + index - 1;
+}
+
+static int janus_lua_rtp_buffer_byte(lua_State *s) {
+	janus_lua_rtp_buffer *rb = janus_lua_rtp_buffer_check(s, 1);
+	char *byte = janus_lua_rtp_buffer_payload_byte(s, rb);
+	lua_pushinteger(s, (uint8_t)*byte);
+	return 1;
+}
+
+static int janus_lua_rtp_buffer_setbyte(lua_State *s) {
+	janus_lua_rtp_buffer *rb = janus_lua_rtp_buffer_check(s, 1);
+	char *byte = janus_lua_rtp_buffer_payload_byte(s, rb);
+	*byte = (char)luaL_checkinteger(s, 3);
+	return 0;
+}
+
+static int janus_lua_rtp_buffer_payload(lua_State *s) {
+	janus_lua_rtp_buffer *rb = janus_lua_rtp_buffer_check(s, 1);
+	int plen = 0;
+	char *payload = janus_rtp_payload(rb->buffer, rb->length, &plen);
+	if(payload == NULL)
+		lua_pushnil(s);
+	else
+		lua_pushlstring(s, payload, plen);
+	return 1;
+}
+
+static int janus_lua_rtp_buffer_index(lua_State *s) {
+	janus_lua_rtp_buffer *rb = janus_lua_rtp_buffer_check(s, 1);
+	const char *key = luaL_checkstring(s, 2);
+	rtp_header *rtp = (rtp_header *)rb->buffer;
+	if(!strcmp(key, "seq")) {
+		lua_pushinteger(s, ntohs(rtp->seq_number));
+	} else if(!strcmp(key, "ts")) {
+		lua_pushinteger(s, ntohl(rtp->timestamp));
+	} else if(!strcmp(key, "ssrc")) {
+		lua_pushinteger(s, ntohl(rtp->ssrc));
+	} else if(!strcmp(key, "pt")) {
+		lua_pushinteger(s, rtp->type);
+	} else if(!strcmp(key, "marker")) {
+		lua_pushboolean(s, rtp->markerbit);
+	} else if(!strcmp(key, "length")) {
+		lua_pushinteger(s, rb->length);
+	} else if(!strcmp(key, "payloadOffset") || !strcmp(key, "payloadLength")) {
+		int plen = 0;
+		char *payload = janus_rtp_payload(rb->buffer, rb->length, &plen);
+		if(payload == NULL)
+			lua_pushnil(s);
+		else
+			lua_pushinteger(s, !strcmp(key, "payloadLength") ? plen : (int)(payload - rb->buffer));
+	} else if(!strcmp(key, "byte")) {
+		lua_pushcfunction(s, janus_lua_rtp_buffer_byte);
+	} else if(!strcmp(key, "setByte")) {
+		lua_pushcfunction(s, janus_lua_rtp_buffer_setbyte);
+	} else if(!strcmp(key, "payload")) {
+		lua_pushcfunction(s, janus_lua_rtp_buffer_payload);
+	} else {
+		lua_pushnil(s);
+	}
+	return 1;
+}
+
+static int janus_lua_rtp_buffer_newindex(lua_State *s) {
+	janus_lua_rtp_buffer *rb = janus_lua_rtp_buffer_check(s, 1);
+	const char *key = luaL_checkstring(s, 2);
+	rtp_header *rtp = (rtp_header *)rb->buffer;
+	if(!strcmp(key, "seq")) {
+		rtp->seq_number = htons((uint16_t)luaL_checkinteger(s, 3));
+	} else if(!strcmp(key, "ts")) {
+		rtp->timestamp = htonl((uint32_t)luaL_checkinteger(s, 3));
+	} else if(!strcmp(key, "ssrc")) {
+		rtp->ssrc = htonl((uint32_t)luaL_checkinteger(s, 3));
+	} else if(!strcmp(key, "pt")) {
+		rtp->type = (uint8_t)luaL_checkinteger(s, 3) & 0x7F;
+	} else if(!strcmp(key, "marker")) {
+		rtp->markerbit = lua_toboolean(s, 3) ? 1 : 0;
+	} else {
+		return luaL_error(s, "Can't set property '%s' on an RTP buffer", key);
+	}
+	return 0;
+}
+
+static int janus_lua_rtp_buffer_len(lua_State *s) {
+	janus_lua_rtp_buffer *rb = janus_lua_rtp_buffer_check(s, 1);
+	lua_pushinteger(s, rb->length);
+	return 1;
+}
+
 /* janus_lua_session is defined in janus_lua_data.h, but it's managed here */
 GHashTable *lua_sessions, *lua_ids;
 janus_mutex lua_sessions_mutex = JANUS_MUTEX_INITIALIZER;
@@ -330,6 +556,8 @@ static void janus_lua_session_free(const janus_refcount *session_ref) {
 	janus_lua_session *session = janus_refcount_containerof(session_ref, janus_lua_session, ref);
 	/* Remove the reference to the core plugin session */
 	janus_refcount_decrease(&session->handle->ref);
+	if(session->state != NULL)
+		g_atomic_int_add(&session->state->sessions, -1);
 	/* This session can be destroyed, free all the resources */
 	g_hash_table_remove(lua_ids, GUINT_TO_POINTER(session->id));
 	janus_recorder_destroy(session->arc);
@@ -402,6 +630,8 @@ static int janus_lua_method_januslog(lua_State *s) {
 
 static int janus_lua_method_pokescheduler(lua_State *s) {
 	/* This method allows the Lua script to poke the scheduler and have it wake up ASAP */
+	janus_lua_state *ls = janus_lua_state_get(s);
+	g_atomic_int_set(&ls->resume, 1);
 	g_async_queue_push(events, GUINT_TO_POINTER(janus_lua_event_resume));
 	lua_pushnumber(s, 0);
 	return 1;
@@ -425,6 +655,7 @@ static int janus_lua_method_timecallback(lua_State *s) {
 	guint32 ms = lua_tonumber(s, 3);
 	/* Create a callback instance */
 	janus_lua_callback *cb = g_malloc0(sizeof(janus_lua_callback));
+	cb->state = janus_lua_state_get(s);
 	cb->function = g_strdup(function);
 	if(argument != NULL)
 		cb->argument = g_strdup(argument);
@@ -438,6 +669,76 @@ static int janus_lua_method_timecallback(lua_State *s) {
 	return 1;
 }
 
+static int janus_lua_method_setshareddata(lua_State *s) {
+	/* This method allows the Lua script to store data all states can access */
+	int n = lua_gettop(s);
+	if(n != 2) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 2)\n", n);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	const char *key = lua_tostring(s, 1);
+	if(key == NULL) {
+		JANUS_LOG(LOG_ERR, "Invalid argument (missing key)\n");
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	const char *value = lua_tostring(s, 2);
+	janus_mutex_lock(&lua_shared_data_mutex);
+	if(value == NULL)
+		g_hash_table_remove(lua_shared_data, key);
+	else
+		g_hash_table_insert(lua_shared_data, g_strdup(key), g_strdup(value));
+	janus_mutex_unlock(&lua_shared_data_mutex);
+	lua_pushnumber(s, 0);
+	return 1;
+}
+
+static int janus_lua_method_getshareddata(lua_State *s) {
+	/* This method allows the Lua script to retrieve data stored by any state */
+	int n = lua_gettop(s);
+	if(n != 1) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 1)\n", n);
+		lua_pushnil(s);
+		return 1;
+	}
+	const char *key = lua_tostring(s, 1);
+	if(key == NULL) {
+		JANUS_LOG(LOG_ERR, "Invalid argument (missing key)\n");
+		lua_pushnil(s);
+		return 1;
+	}
+	janus_mutex_lock(&lua_shared_data_mutex);
+	const char *value = g_hash_table_lookup(lua_shared_data, key);
+	if(value == NULL)
+		lua_pushnil(s);
+	else
+		lua_pushstring(s, value);
+	janus_mutex_unlock(&lua_shared_data_mutex);
+	return 1;
+}
+
+static int janus_lua_method_removeshareddata(lua_State *s) {
+	/* This method allows the Lua script to remove data shared by all states */
+	int n = lua_gettop(s);
+	if(n != 1) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 1)\n", n);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	const char *key = lua_tostring(s, 1);
+	if(key == NULL) {
+		JANUS_LOG(LOG_ERR, "Invalid argument (missing key)\n");
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	janus_mutex_lock(&lua_shared_data_mutex);
+	g_hash_table_remove(lua_shared_data, key);
+	janus_mutex_unlock(&lua_shared_data_mutex);
+	lua_pushnumber(s, 0);
+	return 1;
+}
+
 static int janus_lua_method_pushevent(lua_State *s) {
 	/* Get the arguments from the provided state */
 	int n = lua_gettop(s);
@@ -850,15 +1151,24 @@ static int janus_lua_method_sendpli(lua_State *s) {
 static int janus_lua_method_relayrtp(lua_State *s) {
 	/* Get the arguments from the provided state */
 	int n = lua_gettop(s);
-	if(n != 4) {
-		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 4)\n", n);
+	if(n != 3 && n != 4) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 3 or 4)\n", n);
 		lua_pushnumber(s, -1);
 		return 1;
 	}
 	guint32 id = lua_tonumber(s, 1);
 	int is_video = lua_toboolean(s, 2);
-	const char *payload = lua_tostring(s, 3);
-	int len = lua_tonumber(s, 4);
+	/* The packet may be a string, or a buffer we passed to incomingRtpBuffer() */
+	const char *payload = NULL;
+	int len = 0;
+	janus_lua_rtp_buffer *rb = (janus_lua_rtp_buffer *)luaL_testudata(s, 3, JANUS_LUA_RTP_BUFFER);
+	if(rb != NULL) {
+		payload = rb->buffer;
+		len = rb->length;
+	} else if(n == 4) {
+		payload = lua_tostring(s, 3);
+		len = lua_tonumber(s, 4);
+	}
 	if(!payload || len < 1) {
 		JANUS_LOG(LOG_ERR, "Invalid payload\n");
 		lua_pushnumber(s, -1);
@@ -1095,6 +1405,109 @@ static int janus_lua_method_stoprecording(lua_State *s) {
 
 
 /* Plugin implementation */
+/* Helper to create a new Lua state, register our functions and load the script in it */
+static int janus_lua_state_setup(janus_lua_state *ls, const char *lua_folder, const char *lua_file) {
+	ls->state = luaL_newstate();
+	luaL_openlibs(ls->state);
+	/* Keep track of which state this is, so that our methods can find it */
+	lua_pushlightuserdata(ls->state, ls);
+	lua_setfield(ls->state, LUA_REGISTRYINDEX, "janus_lua_state");
+
+	if(lua_folder != NULL) {
+		/* Add the script folder to the path, so that we can load other scripts from there */
+		lua_getglobal(ls->state, "package");
+		lua_getfield(ls->state, -1, "path");
+		const char *cur_path = lua_tostring(ls->state, -1);
+		char new_path[1024];
+		memset(new_path, 0, sizeof(new_path));
+		g_snprintf(new_path, sizeof(new_path), "%s;%s/?.lua", cur_path, lua_folder);
+		lua_pop(ls->state, 1);
+		lua_pushstring(ls->state, new_path);
+		lua_setfield(ls->state, -2, "path");
+		lua_pop(ls->state, 1);
+	}
+
+	/* Register our functions */
+	lua_register(ls->state, "janusLog", janus_lua_method_januslog);
+	lua_register(ls->state, "pokeScheduler", janus_lua_method_pokescheduler);
+	lua_register(ls->state, "timeCallback", janus_lua_method_timecallback);
+	lua_register(ls->state, "setSharedData", janus_lua_method_setshareddata);
+	lua_register(ls->state, "getSharedData", janus_lua_method_getshareddata);
+	lua_register(ls->state, "removeSharedData", janus_lua_method_removeshareddata);
+	lua_register(ls->state, "pushEvent", janus_lua_method_pushevent);
+	lua_register(ls->state, "notifyEvent", janus_lua_method_notifyevent);
+	lua_register(ls->state, "eventsIsEnabled", janus_lua_method_eventsisenabled);
+	lua_register(ls->state, "closePc", janus_lua_method_closepc);
+	lua_register(ls->state, "endSession", janus_lua_method_endsession);
+	lua_register(ls->state, "configureMedium", janus_lua_method_configuremedium);
+	lua_register(ls->state, "addRecipient", janus_lua_method_addrecipient);
+	lua_register(ls->state, "removeRecipient", janus_lua_method_removerecipient);
+	lua_register(ls->state, "setBitrate", janus_lua_method_setbitrate);
+	lua_register(ls->state, "setPliFreq", janus_lua_method_setplifreq);
+	lua_register(ls->state, "sendPli", janus_lua_method_sendpli);
+	lua_register(ls->state, "relayRtp", janus_lua_method_relayrtp);
+	lua_register(ls->state, "relayRtcp", janus_lua_method_relayrtcp);
+	lua_register(ls->state, "relayData", janus_lua_method_relaydata);
+	lua_register(ls->state, "startRecording", janus_lua_method_startrecording);
+	lua_register(ls->state, "stopRecording", janus_lua_method_stoprecording);
+	/* Register all extra functions, if any were added */
+	janus_lua_register_extra_functions(ls->state);
+	/* Prepare the RTP buffer type, and the instance we'll reuse for all packets */
+	luaL_newmetatable(ls->state, JANUS_LUA_RTP_BUFFER);
+	lua_pushcfunction(ls->state, janus_lua_rtp_buffer_index);
+	lua_setfield(ls->state, -2, "__index");
+	lua_pushcfunction(ls->state, janus_lua_rtp_buffer_newindex);
+	lua_setfield(ls->state, -2, "__newindex");
+	lua_pushcfunction(ls->state, janus_lua_rtp_buffer_len);
+	lua_setfield(ls->state, -2, "__len");
+	lua_pop(ls->state, 1);
+	janus_lua_rtp_buffer *rb = (janus_lua_rtp_buffer *)lua_newuserdata(ls->state, sizeof(janus_lua_rtp_buffer));
+	rb->buffer = NULL;
+	rb->length = 0;
+	luaL_setmetatable(ls->state, JANUS_LUA_RTP_BUFFER);
+	lua_setfield(ls->state, LUA_REGISTRYINDEX, "janus_lua_rtp_buffer");
+
+	/* Now load the script */
+	int err = luaL_dofile(ls->state, lua_file);
+	if(err) {
+		JANUS_LOG(LOG_ERR, "Error loading Lua script %s: %s\n", lua_file, lua_tostring(ls->state, -1));
+		lua_close(ls->state);
+		ls->state = NULL;
+		return -1;
+	}
+	/* Make sure that all the functions we need are there */
+	uint i=0;
+	for(i=0; i<lua_funcsize; i++) {
+		lua_getglobal(ls->state, lua_functions[i]);
+		if(lua_isfunction(ls->state, lua_gettop(ls->state)) == 0) {
+			JANUS_LOG(LOG_ERR, "Function '%s' is missing in %s\n", lua_functions[i], lua_file);
+			lua_close(ls->state);
+			ls->state = NULL;
+			return -1;
+		}
+		lua_pop(ls->state, 1);
+	}
+	return 0;
+}
+
+/* Helper to close all the Lua states we created */
+static void janus_lua_states_close(void) {
+	if(lua_states == NULL)
+		return;
+	guint i = 0;
+	for(i=0; i<lua_states_num; i++) {
+		janus_lua_state *ls = &lua_states[i];
+		janus_mutex_lock(&ls->mutex);
+		if(ls->state != NULL)
+			lua_close(ls->state);
+		ls->state = NULL;
+		janus_mutex_unlock(&ls->mutex);
+		janus_mutex_destroy(&ls->mutex);
+	}
+	g_free(lua_states);
+	lua_states = NULL;
+}
+
 int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	if(g_atomic_int_get(&lua_stopping)) {
 		/* Still stopping from before */
@@ -1139,70 +1552,35 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	janus_config_item *conf = janus_config_get(config, config_general, janus_config_type_item, "config");
 	if(conf && conf->value)
 		lua_config = g_strdup(conf->value);
-	janus_config_destroy(config);
-
-	/* Initialize Lua */
-	lua_state = luaL_newstate();
-	luaL_openlibs(lua_state);
-
-	if(lua_folder != NULL) {
-		/* Add the script folder to the path, so that we can load other scripts from there */
-		lua_getglobal(lua_state, "package");
-		lua_getfield(lua_state, -1, "path");
-		const char *cur_path = lua_tostring(lua_state, -1);
-		char new_path[1024];
-		memset(new_path, 0, sizeof(new_path));
-		g_snprintf(new_path, sizeof(new_path), "%s;%s/?.lua", cur_path, lua_folder);
-		lua_pop(lua_state, 1);
-		lua_pushstring(lua_state, new_path);
-		lua_setfield(lua_state, -2, "path");
-		lua_pop(lua_state, 1);
+	lua_states_num = 1;
+	janus_config_item *states = janus_config_get(config, config_general, janus_config_type_item, "states");
+	if(states && states->value) {
+		int num = atoi(states->value);
+		if(num < 1) {
+			JANUS_LOG(LOG_WARN, "Invalid number of Lua states (%s), using 1\n", states->value);
+		} else {
+			lua_states_num = num;
+		}
 	}
+	janus_config_destroy(config);
 
-	/* Register our functions */
-	lua_register(lua_state, "janusLog", janus_lua_method_januslog);
-	lua_register(lua_state, "pokeScheduler", janus_lua_method_pokescheduler);
-	lua_register(lua_state, "timeCallback", janus_lua_method_timecallback);
-	lua_register(lua_state, "pushEvent", janus_lua_method_pushevent);
-	lua_register(lua_state, "notifyEvent", janus_lua_method_notifyevent);
-	lua_register(lua_state, "eventsIsEnabled", janus_lua_method_eventsisenabled);
-	lua_register(lua_state, "closePc", janus_lua_method_closepc);
-	lua_register(lua_state, "endSession", janus_lua_method_endsession);
-	lua_register(lua_state, "configureMedium", janus_lua_method_configuremedium);
-	lua_register(lua_state, "addRecipient", janus_lua_method_addrecipient);
-	lua_register(lua_state, "removeRecipient", janus_lua_method_removerecipient);
-	lua_register(lua_state, "setBitrate", janus_lua_method_setbitrate);
-	lua_register(lua_state, "setPliFreq", janus_lua_method_setplifreq);
-	lua_register(lua_state, "sendPli", janus_lua_method_sendpli);
-	lua_register(lua_state, "relayRtp", janus_lua_method_relayrtp);
-	lua_register(lua_state, "relayRtcp", janus_lua_method_relayrtcp);
-	lua_register(lua_state, "relayData", janus_lua_method_relaydata);
-	lua_register(lua_state, "startRecording", janus_lua_method_startrecording);
-	lua_register(lua_state, "stopRecording", janus_lua_method_stoprecording);
-	/* Register all extra functions, if any were added */
-	janus_lua_register_extra_functions(lua_state);
-
-	/* Now load the script */
-	int err = luaL_dofile(lua_state, lua_file);
-	if(err) {
-		JANUS_LOG(LOG_ERR, "Error loading Lua script %s: %s\n", lua_file, lua_tostring(lua_state, -1));
-		lua_close(lua_state);
-		g_free(lua_folder);
-		g_free(lua_file);
-		return -1;
-	}
-	/* Make sure that all the functions we need are there */
+	/* Initialize Lua: we create as many states as we were asked to */
+	JANUS_LOG(LOG_VERB, "Creating %u Lua state(s)\n", lua_states_num);
+	lua_states = g_malloc0(lua_states_num * sizeof(janus_lua_state));
 	uint i=0;
-	for(i=0; i<lua_funcsize; i++) {
-		lua_getglobal(lua_state, lua_functions[i]);
-		if(lua_isfunction(lua_state, lua_gettop(lua_state)) == 0) {
-			JANUS_LOG(LOG_ERR, "Function '%s' is missing in %s\n", lua_functions[i], lua_file);
-			lua_close(lua_state);
+	for(i=0; i<lua_states_num; i++) {
+		lua_states[i].index = i;
+		janus_mutex_init(&lua_states[i].mutex);
+		if(janus_lua_state_setup(&lua_states[i], lua_folder, lua_file) < 0) {
+			janus_lua_states_close();
 			g_free(lua_folder);
 			g_free(lua_file);
+			g_free(lua_config);
 			return -1;
 		}
 	}
+	/* All states load the same script, so we can check the first one */
+	lua_State *lua_state = lua_states[0].state;
 	/* Some Lua functions are optional (e.g., those to directly handle RTP, RTCP and
 	 * data, as those will typically be kept at a C level, with Lua only dictating
 	 * the logic, or those overriding the plugin namespace and versioning information */
@@ -1230,6 +1608,9 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	lua_getglobal(lua_state, "incomingRtp");
 	if(lua_isfunction(lua_state, lua_gettop(lua_state)) != 0)
 		has_incoming_rtp = TRUE;
+	lua_getglobal(lua_state, "incomingRtpBuffer");
+	if(lua_isfunction(lua_state, lua_gettop(lua_state)) != 0)
+		has_incoming_rtp_buffer = TRUE;
 	lua_getglobal(lua_state, "incomingRtcp");
 	if(lua_isfunction(lua_state, lua_gettop(lua_state)) != 0)
 		has_incoming_rtcp = TRUE;
@@ -1239,9 +1620,11 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	lua_getglobal(lua_state, "slowLink");
 	if(lua_isfunction(lua_state, lua_gettop(lua_state)) != 0)
 		has_slow_link = TRUE;
+	lua_settop(lua_state, 0);
 
 	lua_sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_lua_session_destroy);
 	lua_ids = g_hash_table_new(NULL, NULL);
+	lua_shared_data = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
 	events = g_async_queue_new();
 
 	g_atomic_int_set(&lua_initialized, 1);
@@ -1253,7 +1636,7 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 		g_atomic_int_set(&lua_initialized, 0);
 		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Lua scheduler thread...\n",
 			error->code, error->message ? error->message : "??");
-		lua_close(lua_state);
+		janus_lua_states_close();
 		g_free(lua_folder);
 		g_free(lua_file);
 		g_free(lua_config);
@@ -1271,7 +1654,7 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 			g_main_loop_unref(timer_loop);
 		if(timer_context != NULL)
 			g_main_context_unref(timer_context);
-		lua_close(lua_state);
+		janus_lua_states_close();
 		g_free(lua_folder);
 		g_free(lua_file);
 		g_free(lua_config);
@@ -1281,10 +1664,15 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	janus_core = callback;
 
-	/* Init the Lua script, in case it's needed */
-	lua_getglobal(lua_state, "init");
-	lua_pushstring(lua_state, lua_config);
-	lua_call(lua_state, 1, 0);
+	/* Init the Lua script in all states, in case it's needed */
+	for(i=0; i<lua_states_num; i++) {
+		janus_lua_state *ls = &lua_states[i];
+		janus_lua_state_lock(ls);
+		lua_getglobal(ls->state, "init");
+		lua_pushstring(ls->state, lua_config);
+		lua_call(ls->state, 1, 0);
+		janus_lua_state_unlock(ls);
+	}
 
 	g_free(lua_folder);
 	g_free(lua_file);
@@ -1319,11 +1707,15 @@ void janus_lua_destroy(void) {
 		timer_context = NULL;
 	}
 
-	/* Deinit the Lua script, in case it's needed */
-	janus_mutex_lock(&lua_mutex);
-	lua_getglobal(lua_state, "destroy");
-	lua_call(lua_state, 0, 0);
-	janus_mutex_unlock(&lua_mutex);
+	/* Deinit the Lua script in all states, in case it's needed */
+	guint i = 0;
+	for(i=0; i<lua_states_num; i++) {
+		janus_lua_state *ls = &lua_states[i];
+		janus_lua_state_lock(ls);
+		lua_getglobal(ls->state, "destroy");
+		lua_call(ls->state, 0, 0);
+		janus_lua_state_unlock(ls);
+	}
 
 	janus_mutex_lock(&lua_sessions_mutex);
 	g_hash_table_destroy(lua_sessions);
@@ -1334,10 +1726,11 @@ void janus_lua_destroy(void) {
 	events = NULL;
 	janus_mutex_unlock(&lua_sessions_mutex);
 
-	janus_mutex_lock(&lua_mutex);
-	lua_close(lua_state);
-	lua_state = NULL;
-	janus_mutex_unlock(&lua_mutex);
+	janus_lua_states_close();
+	janus_mutex_lock(&lua_shared_data_mutex);
+	g_hash_table_destroy(lua_shared_data);
+	lua_shared_data = NULL;
+	janus_mutex_unlock(&lua_shared_data_mutex);
 
 	g_free(lua_script_version_string);
 	g_free(lua_script_description);
@@ -1363,13 +1756,15 @@ int janus_lua_get_version(void) {
 			/* Unless we asked already */
 			return lua_script_version;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_lua_state *ls = &lua_states[0];
+		janus_lua_state_lock(ls);
+		lua_State *t = lua_newthread(ls->state);
 		lua_getglobal(t, "getVersion");
 		lua_call(t, 0, 1);
 		lua_script_version = (int)lua_tonumber(t, -1);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(ls->state, 1);
+		janus_lua_state_unlock(ls);
 		return lua_script_version;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1384,15 +1779,17 @@ const char *janus_lua_get_version_string(void) {
 			/* Unless we asked already */
 			return lua_script_version_string;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_lua_state *ls = &lua_states[0];
+		janus_lua_state_lock(ls);
+		lua_State *t = lua_newthread(ls->state);
 		lua_getglobal(t, "getVersionString");
 		lua_call(t, 0, 1);
 		const char *version = lua_tostring(t, -1);
 		if(version != NULL)
 			lua_script_version_string = g_strdup(version);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(ls->state, 1);
+		janus_lua_state_unlock(ls);
 		return lua_script_version_string;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1407,15 +1804,17 @@ const char *janus_lua_get_description(void) {
 			/* Unless we asked already */
 			return lua_script_description;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_lua_state *ls = &lua_states[0];
+		janus_lua_state_lock(ls);
+		lua_State *t = lua_newthread(ls->state);
 		lua_getglobal(t, "getDescription");
 		lua_call(t, 0, 1);
 		const char *description = lua_tostring(t, -1);
 		if(description != NULL)
 			lua_script_description = g_strdup(description);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(ls->state, 1);
+		janus_lua_state_unlock(ls);
 		return lua_script_description;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1430,15 +1829,17 @@ const char *janus_lua_get_name(void) {
 			/* Unless we asked already */
 			return lua_script_name;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_lua_state *ls = &lua_states[0];
+		janus_lua_state_lock(ls);
+		lua_State *t = lua_newthread(ls->state);
 		lua_getglobal(t, "getName");
 		lua_call(t, 0, 1);
 		const char *name = lua_tostring(t, -1);
 		if(name != NULL)
 			lua_script_name = g_strdup(name);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(ls->state, 1);
+		janus_lua_state_unlock(ls);
 		return lua_script_name;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1453,15 +1854,17 @@ const char *janus_lua_get_author(void) {
 			/* Unless we asked already */
 			return lua_script_author;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_lua_state *ls = &lua_states[0];
+		janus_lua_state_lock(ls);
+		lua_State *t = lua_newthread(ls->state);
 		lua_getglobal(t, "getAuthor");
 		lua_call(t, 0, 1);
 		const char *author = lua_tostring(t, -1);
 		if(author != NULL)
 			lua_script_author = g_strdup(author);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(ls->state, 1);
+		janus_lua_state_unlock(ls);
 		return lua_script_author;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1476,15 +1879,17 @@ const char *janus_lua_get_package(void) {
 			/* Unless we asked already */
 			return lua_script_package;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_lua_state *ls = &lua_states[0];
+		janus_lua_state_lock(ls);
+		lua_State *t = lua_newthread(ls->state);
 		lua_getglobal(t, "getPackage");
 		lua_call(t, 0, 1);
 		const char *package = lua_tostring(t, -1);
 		if(package != NULL)
 			lua_script_package = g_strdup(package);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(ls->state, 1);
+		janus_lua_state_unlock(ls);
 		return lua_script_package;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1517,6 +1922,9 @@ void janus_lua_create_session(janus_plugin_session *handle, int *error) {
 	janus_lua_session *session = (janus_lua_session *)g_malloc0(sizeof(janus_lua_session));
 	session->handle = handle;
 	session->id = id;
+	/* Pin the session to one of the Lua states */
+	session->state = &lua_states[id % lua_states_num];
+	g_atomic_int_inc(&session->state->sessions);
 	janus_rtp_switching_context_reset(&session->rtpctx);
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
@@ -1527,13 +1935,14 @@ void janus_lua_create_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&lua_sessions_mutex);
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_state *ls = session->state;
+	janus_lua_state_lock(ls);
+	lua_State *t = lua_newthread(ls->state);
 	lua_getglobal(t, "createSession");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(ls->state, 1);
+	janus_lua_state_unlock(ls);
 
 	return;
 }
@@ -1557,13 +1966,14 @@ void janus_lua_destroy_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&lua_sessions_mutex);
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_state *ls = session->state;
+	janus_lua_state_lock(ls);
+	lua_State *t = lua_newthread(ls->state);
 	lua_getglobal(t, "destroySession");
 	lua_pushnumber(t, id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(ls->state, 1);
+	janus_lua_state_unlock(ls);
 
 	/* Get any rid references recipients of this sessions may have */
 	janus_mutex_lock(&session->recipients_mutex);
@@ -1601,19 +2011,20 @@ json_t *janus_lua_query_session(janus_plugin_session *handle) {
 	janus_refcount_increase(&session->ref);
 	janus_mutex_unlock(&lua_sessions_mutex);
 	/* Ask the Lua script for information on this session */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_state *ls = session->state;
+	janus_lua_state_lock(ls);
+	lua_State *t = lua_newthread(ls->state);
 	lua_getglobal(t, "querySession");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 1);
-	lua_pop(lua_state, 1);
+	lua_pop(ls->state, 1);
 	janus_refcount_decrease(&session->ref);
 	const char *info = lua_tostring(t, -1);
 	lua_pop(t, 1);
 	/* We need a Jansson object */
 	json_error_t error;
 	json_t *json = json_loads(info, 0, &error);
-	janus_mutex_unlock(&lua_mutex);
+	janus_lua_state_unlock(ls);
 	if(!json) {
 		JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s", error.line, error.text);
 		return NULL;
@@ -1647,15 +2058,16 @@ struct janus_plugin_result *janus_lua_handle_message(janus_plugin_session *handl
 	char *jsep_text = jsep ? json_dumps(jsep, JSON_INDENT(0) | JSON_PRESERVE_ORDER) : NULL;
 	json_decref(jsep);
 	/* Invoke the script function */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_state *ls = session->state;
+	janus_lua_state_lock(ls);
+	lua_State *t = lua_newthread(ls->state);
 	lua_getglobal(t, "handleMessage");
 	lua_pushnumber(t, session->id);
 	lua_pushstring(t, transaction);
 	lua_pushstring(t, message_text);
 	lua_pushstring(t, jsep_text);
 	lua_call(t, 4, 2);
-	lua_pop(lua_state, 1);
+	lua_pop(ls->state, 1);
 	janus_refcount_decrease(&session->ref);
 	if(message_text != NULL)
 		free(message_text);
@@ -1664,7 +2076,7 @@ struct janus_plugin_result *janus_lua_handle_message(janus_plugin_session *handl
 	g_free(transaction);
 	int n = lua_gettop(t);
 	if(n != 2) {
-		janus_mutex_unlock(&lua_mutex);
+		janus_lua_state_unlock(ls);
 		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 2)\n", n);
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Lua error", NULL);
 	}
@@ -1674,40 +2086,63 @@ struct janus_plugin_result *janus_lua_handle_message(janus_plugin_session *handl
 	lua_pop(t, 2);
 	if(res < 0) {
 		/* We got an error */
-		janus_mutex_unlock(&lua_mutex);
+		janus_lua_state_unlock(ls);
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, response ? response : "Lua error", NULL);
 	} else if(res == 0) {
 		/* Synchronous response: we need a Jansson object */
 		json_error_t error;
 		json_t *json = json_loads(response, 0, &error);
-		janus_mutex_unlock(&lua_mutex);
+		janus_lua_state_unlock(ls);
 		if(!json) {
 			JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 			return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Lua error", NULL);
 		}
 		return janus_plugin_result_new(JANUS_PLUGIN_OK, NULL, json);
 	}
-	janus_mutex_unlock(&lua_mutex);
+	janus_lua_state_unlock(ls);
 	/* If we got here, it's an asynchronous response */
 	return janus_plugin_result_new(JANUS_PLUGIN_OK_WAIT, NULL, NULL);
 }
 
 json_t *janus_lua_handle_admin_message(json_t *message) {
-	if(!has_handle_admin_message || message == NULL)
+	if(message == NULL)
+		return NULL;
+	const char *request_text = json_string_value(json_object_get(message, "request"));
+	if(request_text != NULL && !strcasecmp(request_text, "lua_states")) {
+		/* Return info on the Lua states, and how busy they are */
+		json_t *list = json_array();
+		guint i = 0;
+		for(i=0; i<lua_states_num; i++) {
+			janus_lua_state *ls = &lua_states[i];
+			janus_mutex_lock(&ls->mutex);
+			json_t *sl = json_object();
+			json_object_set_new(sl, "index", json_integer(ls->index));
+			json_object_set_new(sl, "sessions", json_integer(g_atomic_int_get(&ls->sessions)));
+			json_object_set_new(sl, "calls", json_integer(ls->calls));
+			json_object_set_new(sl, "cpu_time", json_integer(ls->cpu_time));
+			janus_mutex_unlock(&ls->mutex);
+			json_array_append_new(list, sl);
+		}
+		json_t *response = json_object();
+		json_object_set_new(response, "states", list);
+		return response;
+	}
+	if(!has_handle_admin_message)
 		return NULL;
 	char *message_text = json_dumps(message, JSON_INDENT(0) | JSON_PRESERVE_ORDER);
 	/* Invoke the script function */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_state *ls = &lua_states[0];
+	janus_lua_state_lock(ls);
+	lua_State *t = lua_newthread(ls->state);
 	lua_getglobal(t, "handleAdminMessage");
 	lua_pushstring(t, message_text);
 	lua_call(t, 1, 1);
-	lua_pop(lua_state, 1);
+	lua_pop(ls->state, 1);
 	if(message_text != NULL)
 		free(message_text);
 	int n = lua_gettop(t);
 	if(n != 1) {
-		janus_mutex_unlock(&lua_mutex);
+		janus_lua_state_unlock(ls);
 		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 1)\n", n);
 		return NULL;
 	}
@@ -1715,7 +2150,7 @@ json_t *janus_lua_handle_admin_message(json_t *message) {
 	const char *response = lua_tostring(t, 1);
 	json_error_t error;
 	json_t *json = json_loads(response, 0, &error);
-	janus_mutex_unlock(&lua_mutex);
+	janus_lua_state_unlock(ls);
 	if(!json) {
 		JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 		return NULL;
@@ -1745,13 +2180,14 @@ void janus_lua_setup_media(janus_plugin_session *handle) {
 	session->pli_latest = janus_get_monotonic_time();
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_state *ls = session->state;
+	janus_lua_state_lock(ls);
+	lua_State *t = lua_newthread(ls->state);
 	lua_getglobal(t, "setupMedia");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(ls->state, 1);
+	janus_lua_state_unlock(ls);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -1766,18 +2202,35 @@ void janus_lua_incoming_rtp(janus_plugin_session *handle, int video, char *buf,
 	if(g_atomic_int_get(&session->destroyed) || g_atomic_int_get(&session->hangingup))
 		return;
 	/* Check if the Lua script wants to handle/manipulate RTP packets itself */
-	if(has_incoming_rtp) {
-		/* Yep, pass the data to the Lua script and return */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
-		lua_getglobal(t, "incomingRtp");
-		lua_pushnumber(t, session->id);
-		lua_pushboolean(t, video);
-		lua_pushlstring(t, buf, len);
-		lua_pushnumber(t, len);
-		lua_call(t, 4, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+	if(has_incoming_rtp_buffer) {
+		/* Yep, and without copying them: wrap the packet in the state buffer */
+		janus_lua_state *ls = session->state;
+		janus_lua_state_lock_media(ls);
+		lua_getglobal(ls->state, "incomingRtpBuffer");
+		lua_pushnumber(ls->state, session->id);
+		lua_pushboolean(ls->state, video);
+		lua_getfield(ls->state, LUA_REGISTRYINDEX, "janus_lua_rtp_buffer");
+		janus_lua_rtp_buffer *rb = (janus_lua_rtp_buffer *)lua_touserdata(ls->state, -1);
+		rb->buffer = buf;
+		rb->length = len;
+		lua_call(ls->state, 3, 0);
+		/* The packet belongs to the core: the script can't access it anymore */
+		rb->buffer = NULL;
+		rb->length = 0;
+		janus_lua_state_unlock(ls);
+		return;
+	} else if(has_incoming_rtp) {
+		/* Yep, pass the data to the Lua script and return: as we don't
+		 * expect it to yield, there's no need to create a new thread */
+		janus_lua_state *ls = session->state;
+		janus_lua_state_lock_media(ls);
+		lua_getglobal(ls->state, "incomingRtp");
+		lua_pushnumber(ls->state, session->id);
+		lua_pushboolean(ls->state, video);
+		lua_pushlstring(ls->state, buf, len);
+		lua_pushnumber(ls->state, len);
+		lua_call(ls->state, 4, 0);
+		janus_lua_state_unlock(ls);
 		return;
 	}
 	/* Is this session allowed to send media? */
@@ -1825,17 +2278,17 @@ void janus_lua_incoming_rtcp(janus_plugin_session *handle, int video, char *buf,
 		return;
 	/* Check if the Lua script wants to handle/manipulate RTCP packets itself */
 	if(has_incoming_rtcp) {
-		/* Yep, pass the data to the Lua script and return */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
-		lua_getglobal(t, "incomingRtcp");
-		lua_pushnumber(t, session->id);
-		lua_pushboolean(t, video);
-		lua_pushlstring(t, buf, len);
-		lua_pushnumber(t, len);
-		lua_call(t, 4, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		/* Yep, pass the data to the Lua script and return: as we don't
+		 * expect it to yield, there's no need to create a new thread */
+		janus_lua_state *ls = session->state;
+		janus_lua_state_lock_media(ls);
+		lua_getglobal(ls->state, "incomingRtcp");
+		lua_pushnumber(ls->state, session->id);
+		lua_pushboolean(ls->state, video);
+		lua_pushlstring(ls->state, buf, len);
+		lua_pushnumber(ls->state, len);
+		lua_call(ls->state, 4, 0);
+		janus_lua_state_unlock(ls);
 		return;
 	}
 	/* If a REMB arrived, make sure we cap it to our configuration, and send it as a video RTCP */
@@ -1878,16 +2331,16 @@ void janus_lua_incoming_data(janus_plugin_session *handle, char *label, char *bu
 	janus_recorder_save_frame(session->drc, buf, len);
 	/* Check if the Lua script wants to handle/manipulate data channel packets itself */
 	if(has_incoming_data) {
-		/* Yep, pass the data to the Lua script and return */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
-		lua_getglobal(t, "incomingData");
-		lua_pushnumber(t, session->id);
-		lua_pushlstring(t, buf, len);
-		lua_pushnumber(t, len);
-		lua_call(t, 3, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		/* Yep, pass the data to the Lua script and return: as we don't
+		 * expect it to yield, there's no need to create a new thread */
+		janus_lua_state *ls = session->state;
+		janus_lua_state_lock_media(ls);
+		lua_getglobal(ls->state, "incomingData");
+		lua_pushnumber(ls->state, session->id);
+		lua_pushlstring(ls->state, buf, len);
+		lua_pushnumber(ls->state, len);
+		lua_call(ls->state, 3, 0);
+		janus_lua_state_unlock(ls);
 		return;
 	}
 	/* Is this session allowed to send data? */
@@ -1926,15 +2379,16 @@ void janus_lua_slow_link(janus_plugin_session *handle, int uplink, int video) {
 	janus_refcount_increase(&session->ref);
 	if(has_slow_link) {
 		/* Notify the Lua script */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_lua_state *ls = session->state;
+		janus_lua_state_lock(ls);
+		lua_State *t = lua_newthread(ls->state);
 		lua_getglobal(t, "slowLink");
 		lua_pushnumber(t, session->id);
 		lua_pushboolean(t, uplink);
 		lua_pushboolean(t, video);
 		lua_call(t, 3, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(ls->state, 1);
+		janus_lua_state_unlock(ls);
 	}
 	janus_refcount_decrease(&session->ref);
 }
@@ -1986,13 +2440,14 @@ void janus_lua_hangup_media(janus_plugin_session *handle) {
 	janus_mutex_unlock(&session->recipients_mutex);
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_state *ls = session->state;
+	janus_lua_state_lock(ls);
+	lua_State *t = lua_newthread(ls->state);
 	lua_getglobal(t, "hangupMedia");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(ls->state, 1);
+	janus_lua_state_unlock(ls);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -2050,13 +2505,19 @@ static void *janus_lua_scheduler(void *data) {
 		if(event == GUINT_TO_POINTER(janus_lua_event_exit))
 			break;
 		if(event == GUINT_TO_POINTER(janus_lua_event_resume)) {
-			/* There are coroutines to resume */
-			janus_mutex_lock(&lua_mutex);
-			lua_getglobal(lua_state, "resumeScheduler");
-			lua_call(lua_state, 0, 0);
-			/* Print the count of elements into Lua stack */
-			janus_lua_stackdump(lua_state);
-			janus_mutex_unlock(&lua_mutex);
+			/* There are coroutines to resume: check which states they belong to */
+			guint i = 0;
+			for(i=0; i<lua_states_num; i++) {
+				janus_lua_state *ls = &lua_states[i];
+				if(!g_atomic_int_compare_and_exchange(&ls->resume, 1, 0))
+					continue;
+				janus_lua_state_lock(ls);
+				lua_getglobal(ls->state, "resumeScheduler");
+				lua_call(ls->state, 0, 0);
+				/* Print the count of elements into Lua stack */
+				janus_lua_stackdump(ls->state);
+				janus_lua_state_unlock(ls);
+			}
 		}
 	}
 	JANUS_LOG(LOG_VERB, "Leaving Lua scheduler thread\n");
@@ -2084,8 +2545,9 @@ static gboolean janus_lua_timer_cb(void *data) {
 		return FALSE;
 	/* Invoke the callback with the provided argument, if available */
 	JANUS_LOG(LOG_VERB, "Invoking scheduled callback (waited %"SCNu32"ms) with ID %u\n", cb->ms, cb->id);
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_state *ls = cb->state;
+	janus_lua_state_lock(ls);
+	lua_State *t = lua_newthread(ls->state);
 	lua_getglobal(t, cb->function);
 	if(cb->argument == NULL) {
 		lua_call(t, 0, 0);
@@ -2093,8 +2555,8 @@ static gboolean janus_lua_timer_cb(void *data) {
 		lua_pushstring(t, cb->argument);
 		lua_call(t, 1, 0);
 	}
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(ls->state, 1);
+	janus_lua_state_unlock(ls);
 	/* Done */
 	g_source_destroy(cb->source);
 	g_source_unref(cb->source);
@@ -43,14 +43,35 @@
 extern volatile gint lua_initialized, lua_stopping;
 extern janus_callbacks *janus_core;
 
-/* Lua state: we define state and mutex as extern */
-extern lua_State *lua_state;
-extern janus_mutex lua_mutex;
+/* Lua states: the plugin can run a pool of independent states, each
+ * with its own copy of the script and its own lock, with sessions pinned
+ * to one of them depending on their ID (only one state by default) */
+typedef struct janus_lua_state {
+	guint index;						/* Index of this state in the pool */
+	lua_State *state;					/* The Lua state itself */
+	janus_mutex mutex;					/* Mutex to lock the state (Lua is not thread safe) */
+	volatile gint resume;				/* Whether the scheduler should call resumeScheduler() on this state */
+	volatile gint sessions;				/* How many sessions are pinned to this state */
+	gint64 cpu_started;					/* Thread CPU time when the current owner locked the state */
+	guint cpu_weight;					/* How many calls the current measurement accounts for (0 if not measured) */
+	gint64 cpu_time;					/* Overall CPU time spent in this state, in microseconds */
+	guint64 calls;						/* How many times this state was locked to invoke the script */
+} janus_lua_state;
+extern janus_lua_state *lua_states;
+extern guint lua_states_num;
+/* Helpers to lock/unlock a state while keeping track of the CPU time spent in it: the
+ * media variant only measures a sample of the calls, to keep per-packet overhead low */
+void janus_lua_state_lock(janus_lua_state *ls);
+void janus_lua_state_lock_media(janus_lua_state *ls);
+void janus_lua_state_unlock(janus_lua_state *ls);
+/* Helper to get the janus_lua_state instance a Lua state (or thread) belongs to */
+janus_lua_state *janus_lua_state_get(lua_State *s);
 
 /* Lua session: we keep only the barebone stuff here, the rest will be in the Lua script */
 typedef struct janus_lua_session {
 	janus_plugin_session *handle;		/* Pointer to the core-plugin session */
 	uint32_t id;						/* Unique session ID (will be used to correlate with the Lua script) */
+	janus_lua_state *state;				/* Lua state this session is pinned to */
 	/* The following are only needed for media manipulation, feedback and routing, and may not all be used */
 	gboolean accept_audio;				/* Whether incoming audio can be accepted or must be dropped */
 	gboolean accept_video;				/* Whether incoming video can be accepted or must be dropped */
@@ -53,7 +53,13 @@
  * get a response directly within the context of the transaction. \c list
  * lists all the available recordings, while \c update forces the plugin
  * to scan the folder of recordings again in case some were added manually
- * and not indexed in the meanwhile.
+ * and not indexed in the meanwhile. Notice that the plugin keeps an index
+ * of the \c .nfo files it parsed, so that only new or changed files are
+ * parsed again: on Linux the folder is also monitored via inotify, which
+ * means new recordings are usually indexed automatically, and \c update
+ * only needs to look at the changes that are still pending. The index can
+ * also be persisted to a file (\c index_cache in the configuration), in
+ * order to avoid parsing all the recordings again at startup.
  *
  * The \c record , \c play , \c start and \c stop requests instead are
  * all asynchronous, which means you'll get a notification about their
@@ -259,7 +265,12 @@
 #include <arpa/inet.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include <jansson.h>
+#ifdef HAVE_INOTIFY
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
 
 #include "../debug.h"
 #include "../apierror.h"
@@ -397,6 +408,8 @@ typedef struct janus_recordplay_recording {
 	int video_pt;				/* Payload types to use for audio when playing recordings */
 	char *offer;				/* The SDP offer that will be sent to watchers */
 	GList *viewers;				/* List of users watching this recording */
+	char *nfo_file;				/* Name of the .nfo file this recording was indexed from, if any */
+	gint64 nfo_mtime;			/* Modification time of the .nfo file when we indexed it */
 	volatile gint completed;	/* Whether this recording was completed or still going on */
 	volatile gint destroyed;	/* Whether this recording has been marked as destroyed */
 	janus_refcount ref;			/* Reference counter */
@@ -464,12 +477,34 @@ static void janus_recordplay_recording_free(const janus_refcount *recording_ref)
 	g_free(recording->arc_file);
 	g_free(recording->vrc_file);
 	g_free(recording->offer);
+	g_free(recording->nfo_file);
 	g_free(recording);
 }
 
 
 static char *recordings_path = NULL;
 void janus_recordplay_update_recordings_list(void);
+static void janus_recordplay_refresh_recordings_list(void);
+
+/* Index of the .nfo files we parsed (file name -> recording ID), so that we
+ * only need to parse what changed when new recordings are added or removed:
+ * the index and the related properties are protected by recordings_mutex */
+static GHashTable *nfo_index = NULL;
+static gboolean index_dirty = FALSE;
+static gint64 index_saved = 0;
+static char *index_cache = NULL;
+static void janus_recordplay_load_index(void);
+static void janus_recordplay_save_index(void);
+#ifdef HAVE_INOTIFY
+static gboolean monitor_folder = TRUE;
+/* The inotify descriptor is only closed by the watcher thread (or when the
+ * thread is not running), while inotify_active (protected by recordings_mutex)
+ * tells everybody else whether the folder is still being monitored */
+static int inotify_fd = -1;
+static gboolean inotify_active = FALSE;
+static GThread *watcher_thread = NULL;
+static void *janus_recordplay_watcher(void *data);
+#endif
 static void *janus_recordplay_playout_thread(void *data);
 
 /* Helper to send RTCP feedback back to recorders, if needed */
@@ -707,6 +742,18 @@ int janus_recordplay_init(janus_callbacks *callback, const char *config_path) {
 		janus_config_item *path = janus_config_get(config, config_general, janus_config_type_item, "path");
 		if(path && path->value)
 			recordings_path = g_strdup(path->value);
+		janus_config_item *cache = janus_config_get(config, config_general, janus_config_type_item, "index_cache");
+		if(cache && cache->value)
+			index_cache = g_strdup(cache->value);
+		janus_config_item *monitor = janus_config_get(config, config_general, janus_config_type_item, "monitor");
+		if(monitor && monitor->value) {
+#ifdef HAVE_INOTIFY
+			monitor_folder = janus_is_true(monitor->value);
+#else
+			if(janus_is_true(monitor->value))
+				JANUS_LOG(LOG_WARN, "Monitoring the recordings folder is not supported on this platform\n");
+#endif
+		}
 		janus_config_item *events = janus_config_get(config, config_general, janus_config_type_item, "events");
 		if(events != NULL && events->value != NULL)
 			notify_events = janus_is_true(events->value);
@@ -732,7 +779,24 @@ int janus_recordplay_init(janus_callbacks *callback, const char *config_path) {
 		}
 	}
 	recordings = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, (GDestroyNotify)janus_recordplay_recording_destroy);
+	nfo_index = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
+	/* Start from the cached index, if any, so that only new or changed .nfo files will need to be parsed */
+	janus_recordplay_load_index();
+#ifdef HAVE_INOTIFY
+	if(monitor_folder) {
+		/* Watch the folder before scanning it, so that we don't miss anything in between */
+		inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if(inotify_fd < 0 || inotify_add_watch(inotify_fd, recordings_path,
+				IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+			JANUS_LOG(LOG_WARN, "Couldn't monitor the recordings folder (%d, %s), use 'update' to rescan it\n", errno, strerror(errno));
+			if(inotify_fd > -1)
+				close(inotify_fd);
+			inotify_fd = -1;
+		}
+	}
+#endif
 	janus_recordplay_update_recordings_list();
+	janus_recordplay_save_index();
 
 	sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_recordplay_session_destroy);
 	messages = g_async_queue_new_full((GDestroyNotify) janus_recordplay_message_free);
@@ -749,6 +813,21 @@ int janus_recordplay_init(janus_callbacks *callback, const char *config_path) {
 		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Record&Play handler thread...\n", error->code, error->message ? error->message : "??");
 		return -1;
 	}
+#ifdef HAVE_INOTIFY
+	if(inotify_fd > -1) {
+		/* Launch the thread that will keep the index updated */
+		inotify_active = TRUE;
+		watcher_thread = g_thread_try_new("recordplay watcher", janus_recordplay_watcher, NULL, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_WARN, "Got error %d (%s) trying to launch the Record&Play watcher thread, use 'update' to rescan the folder\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			inotify_active = FALSE;
+			close(inotify_fd);
+			inotify_fd = -1;
+		}
+	}
+#endif
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_RECORDPLAY_NAME);
 	return 0;
 }
@@ -763,13 +842,29 @@ void janus_recordplay_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+#ifdef HAVE_INOTIFY
+	if(watcher_thread != NULL) {
+		g_thread_join(watcher_thread);
+		watcher_thread = NULL;
+	}
+	if(inotify_fd > -1) {
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+#endif
+	/* Persist the index, if needed, so that the next startup will be faster */
+	janus_recordplay_save_index();
 	/* FIXME We should destroy the sessions cleanly */
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
 	sessions = NULL;
 	g_hash_table_destroy(recordings);
 	recordings = NULL;
+	g_hash_table_destroy(nfo_index);
+	nfo_index = NULL;
 	janus_mutex_unlock(&sessions_mutex);
+	g_free(index_cache);
+	index_cache = NULL;
 	g_async_queue_unref(messages);
 	messages = NULL;
 	g_atomic_int_set(&initialized, 0);
@@ -947,8 +1042,8 @@ struct janus_plugin_result *janus_recordplay_handle_message(janus_plugin_session
 	/* Some requests ('create' and 'destroy') can be handled synchronously */
 	const char *request_text = json_string_value(request);
 	if(!strcasecmp(request_text, "update")) {
-		/* Update list of available recordings, scanning the folder again */
-		janus_recordplay_update_recordings_list();
+		/* Update list of available recordings, checking what changed in the folder */
+		janus_recordplay_refresh_recordings_list();
 		/* Send info back */
 		response = json_object();
 		json_object_set_new(response, "recordplay", json_string("ok"));
@@ -1069,8 +1164,8 @@ json_t *janus_recordplay_handle_admin_message(json_t *message) {
 	json_t *request = json_object_get(message, "request");
 	const char *request_text = json_string_value(request);
 	if(!strcasecmp(request_text, "update")) {
-		/* Update list of available recordings, scanning the folder again */
-		janus_recordplay_update_recordings_list();
+		/* Update list of available recordings, checking what changed in the folder */
+		janus_recordplay_refresh_recordings_list();
 		/* Send info back */
 		response = json_object();
 		json_object_set_new(response, "recordplay", json_string("ok"));
@@ -1350,6 +1445,16 @@ static void janus_recordplay_hangup_media_internal(janus_plugin_session *handle)
 				/* Write to the file now */
 				fwrite(nfo, strlen(nfo), sizeof(char), file);
 				fclose(file);
+				/* Add the file to the index ourselves, no need to parse it again */
+				janus_mutex_lock(&recordings_mutex);
+				struct stat st;
+				if(session->recording->nfo_file == NULL && stat(nfofile, &st) == 0) {
+					session->recording->nfo_file = g_strdup_printf("%"SCNu64".nfo", session->recording->id);
+					session->recording->nfo_mtime = (gint64)st.st_mtime;
+					g_hash_table_insert(nfo_index, g_strdup(session->recording->nfo_file), janus_uint64_dup(session->recording->id));
+					index_dirty = TRUE;
+				}
+				janus_mutex_unlock(&recordings_mutex);
 				g_atomic_int_set(&session->recording->completed, 1);
 				/* Generate the offer */
 				if(janus_recordplay_generate_offer(session->recording) < 0) {
@@ -1843,151 +1948,423 @@ error:
 	return NULL;
 }
 
+/* Helper to set the payload types and the offer of a recording we just indexed */
+static void janus_recordplay_recording_prepare(janus_recordplay_recording *rec) {
+	rec->audio_pt = AUDIO_PT;
+	if(rec->acodec != JANUS_AUDIOCODEC_NONE) {
+		/* Some audio codecs have a fixed payload type that we can't mess with */
+		if(rec->acodec == JANUS_AUDIOCODEC_PCMU)
+			rec->audio_pt = 0;
+		else if(rec->acodec == JANUS_AUDIOCODEC_PCMA)
+			rec->audio_pt = 8;
+		else if(rec->acodec == JANUS_AUDIOCODEC_G722)
+			rec->audio_pt = 9;
+	}
+	rec->video_pt = VIDEO_PT;
+	rec->viewers = NULL;
+	if(janus_recordplay_generate_offer(rec) < 0) {
+		JANUS_LOG(LOG_WARN, "Could not generate offer for recording %"SCNu64"...\n", rec->id);
+	}
+	g_atomic_int_set(&rec->destroyed, 0);
+	g_atomic_int_set(&rec->completed, 1);
+	janus_refcount_init(&rec->ref, janus_recordplay_recording_free);
+	janus_mutex_init(&rec->mutex);
+}
+
+/* Helper to parse a .nfo file and create the related recording instance */
+static janus_recordplay_recording *janus_recordplay_recording_from_nfo(const char *filename) {
+	char recpath[1024];
+	g_snprintf(recpath, 1024, "%s/%s", recordings_path, filename);
+	JANUS_LOG(LOG_VERB, "Importing recording '%s'...\n", filename);
+	janus_config *nfo = janus_config_parse(recpath);
+	if(nfo == NULL) {
+		JANUS_LOG(LOG_ERR, "Invalid recording '%s'...\n", filename);
+		return NULL;
+	}
+	GList *cl = janus_config_get_categories(nfo, NULL);
+	if(cl == NULL || cl->data == NULL) {
+		JANUS_LOG(LOG_WARN, "No recording info in '%s', skipping...\n", filename);
+		janus_config_destroy(nfo);
+		return NULL;
+	}
+	janus_config_category *cat = (janus_config_category *)cl->data;
+	guint64 id = g_ascii_strtoull(cat->name, NULL, 0);
+	if(id == 0) {
+		JANUS_LOG(LOG_WARN, "Invalid ID, skipping...\n");
+		g_list_free(cl);
+		janus_config_destroy(nfo);
+		return NULL;
+	}
+	janus_config_item *name = janus_config_get(nfo, cat, janus_config_type_item, "name");
+	janus_config_item *date = janus_config_get(nfo, cat, janus_config_type_item, "date");
+	janus_config_item *audio = janus_config_get(nfo, cat, janus_config_type_item, "audio");
+	janus_config_item *video = janus_config_get(nfo, cat, janus_config_type_item, "video");
+	if(!name || !name->value || strlen(name->value) == 0 || !date || !date->value || strlen(date->value) == 0) {
+		JANUS_LOG(LOG_WARN, "Invalid info for recording %"SCNu64", skipping...\n", id);
+		g_list_free(cl);
+		janus_config_destroy(nfo);
+		return NULL;
+	}
+	if((!audio || !audio->value) && (!video || !video->value)) {
+		JANUS_LOG(LOG_WARN, "No audio and no video in recording %"SCNu64", skipping...\n", id);
+		g_list_free(cl);
+		janus_config_destroy(nfo);
+		return NULL;
+	}
+	janus_recordplay_recording *rec = g_malloc0(sizeof(janus_recordplay_recording));
+	rec->id = id;
+	rec->name = g_strdup(name->value);
+	rec->date = g_strdup(date->value);
+	if(audio && audio->value) {
+		rec->arc_file = g_strdup(audio->value);
+		char *ext = strstr(rec->arc_file, ".mjr");
+		if(ext != NULL)
+			*ext = '\0';
+		/* Check which codec is in this recording */
+		rec->acodec = janus_audiocodec_from_name(janus_recordplay_parse_codec(recordings_path, rec->arc_file));
+	}
+	if(video && video->value) {
+		rec->vrc_file = g_strdup(video->value);
+		char *ext = strstr(rec->vrc_file, ".mjr");
+		if(ext != NULL)
+			*ext = '\0';
+		/* Check which codec is in this recording */
+		rec->vcodec = janus_videocodec_from_name(janus_recordplay_parse_codec(recordings_path, rec->vrc_file));
+	}
+	g_list_free(cl);
+	janus_config_destroy(nfo);
+	janus_recordplay_recording_prepare(rec);
+	return rec;
+}
+
+/* Helpers to add, update or remove a single .nfo file in the index: must be called with recordings_mutex locked */
+static void janus_recordplay_unindex_nfo(const char *filename) {
+	guint64 *id = g_hash_table_lookup(nfo_index, filename);
+	if(id == NULL)
+		return;
+	janus_recordplay_recording *rec = g_hash_table_lookup(recordings, id);
+	if(rec != NULL && rec->nfo_file != NULL && !strcmp(rec->nfo_file, filename)) {
+		JANUS_LOG(LOG_VERB, "Recording %"SCNu64" is not available anymore, removing...\n", rec->id);
+		g_hash_table_remove(recordings, id);
+	}
+	g_hash_table_remove(nfo_index, filename);
+	index_dirty = TRUE;
+}
+
+static void janus_recordplay_index_nfo(const char *filename, gint64 mtime) {
+	guint64 *known = g_hash_table_lookup(nfo_index, filename);
+	if(known != NULL) {
+		janus_recordplay_recording *rec = g_hash_table_lookup(recordings, known);
+		if(rec != NULL && rec->nfo_mtime == mtime) {
+			/* Nothing changed since the last time we looked */
+			return;
+		}
+	}
+	janus_recordplay_recording *rec = janus_recordplay_recording_from_nfo(filename);
+	if(rec == NULL) {
+		/* Not a valid recording (anymore?) */
+		janus_recordplay_unindex_nfo(filename);
+		return;
+	}
+	if(known != NULL && *known != rec->id) {
+		/* The file now refers to a different recording ID */
+		janus_recordplay_unindex_nfo(filename);
+	}
+	rec->nfo_file = g_strdup(filename);
+	rec->nfo_mtime = mtime;
+	janus_recordplay_recording *existing = g_hash_table_lookup(recordings, &rec->id);
+	if(existing != NULL) {
+		if(existing->nfo_file == NULL && !g_atomic_int_get(&existing->completed)) {
+			/* This is a recording we're still writing: we'll index it ourselves when done */
+			janus_recordplay_recording_destroy(rec);
+			return;
+		}
+		if(existing->nfo_file != NULL && strcmp(existing->nfo_file, filename)) {
+			JANUS_LOG(LOG_VERB, "Skipping recording with ID %"SCNu64", it's already in the list (%s)...\n",
+				rec->id, existing->nfo_file);
+			janus_recordplay_recording_destroy(rec);
+			return;
+		}
+		if(existing->nfo_file == NULL) {
+			/* A recording we completed ourselves, just keep track of the file */
+			existing->nfo_file = rec->nfo_file;
+			existing->nfo_mtime = mtime;
+			rec->nfo_file = NULL;
+			g_hash_table_insert(nfo_index, g_strdup(filename), janus_uint64_dup(existing->id));
+			janus_recordplay_recording_destroy(rec);
+			index_dirty = TRUE;
+			return;
+		}
+	}
+	/* Add to (or replace in) the list of recordings */
+	g_hash_table_insert(nfo_index, g_strdup(filename), janus_uint64_dup(rec->id));
+	g_hash_table_insert(recordings, janus_uint64_dup(rec->id), rec);
+	index_dirty = TRUE;
+}
+
+/* Helpers to load and save the persistent cache of the index, so that we don't need to parse all the .nfo and .mjr files at startup */
+static void janus_recordplay_load_index(void) {
+	if(index_cache == NULL)
+		return;
+	json_error_t error;
+	json_t *cache = json_load_file(index_cache, 0, &error);
+	if(cache == NULL) {
+		JANUS_LOG(LOG_WARN, "Couldn't load recordings index cache %s (%s), will scan the folder instead\n",
+			index_cache, error.text);
+		return;
+	}
+	json_t *list = json_object_get(cache, "recordings");
+	if(!json_is_array(list) || json_integer_value(json_object_get(cache, "version")) != 1) {
+		JANUS_LOG(LOG_WARN, "Invalid recordings index cache %s, will scan the folder instead\n", index_cache);
+		json_decref(cache);
+		return;
+	}
+	janus_mutex_lock(&recordings_mutex);
+	size_t i = 0;
+	for(i=0; i<json_array_size(list); i++) {
+		json_t *r = json_array_get(list, i);
+		const char *nfo_file = json_string_value(json_object_get(r, "nfo"));
+		guint64 id = json_integer_value(json_object_get(r, "id"));
+		const char *name = json_string_value(json_object_get(r, "name"));
+		const char *date = json_string_value(json_object_get(r, "date"));
+		if(nfo_file == NULL || id == 0 || name == NULL || date == NULL)
+			continue;
+		if(g_hash_table_lookup(nfo_index, nfo_file) != NULL || g_hash_table_lookup(recordings, &id) != NULL)
+			continue;
+		janus_recordplay_recording *rec = g_malloc0(sizeof(janus_recordplay_recording));
+		rec->id = id;
+		rec->name = g_strdup(name);
+		rec->date = g_strdup(date);
+		const char *audio = json_string_value(json_object_get(r, "audio"));
+		if(audio != NULL) {
+			rec->arc_file = g_strdup(audio);
+			rec->acodec = janus_audiocodec_from_name(json_string_value(json_object_get(r, "audio_codec")));
+		}
+		const char *video = json_string_value(json_object_get(r, "video"));
+		if(video != NULL) {
+			rec->vrc_file = g_strdup(video);
+			rec->vcodec = janus_videocodec_from_name(json_string_value(json_object_get(r, "video_codec")));
+		}
+		rec->nfo_file = g_strdup(nfo_file);
+		rec->nfo_mtime = json_integer_value(json_object_get(r, "mtime"));
+		janus_recordplay_recording_prepare(rec);
+		g_hash_table_insert(nfo_index, g_strdup(nfo_file), janus_uint64_dup(rec->id));
+		g_hash_table_insert(recordings, janus_uint64_dup(rec->id), rec);
+	}
+	JANUS_LOG(LOG_INFO, "Loaded %u recordings from the index cache %s\n", g_hash_table_size(recordings), index_cache);
+	janus_mutex_unlock(&recordings_mutex);
+	json_decref(cache);
+}
+
+static void janus_recordplay_save_index(void) {
+	if(index_cache == NULL)
+		return;
+	janus_mutex_lock(&recordings_mutex);
+	if(!index_dirty) {
+		janus_mutex_unlock(&recordings_mutex);
+		return;
+	}
+	json_t *list = json_array();
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, recordings);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_recordplay_recording *rec = value;
+		if(rec->nfo_file == NULL || !g_atomic_int_get(&rec->completed))
+			continue;
+		json_t *r = json_object();
+		json_object_set_new(r, "nfo", json_string(rec->nfo_file));
+		json_object_set_new(r, "mtime", json_integer(rec->nfo_mtime));
+		json_object_set_new(r, "id", json_integer(rec->id));
+		json_object_set_new(r, "name", json_string(rec->name));
+		json_object_set_new(r, "date", json_string(rec->date));
+		if(rec->arc_file) {
+			json_object_set_new(r, "audio", json_string(rec->arc_file));
+			if(rec->acodec != JANUS_AUDIOCODEC_NONE)
+				json_object_set_new(r, "audio_codec", json_string(janus_audiocodec_name(rec->acodec)));
+		}
+		if(rec->vrc_file) {
+			json_object_set_new(r, "video", json_string(rec->vrc_file));
+			if(rec->vcodec != JANUS_VIDEOCODEC_NONE)
+				json_object_set_new(r, "video_codec", json_string(janus_videocodec_name(rec->vcodec)));
+		}
+		json_array_append_new(list, r);
+	}
+	index_dirty = FALSE;
+	index_saved = janus_get_monotonic_time();
+	janus_mutex_unlock(&recordings_mutex);
+	json_t *cache = json_object();
+	json_object_set_new(cache, "version", json_integer(1));
+	json_object_set_new(cache, "recordings", list);
+	/* Write to a temporary file first, so that we never leave a broken cache around */
+	char tmpfile[1024];
+	g_snprintf(tmpfile, 1024, "%s.tmp", index_cache);
+	if(json_dump_file(cache, tmpfile, JSON_COMPACT) < 0 || rename(tmpfile, index_cache) < 0) {
+		JANUS_LOG(LOG_ERR, "Error saving recordings index cache %s...\n", index_cache);
+		unlink(tmpfile);
+	} else {
+		JANUS_LOG(LOG_VERB, "Saved %zu recordings to the index cache %s\n", json_array_size(list), index_cache);
+	}
+	json_decref(cache);
+}
+
+/* Rescan the folder, only parsing the .nfo files that are new or changed since the last time */
 void janus_recordplay_update_recordings_list(void) {
 	if(recordings_path == NULL)
 		return;
 	JANUS_LOG(LOG_VERB, "Updating recordings list in %s\n", recordings_path);
 	janus_mutex_lock(&recordings_mutex);
-	/* First of all, let's keep track of which recordings are currently available */
-	GList *old_recordings = NULL;
-	if(recordings != NULL && g_hash_table_size(recordings) > 0) {
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, recordings);
-		while(g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_recordplay_recording *rec = value;
-			if(rec) {
-				janus_refcount_increase(&rec->ref);
-				old_recordings = g_list_append(old_recordings, &rec->id);
-			}
-		}
-	}
 	/* Open dir */
 	DIR *dir = opendir(recordings_path);
 	if(!dir) {
 		JANUS_LOG(LOG_ERR, "Couldn't open folder...\n");
-		g_list_free(old_recordings);
 		janus_mutex_unlock(&recordings_mutex);
 		return;
 	}
+	/* Keep track of the files we see, so that we can get rid of the ones that disappeared */
+	GHashTable *found = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
 	struct dirent *recent = NULL;
 	char recpath[1024];
+	struct stat st;
 	while((recent = readdir(dir))) {
 		int len = strlen(recent->d_name);
 		if(len < 4)
 			continue;
 		if(strcasecmp(recent->d_name+len-4, ".nfo"))
 			continue;
-		JANUS_LOG(LOG_VERB, "Importing recording '%s'...\n", recent->d_name);
-		memset(recpath, 0, 1024);
 		g_snprintf(recpath, 1024, "%s/%s", recordings_path, recent->d_name);
-		janus_config *nfo = janus_config_parse(recpath);
-		if(nfo == NULL) {
-			JANUS_LOG(LOG_ERR, "Invalid recording '%s'...\n", recent->d_name);
-			continue;
-		}
-		GList *cl = janus_config_get_categories(nfo, NULL);
-		if(cl == NULL || cl->data == NULL) {
-			JANUS_LOG(LOG_WARN, "No recording info in '%s', skipping...\n", recent->d_name);
-			janus_config_destroy(nfo);
+		if(stat(recpath, &st) < 0)
 			continue;
-		}
-		janus_config_category *cat = (janus_config_category *)cl->data;
-		guint64 id = g_ascii_strtoull(cat->name, NULL, 0);
-		if(id == 0) {
-			JANUS_LOG(LOG_WARN, "Invalid ID, skipping...\n");
-			g_list_free(cl);
-			janus_config_destroy(nfo);
-			continue;
-		}
-		janus_recordplay_recording *rec = g_hash_table_lookup(recordings, &id);
-		if(rec != NULL) {
-			JANUS_LOG(LOG_VERB, "Skipping recording with ID %"SCNu64", it's already in the list...\n", id);
-			g_list_free(cl);
-			janus_config_destroy(nfo);
-			/* Mark that we updated this recording */
-			old_recordings = g_list_remove(old_recordings, &rec->id);
-			janus_refcount_decrease(&rec->ref);
-			continue;
-		}
-		janus_config_item *name = janus_config_get(nfo, cat, janus_config_type_item, "name");
-		janus_config_item *date = janus_config_get(nfo, cat, janus_config_type_item, "date");
-		janus_config_item *audio = janus_config_get(nfo, cat, janus_config_type_item, "audio");
-		janus_config_item *video = janus_config_get(nfo, cat, janus_config_type_item, "video");
-		if(!name || !name->value || strlen(name->value) == 0 || !date || !date->value || strlen(date->value) == 0) {
-			JANUS_LOG(LOG_WARN, "Invalid info for recording %"SCNu64", skipping...\n", id);
-			g_list_free(cl);
-			janus_config_destroy(nfo);
-			continue;
-		}
-		if((!audio || !audio->value) && (!video || !video->value)) {
-			JANUS_LOG(LOG_WARN, "No audio and no video in recording %"SCNu64", skipping...\n", id);
-			janus_config_destroy(nfo);
-			continue;
-		}
-		rec = g_malloc0(sizeof(janus_recordplay_recording));
-		rec->id = id;
-		rec->name = g_strdup(name->value);
-		rec->date = g_strdup(date->value);
-		if(audio && audio->value) {
-			rec->arc_file = g_strdup(audio->value);
-			char *ext = strstr(rec->arc_file, ".mjr");
-			if(ext != NULL)
-				*ext = '\0';
-			/* Check which codec is in this recording */
-			rec->acodec = janus_audiocodec_from_name(janus_recordplay_parse_codec(recordings_path, rec->arc_file));
-		}
-		if(video && video->value) {
-			rec->vrc_file = g_strdup(video->value);
-			char *ext = strstr(rec->vrc_file, ".mjr");
-			if(ext != NULL)
-				*ext = '\0';
-			/* Check which codec is in this recording */
-			rec->vcodec = janus_videocodec_from_name(janus_recordplay_parse_codec(recordings_path, rec->vrc_file));
-		}
-		rec->audio_pt = AUDIO_PT;
-		if(rec->acodec != JANUS_AUDIOCODEC_NONE) {
-			/* Some audio codecs have a fixed payload type that we can't mess with */
-			if(rec->acodec == JANUS_AUDIOCODEC_PCMU)
-				rec->audio_pt = 0;
-			else if(rec->acodec == JANUS_AUDIOCODEC_PCMA)
-				rec->audio_pt = 8;
-			else if(rec->acodec == JANUS_AUDIOCODEC_G722)
-				rec->audio_pt = 9;
-		}
-		rec->video_pt = VIDEO_PT;
-		rec->viewers = NULL;
-		if(janus_recordplay_generate_offer(rec) < 0) {
-			JANUS_LOG(LOG_WARN, "Could not generate offer for recording %"SCNu64"...\n", rec->id);
-		}
-		g_atomic_int_set(&rec->destroyed, 0);
-		g_atomic_int_set(&rec->completed, 1);
-		janus_refcount_init(&rec->ref, janus_recordplay_recording_free);
-		janus_mutex_init(&rec->mutex);
-
-		g_list_free(cl);
-		janus_config_destroy(nfo);
-
-		/* Add to the list of recordings */
-		g_hash_table_insert(recordings, janus_uint64_dup(rec->id), rec);
+		g_hash_table_add(found, g_strdup(recent->d_name));
+		janus_recordplay_index_nfo(recent->d_name, (gint64)st.st_mtime);
 	}
 	closedir(dir);
-	/* Now let's check if any of the previously existing recordings was removed */
-	if(old_recordings != NULL) {
-		while(old_recordings != NULL) {
-			guint64 id = *((guint64 *)old_recordings->data);
-			JANUS_LOG(LOG_VERB, "Recording %"SCNu64" is not available anymore, removing...\n", id);
-			janus_recordplay_recording *old_rec = g_hash_table_lookup(recordings, &id);
-			if(old_rec != NULL) {
-				/* Remove it */
-				g_hash_table_remove(recordings, &id);
-				janus_refcount_decrease(&old_rec->ref);
+	/* Now let's check if any of the previously indexed files was removed */
+	GList *removed = NULL;
+	GHashTableIter iter;
+	gpointer key;
+	g_hash_table_iter_init(&iter, nfo_index);
+	while(g_hash_table_iter_next(&iter, &key, NULL)) {
+		if(!g_hash_table_contains(found, key))
+			removed = g_list_prepend(removed, g_strdup((char *)key));
+	}
+	GList *temp = removed;
+	while(temp) {
+		janus_recordplay_unindex_nfo((char *)temp->data);
+		temp = temp->next;
+	}
+	g_list_free_full(removed, (GDestroyNotify)g_free);
+	g_hash_table_destroy(found);
+	janus_mutex_unlock(&recordings_mutex);
+}
+
+#ifdef HAVE_INOTIFY
+/* Process the pending inotify events, if any: must be called with recordings_mutex locked */
+static gboolean janus_recordplay_process_events(void) {
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	char recpath[1024];
+	gboolean rescan = FALSE;
+	struct stat st;
+	while(inotify_active) {
+		ssize_t len = read(inotify_fd, buffer, sizeof(buffer));
+		if(len <= 0)
+			break;
+		char *ptr = buffer;
+		while(ptr < buffer + len) {
+			const struct inotify_event *event = (const struct inotify_event *)ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+			if(event->mask & IN_Q_OVERFLOW) {
+				/* We lost some events, we'll need to check the whole folder again */
+				JANUS_LOG(LOG_WARN, "Recordings folder events overflow, rescanning...\n");
+				rescan = TRUE;
+				continue;
+			}
+			if(event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+				JANUS_LOG(LOG_WARN, "Recordings folder not monitored anymore, use 'update' to rescan it\n");
+				/* The watcher thread will close the descriptor when it notices */
+				inotify_active = FALSE;
+				break;
 			}
-			old_recordings = old_recordings->next;
+			if(event->len == 0)
+				continue;
+			size_t nlen = strlen(event->name);
+			if(nlen < 4 || strcasecmp(event->name+nlen-4, ".nfo"))
+				continue;
+			if(event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+				JANUS_LOG(LOG_VERB, "Recording info '%s' removed\n", event->name);
+				janus_recordplay_unindex_nfo(event->name);
+			} else if(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+				JANUS_LOG(LOG_VERB, "Recording info '%s' added or changed\n", event->name);
+				g_snprintf(recpath, 1024, "%s/%s", recordings_path, event->name);
+				if(stat(recpath, &st) == 0)
+					janus_recordplay_index_nfo(event->name, (gint64)st.st_mtime);
+			}
+		}
+	}
+	return rescan;
+}
+
+/* Thread to keep the index up to date with what happens in the recordings folder */
+static void *janus_recordplay_watcher(void *data) {
+	JANUS_LOG(LOG_VERB, "Joining Record&Play watcher thread\n");
+	struct pollfd fds;
+	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
+		janus_mutex_lock(&recordings_mutex);
+		gboolean active = inotify_active;
+		janus_mutex_unlock(&recordings_mutex);
+		if(!active)
+			break;
+		fds.fd = inotify_fd;
+		fds.events = POLLIN;
+		fds.revents = 0;
+		int res = poll(&fds, 1, 1000);
+		if(res < 0) {
+			if(errno == EINTR)
+				continue;
+			JANUS_LOG(LOG_ERR, "Error polling the recordings folder events: %d (%s)\n", errno, strerror(errno));
+			break;
+		}
+		if(res > 0) {
+			janus_mutex_lock(&recordings_mutex);
+			gboolean rescan = janus_recordplay_process_events();
+			janus_mutex_unlock(&recordings_mutex);
+			if(rescan)
+				janus_recordplay_update_recordings_list();
 		}
-		g_list_free(old_recordings);
+		/* Persist the changes to the index cache, if any, but not too often */
+		janus_mutex_lock(&recordings_mutex);
+		gboolean save = index_dirty && janus_get_monotonic_time() - index_saved >= 10*G_USEC_PER_SEC;
+		janus_mutex_unlock(&recordings_mutex);
+		if(save)
+			janus_recordplay_save_index();
 	}
+	/* We're the only ones allowed to close the descriptor, as we may be polling it */
+	janus_mutex_lock(&recordings_mutex);
+	inotify_active = FALSE;
+	close(inotify_fd);
+	inotify_fd = -1;
 	janus_mutex_unlock(&recordings_mutex);
+	JANUS_LOG(LOG_VERB, "Leaving Record&Play watcher thread\n");
+	return NULL;
+}
+#endif
+
+/* Bring the index up to date: when we're monitoring the folder we only need
+ * to look at the pending events, otherwise we rescan the folder */
+static void janus_recordplay_refresh_recordings_list(void) {
+#ifdef HAVE_INOTIFY
+	janus_mutex_lock(&recordings_mutex);
+	if(inotify_active) {
+		gboolean rescan = janus_recordplay_process_events();
+		gboolean monitoring = inotify_active;
+		janus_mutex_unlock(&recordings_mutex);
+		if(rescan || !monitoring)
+			janus_recordplay_update_recordings_list();
+		return;
+	}
+	janus_mutex_unlock(&recordings_mutex);
+#endif
+	janus_recordplay_update_recordings_list();
 }
 
 janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, const char *filename) {
@@ -52,7 +52,6 @@
 #include <net/if.h>
 #include <sys/socket.h>
 #include <netdb.h>
-#include <poll.h>
 
 #include <jansson.h>
 
@@ -86,6 +85,7 @@
 #include "../sdp-utils.h"
 #include "../utils.h"
 #include "../ip-utils.h"
+#include "../media-reactor.h"
 
 
 /* Plugin information */
@@ -459,6 +459,8 @@ typedef struct janus_sipre_stack {
 typedef struct janus_sipre_media {
 	char *remote_audio_ip;			/* Peer audio media IP address */
 	char *remote_video_ip;			/* Peer video media IP address */
+	struct sockaddr_in remote_audio_addr;	/* Peer audio media address, resolved when processing the SDP */
+	struct sockaddr_in remote_video_addr;	/* Peer video media address, resolved when processing the SDP */
 	gboolean earlymedia;
 	gboolean update;
 	gboolean ready;
@@ -491,6 +493,10 @@ typedef struct janus_sipre_media {
 	janus_rtp_switching_context context;
 	int pipefd[2];
 	gboolean updated;
+	/* State of the relay (only accessed by the media reactor) */
+	int relay_astep, relay_vstep;
+	guint32 relay_ats, relay_vts;
+	int relay_errors;
 } janus_sipre_media;
 
 struct janus_sipre_session {
@@ -509,7 +515,7 @@ struct janus_sipre_session {
 	janus_recorder *vrc;		/* The Janus recorder instance for this user's video, if enabled */
 	janus_recorder *vrc_peer;	/* The Janus recorder instance for the peer's video, if enabled */
 	janus_mutex rec_mutex;		/* Mutex to protect the recorders from race conditions */
-	GThread *relayer_thread;
+	janus_media_reactor_handler *relayer;
 	volatile gint establishing, established;
 	volatile gint hangingup;
 	volatile gint destroyed;
@@ -851,6 +857,8 @@ static void janus_sipre_media_reset(janus_sipre_session *session) {
 	session->media.remote_audio_ip = NULL;
 	g_free(session->media.remote_video_ip);
 	session->media.remote_video_ip = NULL;
+	memset(&session->media.remote_audio_addr, 0, sizeof(session->media.remote_audio_addr));
+	memset(&session->media.remote_video_addr, 0, sizeof(session->media.remote_video_addr));
 	session->media.earlymedia = FALSE;
 	session->media.update = FALSE;
 	session->media.updated = FALSE;
@@ -940,7 +948,9 @@ void janus_sipre_sdp_process(janus_sipre_session *session, janus_sdp *sdp, gbool
 char *janus_sipre_sdp_manipulate(janus_sipre_session *session, janus_sdp *sdp, gboolean answer);
 /* Media */
 static int janus_sipre_allocate_local_ports(janus_sipre_session *session);
-static void *janus_sipre_relay_thread(void *data);
+static gboolean janus_sipre_relay_start(janus_sipre_session *session);
+static void janus_sipre_relay_incoming(janus_media_reactor_handler *handler, int fd,
+	janus_media_reactor_event event, void *user_data);
 static void janus_sipre_media_cleanup(janus_sipre_session *session);
 
 
@@ -1659,7 +1669,7 @@ static void janus_sipre_hangup_media_internal(janus_plugin_session *handle) {
 		return;
 	session->media.simulcast_ssrc = 0;
 	/* Do cleanup if media thread has not been created */
-	if(!session->media.ready && !session->relayer_thread) {
+	if(!session->media.ready && !session->relayer) {
 		janus_sipre_media_cleanup(session);
 	}
 	session->media.ready = FALSE;
@@ -2335,16 +2345,9 @@ static void *janus_sipre_handler(void *data) {
 			if(answer) {
 				/* Start the media */
 				session->media.ready = TRUE;	/* FIXME Maybe we need a better way to signal this */
-				GError *error = NULL;
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "siprertp %s", session->account.username);
-				janus_refcount_increase(&session->ref);
-				session->relayer_thread = g_thread_try_new(tname, janus_sipre_relay_thread, session, &error);
-				if(error != NULL) {
-					session->relayer_thread = NULL;
+				if(!janus_sipre_relay_start(session)) {
 					session->media.ready = FALSE;
-					janus_refcount_decrease(&session->ref);
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTP/RTCP thread...\n", error->code, error->message ? error->message : "??");
+					JANUS_LOG(LOG_ERR, "Couldn't start relaying RTP/RTCP...\n");
 				}
 			}
 		} else if(!strcasecmp(request_text, "update")) {
@@ -2869,6 +2872,27 @@ error:
 
 
 /* Process an incoming SDP */
+/* Resolve the address of the peer media: this is done here, when processing
+ * the SDP, as gethostbyname() may block waiting for a response on the wire,
+ * which is something the media reactor can't afford, as it serves many calls */
+static void janus_sipre_resolve_address(janus_sipre_session *session, const char *ip, struct sockaddr_in *addr) {
+	memset(addr, 0, sizeof(struct sockaddr_in));
+	if(ip == NULL)
+		return;
+	struct sockaddr_in resolved;
+	memset(&resolved, 0, sizeof(struct sockaddr_in));
+	resolved.sin_family = AF_INET;
+	if(inet_aton(ip, &resolved.sin_addr) == 0) {	/* Not a numeric IP... */
+		struct hostent *host = gethostbyname(ip);	/* ...resolve name */
+		if(!host || host->h_addr_list[0] == NULL) {
+			JANUS_LOG(LOG_ERR, "[SIPre-%s] Couldn't get host (%s)\n", session->account.username, ip);
+			return;
+		}
+		resolved.sin_addr = *(struct in_addr *)host->h_addr_list[0];
+	}
+	*addr = resolved;
+}
+
 void janus_sipre_sdp_process(janus_sipre_session *session, janus_sdp *sdp, gboolean answer, gboolean update, gboolean *changed) {
 	if(!session || !sdp)
 		return;
@@ -2994,6 +3018,9 @@ void janus_sipre_sdp_process(janus_sipre_session *session, janus_sdp *sdp, gbool
 		}
 		temp = temp->next;
 	}
+	/* Resolve the peer addresses now, the media reactor will only use the result */
+	janus_sipre_resolve_address(session, session->media.remote_audio_ip, &session->media.remote_audio_addr);
+	janus_sipre_resolve_address(session, session->media.remote_video_ip, &session->media.remote_video_addr);
 	if(update && changed && *changed) {
 		/* Something changed: mark this on the session, so that the thread can update the sockets */
 		session->media.updated = TRUE;
@@ -3202,7 +3229,7 @@ static int janus_sipre_allocate_local_ports(janus_sipre_session *session) {
 			session->media.local_video_rtcp_port = rtcp_port;
 		}
 	}
-	/* We need this to quickly interrupt the poll when it's time to update a session or wrap up */
+	/* We need this to quickly wake up the relay when it's time to update a session or wrap up */
 	pipe(session->media.pipefd);
 	return 0;
 }
@@ -3292,304 +3319,242 @@ static void janus_sipre_media_cleanup(janus_sipre_session *session) {
 	janus_sipre_media_reset(session);
 }
 
-/* Thread to relay RTP/RTCP frames coming from the SIPre peer */
-static void *janus_sipre_relay_thread(void *data) {
-	janus_sipre_session *session = (janus_sipre_session *)data;
-	if(!session) {
-		g_thread_unref(g_thread_self());
-		return NULL;
-	}
-	if(!session->account.username || !session->callee) {
+/* Relay RTP/RTCP frames coming from the SIPre peer: rather than having a
+ * thread per call polling the sockets, we rely on the shared media
+ * reactor, which notifies us when there's something to read, always from
+ * the same thread for the same call, and about once per second in any case */
+static void janus_sipre_relay_watch(janus_sipre_session *session, janus_media_reactor_handler *handler) {
+	int fds[5] = {
+		session->media.audio_rtp_fd, session->media.audio_rtcp_fd,
+		session->media.video_rtp_fd, session->media.video_rtcp_fd,
+		session->media.pipefd[0]
+	};
+	janus_media_reactor_handler_watch(handler, fds, 5);
+}
+
+static gboolean janus_sipre_relay_start(janus_sipre_session *session) {
+	if(!session->account.username || !session->callee)
+		return FALSE;
+	JANUS_LOG(LOG_VERB, "Starting relay (%s <--> %s)\n", session->account.username, session->callee);
+	session->media.relay_astep = 0;
+	session->media.relay_vstep = 0;
+	session->media.relay_ats = 0;
+	session->media.relay_vts = 0;
+	session->media.relay_errors = 0;
+	session->media.updated = TRUE;	/* Connect UDP sockets as soon as we start */
+	janus_refcount_increase(&session->ref);
+	janus_media_reactor_handler *handler = janus_media_reactor_handler_add(janus_sipre_relay_incoming, session);
+	if(handler == NULL) {
 		janus_refcount_decrease(&session->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
+		return FALSE;
+	}
+	session->relayer = handler;
+	janus_sipre_relay_watch(session, handler);
+	/* Wake the handler up, so that the sockets are connected right away */
+	if(session->media.pipefd[1] > 0) {
+		int code = 1;
+		ssize_t res = 0;
+		do {
+			res = write(session->media.pipefd[1], &code, sizeof(int));
+		} while(res == -1 && errno == EINTR);
 	}
-	JANUS_LOG(LOG_VERB, "Starting relay thread (%s <--> %s)\n", session->account.username, session->callee);
+	return TRUE;
+}
 
-	if(!session->callee) {
-		JANUS_LOG(LOG_VERB, "[SIPre-%s] Leaving thread, no callee...\n", session->account.username);
-		janus_refcount_decrease(&session->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
+static void janus_sipre_relay_stop(janus_sipre_session *session, janus_media_reactor_handler *handler) {
+	janus_media_reactor_handler_remove(handler);
+	/* Cleanup the media session */
+	janus_sipre_media_cleanup(session);
+	/* Done */
+	JANUS_LOG(LOG_VERB, "Leaving SIPre relay\n");
+	session->relayer = NULL;
+	janus_refcount_decrease(&session->ref);
+}
+
+static void janus_sipre_relay_incoming(janus_media_reactor_handler *handler, int fd, janus_media_reactor_event event, void *user_data) {
+	janus_sipre_session *session = (janus_sipre_session *)user_data;
+	if(g_atomic_int_get(&session->destroyed) ||
+			session->status <= janus_sipre_call_status_idle ||
+			session->status >= janus_sipre_call_status_closing) {	/* FIXME We need a per-call watchdog as well */
+		janus_sipre_relay_stop(session, handler);
+		return;
+	}
+	gboolean updated = session->media.updated;
+	if(updated) {
+		/* Apparently there was a session update, or the relay has just been started */
+		session->media.updated = FALSE;
+
+		/* The addresses were resolved when processing the SDP: we just need a copy */
+		gboolean have_audio_server_ip = session->media.remote_audio_addr.sin_family == AF_INET;
+		struct sockaddr_in audio_server_addr = session->media.remote_audio_addr;
+		gboolean have_video_server_ip = session->media.remote_video_addr.sin_family == AF_INET;
+		struct sockaddr_in video_server_addr = session->media.remote_video_addr;
+
+		if(have_audio_server_ip || have_video_server_ip) {
+			janus_sipre_connect_sockets(session, have_audio_server_ip ? &audio_server_addr : NULL,
+				have_video_server_ip ? &video_server_addr : NULL);
+		} else if (session->media.remote_audio_ip == NULL &&  session->media.remote_video_ip == NULL) {
+			JANUS_LOG(LOG_ERR, "[SIPre-%p] Couldn't update session details: both audio and video remote IP addresses are NULL\n",
+				session->account.username);
+		} else {
+			if (session->media.remote_audio_ip)
+				JANUS_LOG(LOG_ERR, "[SIPre-%p] Couldn't update session details: audio remote IP address (%s) is invalid\n",
+					session->account.username, session->media.remote_audio_ip);
+			if (session->media.remote_video_ip)
+				JANUS_LOG(LOG_ERR, "[SIPre-%p] Couldn't update session details: video remote IP address (%s) is invalid\n",
+					session->account.username, session->media.remote_video_ip);
+		}
+		/* The sockets may have changed as well */
+		janus_sipre_relay_watch(session, handler);
+	}
+	if(event == janus_media_reactor_event_tick)
+		return;
+	if(event == janus_media_reactor_event_error) {
+		/* If we just updated the session, let's wait until things have calmed down */
+		if(updated)
+			return;
+		/* Check the socket error */
+		int error = 0;
+		socklen_t errlen = sizeof(error);
+		getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
+		if(error == 0) {
+			/* Maybe not a breaking error after all? */
+			return;
+		} else if(error == 111) {
+			/* ICMP error? If it's related to RTCP, let's just close the RTCP socket and move on */
+			if(fd == session->media.audio_rtcp_fd) {
+				JANUS_LOG(LOG_WARN, "[SIPre-%s] Got a '%s' on the audio RTCP socket, closing it\n",
+					session->account.username, strerror(error));
+				session->media.audio_rtcp_fd = -1;
+				janus_sipre_relay_watch(session, handler);
+				close(fd);
+				return;
+			} else if(fd == session->media.video_rtcp_fd) {
+				JANUS_LOG(LOG_WARN, "[SIPre-%s] Got a '%s' on the video RTCP socket, closing it\n",
+					session->account.username, strerror(error));
+				session->media.video_rtcp_fd = -1;
+				janus_sipre_relay_watch(session, handler);
+				close(fd);
+				return;
+			}
+		}
+		/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
+		session->media.relay_errors++;
+		if(session->media.relay_errors < 100)
+			return;
+		JANUS_LOG(LOG_ERR, "[SIPre-%s] Too many errors polling %d...\n", session->account.username, fd);
+		JANUS_LOG(LOG_ERR, "[SIPre-%s]   -- %d (%s)\n", session->account.username, error, strerror(error));
+		/* FIXME Simulate a "hangup" coming from the browser */
+		janus_sipre_hangup_media(session->handle);
+		/* Can we assume it's pretty much over, after so many errors? */
+		janus_sipre_relay_stop(session, handler);
+		return;
+	}
+	if(fd == session->media.pipefd[0]) {
+		/* We've been woken up for a reason, which we handled already */
+		int code = 0;
+		(void)read(fd, &code, sizeof(int));
+		return;
 	}
 	/* File descriptors */
 	socklen_t addrlen;
 	struct sockaddr_in remote;
-	int resfd = 0, bytes = 0, pollerrs = 0;
-	struct pollfd fds[5];
-	int pipe_fd = session->media.pipefd[0];
+	int bytes = 0;
 	char buffer[1500];
-	memset(buffer, 0, 1500);
-	/* Loop */
-	int num = 0;
-	gboolean goon = TRUE;
-	int astep = 0, vstep = 0;
-	guint32 ats = 0, vts = 0;
-
-	session->media.updated = TRUE; /* Connect UDP sockets upon loop entry */
-	gboolean have_audio_server_ip = TRUE;
-	gboolean have_video_server_ip = TRUE;
-
-	while(goon && session != NULL && !g_atomic_int_get(&session->destroyed) &&
-			session->status > janus_sipre_call_status_idle &&
-			session->status < janus_sipre_call_status_closing) {	/* FIXME We need a per-call watchdog as well */
-
-		if(session->media.updated) {
-			/* Apparently there was a session update, or the loop has just been entered */
-			session->media.updated = FALSE;
-
-			have_audio_server_ip = session->media.remote_audio_ip != NULL;
-			struct sockaddr_in audio_server_addr;
-			memset(&audio_server_addr, 0, sizeof(struct sockaddr_in));
-			audio_server_addr.sin_family = AF_INET;
-
-			have_video_server_ip = session->media.remote_video_ip != NULL;
-			struct sockaddr_in video_server_addr;
-			memset(&video_server_addr, 0, sizeof(struct sockaddr_in));
-			video_server_addr.sin_family = AF_INET;
-
-			if(session->media.remote_audio_ip && inet_aton(session->media.remote_audio_ip, &audio_server_addr.sin_addr) == 0) {	/* Not a numeric IP... */
-				/* Note that gethostbyname() may block waiting for response if it triggers on the wire request.*/
-				struct hostent *host = gethostbyname(session->media.remote_audio_ip);	/* ...resolve name */
-				if(!host) {
-					JANUS_LOG(LOG_ERR, "[SIPre-%s] Couldn't get host (%s)\n", session->account.username, session->media.remote_audio_ip);
-					have_audio_server_ip = FALSE;
-				} else {
-					audio_server_addr.sin_addr = *(struct in_addr *)host->h_addr_list;
-				}
-			}
-
-			if(session->media.remote_video_ip && inet_aton(session->media.remote_video_ip, &video_server_addr.sin_addr) == 0) {	/* Not a numeric IP... */
-				/* Note that gethostbyname() may block waiting for response if it triggers on the wire request.*/
-				struct hostent *host = gethostbyname(session->media.remote_audio_ip);	/* ...resolve name */
-				if(!host) {
-					JANUS_LOG(LOG_ERR, "[SIPre-%s] Couldn't get host (%s)\n", session->account.username, session->media.remote_video_ip);
-					have_video_server_ip = FALSE;
-				} else {
-					video_server_addr.sin_addr = *(struct in_addr *)host->h_addr_list;
-				}
-			}
-
-			if(have_audio_server_ip || have_video_server_ip) {
-				janus_sipre_connect_sockets(session, have_audio_server_ip ? &audio_server_addr : NULL,
-					have_video_server_ip ? &video_server_addr : NULL);
-			} else if (session->media.remote_audio_ip == NULL &&  session->media.remote_video_ip == NULL) {
-				JANUS_LOG(LOG_ERR, "[SIPre-%p] Couldn't update session details: both audio and video remote IP addresses are NULL\n",
-					session->account.username);
+	/* Got an RTP/RTCP packet */
+	addrlen = sizeof(remote);
+	bytes = recvfrom(fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
+	if(bytes < 0) {
+		/* Failed to read? */
+		return;
+	}
+	/* Let's check what this is */
+	gboolean video = fd == session->media.video_rtp_fd || fd == session->media.video_rtcp_fd;
+	gboolean rtcp = fd == session->media.audio_rtcp_fd || fd == session->media.video_rtcp_fd;
+	if(!rtcp) {
+		/* Audio or Video RTP */
+		if(!janus_is_rtp(buffer, bytes)) {
+			/* Not an RTP packet? */
+			return;
+		}
+		session->media.relay_errors = 0;
+		rtp_header *header = (rtp_header *)buffer;
+		if((video && session->media.video_ssrc_peer != ntohl(header->ssrc)) ||
+				(!video && session->media.audio_ssrc_peer != ntohl(header->ssrc))) {
+			if(video) {
+				session->media.video_ssrc_peer = ntohl(header->ssrc);
 			} else {
-				if (session->media.remote_audio_ip)
-					JANUS_LOG(LOG_ERR, "[SIPre-%p] Couldn't update session details: audio remote IP address (%s) is invalid\n",
-						session->account.username, session->media.remote_audio_ip);
-				if (session->media.remote_video_ip)
-					JANUS_LOG(LOG_ERR, "[SIPre-%p] Couldn't update session details: video remote IP address (%s) is invalid\n",
-						session->account.username, session->media.remote_video_ip);
+				session->media.audio_ssrc_peer = ntohl(header->ssrc);
 			}
+			JANUS_LOG(LOG_VERB, "[SIPre-%s] Got SIP peer %s SSRC: %"SCNu32"\n",
+				session->account.username ? session->account.username : "unknown",
+				video ? "video" : "audio", session->media.audio_ssrc_peer);
 		}
-
-		/* Prepare poll */
-		num = 0;
-		if(session->media.audio_rtp_fd != -1) {
-			fds[num].fd = session->media.audio_rtp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		if(session->media.audio_rtcp_fd != -1) {
-			fds[num].fd = session->media.audio_rtcp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		if(session->media.video_rtp_fd != -1) {
-			fds[num].fd = session->media.video_rtp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		if(session->media.video_rtcp_fd != -1) {
-			fds[num].fd = session->media.video_rtcp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		if(pipe_fd != -1) {
-			fds[num].fd = pipe_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		/* Wait for some data */
-		resfd = poll(fds, num, 1000);
-		if(resfd < 0) {
-			if(errno == EINTR) {
-				JANUS_LOG(LOG_HUGE, "[SIPre-%s] Got an EINTR (%s), ignoring...\n", session->account.username, strerror(errno));
-				continue;
+		/* Is this SRTP? */
+		if(session->media.has_srtp_remote) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect(
+				(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
+				buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				guint32 timestamp = ntohl(header->timestamp);
+				guint16 seq = ntohs(header->seq_number);
+				JANUS_LOG(LOG_ERR, "[SIPre-%s] %s SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+					session->account.username ? session->account.username : "unknown",
+					video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+				return;
 			}
-			JANUS_LOG(LOG_ERR, "[SIPre-%s] Error polling...\n", session->account.username);
-			JANUS_LOG(LOG_ERR, "[SIPre-%s]   -- %d (%s)\n", session->account.username, errno, strerror(errno));
-			break;
-		} else if(resfd == 0) {
-			/* No data, keep going */
-			continue;
+			bytes = buflen;
 		}
-		if(session == NULL || g_atomic_int_get(&session->destroyed) ||
-				session->status <= janus_sipre_call_status_idle ||
-				session->status >= janus_sipre_call_status_closing)
-			break;
-		int i = 0;
-		for(i=0; i<num; i++) {
-			if(fds[i].revents & (POLLERR | POLLHUP)) {
-				/* If we just updated the session, let's wait until things have calmed down */
-				if(session->media.updated)
-					break;
-				/* Check the socket error */
-				int error = 0;
-				socklen_t errlen = sizeof(error);
-				getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
-				if(error == 0) {
-					/* Maybe not a breaking error after all? */
-					continue;
-				} else if(error == 111) {
-					/* ICMP error? If it's related to RTCP, let's just close the RTCP socket and move on */
-					if(fds[i].fd == session->media.audio_rtcp_fd) {
-						JANUS_LOG(LOG_WARN, "[SIPre-%s] Got a '%s' on the audio RTCP socket, closing it\n",
-							session->account.username, strerror(error));
-						close(session->media.audio_rtcp_fd);
-						session->media.audio_rtcp_fd = -1;
-						continue;
-					} else if(fds[i].fd == session->media.video_rtcp_fd) {
-						JANUS_LOG(LOG_WARN, "[SIPre-%s] Got a '%s' on the video RTCP socket, closing it\n",
-							session->account.username, strerror(error));
-						close(session->media.video_rtcp_fd);
-						session->media.video_rtcp_fd = -1;
-						continue;
-					}
+		/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
+		guint32 timestamp = ntohl(header->timestamp);
+		janus_rtp_header_update(header, &session->media.context, video,
+			(video ? (session->media.relay_vstep ? session->media.relay_vstep : 4500) : (session->media.relay_astep ? session->media.relay_astep : 960)));
+		if(video) {
+			if(session->media.relay_vts == 0) {
+				session->media.relay_vts = timestamp;
+			} else if(session->media.relay_vstep == 0) {
+				session->media.relay_vstep = timestamp-session->media.relay_vts;
+				if(session->media.relay_vstep < 0) {
+					session->media.relay_vstep = 0;
 				}
-				/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
-				pollerrs++;
-				if(pollerrs < 100)
-					continue;
-				JANUS_LOG(LOG_ERR, "[SIPre-%s] Too many errors polling %d (socket #%d): %s...\n", session->account.username,
-					fds[i].fd, i, fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP");
-				JANUS_LOG(LOG_ERR, "[SIPre-%s]   -- %d (%s)\n", session->account.username, error, strerror(error));
-				/* Can we assume it's pretty much over, after a POLLERR? */
-				goon = FALSE;
-				/* FIXME Simulate a "hangup" coming from the browser */
-				janus_sipre_hangup_media(session->handle);
-				break;
-			} else if(fds[i].revents & POLLIN) {
-				if(pipe_fd != -1 && fds[i].fd == pipe_fd) {
-					/* Poll interrupted for a reason, go on */
-					int code = 0;
-					(void)read(pipe_fd, &code, sizeof(int));
-					break;
-				}
-				/* Got an RTP/RTCP packet */
-				addrlen = sizeof(remote);
-				bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
-				if(bytes < 0) {
-					/* Failed to read? */
-					continue;
-				}
-				/* Let's check what this is */
-				gboolean video = fds[i].fd == session->media.video_rtp_fd || fds[i].fd == session->media.video_rtcp_fd;
-				gboolean rtcp = fds[i].fd == session->media.audio_rtcp_fd || fds[i].fd == session->media.video_rtcp_fd;
-				if(!rtcp) {
-					/* Audio or Video RTP */
-					if(!janus_is_rtp(buffer, bytes)) {
-						/* Not an RTP packet? */
-						continue;
-					}
-					pollerrs = 0;
-					rtp_header *header = (rtp_header *)buffer;
-					if((video && session->media.video_ssrc_peer != ntohl(header->ssrc)) ||
-							(!video && session->media.audio_ssrc_peer != ntohl(header->ssrc))) {
-						if(video) {
-							session->media.video_ssrc_peer = ntohl(header->ssrc);
-						} else {
-							session->media.audio_ssrc_peer = ntohl(header->ssrc);
-						}
-						JANUS_LOG(LOG_VERB, "[SIPre-%s] Got SIP peer %s SSRC: %"SCNu32"\n",
-							session->account.username ? session->account.username : "unknown",
-							video ? "video" : "audio", session->media.audio_ssrc_peer);
-					}
-					/* Is this SRTP? */
-					if(session->media.has_srtp_remote) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect(
-							(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
-							buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							guint32 timestamp = ntohl(header->timestamp);
-							guint16 seq = ntohs(header->seq_number);
-							JANUS_LOG(LOG_ERR, "[SIPre-%s] %s SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-								session->account.username ? session->account.username : "unknown",
-								video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
-					guint32 timestamp = ntohl(header->timestamp);
-					janus_rtp_header_update(header, &session->media.context, video,
-						(video ? (vstep ? vstep : 4500) : (astep ? astep : 960)));
-					if(video) {
-						if(vts == 0) {
-							vts = timestamp;
-						} else if(vstep == 0) {
-							vstep = timestamp-vts;
-							if(vstep < 0) {
-								vstep = 0;
-							}
-						}
-					} else {
-						if(ats == 0) {
-							ats = timestamp;
-						} else if(astep == 0) {
-							astep = timestamp-ats;
-							if(astep < 0) {
-								astep = 0;
-							}
-						}
-					}
-					/* Save the frame if we're recording */
-					janus_recorder_save_frame(video ? session->vrc_peer : session->arc_peer, buffer, bytes);
-					/* Relay to browser */
-					gateway->relay_rtp(session->handle, video, buffer, bytes);
-					continue;
-				} else {
-					/* Audio or Video RTCP */
-					if(!janus_is_rtcp(buffer, bytes)) {
-						/* Not an RTCP packet? */
-						continue;
-					}
-					if(session->media.has_srtp_remote) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect_rtcp(
-							(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
-							buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							JANUS_LOG(LOG_ERR, "[SIPre-%s] %s SRTCP unprotect error: %s (len=%d-->%d)\n",
-								session->account.username ? session->account.username : "unknown",
-								video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Relay to browser */
-					gateway->relay_rtcp(session->handle, video, buffer, bytes);
-					continue;
+			}
+		} else {
+			if(session->media.relay_ats == 0) {
+				session->media.relay_ats = timestamp;
+			} else if(session->media.relay_astep == 0) {
+				session->media.relay_astep = timestamp-session->media.relay_ats;
+				if(session->media.relay_astep < 0) {
+					session->media.relay_astep = 0;
 				}
 			}
 		}
+		/* Save the frame if we're recording */
+		janus_recorder_save_frame(video ? session->vrc_peer : session->arc_peer, buffer, bytes);
+		/* Relay to browser */
+		gateway->relay_rtp(session->handle, video, buffer, bytes);
+	} else {
+		/* Audio or Video RTCP */
+		if(!janus_is_rtcp(buffer, bytes)) {
+			/* Not an RTCP packet? */
+			return;
+		}
+		if(session->media.has_srtp_remote) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect_rtcp(
+				(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
+				buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				JANUS_LOG(LOG_ERR, "[SIPre-%s] %s SRTCP unprotect error: %s (len=%d-->%d)\n",
+					session->account.username ? session->account.username : "unknown",
+					video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen);
+				return;
+			}
+			bytes = buflen;
+		}
+		/* Relay to browser */
+		gateway->relay_rtcp(session->handle, video, buffer, bytes);
 	}
-	/* Cleanup the media session */
-	janus_sipre_media_cleanup(session);
-	/* Done */
-	JANUS_LOG(LOG_VERB, "Leaving SIPre relay thread\n");
-	janus_refcount_decrease(&session->ref);
-	g_thread_unref(g_thread_self());
-	return NULL;
 }
 
 
@@ -3769,7 +3734,7 @@ void janus_sipre_cb_incoming(const struct sip_msg *msg, void *arg) {
 	g_snprintf(callid, sizeof(callid), "%.*s", (int)msg->callid.l, msg->callid.p);
 	JANUS_LOG(LOG_HUGE, "[SIPre-%s]   -- Call-ID: %s\n", session->account.username, callid);
 	/* Make sure we're not in a call already */
-	if(session->stack.sess != NULL || g_atomic_int_get(&session->establishing) || g_atomic_int_get(&session->established) || session->relayer_thread != NULL) {
+	if(session->stack.sess != NULL || g_atomic_int_get(&session->establishing) || g_atomic_int_get(&session->established) || session->relayer != NULL) {
 		/* Already in a call */
 		JANUS_LOG(LOG_VERB, "Already in a call (busy, status=%s)\n", janus_sipre_call_status_string(session->status));
 		mqueue_push(mq, janus_sipre_mqueue_event_do_rcode, janus_sipre_mqueue_payload_create(session, msg, 486, session));
@@ -4007,16 +3972,9 @@ int janus_sipre_cb_answer(const struct sip_msg *msg, void *arg) {
 		return 0;
 	}
 	if(!session->media.earlymedia && !session->media.update) {
-		GError *error = NULL;
-		char tname[16];
-		g_snprintf(tname, sizeof(tname), "siprertp %s", session->account.username);
-		janus_refcount_increase(&session->ref);
-		session->relayer_thread = g_thread_try_new(tname, janus_sipre_relay_thread, session, &error);
-		if(error != NULL) {
-			session->relayer_thread = NULL;
+		if(!janus_sipre_relay_start(session)) {
 			session->media.ready = FALSE;
-			janus_refcount_decrease(&session->ref);
-			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTP/RTCP thread...\n", error->code, error->message ? error->message : "??");
+			JANUS_LOG(LOG_ERR, "Couldn't start relaying RTP/RTCP...\n");
 		}
 	}
 	/* Send event back to the browser */
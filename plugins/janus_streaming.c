@@ -42,6 +42,18 @@
  * that you'll have to stay within the boundaries of the MTU, as each
  * message will have to stay within the size of an UDP packet.
  *
+ * In case the media to broadcast comes from another plugin in the same
+ * Janus instance (e.g., a VideoRoom publisher you want to make available
+ * to a much larger audience), you don't need to RTP forward it to your
+ * own ports: a \c bridge mountpoint can receive it directly via the core
+ * media bridge instead, which means no sockets, no syscalls and no SRTP
+ * involved for each packet. The mountpoint gets the packets in a thread
+ * of its own, so a large audience won't slow down the plugin that is
+ * originating the media. Keyframe requests from viewers are sent
+ * back to the source plugin the same way. The name of the source to
+ * attach to depends on the plugin originating the media: VideoRoom
+ * publishers, for instance, are available as \c videoroom/<room>/<id> .
+ *
  * Streams to make available are listed in the plugin configuration file.
  * A pre-filled configuration file is provided in \c conf/janus.plugin.streaming.jcfg
  * and includes a stream of every type.
@@ -58,7 +70,7 @@ stream-name: {
  * with the allowed settings listed below:
  *
  * \verbatim
-type = rtp|live|ondemand|rtsp
+type = rtp|live|ondemand|rtsp|bridge
        rtp = stream originated by an external tool (e.g., gstreamer or
              ffmpeg) and sent to the plugin via RTP
        live = local file streamed live to multiple viewers
@@ -67,6 +79,8 @@ type = rtp|live|ondemand|rtsp
                   (multiple viewers = different streaming contexts)
        rtsp = stream originated by an external RTSP feed (only
               available if libcurl support was compiled)
+       bridge = stream originated by another plugin in the same
+                instance (e.g., a VideoRoom publisher) via the media bridge
 id = <unique numeric ID>
 description = This is my awesome stream
 is_private = true|false (private streams don't appear when you do a 'list' request)
@@ -94,8 +108,13 @@ videoiface = network interface or IP address to bind to, if any (binds to all ot
 videopt = <video RTP payload type> (e.g., 100)
 videortpmap = RTP map of the video codec (e.g., VP8/90000)
 videofmtp = Codec specific parameters, if any
-videobufferkf = true|false (whether the plugin should store the latest
-	keyframe and send it immediately for new viewers, EXPERIMENTAL)
+videobufferkf = true|false (whether the plugin should store all the packets
+	since the latest keyframe, i.e., the whole GOP, and send them immediately
+	to new viewers, so that they can start rendering without waiting for
+	a new keyframe; with simulcast, a GOP is kept for each substream)
+videobufferkfsize = maximum number of video packets to store for each GOP,
+	when videobufferkf is enabled (default=1024); if a GOP gets larger
+	than that, only its keyframe is kept and sent to new viewers
 videosimulcast = true|false (do|don't enable video simulcasting)
 videoport2 = second local port for receiving video frames (only for rtp, and simulcasting)
 videoport3 = third local port for receiving video frames (only for rtp, and simulcasting)
@@ -128,6 +147,13 @@ rtsp_user = RTSP authorization username, if needed
 rtsp_pwd = RTSP authorization password, if needed
 rtsp_failcheck = whether an error should be returned if connecting to the RTSP server fails (default=true)
 rtspiface = network interface IP address or device name to listen on when receiving RTSP streams
+
+The following options are only valid for the 'bridge' type (which also
+supports audiopt, audiortpmap, audiofmtp, videopt, videortpmap, videofmtp,
+videobufferkf, videobufferkfsize, videosimulcast and threads, with the
+same meaning as above):
+source = name of the media bridge source to receive media from (e.g.,
+	videoroom/1234/5678 for publisher 5678 in VideoRoom room 1234)
 \endverbatim
  *
  * \section streamapi Streaming API
@@ -175,18 +201,23 @@ rtspiface = network interface IP address or device name to listen on when receiv
  *
 \verbatim
 {
-	"request" : "list"
+	"request" : "list",
+	"offset" : <number of mountpoints to skip, to paginate the list; optional, default=0>,
+	"limit" : <maximum number of mountpoints to return; optional, default=0 (no limit)>
 }
 \endverbatim
  *
- * If successful, it will return an array with a list of all the mountpoints.
- * Notice that only the public mountpoints will be returned: those with
- * an \c is_private set to yes/true will be skipped. The response will
- * be formatted like this:
+ * If successful, it will return an array with a list of all the mountpoints,
+ * sorted by ID. Notice that only the public mountpoints will be returned:
+ * those with an \c is_private set to yes/true will be skipped. The
+ * \c total property contains the number of public mountpoints, which
+ * can be used together with \c offset and \c limit to paginate the
+ * list. The response will be formatted like this:
  *
 \verbatim
 {
 	"streaming" : "list",
+	"total" : <number of public mountpoints>,
 	"list" : [
 		{
 			"id" : <unique ID of mountpoint #1>,
@@ -492,7 +523,10 @@ rtspiface = network interface IP address or device name to listen on when receiv
 	"pin" : "<PIN required to access the mountpoint; mandatory if configured>",
 	"offer_audio" : <true|false; whether or not audio should be negotiated; true by default if the mountpoint has audio>,
 	"offer_video" : <true|false; whether or not video should be negotiated; true by default if the mountpoint has video>,
-	"offer_data" : <true|false; whether or not datachannels should be negotiated; true by default if the mountpoint has datachannels>
+	"offer_data" : <true|false; whether or not datachannels should be negotiated; true by default if the mountpoint has datachannels>,
+	"substream" : <substream to receive (0-2), in case simulcasting is enabled; optional>,
+	"temporal" : <temporal layers to receive (0-2), in case simulcasting is enabled; optional>,
+	"auto_simulcast" : <true|false, whether the substream and temporal layer should be picked automatically according to the estimated bandwidth, in case simulcasting is enabled; optional>
 }
 \endverbatim
  *
@@ -593,6 +627,7 @@ rtspiface = network interface IP address or device name to listen on when receiv
 	"data" : <true|false, depending on whether datachannel messages should be relayed or not; optional>,
 	"substream" : <substream to receive (0-2), in case simulcasting is enabled; optional>,
 	"temporal" : <temporal layers to receive (0-2), in case simulcasting is enabled; optional>,
+	"auto_simulcast" : <true|false, whether the substream and temporal layer should be picked automatically according to the estimated bandwidth, in case simulcasting is enabled; optional>,
 	"spatial_layer" : <spatial layer to receive (0-1), in case VP9-SVC is enabled; optional>,
 	"temporal_layer" : <temporal layers to receive (0-2), in case VP9-SVC is enabled; optional>
 }
@@ -605,6 +640,14 @@ rtspiface = network interface IP address or device name to listen on when receiv
  * when the mountpoint is configured with video simulcasting support, and
  * as such the viewer is interested in receiving a specific substream
  * or temporal layer, rather than any other of the available ones.
+ * Setting \c auto_simulcast to \c true (which can be done in the \c watch
+ * request too) lets the plugin pick the substream and temporal layer
+ * automatically instead: the bandwidth available to the viewer is estimated
+ * out of the losses it reports in its RTCP receiver reports and the REMB
+ * feedback it sends, if any, and is compared to the bitrate of each
+ * substream, in order to always relay the highest quality that fits. In
+ * that case, \c substream and \c temporal are considered as the highest
+ * substream and temporal layer the viewer is willing to receive.
  * The \c spatial_layer and \c temporal_layer have exactly the same meaning,
  * but within the context of VP9-SVC mountpoints, and will have no effect
  * on mountpoints involving a different video codec.
@@ -696,6 +739,7 @@ rtspiface = network interface IP address or device name to listen on when receiv
 #include "../record.h"
 #include "../utils.h"
 #include "../ip-utils.h"
+#include "../media-bridge.h"
 
 
 /* Plugin information */
@@ -763,6 +807,10 @@ janus_plugin *create(void) {
 static struct janus_json_parameter request_parameters[] = {
 	{"request", JSON_STRING, JANUS_JSON_PARAM_REQUIRED}
 };
+static struct janus_json_parameter list_parameters[] = {
+	{"offset", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"limit", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
 static struct janus_json_parameter id_parameters[] = {
 	{"id", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
 };
@@ -843,6 +891,29 @@ static struct janus_json_parameter rtsp_parameters[] = {
 	{"rtsp_failcheck", JANUS_JSON_BOOL, 0}
 };
 #endif
+static struct janus_json_parameter bridge_parameters[] = {
+	{"id", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"name", JSON_STRING, 0},
+	{"description", JSON_STRING, 0},
+	{"is_private", JANUS_JSON_BOOL, 0},
+	{"source", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
+	{"audio", JANUS_JSON_BOOL, 0},
+	{"video", JANUS_JSON_BOOL, 0},
+	{"threads", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
+static struct janus_json_parameter bridge_audio_parameters[] = {
+	{"audiopt", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
+	{"audiortpmap", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
+	{"audiofmtp", JSON_STRING, 0}
+};
+static struct janus_json_parameter bridge_video_parameters[] = {
+	{"videopt", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
+	{"videortpmap", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
+	{"videofmtp", JSON_STRING, 0},
+	{"videobufferkf", JANUS_JSON_BOOL, 0},
+	{"videobufferkfsize", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"videosimulcast", JANUS_JSON_BOOL, 0}
+};
 static struct janus_json_parameter rtp_audio_parameters[] = {
 	{"audiomcast", JSON_STRING, 0},
 	{"audioport", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
@@ -861,6 +932,7 @@ static struct janus_json_parameter rtp_video_parameters[] = {
 	{"videortpmap", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
 	{"videofmtp", JSON_STRING, 0},
 	{"videobufferkf", JANUS_JSON_BOOL, 0},
+	{"videobufferkfsize", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"videoiface", JSON_STRING, 0},
 	{"videosimulcast", JANUS_JSON_BOOL, 0},
 	{"videoport2", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
@@ -893,7 +965,8 @@ static struct janus_json_parameter recording_stop_parameters[] = {
 };
 static struct janus_json_parameter simulcast_parameters[] = {
 	{"substream", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
-	{"temporal", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+	{"temporal", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"auto_simulcast", JANUS_JSON_BOOL, 0}
 };
 static struct janus_json_parameter svc_parameters[] = {
 	{"spatial_layer", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
@@ -906,6 +979,7 @@ static struct janus_json_parameter configure_parameters[] = {
 	/* For VP8 (or H.264) simulcast */
 	{"substream", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"temporal", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"auto_simulcast", JANUS_JSON_BOOL, 0},
 	/* For VP9 SVC */
 	{"spatial_layer", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"temporal_layer", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
@@ -955,12 +1029,9 @@ typedef enum janus_streaming_source {
 
 typedef struct janus_streaming_rtp_keyframe {
 	gboolean enabled;
-	/* If enabled, we store the packets of the last keyframe, to immediately send them for new viewers */
-	GList *latest_keyframe;
-	/* This is where we store packets while we're still collecting the whole keyframe */
-	GList *temp_keyframe;
-	guint32 temp_ts;
-	janus_mutex mutex;
+	guint size;		/* Maximum number of packets to store for each GOP */
+	/* If enabled, we store the packets of the latest GOP (one per substream), to immediately send them for new viewers */
+	janus_rtp_gop_cache gop[3];
 } janus_streaming_rtp_keyframe;
 
 typedef struct janus_streaming_rtp_relay_packet {
@@ -1017,6 +1088,7 @@ typedef struct janus_streaming_rtp_source {
 	int audio_rtcp_fd;
 	int video_rtcp_fd;
 	gboolean simulcast;
+	janus_rtp_simulcasting_bitrates sc_bitrates;	/* Bitrate of each substream, for viewers doing auto_simulcast */
 	gboolean svc;
 	gboolean askew, vskew;
 	gint64 last_received_audio;
@@ -1042,6 +1114,11 @@ typedef struct janus_streaming_rtp_source {
 	gint64 reconnect_timer;
 	janus_mutex rtsp_mutex;
 #endif
+	/* Only needed for mountpoints fed by another plugin via the media bridge */
+	char *bridge_source;
+	janus_media_bridge_sink *bridge;
+	janus_mutex bridge_mutex;	/* Mutex to protect the sink from keyframe requests while we remove it */
+	uint32_t bridge_video_ssrc[3];
 	janus_streaming_rtp_keyframe keyframe;
 	gboolean buffermsg;
 	int rtp_collision;
@@ -1060,6 +1137,7 @@ typedef struct janus_streaming_rtp_source {
 
 typedef struct janus_streaming_file_source {
 	char *filename;
+	janus_media_clock *clock;	/* Clock the live filesource thread uses to pace itself */
 } janus_streaming_file_source;
 
 /* used for audio/video fd and RTCP fd */
@@ -1103,6 +1181,13 @@ typedef struct janus_streaming_mountpoint {
 } janus_streaming_mountpoint;
 GHashTable *mountpoints = NULL, *mountpoints_temp = NULL;
 janus_mutex mountpoints_mutex;
+/* Cached list of public mountpoints (static properties only), sorted by ID:
+ * the list is protected by mountpoints_mutex, and only rebuilt when flagged */
+static json_t *mountpoints_list = NULL;
+static volatile gint mountpoints_list_changed = 1;
+static void janus_streaming_mountpoints_changed(void) {
+	g_atomic_int_set(&mountpoints_list_changed, 1);
+}
 static char *admin_key = NULL;
 
 typedef struct janus_streaming_helper {
@@ -1123,7 +1208,7 @@ janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 		uint64_t id, char *name, char *desc,
 		int srtpsuite, char *srtpcrypto, int threads,
 		gboolean doaudio, char *amcast, const janus_network_address *aiface, uint16_t aport, uint16_t artcpport, uint8_t acodec, char *artpmap, char *afmtp, gboolean doaskew,
-		gboolean dovideo, char *vmcast, const janus_network_address *viface, uint16_t vport, uint16_t vrtcpport, uint8_t vcodec, char *vrtpmap, char *vfmtp, gboolean bufferkf,
+		gboolean dovideo, char *vmcast, const janus_network_address *viface, uint16_t vport, uint16_t vrtcpport, uint8_t vcodec, char *vrtpmap, char *vfmtp, gboolean bufferkf, guint bufferkf_size,
 			gboolean simulcast, uint16_t vport2, uint16_t vport3, gboolean svc, gboolean dovskew, int rtp_collision,
 		gboolean dodata, const janus_network_address *diface, uint16_t dport, gboolean buffermsg);
 /* Helper to create a file/ondemand live source */
@@ -1138,6 +1223,11 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 		gboolean dovideo, int videopt, char *vrtpmap, char *vfmtp,
 		const janus_network_address *iface,
 		gboolean error_on_failure);
+/* Helper to create a live source fed by another plugin (e.g., a VideoRoom publisher) */
+janus_streaming_mountpoint *janus_streaming_create_bridge_source(
+		uint64_t id, char *name, char *desc, char *bridge, int threads,
+		gboolean doaudio, uint8_t acodec, char *artpmap, char *afmtp,
+		gboolean dovideo, uint8_t vcodec, char *vrtpmap, char *vfmtp, gboolean bufferkf, guint bufferkf_size, gboolean simulcast);
 
 
 typedef struct janus_streaming_message {
@@ -1164,6 +1254,14 @@ typedef struct janus_streaming_session {
 	 * simulcast, which has similar info (substream/templayer) but in a completely different context */
 	int spatial_layer, target_spatial_layer;
 	int temporal_layer, target_temporal_layer;
+	volatile gint gop_pending;	/* Whether we should send the cached GOP before the next video packet */
+	/* The following are only relevant if the viewer asked for auto_simulcast, in which case
+	 * the simulcast targets are picked automatically according to the estimated bandwidth */
+	gboolean bwe_enabled;
+	janus_rtcp_bwe_context bwe;
+	int bwe_max_substream, bwe_max_templayer;
+	janus_media_clock *clock;	/* Clock the on-demand filesource thread uses to pace itself for this viewer */
+	janus_mutex mutex;
 	gboolean stopping;
 	volatile gint hangingup;
 	volatile gint destroyed;
@@ -1200,6 +1298,17 @@ static void janus_streaming_mountpoint_destroy(janus_streaming_mountpoint *mount
 				res = write(source->pipefd[1], &code, sizeof(int));
 			} while(res == -1 && errno == EINTR);
 		}
+		if(source != NULL && source->bridge_source != NULL) {
+			/* The media bridge doesn't hold a reference to the mountpoint, so
+			 * detach from it now: once the sink is not on the source anymore,
+			 * no keyframe request can use it, and removing it returns only
+			 * when the bridge can't invoke our callback anymore */
+			janus_mutex_lock(&source->bridge_mutex);
+			janus_media_bridge_sink *sink = source->bridge;
+			source->bridge = NULL;
+			janus_mutex_unlock(&source->bridge_mutex);
+			janus_media_bridge_sink_remove(sink);
+		}
 	}
 	/* Wait for the thread to finish */
 	if(mountpoint->thread != NULL)
@@ -1267,7 +1376,7 @@ static void janus_streaming_message_free(janus_streaming_message *msg) {
 
 /* Helper method to send an RTCP PLI */
 static void janus_streaming_rtcp_pli_send(janus_streaming_rtp_source *source) {
-	if(source == NULL || source->video_rtcp_fd < 0 || source->video_rtcp_addr.ss_family == 0)
+	if(source == NULL || (source->bridge_source == NULL && (source->video_rtcp_fd < 0 || source->video_rtcp_addr.ss_family == 0)))
 		return;
 	if(!g_atomic_int_compare_and_exchange(&source->sending_pli, 0, 1))
 		return;
@@ -1281,6 +1390,17 @@ static void janus_streaming_rtcp_pli_send(janus_streaming_rtp_source *source) {
 	/* Update the time of when we last sent a keyframe request */
 	g_atomic_int_set(&source->need_pli, 0);
 	source->pli_latest = janus_get_monotonic_time();
+	if(source->bridge_source != NULL) {
+		/* The media comes from another plugin, ask it for a keyframe instead */
+		janus_mutex_lock(&source->bridge_mutex);
+		if(source->bridge != NULL) {
+			JANUS_LOG(LOG_HUGE, "Requesting keyframe via media bridge\n");
+			janus_media_bridge_sink_request_keyframe(source->bridge);
+		}
+		janus_mutex_unlock(&source->bridge_mutex);
+		g_atomic_int_set(&source->sending_pli, 0);
+		return;
+	}
 	JANUS_LOG(LOG_HUGE, "Sending PLI\n");
 	/* Generate a PLI */
 	char rtcp_buf[12];
@@ -1298,6 +1418,39 @@ static void janus_streaming_rtcp_pli_send(janus_streaming_rtp_source *source) {
 	g_atomic_int_set(&source->sending_pli, 0);
 }
 
+/* Helper method to save the properties of a bridge mountpoint to the configuration */
+static void janus_streaming_bridge_save_config(janus_config_category *c, janus_streaming_mountpoint *mp, janus_streaming_rtp_source *source) {
+	char value[BUFSIZ];
+	janus_config_add(config, c, janus_config_item_create("source", source->bridge_source));
+	janus_config_add(config, c, janus_config_item_create("audio", mp->codecs.audio_pt >= 0 ? "yes" : "no"));
+	if(mp->codecs.audio_pt >= 0) {
+		g_snprintf(value, BUFSIZ, "%d", mp->codecs.audio_pt);
+		janus_config_add(config, c, janus_config_item_create("audiopt", value));
+		janus_config_add(config, c, janus_config_item_create("audiortpmap", mp->codecs.audio_rtpmap));
+		if(mp->codecs.audio_fmtp)
+			janus_config_add(config, c, janus_config_item_create("audiofmtp", mp->codecs.audio_fmtp));
+	}
+	janus_config_add(config, c, janus_config_item_create("video", mp->codecs.video_pt > 0 ? "yes" : "no"));
+	if(mp->codecs.video_pt > 0) {
+		g_snprintf(value, BUFSIZ, "%d", mp->codecs.video_pt);
+		janus_config_add(config, c, janus_config_item_create("videopt", value));
+		janus_config_add(config, c, janus_config_item_create("videortpmap", mp->codecs.video_rtpmap));
+		if(mp->codecs.video_fmtp)
+			janus_config_add(config, c, janus_config_item_create("videofmtp", mp->codecs.video_fmtp));
+		if(source->keyframe.enabled) {
+			janus_config_add(config, c, janus_config_item_create("videobufferkf", "yes"));
+			g_snprintf(value, BUFSIZ, "%u", source->keyframe.size);
+			janus_config_add(config, c, janus_config_item_create("videobufferkfsize", value));
+		}
+		if(source->simulcast)
+			janus_config_add(config, c, janus_config_item_create("videosimulcast", "yes"));
+	}
+	if(mp->helper_threads > 0) {
+		g_snprintf(value, BUFSIZ, "%d", mp->helper_threads);
+		janus_config_add(config, c, janus_config_item_create("threads", value));
+	}
+}
+
 /* Helper method to send an RTCP REMB */
 static void janus_streaming_rtcp_remb_send(janus_streaming_rtp_source *source) {
 	if(source == NULL || source->video_rtcp_fd < 0 || source->video_rtcp_addr.ss_family == 0)
@@ -1465,6 +1618,7 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 				janus_config_item *vrtpmap = janus_config_get(config, cat, janus_config_type_item, "videortpmap");
 				janus_config_item *vfmtp = janus_config_get(config, cat, janus_config_type_item, "videofmtp");
 				janus_config_item *vkf = janus_config_get(config, cat, janus_config_type_item, "videobufferkf");
+				janus_config_item *vkfsize = janus_config_get(config, cat, janus_config_type_item, "videobufferkfsize");
 				janus_config_item *vsc = janus_config_get(config, cat, janus_config_type_item, "videosimulcast");
 				janus_config_item *vport2 = janus_config_get(config, cat, janus_config_type_item, "videoport2");
 				janus_config_item *vport3 = janus_config_get(config, cat, janus_config_type_item, "videoport3");
@@ -1483,11 +1637,6 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 				gboolean dodata = data && data->value && janus_is_true(data->value);
 				gboolean bufferkf = video && vkf && vkf->value && janus_is_true(vkf->value);
 				gboolean simulcast = video && vsc && vsc->value && janus_is_true(vsc->value);
-				if(simulcast && bufferkf) {
-					/* FIXME We'll need to take care of this */
-					JANUS_LOG(LOG_WARN, "Simulcasting enabled, so disabling buffering of keyframes\n");
-					bufferkf = FALSE;
-				}
 				gboolean buffermsg = data && dbm && dbm->value && janus_is_true(dbm->value);
 				if(!doaudio && !dovideo && !dodata) {
 					JANUS_LOG(LOG_ERR, "Can't add 'rtp' stream '%s', no audio, video or data have to be streamed...\n", cat->name);
@@ -1616,6 +1765,7 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 						vrtpmap ? (char *)vrtpmap->value : NULL,
 						vfmtp ? (char *)vfmtp->value : NULL,
 						bufferkf,
+						(vkfsize && vkfsize->value && atoi(vkfsize->value) > 0) ? atoi(vkfsize->value) : 0,
 						simulcast,
 						(vport2 && vport2->value) ? atoi(vport2->value) : 0,
 						(vport3 && vport3->value) ? atoi(vport3->value) : 0,
@@ -1631,6 +1781,7 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 					continue;
 				}
 				mp->is_private = is_private;
+				janus_streaming_mountpoints_changed();
 				if(secret && secret->value)
 					mp->secret = g_strdup(secret->value);
 				if(pin && pin->value)
@@ -1696,6 +1847,7 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 					continue;
 				}
 				mp->is_private = is_private;
+				janus_streaming_mountpoints_changed();
 				if(secret && secret->value)
 					mp->secret = g_strdup(secret->value);
 				if(pin && pin->value)
@@ -1761,6 +1913,7 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 					continue;
 				}
 				mp->is_private = is_private;
+				janus_streaming_mountpoints_changed();
 				if(secret && secret->value)
 					mp->secret = g_strdup(secret->value);
 				if(pin && pin->value)
@@ -1851,11 +2004,85 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 					continue;
 				}
 				mp->is_private = is_private;
+				janus_streaming_mountpoints_changed();
 				if(secret && secret->value)
 					mp->secret = g_strdup(secret->value);
 				if(pin && pin->value)
 					mp->pin = g_strdup(pin->value);
 #endif
+			} else if(!strcasecmp(type->value, "bridge")) {
+				/* Live stream fed by another plugin via the media bridge */
+				janus_config_item *id = janus_config_get(config, cat, janus_config_type_item, "id");
+				janus_config_item *desc = janus_config_get(config, cat, janus_config_type_item, "description");
+				janus_config_item *priv = janus_config_get(config, cat, janus_config_type_item, "is_private");
+				janus_config_item *secret = janus_config_get(config, cat, janus_config_type_item, "secret");
+				janus_config_item *pin = janus_config_get(config, cat, janus_config_type_item, "pin");
+				janus_config_item *bsource = janus_config_get(config, cat, janus_config_type_item, "source");
+				janus_config_item *audio = janus_config_get(config, cat, janus_config_type_item, "audio");
+				janus_config_item *acodec = janus_config_get(config, cat, janus_config_type_item, "audiopt");
+				janus_config_item *artpmap = janus_config_get(config, cat, janus_config_type_item, "audiortpmap");
+				janus_config_item *afmtp = janus_config_get(config, cat, janus_config_type_item, "audiofmtp");
+				janus_config_item *video = janus_config_get(config, cat, janus_config_type_item, "video");
+				janus_config_item *vcodec = janus_config_get(config, cat, janus_config_type_item, "videopt");
+				janus_config_item *vrtpmap = janus_config_get(config, cat, janus_config_type_item, "videortpmap");
+				janus_config_item *vfmtp = janus_config_get(config, cat, janus_config_type_item, "videofmtp");
+				janus_config_item *vkf = janus_config_get(config, cat, janus_config_type_item, "videobufferkf");
+				janus_config_item *vkfsize = janus_config_get(config, cat, janus_config_type_item, "videobufferkfsize");
+				janus_config_item *vsc = janus_config_get(config, cat, janus_config_type_item, "videosimulcast");
+				janus_config_item *threads = janus_config_get(config, cat, janus_config_type_item, "threads");
+				gboolean is_private = priv && priv->value && janus_is_true(priv->value);
+				gboolean doaudio = audio && audio->value && janus_is_true(audio->value);
+				gboolean dovideo = video && video->value && janus_is_true(video->value);
+				gboolean bufferkf = vkf && vkf->value && janus_is_true(vkf->value);
+				gboolean simulcast = vsc && vsc->value && janus_is_true(vsc->value);
+				if(bsource == NULL || bsource->value == NULL || (!doaudio && !dovideo) ||
+						(doaudio && (acodec == NULL || acodec->value == NULL || artpmap == NULL || artpmap->value == NULL)) ||
+						(dovideo && (vcodec == NULL || vcodec->value == NULL || vrtpmap == NULL || vrtpmap->value == NULL))) {
+					JANUS_LOG(LOG_ERR, "Can't add 'bridge' stream '%s', missing mandatory information...\n", cat->name);
+					cl = cl->next;
+					continue;
+				}
+				if(id == NULL || id->value == NULL) {
+					JANUS_LOG(LOG_VERB, "Missing id for stream '%s', will generate a random one...\n", cat->name);
+				} else {
+					janus_mutex_lock(&mountpoints_mutex);
+					guint64 mpid = g_ascii_strtoull(id->value, 0, 10);
+					janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, &mpid);
+					janus_mutex_unlock(&mountpoints_mutex);
+					if(mp != NULL) {
+						JANUS_LOG(LOG_ERR, "A stream with the provided ID %s already exists, skipping '%s'\n", id->value, cat->name);
+						cl = cl->next;
+						continue;
+					}
+				}
+				janus_streaming_mountpoint *mp = NULL;
+				if((mp = janus_streaming_create_bridge_source(
+						(id && id->value) ? g_ascii_strtoull(id->value, 0, 10) : 0,
+						(char *)cat->name,
+						desc ? (char *)desc->value : NULL,
+						(char *)bsource->value,
+						(threads && threads->value) ? atoi(threads->value) : 0,
+						doaudio,
+						doaudio ? atoi(acodec->value) : 0,
+						artpmap ? (char *)artpmap->value : NULL,
+						afmtp ? (char *)afmtp->value : NULL,
+						dovideo,
+						dovideo ? atoi(vcodec->value) : 0,
+						vrtpmap ? (char *)vrtpmap->value : NULL,
+						vfmtp ? (char *)vfmtp->value : NULL,
+						bufferkf,
+						(vkfsize && vkfsize->value && atoi(vkfsize->value) > 0) ? atoi(vkfsize->value) : 0,
+						simulcast)) == NULL) {
+					JANUS_LOG(LOG_ERR, "Error creating 'bridge' stream '%s'...\n", cat->name);
+					cl = cl->next;
+					continue;
+				}
+				mp->is_private = is_private;
+				janus_streaming_mountpoints_changed();
+				if(secret && secret->value)
+					mp->secret = g_strdup(secret->value);
+				if(pin && pin->value)
+					mp->pin = g_strdup(pin->value);
 			} else {
 				JANUS_LOG(LOG_WARN, "Ignoring unknown stream type '%s' (%s)...\n", type->value, cat->name);
 			}
@@ -1918,6 +2145,9 @@ void janus_streaming_destroy(void) {
 	mountpoints = NULL;
 	g_hash_table_destroy(mountpoints_temp);
 	mountpoints_temp = NULL;
+	if(mountpoints_list)
+		json_decref(mountpoints_list);
+	mountpoints_list = NULL;
 	janus_mutex_unlock(&mountpoints_mutex);
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
@@ -1981,6 +2211,7 @@ void janus_streaming_create_session(janus_plugin_session *handle, int *error) {
 	session->mountpoint = NULL;	/* This will happen later */
 	session->started = FALSE;	/* This will happen later */
 	session->paused = FALSE;
+	janus_mutex_init(&session->mutex);
 	g_atomic_int_set(&session->destroyed, 0);
 	g_atomic_int_set(&session->hangingup, 0);
 	handle->plugin_handle = session;
@@ -2049,6 +2280,14 @@ json_t *janus_streaming_query_session(janus_plugin_session *handle) {
 				json_object_set_new(simulcast, "substream-target", json_integer(session->sim_context.substream_target));
 				json_object_set_new(simulcast, "temporal-layer", json_integer(session->sim_context.templayer));
 				json_object_set_new(simulcast, "temporal-layer-target", json_integer(session->sim_context.templayer_target));
+				if(session->bwe_enabled) {
+					json_t *bwe = json_object();
+					json_object_set_new(bwe, "estimate", json_integer(session->bwe.estimate));
+					if(session->bwe.remb > 0)
+						json_object_set_new(bwe, "remb", json_integer(session->bwe.remb));
+					json_object_set_new(bwe, "fraction-lost", json_integer(session->bwe.fraction_lost));
+					json_object_set_new(simulcast, "auto", bwe);
+				}
 				json_object_set_new(info, "simulcast", simulcast);
 			}
 			if(source->svc) {
@@ -2059,6 +2298,12 @@ json_t *janus_streaming_query_session(janus_plugin_session *handle) {
 				json_object_set_new(svc, "target-temporal-layer", json_integer(session->target_temporal_layer));
 				json_object_set_new(info, "svc", svc);
 			}
+		} else if(mp->streaming_source == janus_streaming_source_file) {
+			/* On-demand viewers are paced by a thread (and clock) of their own */
+			janus_mutex_lock(&session->mutex);
+			if(session->clock)
+				json_object_set_new(info, "clock", janus_media_clock_stats(session->clock));
+			janus_mutex_unlock(&session->mutex);
 		}
 		janus_refcount_decrease(&mp->ref);
 	}
@@ -2068,6 +2313,36 @@ json_t *janus_streaming_query_session(janus_plugin_session *handle) {
 	return info;
 }
 
+/* Helpers to build the cached list of public mountpoints: entries are
+ * shared with whoever is using the list, and so must never be modified */
+static gint janus_streaming_compare_ids(gconstpointer a, gconstpointer b) {
+	guint64 first = *((const guint64 *)a), second = *((const guint64 *)b);
+	return first < second ? -1 : (first > second ? 1 : 0);
+}
+
+/* Must be called with mountpoints_mutex held: returns a new reference */
+static json_t *janus_streaming_mountpoints_list(void) {
+	if(mountpoints_list == NULL || g_atomic_int_compare_and_exchange(&mountpoints_list_changed, 1, 0)) {
+		if(mountpoints_list)
+			json_decref(mountpoints_list);
+		mountpoints_list = json_array();
+		GList *ids = g_list_sort(g_hash_table_get_keys(mountpoints), janus_streaming_compare_ids), *l = ids;
+		while(l) {
+			janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, l->data);
+			l = l->next;
+			if(mp->is_private)
+				continue;
+			json_t *ml = json_object();
+			json_object_set_new(ml, "id", json_integer(mp->id));
+			json_object_set_new(ml, "description", json_string(mp->description));
+			json_object_set_new(ml, "type", json_string(mp->streaming_type == janus_streaming_type_live ? "live" : "on demand"));
+			json_array_append_new(mountpoints_list, ml);
+		}
+		g_list_free(ids);
+	}
+	return json_incref(mountpoints_list);
+}
+
 /* Helper method to process synchronous requests */
 static json_t *janus_streaming_process_synchronous_request(janus_streaming_session *session, json_t *message) {
 	json_t *request = json_object_get(message, "request");
@@ -2081,40 +2356,45 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 	struct ifaddrs *ifas = NULL;
 
 	if(!strcasecmp(request_text, "list")) {
+		JANUS_VALIDATE_JSON_OBJECT(root, list_parameters,
+			error_code, error_cause, TRUE,
+			JANUS_STREAMING_ERROR_MISSING_ELEMENT, JANUS_STREAMING_ERROR_INVALID_ELEMENT);
+		if(error_code != 0)
+			goto prepare_response;
+		size_t offset = json_integer_value(json_object_get(root, "offset"));
+		size_t limit = json_integer_value(json_object_get(root, "limit"));
 		json_t *list = json_array();
 		JANUS_LOG(LOG_VERB, "Request for the list of mountpoints\n");
-		/* Return a list of all available mountpoints */
+		/* Return a list of all available mountpoints: the static properties
+		 * come from the cached list, we only add the ages of the page we return */
 		janus_mutex_lock(&mountpoints_mutex);
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, mountpoints);
-		while(g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_streaming_mountpoint *mp = value;
-			if(mp->is_private) {
-				/* Skip private stream */
-				JANUS_LOG(LOG_VERB, "Skipping private mountpoint '%s'\n", mp->description);
+		json_t *cached = janus_streaming_mountpoints_list();
+		size_t i = 0, total = json_array_size(cached);
+		gint64 now = janus_get_monotonic_time();
+		for(i=offset; i<total && (limit == 0 || json_array_size(list) < limit); i++) {
+			json_t *ml = json_array_get(cached, i);
+			guint64 id_value = json_integer_value(json_object_get(ml, "id"));
+			janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints, &id_value);
+			if(mp == NULL)
 				continue;
-			}
-			janus_refcount_increase(&mp->ref);
-			json_t *ml = json_object();
-			json_object_set_new(ml, "id", json_integer(mp->id));
-			json_object_set_new(ml, "description", json_string(mp->description));
-			json_object_set_new(ml, "type", json_string(mp->streaming_type == janus_streaming_type_live ? "live" : "on demand"));
 			if(mp->streaming_source == janus_streaming_source_rtp) {
 				janus_streaming_rtp_source *source = mp->source;
-				gint64 now = janus_get_monotonic_time();
+				ml = json_copy(ml);
 				if(source->audio_fd != -1)
 					json_object_set_new(ml, "audio_age_ms", json_integer((now - source->last_received_audio) / 1000));
 				if(source->video_fd[0] != -1 || source->video_fd[1] != -1 || source->video_fd[2] != -1)
 					json_object_set_new(ml, "video_age_ms", json_integer((now - source->last_received_video) / 1000));
+				json_array_append_new(list, ml);
+			} else {
+				json_array_append(list, ml);
 			}
-			json_array_append_new(list, ml);
-			janus_refcount_decrease(&mp->ref);
 		}
 		janus_mutex_unlock(&mountpoints_mutex);
+		json_decref(cached);
 		/* Send info back */
 		response = json_object();
 		json_object_set_new(response, "streaming", json_string("list"));
+		json_object_set_new(response, "total", json_integer(total));
 		json_object_set_new(response, "list", list);
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "info")) {
@@ -2185,6 +2465,8 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			janus_streaming_file_source *source = mp->source;
 			if(admin && source->filename)
 				json_object_set_new(ml, "filename", json_string(source->filename));
+			if(admin && source->clock)
+				json_object_set_new(ml, "clock", janus_media_clock_stats(source->clock));
 		} else if(mp->streaming_source == janus_streaming_source_rtp) {
 			janus_streaming_rtp_source *source = mp->source;
 			if(source->is_srtp) {
@@ -2204,8 +2486,11 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 				}
 			}
 #endif
+			if(source->bridge_source && admin)
+				json_object_set_new(ml, "source", json_string(source->bridge_source));
 			if(source->keyframe.enabled) {
 				json_object_set_new(ml, "videobufferkf", json_true());
+				json_object_set_new(ml, "videobufferkfsize", json_integer(source->keyframe.size));
 			}
 			if(source->simulcast) {
 				json_object_set_new(ml, "videosimulcast", json_true());
@@ -2380,6 +2665,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			uint8_t vcodec = 0;
 			char *vrtpmap = NULL, *vfmtp = NULL, *vmcast = NULL;
 			gboolean bufferkf = FALSE, simulcast = FALSE;
+			guint bufferkf_size = 0;
 			if(dovideo) {
 				JANUS_VALIDATE_JSON_OBJECT(root, rtp_video_parameters,
 					error_code, error_cause, TRUE,
@@ -2401,13 +2687,10 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 				vfmtp = (char *)json_string_value(videofmtp);
 				json_t *vkf = json_object_get(root, "videobufferkf");
 				bufferkf = vkf ? json_is_true(vkf) : FALSE;
+				json_t *vkfsize = json_object_get(root, "videobufferkfsize");
+				bufferkf_size = vkfsize ? json_integer_value(vkfsize) : 0;
 				json_t *vsc = json_object_get(root, "videosimulcast");
 				simulcast = vsc ? json_is_true(vsc) : FALSE;
-				if(simulcast && bufferkf) {
-					/* FIXME We'll need to take care of this */
-					JANUS_LOG(LOG_WARN, "Simulcasting enabled, so disabling buffering of keyframes\n");
-					bufferkf = FALSE;
-				}
 				json_t *videoport2 = json_object_get(root, "videoport2");
 				vport2 = json_integer_value(videoport2);
 				json_t *videoport3 = json_object_get(root, "videoport3");
@@ -2496,7 +2779,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 					scrypto ? (char *)json_string_value(scrypto) : NULL,
 					threads ? json_integer_value(threads) : 0,
 					doaudio, amcast, &audio_iface, aport, artcpport, acodec, artpmap, afmtp, doaskew,
-					dovideo, vmcast, &video_iface, vport, vrtcpport, vcodec, vrtpmap, vfmtp, bufferkf,
+					dovideo, vmcast, &video_iface, vport, vrtcpport, vcodec, vrtpmap, vfmtp, bufferkf, bufferkf_size,
 					simulcast, vport2, vport3, dosvc, dovskew,
 					rtpcollision ? json_integer_value(rtpcollision) : 0,
 					dodata, &data_iface, dport, buffermsg);
@@ -2510,6 +2793,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 				goto prepare_response;
 			}
 			mp->is_private = is_private ? json_is_true(is_private) : FALSE;
+			janus_streaming_mountpoints_changed();
 		} else if(!strcasecmp(type_text, "live")) {
 			/* File live source */
 			JANUS_VALIDATE_JSON_OBJECT(root, live_parameters,
@@ -2590,6 +2874,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 				goto prepare_response;
 			}
 			mp->is_private = is_private ? json_is_true(is_private) : FALSE;
+			janus_streaming_mountpoints_changed();
 		} else if(!strcasecmp(type_text, "ondemand")) {
 			/* mu-Law file on demand source */
 			JANUS_VALIDATE_JSON_OBJECT(root, ondemand_parameters,
@@ -2670,6 +2955,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 				goto prepare_response;
 			}
 			mp->is_private = is_private ? json_is_true(is_private) : FALSE;
+			janus_streaming_mountpoints_changed();
 		} else if(!strcasecmp(type_text, "rtsp")) {
 #ifndef HAVE_LIBCURL
 			JANUS_LOG(LOG_ERR, "Can't create 'rtsp' mountpoint, libcurl support not compiled...\n");
@@ -2773,7 +3059,103 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 				goto prepare_response;
 			}
 			mp->is_private = is_private ? json_is_true(is_private) : FALSE;
+			janus_streaming_mountpoints_changed();
 #endif
+		} else if(!strcasecmp(type_text, "bridge")) {
+			/* Live stream fed by another plugin via the media bridge */
+			JANUS_VALIDATE_JSON_OBJECT(root, bridge_parameters,
+				error_code, error_cause, TRUE,
+				JANUS_STREAMING_ERROR_MISSING_ELEMENT, JANUS_STREAMING_ERROR_INVALID_ELEMENT);
+			if(error_code != 0)
+				goto prepare_response;
+			json_t *id = json_object_get(root, "id");
+			json_t *name = json_object_get(root, "name");
+			json_t *desc = json_object_get(root, "description");
+			json_t *is_private = json_object_get(root, "is_private");
+			json_t *bsource = json_object_get(root, "source");
+			json_t *audio = json_object_get(root, "audio");
+			json_t *video = json_object_get(root, "video");
+			json_t *threads = json_object_get(root, "threads");
+			gboolean doaudio = audio ? json_is_true(audio) : FALSE;
+			gboolean dovideo = video ? json_is_true(video) : FALSE;
+			if(!doaudio && !dovideo) {
+				JANUS_LOG(LOG_ERR, "Can't add 'bridge' stream, no audio or video have to be streamed...\n");
+				error_code = JANUS_STREAMING_ERROR_CANT_CREATE;
+				g_snprintf(error_cause, 512, "Can't add 'bridge' stream, no audio or video have to be streamed...");
+				goto prepare_response;
+			}
+			uint8_t acodec = 0, vcodec = 0;
+			char *artpmap = NULL, *afmtp = NULL, *vrtpmap = NULL, *vfmtp = NULL;
+			gboolean bufferkf = FALSE, simulcast = FALSE;
+			guint bufferkf_size = 0;
+			if(doaudio) {
+				JANUS_VALIDATE_JSON_OBJECT(root, bridge_audio_parameters,
+					error_code, error_cause, TRUE,
+					JANUS_STREAMING_ERROR_MISSING_ELEMENT, JANUS_STREAMING_ERROR_INVALID_ELEMENT);
+				if(error_code != 0)
+					goto prepare_response;
+				acodec = json_integer_value(json_object_get(root, "audiopt"));
+				artpmap = (char *)json_string_value(json_object_get(root, "audiortpmap"));
+				afmtp = (char *)json_string_value(json_object_get(root, "audiofmtp"));
+			}
+			if(dovideo) {
+				JANUS_VALIDATE_JSON_OBJECT(root, bridge_video_parameters,
+					error_code, error_cause, TRUE,
+					JANUS_STREAMING_ERROR_MISSING_ELEMENT, JANUS_STREAMING_ERROR_INVALID_ELEMENT);
+				if(error_code != 0)
+					goto prepare_response;
+				vcodec = json_integer_value(json_object_get(root, "videopt"));
+				vrtpmap = (char *)json_string_value(json_object_get(root, "videortpmap"));
+				vfmtp = (char *)json_string_value(json_object_get(root, "videofmtp"));
+				json_t *vkf = json_object_get(root, "videobufferkf");
+				bufferkf = vkf ? json_is_true(vkf) : FALSE;
+				json_t *vkfsize = json_object_get(root, "videobufferkfsize");
+				bufferkf_size = vkfsize ? json_integer_value(vkfsize) : 0;
+				json_t *vsc = json_object_get(root, "videosimulcast");
+				simulcast = vsc ? json_is_true(vsc) : FALSE;
+			}
+			/* Check if an ID has been provided, or if we need to generate one ourselves */
+			janus_mutex_lock(&mountpoints_mutex);
+			guint64 mpid = 0;
+			if(id == NULL) {
+				JANUS_LOG(LOG_VERB, "Missing id, will generate a random one...\n");
+				while(mpid == 0) {
+					mpid = janus_random_uint64();
+					if(g_hash_table_lookup(mountpoints, &mpid) != NULL ||
+							g_hash_table_lookup(mountpoints_temp, &mpid) != NULL) {
+						/* ID already in use, try another one */
+						mpid = 0;
+					}
+				}
+			} else {
+				mpid = json_integer_value(id);
+				mp = g_hash_table_lookup(mountpoints, &mpid);
+				if(mp != NULL || g_hash_table_lookup(mountpoints_temp, &mpid)) {
+					janus_mutex_unlock(&mountpoints_mutex);
+					JANUS_LOG(LOG_ERR, "A stream with the provided ID already exists\n");
+					error_code = JANUS_STREAMING_ERROR_CANT_CREATE;
+					g_snprintf(error_cause, 512, "A stream with the provided ID already exists");
+					goto prepare_response;
+				}
+			}
+			g_hash_table_insert(mountpoints_temp, &mpid, GUINT_TO_POINTER(TRUE));
+			janus_mutex_unlock(&mountpoints_mutex);
+			mp = janus_streaming_create_bridge_source(
+					mpid,
+					name ? (char *)json_string_value(name) : NULL,
+					desc ? (char *)json_string_value(desc) : NULL,
+					(char *)json_string_value(bsource),
+					threads ? json_integer_value(threads) : 0,
+					doaudio, acodec, artpmap, afmtp,
+					dovideo, vcodec, vrtpmap, vfmtp, bufferkf, bufferkf_size, simulcast);
+			if(mp == NULL) {
+				JANUS_LOG(LOG_ERR, "Error creating 'bridge' stream...\n");
+				error_code = JANUS_STREAMING_ERROR_CANT_CREATE;
+				g_snprintf(error_cause, 512, "Error creating 'bridge' stream");
+				goto prepare_response;
+			}
+			mp->is_private = is_private ? json_is_true(is_private) : FALSE;
+			janus_streaming_mountpoints_changed();
 		} else {
 			JANUS_LOG(LOG_ERR, "Unknown stream type '%s'...\n", type_text);
 			error_code = JANUS_STREAMING_ERROR_INVALID_ELEMENT;
@@ -2842,8 +3224,11 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 					janus_config_add(config, c, janus_config_item_create("videortpmap", mp->codecs.video_rtpmap));
 					if(mp->codecs.video_fmtp)
 						janus_config_add(config, c, janus_config_item_create("videofmtp", mp->codecs.video_fmtp));
-					if(source->keyframe.enabled)
+					if(source->keyframe.enabled) {
 						janus_config_add(config, c, janus_config_item_create("videobufferkf", "yes"));
+						g_snprintf(value, BUFSIZ, "%u", source->keyframe.size);
+						janus_config_add(config, c, janus_config_item_create("videobufferkfsize", value));
+					}
 					if(source->simulcast) {
 						janus_config_add(config, c, janus_config_item_create("videosimulcast", "yes"));
 						if(source->video_port[1]) {
@@ -2918,6 +3303,9 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 				json_t *iface = json_object_get(root, "rtspiface");
 				if(iface)
 					janus_config_add(config, c, janus_config_item_create("rtspiface", json_string_value(iface)));
+			} else if(!strcasecmp(type_text, "bridge")) {
+				janus_streaming_rtp_source *source = mp->source;
+				janus_streaming_bridge_save_config(c, mp, source);
 			}
 			/* Some more common values */
 			if(mp->secret)
@@ -3024,6 +3412,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 		}
 		if(is_private)
 			mp->is_private = json_is_true(is_private);
+		janus_streaming_mountpoints_changed();
 		/* A secret may be required for this action */
 		JANUS_CHECK_SECRET(mp->secret, root, "secret", error_code, error_cause,
 			JANUS_STREAMING_ERROR_MISSING_ELEMENT, JANUS_STREAMING_ERROR_INVALID_ELEMENT, JANUS_STREAMING_ERROR_UNAUTHORIZED);
@@ -3094,6 +3483,9 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 					json_t *iface = json_object_get(root, "rtspiface");
 					if(iface)
 						janus_config_add(config, c, janus_config_item_create("rtspiface", json_string_value(iface)));
+				} else if(((janus_streaming_rtp_source *)mp->source)->bridge_source != NULL) {
+					janus_config_add(config, c, janus_config_item_create("type", "bridge"));
+					janus_streaming_bridge_save_config(c, mp, mp->source);
 				} else {
 					janus_config_add(config, c, janus_config_item_create("type", "rtp"));
 					janus_config_add(config, c, janus_config_item_create("audio", mp->codecs.audio_pt >= 0 ? "yes" : "no"));
@@ -3135,8 +3527,11 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 						janus_config_add(config, c, janus_config_item_create("videortpmap", mp->codecs.video_rtpmap));
 						if(mp->codecs.video_fmtp)
 							janus_config_add(config, c, janus_config_item_create("videofmtp", mp->codecs.video_fmtp));
-						if(source->keyframe.enabled)
+						if(source->keyframe.enabled) {
 							janus_config_add(config, c, janus_config_item_create("videobufferkf", "yes"));
+							g_snprintf(value, BUFSIZ, "%u", source->keyframe.size);
+							janus_config_add(config, c, janus_config_item_create("videobufferkfsize", value));
+						}
 						if(source->simulcast) {
 							janus_config_add(config, c, janus_config_item_create("videosimulcast", "yes"));
 							if(source->video_port[1]) {
@@ -3253,6 +3648,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 		JANUS_LOG(LOG_VERB, "Request to unmount mountpoint/stream %"SCNu64"\n", id_value);
 		/* Remove mountpoint from the hashtable: this will get it destroyed eventually */
 		g_hash_table_remove(mountpoints, &id_value);
+		janus_streaming_mountpoints_changed();
 		/* FIXME Should we kick the current viewers as well? */
 		janus_mutex_lock(&mp->mutex);
 		GList *viewer = g_list_first(mp->viewers);
@@ -3568,6 +3964,15 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			/* Enable a previously disabled mountpoint */
 			JANUS_LOG(LOG_INFO, "[%s] Stream enabled\n", mp->name);
 			mp->enabled = TRUE;
+			if(mp->streaming_source == janus_streaming_source_rtp) {
+				/* Packets were not cached while disabled, so wait for a new GOP */
+				janus_streaming_rtp_source *source = mp->source;
+				if(source->keyframe.enabled) {
+					int i=0;
+					for(i=0; i<3; i++)
+						janus_rtp_gop_cache_reset(&source->keyframe.gop[i]);
+				}
+			}
 			/* FIXME: Should we notify the viewers, or is this up to the controller application? */
 		} else {
 			/* Disable a previously enabled mountpoint */
@@ -3807,17 +4212,8 @@ void janus_streaming_setup_media(janus_plugin_session *handle) {
 	if(mountpoint->streaming_source == janus_streaming_source_rtp) {
 		janus_streaming_rtp_source *source = mountpoint->source;
 		if(source->keyframe.enabled) {
-			JANUS_LOG(LOG_HUGE, "Any keyframe to send?\n");
-			janus_mutex_lock(&source->keyframe.mutex);
-			if(source->keyframe.latest_keyframe != NULL) {
-				JANUS_LOG(LOG_HUGE, "Yep! %d packets\n", g_list_length(source->keyframe.latest_keyframe));
-				GList *temp = source->keyframe.latest_keyframe;
-				while(temp) {
-					janus_streaming_relay_rtp_packet(session, temp->data);
-					temp = temp->next;
-				}
-			}
-			janus_mutex_unlock(&source->keyframe.mutex);
+			/* The cached GOP will be sent right before the next video packet */
+			g_atomic_int_set(&session->gop_pending, 1);
 		}
 		if(source->buffermsg) {
 			JANUS_LOG(LOG_HUGE, "Any recent datachannel message to send?\n");
@@ -3858,11 +4254,26 @@ void janus_streaming_incoming_rtcp(janus_plugin_session *handle, int video, char
 	if(mp->streaming_source != janus_streaming_source_rtp)
 		return;
 	janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mp->source;
+	if(video && source->simulcast && session->bwe_enabled && janus_rtcp_bwe_context_process(&session->bwe, buf, len)) {
+		/* The bandwidth estimation for this viewer changed, check if we need
+		 * to move it to a different substream or temporal layer */
+		int substream_target = session->sim_context.substream_target;
+		if(janus_rtp_simulcasting_context_bwe_update(&session->sim_context, session->bwe.estimate,
+				source->sc_bitrates.bitrate, session->bwe_max_substream, session->bwe_max_templayer)) {
+			JANUS_LOG(LOG_VERB, "Bandwidth estimate for viewer is %"SCNu32" bps, targets now: substream %d, temporal layer %d\n",
+				session->bwe.estimate, session->sim_context.substream_target, session->sim_context.templayer_target);
+			if(session->sim_context.substream_target != substream_target &&
+					session->sim_context.substream_target != session->sim_context.substream) {
+				/* Schedule a PLI */
+				g_atomic_int_set(&source->need_pli, 1);
+			}
+		}
+	}
 	if(!video && (source->audio_rtcp_fd > -1) && (source->audio_rtcp_addr.ss_family != 0)) {
 		JANUS_LOG(LOG_HUGE, "Got audio RTCP feedback from a viewer: SSRC %"SCNu32"\n",
 			janus_rtcp_get_sender_ssrc(buf, len));
 		/* FIXME We don't forward RR packets, so what should we check here? */
-	} else if(video && (source->video_rtcp_fd > -1) && (source->video_rtcp_addr.ss_family != 0)) {
+	} else if(video && (source->bridge_source != NULL || ((source->video_rtcp_fd > -1) && (source->video_rtcp_addr.ss_family != 0)))) {
 		JANUS_LOG(LOG_HUGE, "Got video RTCP feedback from a viewer: SSRC %"SCNu32"\n",
 			janus_rtcp_get_sender_ssrc(buf, len));
 		/* We only relay PLI/FIR and REMB packets, but in a selective way */
@@ -4136,6 +4547,12 @@ static void *janus_streaming_handler(void *data) {
 						JANUS_LOG(LOG_VERB, "Setting video temporal layer to let through (simulcast): %d (was %d)\n",
 							session->sim_context.templayer_target, session->sim_context.templayer);
 					}
+					/* Check if the layers should be picked according to the available bandwidth instead */
+					json_t *auto_simulcast = json_object_get(root, "auto_simulcast");
+					session->bwe_enabled = auto_simulcast ? json_is_true(auto_simulcast) : FALSE;
+					session->bwe_max_substream = session->sim_context.substream_target;
+					session->bwe_max_templayer = session->sim_context.templayer_target;
+					janus_rtcp_bwe_context_init(&session->bwe, 0, 0);
 				} else if(source && source->svc) {
 					JANUS_VALIDATE_JSON_OBJECT(root, svc_parameters,
 						error_code, error_cause, TRUE,
@@ -4339,6 +4756,18 @@ done:
 				if(source && source->simulcast) {
 					/* Check if the viewer is requesting a different substream/temporal layer */
 					json_t *substream = json_object_get(root, "substream");
+					json_t *temporal = json_object_get(root, "temporal");
+					if(substream)
+						session->bwe_max_substream = json_integer_value(substream);
+					if(temporal)
+						session->bwe_max_templayer = json_integer_value(temporal);
+					json_t *auto_simulcast = json_object_get(root, "auto_simulcast");
+					if(auto_simulcast) {
+						gboolean bwe_enabled = json_is_true(auto_simulcast);
+						if(bwe_enabled && !session->bwe_enabled)
+							janus_rtcp_bwe_context_init(&session->bwe, 0, 0);
+						session->bwe_enabled = bwe_enabled;
+					}
 					if(substream) {
 						session->sim_context.substream_target = json_integer_value(substream);
 						JANUS_LOG(LOG_VERB, "Setting video substream to let through (simulcast): %d (was %d)\n",
@@ -4358,7 +4787,6 @@ done:
 							g_atomic_int_set(&source->need_pli, 1);
 						}
 					}
-					json_t *temporal = json_object_get(root, "temporal");
 					if(temporal) {
 						session->sim_context.templayer_target = json_integer_value(temporal);
 						JANUS_LOG(LOG_VERB, "Setting video temporal layer to let through (simulcast): %d (was %d)\n",
@@ -4520,6 +4948,11 @@ done:
 			janus_mutex_unlock(&mp->mutex);
 			session->mountpoint = mp;
 			session->paused = FALSE;
+			if(mp->streaming_source == janus_streaming_source_rtp &&
+					((janus_streaming_rtp_source *)mp->source)->keyframe.enabled) {
+				/* Start from the cached GOP of the new mountpoint */
+				g_atomic_int_set(&session->gop_pending, 1);
+			}
 			/* Done */
 			janus_refcount_decrease(&oldmp->ref);	/* This is for the request being done with it */
 			result = json_object();
@@ -4799,6 +5232,15 @@ static int janus_streaming_get_fd_port(int fd) {
 
 /* Helpers to destroy a streaming mountpoint. */
 static void janus_streaming_rtp_source_free(janus_streaming_rtp_source *source) {
+	if(source->bridge_source != NULL) {
+		/* Once this returns, the bridge won't invoke our callback anymore */
+		janus_mutex_lock(&source->bridge_mutex);
+		janus_media_bridge_sink *sink = source->bridge;
+		source->bridge = NULL;
+		janus_mutex_unlock(&source->bridge_mutex);
+		janus_media_bridge_sink_remove(sink);
+	}
+	g_free(source->bridge_source);
 	if(source->audio_fd > -1) {
 		close(source->audio_fd);
 	}
@@ -4826,11 +5268,11 @@ static void janus_streaming_rtp_source_free(janus_streaming_rtp_source *source)
 	if(source->pipefd[1] > -1) {
 		close(source->pipefd[1]);
 	}
-	janus_mutex_lock(&source->keyframe.mutex);
-	if(source->keyframe.latest_keyframe != NULL)
-		g_list_free_full(source->keyframe.latest_keyframe, (GDestroyNotify)janus_streaming_rtp_relay_packet_free);
-	source->keyframe.latest_keyframe = NULL;
-	janus_mutex_unlock(&source->keyframe.mutex);
+	if(source->keyframe.enabled) {
+		int i=0;
+		for(i=0; i<3; i++)
+			janus_rtp_gop_cache_destroy(&source->keyframe.gop[i]);
+	}
 	janus_mutex_lock(&source->buffermsg_mutex);
 	if(source->last_msg != NULL)
 		janus_streaming_rtp_relay_packet_free((janus_streaming_rtp_relay_packet *)source->last_msg);
@@ -4869,6 +5311,7 @@ static void janus_streaming_rtp_source_free(janus_streaming_rtp_source *source)
 
 static void janus_streaming_file_source_free(janus_streaming_file_source *source) {
 	g_free(source->filename);
+	janus_media_clock_destroy(source->clock);
 	g_free(source);
 }
 
@@ -4877,7 +5320,7 @@ janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 		uint64_t id, char *name, char *desc,
 		int srtpsuite, char *srtpcrypto, int threads,
 		gboolean doaudio, char *amcast, const janus_network_address *aiface, uint16_t aport, uint16_t artcpport, uint8_t acodec, char *artpmap, char *afmtp, gboolean doaskew,
-		gboolean dovideo, char *vmcast, const janus_network_address *viface, uint16_t vport, uint16_t vrtcpport, uint8_t vcodec, char *vrtpmap, char *vfmtp, gboolean bufferkf,
+		gboolean dovideo, char *vmcast, const janus_network_address *viface, uint16_t vport, uint16_t vrtcpport, uint8_t vcodec, char *vrtpmap, char *vfmtp, gboolean bufferkf, guint bufferkf_size,
 			gboolean simulcast, uint16_t vport2, uint16_t vport3, gboolean svc, gboolean dovskew, int rtp_collision,
 		gboolean dodata, const janus_network_address *diface, uint16_t dport, gboolean buffermsg) {
 	char tempname[255];
@@ -5185,10 +5628,12 @@ janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 	live_rtp_source->last_received_video = janus_get_monotonic_time();
 	live_rtp_source->last_received_data = janus_get_monotonic_time();
 	live_rtp_source->keyframe.enabled = bufferkf;
-	live_rtp_source->keyframe.latest_keyframe = NULL;
-	live_rtp_source->keyframe.temp_keyframe = NULL;
-	live_rtp_source->keyframe.temp_ts = 0;
-	janus_mutex_init(&live_rtp_source->keyframe.mutex);
+	live_rtp_source->keyframe.size = bufferkf_size > 0 ? bufferkf_size : JANUS_RTP_GOP_CACHE_DEFAULT_SIZE;
+	if(bufferkf) {
+		int i=0;
+		for(i=0; i<3; i++)
+			janus_rtp_gop_cache_init(&live_rtp_source->keyframe.gop[i], live_rtp_source->keyframe.size);
+	}
 	live_rtp_source->rtp_collision = rtp_collision;
 	live_rtp_source->buffermsg = buffermsg;
 	live_rtp_source->last_msg = NULL;
@@ -5223,6 +5668,7 @@ janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 	janus_mutex_init(&live_rtp->mutex);
 	janus_mutex_lock(&mountpoints_mutex);
 	g_hash_table_insert(mountpoints, janus_uint64_dup(live_rtp->id), live_rtp);
+	janus_streaming_mountpoints_changed();
 	g_hash_table_remove(mountpoints_temp, &id);
 	janus_mutex_unlock(&mountpoints_mutex);
 	/* If we need helper threads, spawn them now */
@@ -5338,6 +5784,7 @@ janus_streaming_mountpoint *janus_streaming_create_file_source(
 	janus_mutex_init(&file_source->mutex);
 	janus_mutex_lock(&mountpoints_mutex);
 	g_hash_table_insert(mountpoints, janus_uint64_dup(file_source->id), file_source);
+	janus_streaming_mountpoints_changed();
 	g_hash_table_remove(mountpoints_temp, &id);
 	janus_mutex_unlock(&mountpoints_mutex);
 	if(live) {
@@ -5916,6 +6363,7 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 	}
 	janus_mutex_lock(&mountpoints_mutex);
 	g_hash_table_insert(mountpoints, janus_uint64_dup(live_rtsp->id), live_rtsp);
+	janus_streaming_mountpoints_changed();
 	g_hash_table_remove(mountpoints_temp, &id);
 	janus_mutex_unlock(&mountpoints_mutex);
 	return live_rtsp;
@@ -5934,6 +6382,292 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 }
 #endif
 
+/* Helper to add a video packet to the GOP cache of its substream, once its header has been
+ * updated: keyframe is 1 or 0 if the caller knows already, and -1 if we need to inspect the payload */
+static void janus_streaming_rtp_gop_save(janus_streaming_mountpoint *mountpoint, janus_streaming_rtp_source *source,
+		char *buffer, int bytes, int index, int keyframe) {
+	gboolean kf = (keyframe == 1);
+	if(keyframe < 0) {
+		int plen = 0;
+		char *payload = janus_rtp_payload(buffer, bytes, &plen);
+		if(payload) {
+			switch(mountpoint->codecs.video_codec) {
+				case JANUS_VIDEOCODEC_VP8:
+					kf = janus_vp8_is_keyframe(payload, plen);
+					break;
+				case JANUS_VIDEOCODEC_VP9:
+					kf = janus_vp9_is_keyframe(payload, plen);
+					break;
+				case JANUS_VIDEOCODEC_H264:
+					kf = janus_h264_is_keyframe(payload, plen);
+					break;
+				default:
+					break;
+			}
+		}
+	}
+	if(kf) {
+		janus_rtp_header *rtp = (janus_rtp_header *)buffer;
+		JANUS_LOG(LOG_HUGE, "[%s] New keyframe received on substream %d, starting a new GOP (ts=%"SCNu32")\n",
+			mountpoint->name, index, ntohl(rtp->timestamp));
+	}
+	janus_rtp_gop_cache_add(&source->keyframe.gop[index], buffer, bytes, kf);
+}
+
+/* Callback the media bridge invokes, in the bridge thread of a bridge mountpoint, for each packet the feeding plugin relays */
+static void janus_streaming_bridge_incoming(const janus_media_bridge_packet *bpkt, void *user_data) {
+	janus_streaming_mountpoint *mountpoint = (janus_streaming_mountpoint *)user_data;
+	if(g_atomic_int_get(&stopping) || g_atomic_int_get(&mountpoint->destroyed))
+		return;
+	janus_streaming_rtp_source *source = mountpoint->source;
+	if(bpkt->length > 1500 || !janus_is_rtp((char *)bpkt->buffer, bpkt->length))
+		return;
+	if((bpkt->video && !mountpoint->video) || (!bpkt->video && !mountpoint->audio))
+		return;
+	int index = bpkt->video ? bpkt->substream : 0;
+	if(index < 0 || index > 2 || (index > 0 && !source->simulcast))
+		return;
+	if(mountpoint->active == FALSE)
+		mountpoint->active = TRUE;
+	gint64 now = janus_get_monotonic_time();
+	/* We can't modify what the bridge gives us, and we need to update the header */
+	char buffer[1500];
+	int bytes = bpkt->length;
+	memcpy(buffer, bpkt->buffer, bytes);
+	janus_rtp_header *rtp = (janus_rtp_header *)buffer;
+	uint32_t ssrc = ntohl(rtp->ssrc);
+	janus_streaming_rtp_relay_packet packet;
+	memset(&packet, 0, sizeof(packet));
+	packet.data = rtp;
+	packet.length = bytes;
+	packet.is_rtp = TRUE;
+	packet.is_video = bpkt->video;
+	packet.is_keyframe = FALSE;
+	if(!bpkt->video) {
+		source->last_received_audio = now;
+		/* Do we have a new stream? */
+		if(ssrc != source->audio_ssrc) {
+			source->audio_ssrc = ssrc;
+			JANUS_LOG(LOG_INFO, "[%s] New audio stream! (ssrc=%"SCNu32")\n", mountpoint->name, ssrc);
+		}
+		/* If paused, ignore this packet */
+		if(!mountpoint->enabled && !source->arc)
+			return;
+		packet.data->type = mountpoint->codecs.audio_pt;
+		janus_rtp_header_update(packet.data, &source->context[0], FALSE, 0);
+		/* Is there a recorder? */
+		if(source->arc) {
+			packet.data->ssrc = htonl((uint32_t)mountpoint->id);
+			janus_recorder_save_frame(source->arc, buffer, bytes);
+		}
+	} else {
+		source->last_received_video = now;
+		/* Do we have a new stream? */
+		if(ssrc != source->bridge_video_ssrc[index]) {
+			source->bridge_video_ssrc[index] = ssrc;
+			if(index == 0)
+				source->video_ssrc = ssrc;
+			JANUS_LOG(LOG_INFO, "[%s] New video stream! (ssrc=%"SCNu32", index %d)\n", mountpoint->name, ssrc, index);
+		}
+		if(source->simulcast)
+			janus_rtp_simulcasting_bitrates_update(&source->sc_bitrates, index, bytes);
+		/* If paused, ignore this packet */
+		if(!mountpoint->enabled && !source->vrc)
+			return;
+		packet.simulcast = source->simulcast;
+		packet.substream = index;
+		packet.codec = mountpoint->codecs.video_codec;
+		packet.data->type = mountpoint->codecs.video_pt;
+		janus_rtp_header_update(packet.data, &source->context[index], TRUE, 0);
+		/* Is there a recorder? (FIXME notice we only record the first substream, if simulcasting) */
+		if(index == 0 && source->vrc) {
+			packet.data->ssrc = htonl((uint32_t)mountpoint->id);
+			janus_recorder_save_frame(source->vrc, buffer, bytes);
+		}
+		/* Take note of the simulcast SSRCs */
+		if(source->simulcast) {
+			packet.ssrc[0] = source->bridge_video_ssrc[0];
+			packet.ssrc[1] = source->bridge_video_ssrc[1];
+			packet.ssrc[2] = source->bridge_video_ssrc[2];
+		}
+	}
+	if(mountpoint->enabled) {
+		packet.data->ssrc = htonl(ssrc);
+		/* Backup the actual timestamp and sequence number set by the source, in case switching is involved */
+		packet.timestamp = ntohl(packet.data->timestamp);
+		packet.seq_number = ntohs(packet.data->seq_number);
+		/* Go! */
+		janus_mutex_lock(&mountpoint->mutex);
+		g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
+			mountpoint->helper_threads == 0 ? janus_streaming_relay_rtp_packet : janus_streaming_helper_rtprtcp_packet,
+			&packet);
+		janus_mutex_unlock(&mountpoint->mutex);
+		/* Update the GOP cache, now that viewers got the packet: the source
+		 * told us already whether this is a keyframe, no need to parse it again */
+		if(bpkt->video && source->keyframe.enabled)
+			janus_streaming_rtp_gop_save(mountpoint, source, buffer, bytes, index, bpkt->keyframe ? 1 : 0);
+	}
+	/* There's no relay thread for bridge mountpoints, so we check for delayed keyframe requests here */
+	if(g_atomic_int_get(&source->need_pli))
+		janus_streaming_rtcp_pli_send(source);
+}
+
+/* Helper to create a live source fed by another plugin (e.g., a VideoRoom publisher) */
+janus_streaming_mountpoint *janus_streaming_create_bridge_source(
+		uint64_t id, char *name, char *desc, char *bridge, int threads,
+		gboolean doaudio, uint8_t acodec, char *artpmap, char *afmtp,
+		gboolean dovideo, uint8_t vcodec, char *vrtpmap, char *vfmtp, gboolean bufferkf, guint bufferkf_size, gboolean simulcast) {
+	char tempname[255];
+	if(name == NULL) {
+		JANUS_LOG(LOG_VERB, "Missing name, will generate a random one...\n");
+		memset(tempname, 0, 255);
+		g_snprintf(tempname, 255, "mp-%"SCNu64, id);
+	} else if(atoi(name) != 0) {
+		JANUS_LOG(LOG_VERB, "Names can't start with a number, prefixing it...\n");
+		memset(tempname, 0, 255);
+		g_snprintf(tempname, 255, "mp-%s", name);
+		name = NULL;
+	}
+	if(bridge == NULL || (!doaudio && !dovideo) ||
+			(doaudio && artpmap == NULL) || (dovideo && (vcodec == 0 || vrtpmap == NULL))) {
+		JANUS_LOG(LOG_ERR, "Can't add 'bridge' stream, missing mandatory information...\n");
+		janus_mutex_lock(&mountpoints_mutex);
+		g_hash_table_remove(mountpoints_temp, &id);
+		janus_mutex_unlock(&mountpoints_mutex);
+		return NULL;
+	}
+	JANUS_LOG(LOG_VERB, "Audio %s, Video %s, bridged from %s\n",
+		doaudio ? "enabled" : "NOT enabled",
+		dovideo ? "enabled" : "NOT enabled", bridge);
+	janus_network_address nil;
+	janus_network_address_nullify(&nil);
+
+	/* Create the mountpoint: we reuse the RTP source, but without any socket */
+	janus_streaming_mountpoint *live_bridge = g_malloc0(sizeof(janus_streaming_mountpoint));
+	live_bridge->id = id;
+	live_bridge->name = g_strdup(name ? name : tempname);
+	live_bridge->description = g_strdup(desc ? desc : (name ? name : tempname));
+	live_bridge->enabled = TRUE;
+	live_bridge->active = FALSE;
+	live_bridge->audio = doaudio;
+	live_bridge->video = dovideo;
+	live_bridge->data = FALSE;
+	live_bridge->streaming_type = janus_streaming_type_live;
+	live_bridge->streaming_source = janus_streaming_source_rtp;
+	janus_streaming_rtp_source *live_bridge_source = g_malloc0(sizeof(janus_streaming_rtp_source));
+	live_bridge_source->bridge_source = g_strdup(bridge);
+	live_bridge_source->audio_port = -1;
+	live_bridge_source->video_port[0] = -1;
+	live_bridge_source->video_port[1] = -1;
+	live_bridge_source->video_port[2] = -1;
+	live_bridge_source->data_port = -1;
+	live_bridge_source->audio_iface = nil;
+	live_bridge_source->video_iface = nil;
+	live_bridge_source->data_iface = nil;
+	live_bridge_source->simulcast = dovideo && simulcast;
+	live_bridge_source->arc = NULL;
+	live_bridge_source->vrc = NULL;
+	live_bridge_source->drc = NULL;
+	janus_rtp_switching_context_reset(&live_bridge_source->context[0]);
+	janus_rtp_switching_context_reset(&live_bridge_source->context[1]);
+	janus_rtp_switching_context_reset(&live_bridge_source->context[2]);
+	janus_mutex_init(&live_bridge_source->rec_mutex);
+	janus_mutex_init(&live_bridge_source->bridge_mutex);
+	live_bridge_source->audio_fd = -1;
+	live_bridge_source->audio_rtcp_fd = -1;
+	live_bridge_source->video_fd[0] = -1;
+	live_bridge_source->video_fd[1] = -1;
+	live_bridge_source->video_fd[2] = -1;
+	live_bridge_source->video_rtcp_fd = -1;
+	live_bridge_source->data_fd = -1;
+	live_bridge_source->pipefd[0] = -1;
+	live_bridge_source->pipefd[1] = -1;
+	live_bridge_source->last_received_audio = janus_get_monotonic_time();
+	live_bridge_source->last_received_video = janus_get_monotonic_time();
+	live_bridge_source->last_received_data = janus_get_monotonic_time();
+	live_bridge_source->keyframe.enabled = bufferkf;
+	live_bridge_source->keyframe.size = bufferkf_size > 0 ? bufferkf_size : JANUS_RTP_GOP_CACHE_DEFAULT_SIZE;
+	if(bufferkf) {
+		int i=0;
+		for(i=0; i<3; i++)
+			janus_rtp_gop_cache_init(&live_bridge_source->keyframe.gop[i], live_bridge_source->keyframe.size);
+	}
+	live_bridge_source->buffermsg = FALSE;
+	live_bridge_source->last_msg = NULL;
+	janus_mutex_init(&live_bridge_source->buffermsg_mutex);
+	live_bridge->source = live_bridge_source;
+	live_bridge->source_destroy = (GDestroyNotify) janus_streaming_rtp_source_free;
+	live_bridge->codecs.audio_pt = doaudio ? acodec : -1;
+	live_bridge->codecs.audio_rtpmap = doaudio ? g_strdup(artpmap) : NULL;
+	live_bridge->codecs.audio_fmtp = doaudio ? (afmtp ? g_strdup(afmtp) : NULL) : NULL;
+	live_bridge->codecs.video_codec = JANUS_VIDEOCODEC_NONE;
+	if(dovideo) {
+		if(strstr(vrtpmap, "vp8") || strstr(vrtpmap, "VP8"))
+			live_bridge->codecs.video_codec = JANUS_VIDEOCODEC_VP8;
+		else if(strstr(vrtpmap, "vp9") || strstr(vrtpmap, "VP9"))
+			live_bridge->codecs.video_codec = JANUS_VIDEOCODEC_VP9;
+		else if(strstr(vrtpmap, "h264") || strstr(vrtpmap, "H264"))
+			live_bridge->codecs.video_codec = JANUS_VIDEOCODEC_H264;
+	}
+	live_bridge->codecs.video_pt = dovideo ? vcodec : -1;
+	live_bridge->codecs.video_rtpmap = dovideo ? g_strdup(vrtpmap) : NULL;
+	live_bridge->codecs.video_fmtp = dovideo ? (vfmtp ? g_strdup(vfmtp) : NULL) : NULL;
+	live_bridge->viewers = NULL;
+	g_atomic_int_set(&live_bridge->destroyed, 0);
+	janus_refcount_init(&live_bridge->ref, janus_streaming_mountpoint_free);
+	janus_mutex_init(&live_bridge->mutex);
+	janus_mutex_lock(&mountpoints_mutex);
+	g_hash_table_insert(mountpoints, janus_uint64_dup(live_bridge->id), live_bridge);
+	janus_streaming_mountpoints_changed();
+	g_hash_table_remove(mountpoints_temp, &id);
+	janus_mutex_unlock(&mountpoints_mutex);
+	/* If we need helper threads, spawn them now */
+	GError *error = NULL;
+	char tname[16];
+	if(threads > 0) {
+		int i=0;
+		for(i=0; i<threads; i++) {
+			janus_streaming_helper *helper = g_malloc0(sizeof(janus_streaming_helper));
+			helper->id = i+1;
+			helper->mp = live_bridge;
+			helper->queued_packets = g_async_queue_new_full((GDestroyNotify)janus_streaming_rtp_relay_packet_free);
+			/* Add a reference because the bridge callback is going to push on these queues */
+			g_async_queue_ref(helper->queued_packets);
+			janus_mutex_init(&helper->mutex);
+			live_bridge->helper_threads++;
+			g_snprintf(tname, sizeof(tname), "help %u-%"SCNu64, helper->id, live_bridge->id);
+			janus_refcount_increase(&live_bridge->ref);
+			helper->thread = g_thread_try_new(tname, &janus_streaming_helper_thread, helper, &error);
+			if(error != NULL) {
+				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the helper thread...\n",
+					error->code, error->message ? error->message : "??");
+				janus_refcount_decrease(&live_bridge->ref);	/* This is for the helper thread */
+				janus_mutex_lock(&mountpoints_mutex);
+				g_hash_table_remove(mountpoints, &live_bridge->id);
+				janus_streaming_mountpoints_changed();
+				janus_mutex_unlock(&mountpoints_mutex);
+				return NULL;
+			}
+			live_bridge->threads = g_list_append(live_bridge->threads, helper);
+		}
+	}
+	/* Finally, attach to the media bridge: no thread needed here, as the
+	 * bridge passes us the packets from a thread of its own */
+	janus_media_bridge_sink *sink = janus_media_bridge_sink_add(bridge, janus_streaming_bridge_incoming, live_bridge);
+	janus_mutex_lock(&live_bridge_source->bridge_mutex);
+	live_bridge_source->bridge = sink;
+	janus_mutex_unlock(&live_bridge_source->bridge_mutex);
+	if(sink == NULL) {
+		JANUS_LOG(LOG_ERR, "Couldn't attach to media bridge %s...\n", bridge);
+		janus_mutex_lock(&mountpoints_mutex);
+		g_hash_table_remove(mountpoints, &live_bridge->id);
+		janus_streaming_mountpoints_changed();
+		janus_mutex_unlock(&mountpoints_mutex);
+		return NULL;
+	}
+	return live_bridge;
+}
+
 /* FIXME Thread to send RTP packets from a file (on demand) */
 static void *janus_streaming_ondemand_thread(void *data) {
 	JANUS_LOG(LOG_VERB, "Filesource (on demand) RTP thread starting...\n");
@@ -5996,33 +6730,18 @@ static void *janus_streaming_ondemand_thread(void *data) {
 	header->timestamp = htonl(ts);
 	header->ssrc = htonl(1);	/* The gateway will fix this anyway */
 	/* Timer */
-	struct timeval now, before;
-	gettimeofday(&before, NULL);
-	now.tv_sec = before.tv_sec;
-	now.tv_usec = before.tv_usec;
-	time_t passed, d_s, d_us;
+	janus_media_clock *clock = janus_media_clock_create(20000);
+	janus_mutex_lock(&session->mutex);
+	session->clock = clock;
+	janus_mutex_unlock(&session->mutex);
 	/* Loop */
 	gint read = 0;
 	janus_streaming_rtp_relay_packet packet;
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed) && !session->stopping && !g_atomic_int_get(&session->destroyed)) {
-		/* See if it's time to prepare a frame */
-		gettimeofday(&now, NULL);
-		d_s = now.tv_sec - before.tv_sec;
-		d_us = now.tv_usec - before.tv_usec;
-		if(d_us < 0) {
-			d_us += 1000000;
-			--d_s;
-		}
-		passed = d_s*1000000 + d_us;
-		if(passed < 18000) {	/* Let's wait about 18ms */
-			g_usleep(5000);
-			continue;
-		}
-		/* Update the reference time */
-		before.tv_usec += 20000;
-		if(before.tv_usec > 1000000) {
-			before.tv_sec++;
-			before.tv_usec -= 1000000;
+		/* Wait until it's time to prepare a frame */
+		if(janus_media_clock_wait(clock) < 0) {
+			JANUS_LOG(LOG_ERR, "[%s] Error waiting for the media clock...\n", name);
+			break;
 		}
 		/* If not started or paused, wait some more */
 		if(!session->started || session->paused || !mountpoint->enabled)
@@ -6061,6 +6780,11 @@ static void *janus_streaming_ondemand_thread(void *data) {
 		header->markerbit = 0;
 	}
 	JANUS_LOG(LOG_VERB, "[%s] Leaving filesource (ondemand) thread\n", name);
+	janus_mutex_lock(&session->mutex);
+	if(session->clock == clock)
+		session->clock = NULL;
+	janus_mutex_unlock(&session->mutex);
+	janus_media_clock_destroy(clock);
 	g_free(name);
 	g_free(buf);
 	fclose(audio);
@@ -6116,33 +6840,16 @@ static void *janus_streaming_filesource_thread(void *data) {
 	header->timestamp = htonl(ts);
 	header->ssrc = htonl(1);	/* The Janus core will fix this anyway */
 	/* Timer */
-	struct timeval now, before;
-	gettimeofday(&before, NULL);
-	now.tv_sec = before.tv_sec;
-	now.tv_usec = before.tv_usec;
-	time_t passed, d_s, d_us;
+	janus_media_clock *clock = janus_media_clock_create(20000);
+	source->clock = clock;
 	/* Loop */
 	gint read = 0;
 	janus_streaming_rtp_relay_packet packet;
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed)) {
-		/* See if it's time to prepare a frame */
-		gettimeofday(&now, NULL);
-		d_s = now.tv_sec - before.tv_sec;
-		d_us = now.tv_usec - before.tv_usec;
-		if(d_us < 0) {
-			d_us += 1000000;
-			--d_s;
-		}
-		passed = d_s*1000000 + d_us;
-		if(passed < 18000) {	/* Let's wait about 18ms */
-			g_usleep(5000);
-			continue;
-		}
-		/* Update the reference time */
-		before.tv_usec += 20000;
-		if(before.tv_usec > 1000000) {
-			before.tv_sec++;
-			before.tv_usec -= 1000000;
+		/* Wait until it's time to prepare a frame */
+		if(janus_media_clock_wait(clock) < 0) {
+			JANUS_LOG(LOG_ERR, "[%s] Error waiting for the media clock...\n", name);
+			break;
 		}
 		/* If paused, wait some more */
 		if(!mountpoint->enabled)
@@ -6620,82 +7327,8 @@ static void *janus_streaming_relay_thread(void *data) {
 						}
 						bytes = buflen;
 					}
-					/* First of all, let's check if this is (part of) a keyframe that we may need to save it for future reference */
-					if(source->keyframe.enabled) {
-						if(source->keyframe.temp_ts > 0 && ntohl(rtp->timestamp) != source->keyframe.temp_ts) {
-							/* We received the last part of the keyframe, get rid of the old one and use this from now on */
-							JANUS_LOG(LOG_HUGE, "[%s] ... ... last part of keyframe received! ts=%"SCNu32", %d packets\n",
-								name, source->keyframe.temp_ts, g_list_length(source->keyframe.temp_keyframe));
-							source->keyframe.temp_ts = 0;
-							janus_mutex_lock(&source->keyframe.mutex);
-							if(source->keyframe.latest_keyframe != NULL)
-								g_list_free_full(source->keyframe.latest_keyframe, (GDestroyNotify)janus_streaming_rtp_relay_packet_free);
-							source->keyframe.latest_keyframe = source->keyframe.temp_keyframe;
-							source->keyframe.temp_keyframe = NULL;
-							janus_mutex_unlock(&source->keyframe.mutex);
-						} else if(ntohl(rtp->timestamp) == source->keyframe.temp_ts) {
-							/* Part of the keyframe we're currently saving, store */
-							janus_mutex_lock(&source->keyframe.mutex);
-							JANUS_LOG(LOG_HUGE, "[%s] ... other part of keyframe received! ts=%"SCNu32"\n", name, source->keyframe.temp_ts);
-							janus_streaming_rtp_relay_packet *pkt = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
-							pkt->data = g_malloc(bytes);
-							memcpy(pkt->data, buffer, bytes);
-							pkt->data->ssrc = htons(1);
-							pkt->data->type = mountpoint->codecs.video_pt;
-							packet.is_rtp = TRUE;
-							packet.is_video = TRUE;
-							packet.is_keyframe = TRUE;
-							pkt->length = bytes;
-							pkt->timestamp = source->keyframe.temp_ts;
-							pkt->seq_number = ntohs(rtp->seq_number);
-							source->keyframe.temp_keyframe = g_list_append(source->keyframe.temp_keyframe, pkt);
-							janus_mutex_unlock(&source->keyframe.mutex);
-						} else {
-							gboolean kf = FALSE;
-							/* Parse RTP header first */
-							janus_rtp_header *header = (janus_rtp_header *)buffer;
-							guint32 timestamp = ntohl(header->timestamp);
-							guint16 seq = ntohs(header->seq_number);
-							JANUS_LOG(LOG_HUGE, "Checking if packet (size=%d, seq=%"SCNu16", ts=%"SCNu32") is a key frame...\n",
-								bytes, seq, timestamp);
-							int plen = 0;
-							char *payload = janus_rtp_payload(buffer, bytes, &plen);
-							if(payload) {
-								switch(mountpoint->codecs.video_codec) {
-									case JANUS_VIDEOCODEC_VP8:
-										kf = janus_vp8_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_VP9:
-										kf = janus_vp9_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_H264:
-										kf = janus_h264_is_keyframe(payload, plen);
-										break;
-									default:
-										break;
-								}
-								if(kf) {
-									/* New keyframe, start saving it */
-									source->keyframe.temp_ts = ntohl(rtp->timestamp);
-									JANUS_LOG(LOG_HUGE, "[%s] New keyframe received! ts=%"SCNu32"\n", name, source->keyframe.temp_ts);
-									janus_mutex_lock(&source->keyframe.mutex);
-									janus_streaming_rtp_relay_packet *pkt = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
-									pkt->data = g_malloc(bytes);
-									memcpy(pkt->data, buffer, bytes);
-									pkt->data->ssrc = htons(1);
-									pkt->data->type = mountpoint->codecs.video_pt;
-									packet.is_rtp = TRUE;
-									packet.is_video = TRUE;
-									packet.is_keyframe = TRUE;
-									pkt->length = bytes;
-									pkt->timestamp = source->keyframe.temp_ts;
-									pkt->seq_number = ntohs(rtp->seq_number);
-									source->keyframe.temp_keyframe = g_list_append(source->keyframe.temp_keyframe, pkt);
-									janus_mutex_unlock(&source->keyframe.mutex);
-								}
-							}
-						}
-					}
+					if(source->simulcast)
+						janus_rtp_simulcasting_bitrates_update(&source->sc_bitrates, index, bytes);
 					/* If paused, ignore this packet */
 					if(!mountpoint->enabled && !source->vrc)
 						continue;
@@ -6767,6 +7400,9 @@ static void *janus_streaming_relay_thread(void *data) {
 							mountpoint->helper_threads == 0 ? janus_streaming_relay_rtp_packet : janus_streaming_helper_rtprtcp_packet,
 							&packet);
 						janus_mutex_unlock(&mountpoint->mutex);
+						/* Update the GOP cache, now that viewers got the packet */
+						if(source->keyframe.enabled)
+							janus_streaming_rtp_gop_save(mountpoint, source, buffer, bytes, index, -1);
 					}
 					continue;
 				} else if(data_fd != -1 && fds[i].fd == data_fd) {
@@ -6917,6 +7553,68 @@ static void *janus_streaming_relay_thread(void *data) {
 	return NULL;
 }
 
+/* Helper to send the cached GOP of a mountpoint to a new viewer, right before the provided packet */
+static void janus_streaming_gop_replay(janus_streaming_session *session, janus_streaming_rtp_relay_packet *next) {
+	if(!g_atomic_int_compare_and_exchange(&session->gop_pending, 1, 0))
+		return;
+	janus_streaming_mountpoint *mountpoint = session->mountpoint;
+	if(mountpoint == NULL || mountpoint->streaming_source != janus_streaming_source_rtp)
+		return;
+	janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mountpoint->source;
+	if(source == NULL || !source->keyframe.enabled)
+		return;
+	/* In case of simulcast, pick the GOP of the substream the viewer is waiting for */
+	int index = 0;
+	if(source->simulcast) {
+		index = session->sim_context.substream_target;
+		if(index < 0 || index > 2)
+			index = 0;
+		if(!janus_rtp_gop_cache_is_valid(&source->keyframe.gop[index]) && index == 2 &&
+				session->sim_context.substream < 1)
+			index = 1;
+	}
+	guint count = 0;
+	janus_rtp_gop_packet **packets = janus_rtp_gop_cache_get(&source->keyframe.gop[index], &count);
+	if(packets == NULL) {
+		/* Nothing cached yet, let's ask for a keyframe */
+		g_atomic_int_set(&source->need_pli, 1);
+		return;
+	}
+	JANUS_LOG(LOG_VERB, "[%s] Sending cached GOP to new viewer (%u packets)\n", mountpoint->name, count);
+	char buffer[1500];
+	guint i = 0;
+	for(i=0; i<count; i++) {
+		janus_rtp_gop_packet *gp = packets[i];
+		janus_rtp_header *rtp = (janus_rtp_header *)gp->buffer;
+		/* With helper threads the cache may be ahead of us: stop where the live stream is */
+		if(next->substream == index && (gint16)(ntohs(rtp->seq_number) - next->seq_number) >= 0) {
+			for(; i<count; i++)
+				janus_rtp_gop_packet_unref(packets[i]);
+			break;
+		}
+		if(gp->length <= (int)sizeof(buffer)) {
+			/* Relaying may update the packet, so we work on a copy */
+			memcpy(buffer, gp->buffer, gp->length);
+			janus_streaming_rtp_relay_packet packet;
+			memset(&packet, 0, sizeof(packet));
+			packet.data = (janus_rtp_header *)buffer;
+			packet.length = gp->length;
+			packet.is_rtp = TRUE;
+			packet.is_video = TRUE;
+			packet.simulcast = source->simulcast;
+			packet.substream = index;
+			packet.codec = mountpoint->codecs.video_codec;
+			/* The cache only contains packets from this substream, so we only need its SSRC */
+			packet.ssrc[index] = ntohl(packet.data->ssrc);
+			packet.timestamp = ntohl(packet.data->timestamp);
+			packet.seq_number = ntohs(packet.data->seq_number);
+			janus_streaming_relay_rtp_packet(session, &packet);
+		}
+		janus_rtp_gop_packet_unref(gp);
+	}
+	g_free(packets);
+}
+
 static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data) {
 	janus_streaming_rtp_relay_packet *packet = (janus_streaming_rtp_relay_packet *)user_data;
 	if(!packet || !packet->data || packet->length < 1) {
@@ -6938,6 +7636,9 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 		if(packet->is_video) {
 			if(!session->video)
 				return;
+			/* If this viewer just started, send the cached GOP first */
+			if(g_atomic_int_get(&session->gop_pending))
+				janus_streaming_gop_replay(session, packet);
 			/* Check if there's any SVC info to take into account */
 			if(packet->svc) {
 				/* There is: check if this is a layer that can be dropped for this viewer
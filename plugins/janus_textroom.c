@@ -30,7 +30,22 @@
  * incoming messages. If configured, messages addressed to that room will
  * also be forwarded, by means of an HTTP POST, to the specified address.
  * Notice that this will only work if libcurl was available when
- * configuring and installing Janus.
+ * configuring and installing Janus. Messages are not posted by the thread
+ * that handles them, but queued and sent by a dedicated thread, which
+ * means a slow backend will not stall the room: the queue is bounded by
+ * the \c backend_queue property in the plugin settings (default=1000
+ * messages), after which new messages are dropped. Failed posts (network
+ * errors or 5xx responses) are retried up to \c backend_retries times
+ * (default=3) with an exponential backoff. Setting \c backend_batch_window
+ * to a value in milliseconds (default=0, no batching) will cause messages
+ * for the same backend within that window to be sent together, up to
+ * \c backend_batch_size messages (default=50): in that case, the backend
+ * will receive a JSON array of messages, rather than a single one, every
+ * time more than a message is available. The state of the queue and the
+ * latency of the backends can be checked with a \c backend_stats request
+ * via Admin API, which returns a \c backend object with the count of
+ * queued, in flight, sent, failed and dropped messages, and the last,
+ * average and maximum time (in milliseconds) the backends took to answer.
  *
  * \note This plugin is only meant to showcase what you can do with
  * data channels involving multiple participants at the same time. While
@@ -669,6 +684,9 @@ typedef struct janus_textroom_room {
 	GHashTable *participants;	/* Map of participants */
 	gboolean check_tokens;		/* Whether to check tokens when participants join (see below) */
 	GHashTable *allowed;		/* Map of participants (as tokens) allowed to join */
+	struct janus_textroom_recipients *recipients;	/* Immutable copy of the participants, for broadcasts */
+	GAsyncQueue *fanout;		/* Queue of broadcasts for the fan-out thread */
+	GThread *fanout_thread;		/* Thread relaying broadcasts to all participants, started when needed */
 	volatile gint destroyed;	/* Whether this room has been destroyed */
 	janus_mutex mutex;			/* Mutex to lock this room instance */
 	janus_refcount ref;
@@ -701,9 +719,145 @@ typedef struct janus_textroom_participant {
 	janus_refcount ref;
 } janus_textroom_participant;
 
+/* Broadcasts are not relayed by the thread that originates them: the
+ * message is serialized once, and handed to a per-room fan-out thread
+ * together with the list of recipients at that time. The list is an
+ * immutable copy of the participants that's rebuilt when someone joins
+ * or leaves, so queueing a broadcast doesn't depend on the room size */
+typedef struct janus_textroom_recipients {
+	guint count;						/* Number of recipients */
+	janus_textroom_session **sessions;	/* Sessions of the participants at the time of the copy */
+	janus_refcount ref;
+} janus_textroom_recipients;
+
+typedef struct janus_textroom_payload {
+	char *text;				/* Serialized message, as returned by json_dumps */
+	size_t length;			/* Length of the message */
+	janus_refcount ref;
+} janus_textroom_payload;
+
+typedef struct janus_textroom_broadcast {
+	janus_textroom_payload *payload;
+	janus_textroom_recipients *recipients;
+} janus_textroom_broadcast;
+static janus_textroom_broadcast fanout_exit_broadcast;
+/* Fan-out threads are not detached: when they're done, they put themselves in
+ * this queue, so that they can be joined later, either when a new one is
+ * started or, for those still running, when the plugin is destroyed */
+static GAsyncQueue *fanout_finished = NULL;
+static volatile gint fanout_threads = 0;
+
+static void janus_textroom_recipients_free(const janus_refcount *recipients_ref) {
+	janus_textroom_recipients *recipients = janus_refcount_containerof(recipients_ref, janus_textroom_recipients, ref);
+	guint i = 0;
+	for(i=0; i<recipients->count; i++)
+		janus_refcount_decrease(&recipients->sessions[i]->ref);
+	g_free(recipients->sessions);
+	g_free(recipients);
+}
+
+static void janus_textroom_payload_free(const janus_refcount *payload_ref) {
+	janus_textroom_payload *payload = janus_refcount_containerof(payload_ref, janus_textroom_payload, ref);
+	free(payload->text);
+	g_free(payload);
+}
+
+static void janus_textroom_broadcast_free(janus_textroom_broadcast *broadcast) {
+	if(!broadcast || broadcast == &fanout_exit_broadcast)
+		return;
+	janus_refcount_decrease(&broadcast->payload->ref);
+	janus_refcount_decrease(&broadcast->recipients->ref);
+	g_free(broadcast);
+}
+
+static janus_textroom_recipients *janus_textroom_recipients_new(guint size) {
+	janus_textroom_recipients *recipients = g_malloc(sizeof(janus_textroom_recipients));
+	recipients->count = 0;
+	recipients->sessions = g_malloc(size * sizeof(janus_textroom_session *));
+	janus_refcount_init(&recipients->ref, janus_textroom_recipients_free);
+	return recipients;
+}
+
+/* Must be called with the room mutex held, after changing textroom->participants */
+static void janus_textroom_recipients_update(janus_textroom_room *textroom) {
+	janus_textroom_recipients *recipients = NULL;
+	guint count = g_hash_table_size(textroom->participants);
+	if(count > 0) {
+		recipients = janus_textroom_recipients_new(count);
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, textroom->participants);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_textroom_participant *p = value;
+			if(p->session == NULL)
+				continue;
+			janus_refcount_increase(&p->session->ref);
+			recipients->sessions[recipients->count++] = p->session;
+		}
+	}
+	if(textroom->recipients != NULL)
+		janus_refcount_decrease(&textroom->recipients->ref);
+	textroom->recipients = recipients;
+}
+
+static void *janus_textroom_fanout_thread(void *data);
+
+/* Join the fan-out threads that are done, or all of them if wait is TRUE */
+static void janus_textroom_fanout_reap(gboolean wait) {
+	GThread *thread = NULL;
+	while(g_atomic_int_get(&fanout_threads) > 0) {
+		thread = wait ? g_async_queue_pop(fanout_finished) : g_async_queue_try_pop(fanout_finished);
+		if(thread == NULL)
+			break;
+		g_thread_join(thread);
+		g_atomic_int_add(&fanout_threads, -1);
+	}
+}
+
+/* Queue a message for all the provided recipients: the text is owned by
+ * the broadcast from now on. Must be called with the room mutex held */
+static void janus_textroom_room_broadcast(janus_textroom_room *textroom, janus_textroom_recipients *recipients, char *text) {
+	if(recipients == NULL || recipients->count == 0) {
+		free(text);
+		return;
+	}
+	if(textroom->fanout_thread == NULL) {
+		/* First broadcast in this room, start the fan-out thread */
+		janus_textroom_fanout_reap(FALSE);
+		GError *error = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "textroom %"SCNu64, textroom->room_id);
+		janus_refcount_increase(&textroom->ref);
+		g_atomic_int_inc(&fanout_threads);
+		textroom->fanout_thread = g_thread_try_new(tname, &janus_textroom_fanout_thread, textroom, &error);
+		if(error != NULL) {
+			g_atomic_int_add(&fanout_threads, -1);
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the fan-out thread for room %"SCNu64"...\n",
+				error->code, error->message ? error->message : "??", textroom->room_id);
+			g_error_free(error);
+			textroom->fanout_thread = NULL;
+			janus_refcount_decrease(&textroom->ref);
+			free(text);
+			return;
+		}
+	}
+	janus_textroom_payload *payload = g_malloc(sizeof(janus_textroom_payload));
+	payload->text = text;
+	payload->length = strlen(text);
+	janus_refcount_init(&payload->ref, janus_textroom_payload_free);
+	janus_textroom_broadcast *broadcast = g_malloc(sizeof(janus_textroom_broadcast));
+	broadcast->payload = payload;
+	janus_refcount_increase(&recipients->ref);
+	broadcast->recipients = recipients;
+	g_async_queue_push(textroom->fanout, broadcast);
+}
+
 static void janus_textroom_room_destroy(janus_textroom_room *textroom) {
-	if(textroom && g_atomic_int_compare_and_exchange(&textroom->destroyed, 0, 1))
+	if(textroom && g_atomic_int_compare_and_exchange(&textroom->destroyed, 0, 1)) {
+		/* Let the fan-out thread know it can go away, once it's done with what it has */
+		g_async_queue_push(textroom->fanout, &fanout_exit_broadcast);
 		janus_refcount_decrease(&textroom->ref);
+	}
 }
 static void janus_textroom_room_free(const janus_refcount *textroom_ref) {
 	janus_textroom_room *textroom = janus_refcount_containerof(textroom_ref, janus_textroom_room, ref);
@@ -714,6 +868,9 @@ static void janus_textroom_room_free(const janus_refcount *textroom_ref) {
 	g_free(textroom->http_backend);
 	g_hash_table_destroy(textroom->participants);
 	g_hash_table_destroy(textroom->allowed);
+	if(textroom->recipients != NULL)
+		janus_refcount_decrease(&textroom->recipients->ref);
+	g_async_queue_unref(textroom->fanout);
 	g_free(textroom);
 }
 
@@ -811,6 +968,61 @@ static void janus_textroom_message_free(janus_textroom_message *msg) {
 static size_t janus_textroom_write_data(void *buffer, size_t size, size_t nmemb, void *userp) {
 	return size*nmemb;
 }
+
+/* Messages for HTTP backends are posted by a dedicated thread */
+typedef struct janus_textroom_backend_message {
+	char *url;
+	char *text;
+	gint64 queued;
+} janus_textroom_backend_message;
+static janus_textroom_backend_message backend_exit_message;
+static GAsyncQueue *backend_messages = NULL;
+static GThread *backend_thread = NULL;
+static CURLM *backend_multi = NULL;
+static void *janus_textroom_backend_thread(void *data);
+static guint backend_queue_size = 1000;
+static guint backend_batch_window = 0;
+static guint backend_batch_size = 50;
+static guint backend_retries = 3;
+#define JANUS_TEXTROOM_BACKEND_TIMEOUT		10
+#define JANUS_TEXTROOM_BACKEND_RETRY_DELAY	500
+
+/* Backend metrics: the depth of the queue includes all messages that
+ * have been accepted and not delivered (or given up on) yet */
+static volatile gint backend_queued = 0, backend_inflight = 0;
+typedef struct janus_textroom_backend_stats {
+	guint64 posts, sent, failed, dropped, retries;
+	gint64 latency_last, latency_max, latency_total;
+} janus_textroom_backend_stats;
+static janus_textroom_backend_stats backend_stats;
+static janus_mutex backend_mutex = JANUS_MUTEX_INITIALIZER;
+
+static void janus_textroom_backend_message_free(janus_textroom_backend_message *msg) {
+	if(!msg || msg == &backend_exit_message)
+		return;
+	g_free(msg->url);
+	g_free(msg->text);
+	g_free(msg);
+}
+
+/* Queue a message for an HTTP backend: this never blocks */
+static void janus_textroom_backend_queue(const char *url, const char *text) {
+	if(url == NULL || text == NULL || backend_thread == NULL)
+		return;
+	if((guint)g_atomic_int_get(&backend_queued) >= backend_queue_size) {
+		janus_mutex_lock(&backend_mutex);
+		backend_stats.dropped++;
+		janus_mutex_unlock(&backend_mutex);
+		JANUS_LOG(LOG_WARN, "Too many messages waiting for HTTP backends, dropping message for %s\n", url);
+		return;
+	}
+	g_atomic_int_inc(&backend_queued);
+	janus_textroom_backend_message *msg = g_malloc(sizeof(janus_textroom_backend_message));
+	msg->url = g_strdup(url);
+	msg->text = g_strdup(text);
+	msg->queued = janus_get_monotonic_time();
+	g_async_queue_push(backend_messages, msg);
+}
 #endif
 
 /* We use this method to handle incoming requests. Since most of the requests
@@ -853,6 +1065,7 @@ int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
 	rooms = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, (GDestroyNotify)janus_textroom_room_destroy);
 	sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_textroom_session_destroy);
 	messages = g_async_queue_new_full((GDestroyNotify) janus_textroom_message_free);
+	fanout_finished = g_async_queue_new();
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	gateway = callback;
 
@@ -886,6 +1099,45 @@ int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
 		if(!notify_events && callback->events_is_enabled()) {
 			JANUS_LOG(LOG_WARN, "Notification of events to handlers disabled for %s\n", JANUS_TEXTROOM_NAME);
 		}
+#ifdef HAVE_LIBCURL
+		/* How should we post messages to HTTP backends? */
+		janus_config_item *item_bq = janus_config_get(config, config_general, janus_config_type_item, "backend_queue");
+		if(item_bq && item_bq->value) {
+			int size = atoi(item_bq->value);
+			if(size < 1) {
+				JANUS_LOG(LOG_WARN, "Invalid backend_queue value %s, using default (%u)\n", item_bq->value, backend_queue_size);
+			} else {
+				backend_queue_size = size;
+			}
+		}
+		janus_config_item *item_bw = janus_config_get(config, config_general, janus_config_type_item, "backend_batch_window");
+		if(item_bw && item_bw->value) {
+			int window = atoi(item_bw->value);
+			if(window < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid backend_batch_window value %s, not batching messages\n", item_bw->value);
+			} else {
+				backend_batch_window = window;
+			}
+		}
+		janus_config_item *item_bs = janus_config_get(config, config_general, janus_config_type_item, "backend_batch_size");
+		if(item_bs && item_bs->value) {
+			int size = atoi(item_bs->value);
+			if(size < 1) {
+				JANUS_LOG(LOG_WARN, "Invalid backend_batch_size value %s, using default (%u)\n", item_bs->value, backend_batch_size);
+			} else {
+				backend_batch_size = size;
+			}
+		}
+		janus_config_item *item_br = janus_config_get(config, config_general, janus_config_type_item, "backend_retries");
+		if(item_br && item_br->value) {
+			int retries = atoi(item_br->value);
+			if(retries < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid backend_retries value %s, using default (%u)\n", item_br->value, backend_retries);
+			} else {
+				backend_retries = retries;
+			}
+		}
+#endif
 		/* Iterate on all rooms */
 		GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
 		while(cl != NULL) {
@@ -930,6 +1182,7 @@ int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
 			textroom->participants = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)janus_textroom_participant_dereference);
 			textroom->check_tokens = FALSE;	/* Static rooms can't have an "allowed" list yet, no hooks to the configuration file */
 			textroom->allowed = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
+			textroom->fanout = g_async_queue_new_full((GDestroyNotify)janus_textroom_broadcast_free);
 			textroom->destroyed = 0;
 			janus_mutex_init(&textroom->mutex);
 			janus_refcount_init(&textroom->ref, janus_textroom_room_free);
@@ -970,6 +1223,24 @@ int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
 		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the TextRoom handler thread...\n", error->code, error->message ? error->message : "??");
 		return -1;
 	}
+#ifdef HAVE_LIBCURL
+	/* Launch the thread that will post messages to HTTP backends */
+	backend_messages = g_async_queue_new_full((GDestroyNotify)janus_textroom_backend_message_free);
+	backend_multi = curl_multi_init();
+	if(backend_multi == NULL) {
+		JANUS_LOG(LOG_ERR, "Error initializing CURL multi context, messages won't be posted to HTTP backends\n");
+	} else {
+		backend_thread = g_thread_try_new("textroom backend", janus_textroom_backend_thread, NULL, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the TextRoom backend thread, messages won't be posted to HTTP backends\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			backend_thread = NULL;
+			curl_multi_cleanup(backend_multi);
+			backend_multi = NULL;
+		}
+	}
+#endif
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_TEXTROOM_NAME);
 	return 0;
 }
@@ -996,8 +1267,24 @@ void janus_textroom_destroy(void) {
 	janus_mutex_unlock(&rooms_mutex);
 	g_async_queue_unref(messages);
 	messages = NULL;
+	/* Destroying the rooms told all fan-out threads to go away: wait for them */
+	janus_textroom_fanout_reap(TRUE);
+	g_async_queue_unref(fanout_finished);
+	fanout_finished = NULL;
 
 #ifdef HAVE_LIBCURL
+	/* Stop the backend thread: messages still waiting to be posted are lost */
+	if(backend_thread != NULL) {
+		g_async_queue_push(backend_messages, &backend_exit_message);
+		g_thread_join(backend_thread);
+		backend_thread = NULL;
+	}
+	if(backend_multi != NULL) {
+		curl_multi_cleanup(backend_multi);
+		backend_multi = NULL;
+	}
+	g_async_queue_unref(backend_messages);
+	backend_messages = NULL;
 	curl_global_cleanup();
 #endif
 
@@ -1258,6 +1545,29 @@ json_t *janus_textroom_handle_admin_message(json_t *message) {
 		result->content = NULL;
 		janus_plugin_result_destroy(result);
 		goto admin_response;
+	} else if(!strcasecmp(request_text, "backend_stats")) {
+		/* Return the state of the queue of messages for HTTP backends */
+		json_t *backend = json_object();
+#ifdef HAVE_LIBCURL
+		json_object_set_new(backend, "queued", json_integer(g_atomic_int_get(&backend_queued)));
+		json_object_set_new(backend, "queue_size", json_integer(backend_queue_size));
+		json_object_set_new(backend, "in_flight", json_integer(g_atomic_int_get(&backend_inflight)));
+		janus_mutex_lock(&backend_mutex);
+		json_object_set_new(backend, "posts", json_integer(backend_stats.posts));
+		json_object_set_new(backend, "sent", json_integer(backend_stats.sent));
+		json_object_set_new(backend, "failed", json_integer(backend_stats.failed));
+		json_object_set_new(backend, "dropped", json_integer(backend_stats.dropped));
+		json_object_set_new(backend, "retries", json_integer(backend_stats.retries));
+		json_object_set_new(backend, "latency_last", json_integer(backend_stats.latency_last/1000));
+		json_object_set_new(backend, "latency_avg",
+			json_integer(backend_stats.posts ? backend_stats.latency_total/backend_stats.posts/1000 : 0));
+		json_object_set_new(backend, "latency_max", json_integer(backend_stats.latency_max/1000));
+		janus_mutex_unlock(&backend_mutex);
+#endif
+		response = json_object();
+		json_object_set_new(response, "textroom", json_string("success"));
+		json_object_set_new(response, "backend", backend);
+		goto admin_response;
 	} else {
 		JANUS_LOG(LOG_VERB, "Unknown request '%s'\n", request_text);
 		error_code = JANUS_TEXTROOM_ERROR_INVALID_REQUEST;
@@ -1420,35 +1730,20 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		reply = json_object();
 		json_object_set_new(reply, "textroom", json_string("success"));
 		/* Who should we send this message to? */
-		if(username) {
-			/* A single user */
-			json_t *sent = json_object();
-			const char *to = json_string_value(username);
-			JANUS_LOG(LOG_VERB, "To %s in %"SCNu64": %s\n", to, room_id, message);
-			janus_textroom_participant *top = g_hash_table_lookup(textroom->participants, to);
-			if(top) {
-				janus_refcount_increase(&top->ref);
-				gateway->relay_data(top->session->handle, NULL, msg_text, strlen(msg_text));
-				janus_refcount_decrease(&top->ref);
-				json_object_set_new(sent, to, json_true());
-			} else {
-				JANUS_LOG(LOG_WARN, "User %s is not in room %"SCNu64", failed to send message\n", to, room_id);
-				json_object_set_new(sent, to, json_false());
-			}
-			json_object_set_new(reply, "sent", sent);
-		} else if(usernames) {
-			/* A limited number of users */
+		if(username || usernames) {
+			/* A single user or a limited number of users: private messages go
+			 * through the fan-out thread too, so that they're not relayed out
+			 * of order with respect to what was broadcast in the room before */
 			json_t *sent = json_object();
-			size_t i = 0;
-			for(i=0; i<json_array_size(usernames); i++) {
-				json_t *u = json_array_get(usernames, i);
-				const char *to = json_string_value(u);
+			size_t i = 0, num = username ? 1 : json_array_size(usernames);
+			janus_textroom_recipients *recipients = janus_textroom_recipients_new(num);
+			for(i=0; i<num; i++) {
+				const char *to = json_string_value(username ? username : json_array_get(usernames, i));
 				JANUS_LOG(LOG_VERB, "To %s in %"SCNu64": %s\n", to, room_id, message);
 				janus_textroom_participant *top = g_hash_table_lookup(textroom->participants, to);
-				if(top) {
-					janus_refcount_increase(&top->ref);
-					gateway->relay_data(top->session->handle, NULL, msg_text, strlen(msg_text));
-					janus_refcount_decrease(&top->ref);
+				if(top && top->session) {
+					janus_refcount_increase(&top->session->ref);
+					recipients->sessions[recipients->count++] = top->session;
 					json_object_set_new(sent, to, json_true());
 				} else {
 					JANUS_LOG(LOG_WARN, "User %s is not in room %"SCNu64", failed to send message\n", to, room_id);
@@ -1456,50 +1751,20 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				}
 			}
 			json_object_set_new(reply, "sent", sent);
+			janus_textroom_room_broadcast(textroom, recipients, msg_text);
+			msg_text = NULL;
+			janus_refcount_decrease(&recipients->ref);
 		} else {
 			/* Everybody in the room */
 			JANUS_LOG(LOG_VERB, "To everybody in %"SCNu64": %s\n", room_id, message);
-			if(textroom->participants) {
-				GHashTableIter iter;
-				gpointer value;
-				g_hash_table_iter_init(&iter, textroom->participants);
-				while(g_hash_table_iter_next(&iter, NULL, &value)) {
-					janus_textroom_participant *top = value;
-					JANUS_LOG(LOG_VERB, "  >> To %s in %"SCNu64": %s\n", top->username, room_id, message);
-					janus_refcount_increase(&top->ref);
-					gateway->relay_data(top->session->handle, NULL, msg_text, strlen(msg_text));
-					janus_refcount_decrease(&top->ref);
-				}
-			}
 #ifdef HAVE_LIBCURL
 			/* Is there a backend waiting for this message too? */
-			if(textroom->http_backend) {
-				/* Prepare the libcurl context */
-				CURLcode res;
-				CURL *curl = curl_easy_init();
-				if(curl == NULL) {
-					JANUS_LOG(LOG_ERR, "Error initializing CURL context\n");
-				} else {
-					curl_easy_setopt(curl, CURLOPT_URL, textroom->http_backend);
-					struct curl_slist *headers = NULL;
-					headers = curl_slist_append(headers, "Accept: application/json");
-					headers = curl_slist_append(headers, "Content-Type: application/json");
-					headers = curl_slist_append(headers, "charsets: utf-8");
-					curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-					curl_easy_setopt(curl, CURLOPT_POSTFIELDS, msg_text);
-					curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, janus_textroom_write_data);
-					/* Send the request */
-					res = curl_easy_perform(curl);
-					if(res != CURLE_OK) {
-						JANUS_LOG(LOG_ERR, "Couldn't relay event to the backend: %s\n", curl_easy_strerror(res));
-					} else {
-						JANUS_LOG(LOG_DBG, "Event sent!\n");
-					}
-					curl_easy_cleanup(curl);
-					curl_slist_free_all(headers);
-				}
-			}
+			if(textroom->http_backend)
+				janus_textroom_backend_queue(textroom->http_backend, msg_text);
 #endif
+			/* The fan-out thread will take care of the actual relaying */
+			janus_textroom_room_broadcast(textroom, textroom->recipients, msg_text);
+			msg_text = NULL;
 		}
 		janus_refcount_decrease(&participant->ref);
 		free(msg_text);
@@ -1580,6 +1845,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		g_hash_table_insert(session->rooms, janus_uint64_dup(textroom->room_id), participant);
 		janus_refcount_increase(&participant->ref);
 		g_hash_table_insert(textroom->participants, participant->username, participant);
+		/* The participants before this join are the ones we notify */
+		janus_textroom_recipients *recipients = textroom->recipients;
+		if(recipients != NULL)
+			janus_refcount_increase(&recipients->ref);
+		janus_textroom_recipients_update(textroom);
 		/* Notify all participants */
 		JANUS_LOG(LOG_VERB, "Notifying all participants about the new join\n");
 		json_t *list = json_array();
@@ -1595,6 +1865,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			json_decref(event);
 			gateway->relay_data(handle, NULL, event_text, strlen(event_text));
 			/* Broadcast */
+			janus_textroom_room_broadcast(textroom, recipients, event_text);
+			/* Take note of the other users */
 			GHashTableIter iter;
 			gpointer value;
 			g_hash_table_iter_init(&iter, textroom->participants);
@@ -1602,19 +1874,15 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				janus_textroom_participant *top = value;
 				if(top == participant)
 					continue;	/* Skip us */
-				janus_refcount_increase(&top->ref);
-				JANUS_LOG(LOG_VERB, "  >> To %s in %"SCNu64"\n", top->username, room_id);
-				gateway->relay_data(top->session->handle, NULL, event_text, strlen(event_text));
-				/* Take note of this user */
 				json_t *p = json_object();
 				json_object_set_new(p, "username", json_string(top->username));
 				if(top->display != NULL)
 					json_object_set_new(p, "display", json_string(top->display));
 				json_array_append_new(list, p);
-				janus_refcount_decrease(&top->ref);
 			}
-			free(event_text);
 		}
+		if(recipients != NULL)
+			janus_refcount_decrease(&recipients->ref);
 		janus_mutex_unlock(&session->mutex);
 		janus_mutex_unlock(&textroom->mutex);
 		janus_refcount_decrease(&textroom->ref);
@@ -1668,6 +1936,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		janus_refcount_increase(&participant->ref);
 		g_hash_table_remove(session->rooms, &room_id);
 		g_hash_table_remove(textroom->participants, participant->username);
+		janus_textroom_recipients_update(textroom);
 		participant->session = NULL;
 		participant->room = NULL;
 		/* Notify all participants */
@@ -1680,21 +1949,16 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			json_object_set_new(event, "username", json_string(participant->username));
 			char *event_text = json_dumps(event, json_format);
 			json_decref(event);
-			gateway->relay_data(handle, NULL, event_text, strlen(event_text));
+			/* We're not in the list anymore, so we queue the event for us on its
+			 * own: going through the fan-out thread, it can't be relayed before
+			 * what was broadcast in the room before we left */
+			janus_textroom_recipients *recipients = janus_textroom_recipients_new(1);
+			janus_refcount_increase(&session->ref);
+			recipients->sessions[recipients->count++] = session;
+			janus_textroom_room_broadcast(textroom, recipients, strdup(event_text));
+			janus_refcount_decrease(&recipients->ref);
 			/* Broadcast */
-			GHashTableIter iter;
-			gpointer value;
-			g_hash_table_iter_init(&iter, textroom->participants);
-			while(g_hash_table_iter_next(&iter, NULL, &value)) {
-				janus_textroom_participant *top = value;
-				if(top == participant)
-					continue;	/* Skip us */
-				janus_refcount_increase(&top->ref);
-				JANUS_LOG(LOG_VERB, "  >> To %s in %"SCNu64"\n", top->username, room_id);
-				gateway->relay_data(top->session->handle, NULL, event_text, strlen(event_text));
-				janus_refcount_decrease(&top->ref);
-			}
-			free(event_text);
+			janus_textroom_room_broadcast(textroom, textroom->recipients, event_text);
 		}
 		/* Also notify event handlers */
 		if(notify_events && gateway->events_is_enabled()) {
@@ -1939,16 +2203,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			json_object_set_new(event, "username", json_string(participant->username));
 			char *event_text = json_dumps(event, json_format);
 			json_decref(event);
-			/* Broadcast */
-			GHashTableIter iter;
-			gpointer value;
-			g_hash_table_iter_init(&iter, textroom->participants);
-			while(g_hash_table_iter_next(&iter, NULL, &value)) {
-				janus_textroom_participant *top = value;
-				JANUS_LOG(LOG_VERB, "  >> To %s in %"SCNu64"\n", top->username, room_id);
-				gateway->relay_data(top->session->handle, NULL, event_text, strlen(event_text));
-			}
-			free(event_text);
+			/* Broadcast (the kicked participant is still in the list) */
+			janus_textroom_room_broadcast(textroom, textroom->recipients, event_text);
 		}
 		/* Also notify event handlers */
 		if(notify_events && gateway->events_is_enabled()) {
@@ -1961,6 +2217,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		/* Remove user from list */
 		g_hash_table_remove(participant->session->rooms, &room_id);
 		g_hash_table_remove(textroom->participants, participant->username);
+		janus_textroom_recipients_update(textroom);
 		participant->session = NULL;
 		participant->room = NULL;
 		g_free(participant->username);
@@ -2018,49 +2275,14 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		json_object_set_new(msg, "text", json_string(message));
 		char *msg_text = json_dumps(msg, json_format);
 		json_decref(msg);
-		/* Send the announcement to everybody in the room */
-		if(textroom->participants) {
-			GHashTableIter iter;
-			gpointer value;
-			g_hash_table_iter_init(&iter, textroom->participants);
-			while(g_hash_table_iter_next(&iter, NULL, &value)) {
-				janus_textroom_participant *top = value;
-				JANUS_LOG(LOG_VERB, "  >> To %s in %"SCNu64": %s\n", top->username, room_id, message);
-				janus_refcount_increase(&top->ref);
-				gateway->relay_data(top->session->handle, NULL, msg_text, strlen(msg_text));
-				janus_refcount_decrease(&top->ref);
-			}
-		}
 #ifdef HAVE_LIBCURL
 		/* Is there a backend waiting for this message too? */
-		if(textroom->http_backend) {
-			/* Prepare the libcurl context */
-			CURLcode res;
-			CURL *curl = curl_easy_init();
-			if(curl == NULL) {
-				JANUS_LOG(LOG_ERR, "Error initializing CURL context\n");
-			} else {
-				curl_easy_setopt(curl, CURLOPT_URL, textroom->http_backend);
-				struct curl_slist *headers = NULL;
-				headers = curl_slist_append(headers, "Accept: application/json");
-				headers = curl_slist_append(headers, "Content-Type: application/json");
-				headers = curl_slist_append(headers, "charsets: utf-8");
-				curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-				curl_easy_setopt(curl, CURLOPT_POSTFIELDS, msg_text);
-				curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, janus_textroom_write_data);
-				/* Send the request */
-				res = curl_easy_perform(curl);
-				if(res != CURLE_OK) {
-					JANUS_LOG(LOG_ERR, "Couldn't relay event to the backend: %s\n", curl_easy_strerror(res));
-				} else {
-					JANUS_LOG(LOG_DBG, "Event sent!\n");
-				}
-				curl_easy_cleanup(curl);
-				curl_slist_free_all(headers);
-			}
-		}
+		if(textroom->http_backend)
+			janus_textroom_backend_queue(textroom->http_backend, msg_text);
 #endif
-		free(msg_text);
+		/* Send the announcement to everybody in the room */
+		JANUS_LOG(LOG_VERB, "Announcement to everybody in %"SCNu64": %s\n", room_id, message);
+		janus_textroom_room_broadcast(textroom, textroom->recipients, msg_text);
 		janus_mutex_unlock(&textroom->mutex);
 		janus_refcount_decrease(&textroom->ref);
 		if(!internal) {
@@ -2187,6 +2409,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			}
 			textroom->check_tokens = TRUE;
 		}
+		textroom->fanout = g_async_queue_new_full((GDestroyNotify)janus_textroom_broadcast_free);
 		textroom->destroyed = 0;
 		janus_mutex_init(&textroom->mutex);
 		janus_refcount_init(&textroom->ref, janus_textroom_room_free);
@@ -2408,6 +2631,16 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			janus_refcount_decrease(&textroom->ref);
 			goto msg_response;
 		}
+		/* Notify all participants: we queue the event before removing the room, so
+		 * that the fan-out thread sends it after what was broadcast until now */
+		JANUS_LOG(LOG_VERB, "Notifying all participants about the destroy\n");
+		json_t *event = json_object();
+		json_object_set_new(event, "textroom", json_string("destroyed"));
+		json_object_set_new(event, "room", json_integer(textroom->room_id));
+		char *event_text = json_dumps(event, json_format);
+		json_decref(event);
+		gateway->relay_data(handle, NULL, event_text, strlen(event_text));
+		janus_textroom_room_broadcast(textroom, textroom->recipients, event_text);
 		/* Remove room */
 		g_hash_table_remove(rooms, &room_id);
 		if(save) {
@@ -2424,32 +2657,20 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				save = FALSE;	/* This will notify the user the room destruction is not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
-		/* Notify all participants */
-		JANUS_LOG(LOG_VERB, "Notifying all participants about the destroy\n");
+		/* Get rid of the participants */
 		if(textroom->participants) {
-			/* Prepare event */
-			json_t *event = json_object();
-			json_object_set_new(event, "textroom", json_string("destroyed"));
-			json_object_set_new(event, "room", json_integer(textroom->room_id));
-			char *event_text = json_dumps(event, json_format);
-			json_decref(event);
-			gateway->relay_data(handle, NULL, event_text, strlen(event_text));
-			/* Broadcast */
 			GHashTableIter iter;
 			gpointer value;
 			g_hash_table_iter_init(&iter, textroom->participants);
 			while(g_hash_table_iter_next(&iter, NULL, &value)) {
 				janus_textroom_participant *top = value;
 				janus_refcount_increase(&top->ref);
-				JANUS_LOG(LOG_VERB, "  >> To %s in %"SCNu64"\n", top->username, room_id);
-				gateway->relay_data(top->session->handle, NULL, event_text, strlen(event_text));
 				janus_mutex_lock(&top->session->mutex);
 				g_hash_table_remove(top->session->rooms, &room_id);
 				janus_mutex_unlock(&top->session->mutex);
 				janus_refcount_decrease(&top->ref);
 				janus_textroom_participant_destroy(top);
 			}
-			free(event_text);
 		}
 		janus_mutex_unlock(&textroom->mutex);
 		janus_mutex_unlock(&rooms_mutex);
@@ -2697,3 +2918,313 @@ error:
 	JANUS_LOG(LOG_VERB, "Leaving TextRoom handler thread\n");
 	return NULL;
 }
+
+/* Thread to relay broadcasts to all the participants of a room */
+static void *janus_textroom_fanout_thread(void *data) {
+	janus_textroom_room *textroom = (janus_textroom_room *)data;
+	JANUS_LOG(LOG_VERB, "Joining fan-out thread for room %"SCNu64"\n", textroom->room_id);
+	janus_textroom_broadcast *broadcast = NULL;
+	while((broadcast = g_async_queue_pop(textroom->fanout)) != &fanout_exit_broadcast) {
+		janus_textroom_payload *payload = broadcast->payload;
+		janus_textroom_recipients *recipients = broadcast->recipients;
+		guint i = 0;
+		for(i=0; i<recipients->count; i++) {
+			janus_textroom_session *session = recipients->sessions[i];
+			if(g_atomic_int_get(&session->destroyed) || g_atomic_int_get(&session->hangingup))
+				continue;
+			gateway->relay_data(session->handle, NULL, payload->text, payload->length);
+		}
+		janus_textroom_broadcast_free(broadcast);
+	}
+	JANUS_LOG(LOG_VERB, "Leaving fan-out thread for room %"SCNu64"\n", textroom->room_id);
+	janus_refcount_decrease(&textroom->ref);
+	/* We're done, whoever reaps fan-out threads can join us now */
+	g_async_queue_push(fanout_finished, g_thread_self());
+	return NULL;
+}
+
+#ifdef HAVE_LIBCURL
+/* A POST to an HTTP backend, possibly carrying more than one message */
+typedef struct janus_textroom_backend_post {
+	char *url;
+	GList *texts;
+	guint count;
+	gint64 queued;
+	gint64 deadline;
+	char *body;
+	guint attempts;
+	gint64 retry_at;
+	gint64 started;
+	CURL *curl;
+	struct curl_slist *headers;
+} janus_textroom_backend_post;
+
+static janus_textroom_backend_post *janus_textroom_backend_post_new(janus_textroom_backend_message *msg) {
+	janus_textroom_backend_post *post = g_malloc0(sizeof(janus_textroom_backend_post));
+	post->url = msg->url;
+	msg->url = NULL;
+	post->queued = msg->queued;
+	post->deadline = msg->queued + (gint64)backend_batch_window*1000;
+	return post;
+}
+
+static void janus_textroom_backend_post_add(janus_textroom_backend_post *post, janus_textroom_backend_message *msg) {
+	post->texts = g_list_prepend(post->texts, msg->text);
+	msg->text = NULL;
+	post->count++;
+}
+
+static void janus_textroom_backend_post_free(janus_textroom_backend_post *post) {
+	if(post == NULL)
+		return;
+	if(post->curl != NULL)
+		curl_easy_cleanup(post->curl);
+	curl_slist_free_all(post->headers);
+	g_list_free_full(post->texts, (GDestroyNotify)g_free);
+	g_free(post->url);
+	g_free(post->body);
+	g_free(post);
+}
+
+/* Send (or resend) a POST: we use a new easy handle every time, but the
+ * multi handle keeps a cache of the connections, so they're reused */
+static gboolean janus_textroom_backend_post_start(janus_textroom_backend_post *post, GHashTable *inflight) {
+	if(post->body == NULL) {
+		/* A single message is sent as it is, more messages as a JSON array */
+		post->texts = g_list_reverse(post->texts);
+		if(post->count == 1) {
+			post->body = g_strdup((char *)post->texts->data);
+		} else {
+			GString *body = g_string_new("[");
+			GList *l = post->texts;
+			while(l) {
+				g_string_append(body, (char *)l->data);
+				if(l->next)
+					g_string_append_c(body, ',');
+				l = l->next;
+			}
+			g_string_append_c(body, ']');
+			post->body = g_string_free(body, FALSE);
+		}
+		g_list_free_full(post->texts, (GDestroyNotify)g_free);
+		post->texts = NULL;
+		post->headers = curl_slist_append(post->headers, "Accept: application/json");
+		post->headers = curl_slist_append(post->headers, "Content-Type: application/json");
+		post->headers = curl_slist_append(post->headers, "charsets: utf-8");
+	}
+	post->curl = curl_easy_init();
+	if(post->curl == NULL) {
+		JANUS_LOG(LOG_ERR, "Error initializing CURL context\n");
+		return FALSE;
+	}
+	curl_easy_setopt(post->curl, CURLOPT_URL, post->url);
+	curl_easy_setopt(post->curl, CURLOPT_HTTPHEADER, post->headers);
+	curl_easy_setopt(post->curl, CURLOPT_POSTFIELDS, post->body);
+	curl_easy_setopt(post->curl, CURLOPT_WRITEFUNCTION, janus_textroom_write_data);
+	curl_easy_setopt(post->curl, CURLOPT_TIMEOUT, JANUS_TEXTROOM_BACKEND_TIMEOUT);
+	curl_easy_setopt(post->curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(post->curl, CURLOPT_PRIVATE, post);
+	if(curl_multi_add_handle(backend_multi, post->curl) != CURLM_OK) {
+		JANUS_LOG(LOG_ERR, "Error adding CURL context to the multi handle\n");
+		curl_easy_cleanup(post->curl);
+		post->curl = NULL;
+		return FALSE;
+	}
+	post->attempts++;
+	post->started = janus_get_monotonic_time();
+	g_hash_table_add(inflight, post);
+	g_atomic_int_inc(&backend_inflight);
+	return TRUE;
+}
+
+/* We're done with a POST, whether it was successful or not */
+static void janus_textroom_backend_post_done(janus_textroom_backend_post *post, gboolean success) {
+	janus_mutex_lock(&backend_mutex);
+	if(success)
+		backend_stats.sent += post->count;
+	else
+		backend_stats.failed += post->count;
+	janus_mutex_unlock(&backend_mutex);
+	g_atomic_int_add(&backend_queued, -((gint)post->count));
+	janus_textroom_backend_post_free(post);
+}
+
+/* Thread to post messages to HTTP backends */
+static void *janus_textroom_backend_thread(void *data) {
+	JANUS_LOG(LOG_VERB, "Joining TextRoom backend thread\n");
+	/* Batches we're still collecting messages for, indexed by URL, and posts waiting to be retried */
+	GHashTable *batches = g_hash_table_new(g_str_hash, g_str_equal);
+	GHashTable *inflight = g_hash_table_new(NULL, NULL);
+	GList *retries = NULL, *l = NULL;
+	GHashTableIter iter;
+	gpointer value;
+	janus_textroom_backend_message *msg = NULL;
+	janus_textroom_backend_post *post = NULL;
+	int running = 0;
+	gboolean stop = FALSE;
+	while(!stop) {
+		/* Figure out how long we can wait before something needs to be done */
+		gint64 now = janus_get_monotonic_time();
+		gint64 wait = 100000;
+		g_hash_table_iter_init(&iter, batches);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			post = (janus_textroom_backend_post *)value;
+			if(post->deadline - now < wait)
+				wait = post->deadline - now;
+		}
+		for(l = retries; l != NULL; l = l->next) {
+			post = (janus_textroom_backend_post *)l->data;
+			if(post->retry_at - now < wait)
+				wait = post->retry_at - now;
+		}
+		if(wait < 0)
+			wait = 0;
+		/* While posts are in flight we wait on their sockets instead, and only check the queue */
+		if(running > 0)
+			msg = g_async_queue_try_pop(backend_messages);
+		else
+			msg = g_async_queue_timeout_pop(backend_messages, wait);
+		while(msg != NULL) {
+			if(msg == &backend_exit_message) {
+				stop = TRUE;
+				break;
+			}
+			if(backend_batch_window == 0) {
+				/* No batching, send right away */
+				post = janus_textroom_backend_post_new(msg);
+				janus_textroom_backend_post_add(post, msg);
+				if(!janus_textroom_backend_post_start(post, inflight))
+					janus_textroom_backend_post_done(post, FALSE);
+			} else {
+				post = g_hash_table_lookup(batches, msg->url);
+				if(post == NULL) {
+					post = janus_textroom_backend_post_new(msg);
+					g_hash_table_insert(batches, post->url, post);
+				}
+				janus_textroom_backend_post_add(post, msg);
+				if(post->count >= backend_batch_size) {
+					/* Batch is full, send it now */
+					g_hash_table_remove(batches, post->url);
+					if(!janus_textroom_backend_post_start(post, inflight))
+						janus_textroom_backend_post_done(post, FALSE);
+				}
+			}
+			janus_textroom_backend_message_free(msg);
+			msg = g_async_queue_try_pop(backend_messages);
+		}
+		if(stop)
+			break;
+		now = janus_get_monotonic_time();
+		/* Send the batches whose window expired */
+		g_hash_table_iter_init(&iter, batches);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			post = (janus_textroom_backend_post *)value;
+			if(post->deadline > now)
+				continue;
+			g_hash_table_iter_remove(&iter);
+			if(!janus_textroom_backend_post_start(post, inflight))
+				janus_textroom_backend_post_done(post, FALSE);
+		}
+		/* Retry the posts whose backoff expired */
+		l = retries;
+		while(l != NULL) {
+			GList *next = l->next;
+			post = (janus_textroom_backend_post *)l->data;
+			if(post->retry_at <= now) {
+				retries = g_list_delete_link(retries, l);
+				if(!janus_textroom_backend_post_start(post, inflight))
+					janus_textroom_backend_post_done(post, FALSE);
+			}
+			l = next;
+		}
+		if(g_atomic_int_get(&backend_inflight) == 0) {
+			running = 0;
+			continue;
+		}
+		/* Let libcurl do its job, and check which posts are done */
+		curl_multi_perform(backend_multi, &running);
+		CURLMsg *done = NULL;
+		int left = 0;
+		while((done = curl_multi_info_read(backend_multi, &left)) != NULL) {
+			if(done->msg != CURLMSG_DONE)
+				continue;
+			post = NULL;
+			curl_easy_getinfo(done->easy_handle, CURLINFO_PRIVATE, (char **)&post);
+			CURLcode res = done->data.result;
+			long code = 0;
+			curl_easy_getinfo(done->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+			curl_multi_remove_handle(backend_multi, done->easy_handle);
+			g_atomic_int_add(&backend_inflight, -1);
+			if(post == NULL || !g_hash_table_remove(inflight, post)) {
+				curl_easy_cleanup(done->easy_handle);
+				continue;
+			}
+			curl_easy_cleanup(post->curl);
+			post->curl = NULL;
+			now = janus_get_monotonic_time();
+			gint64 latency = now - post->started;
+			janus_mutex_lock(&backend_mutex);
+			backend_stats.posts++;
+			backend_stats.latency_last = latency;
+			backend_stats.latency_total += latency;
+			if(latency > backend_stats.latency_max)
+				backend_stats.latency_max = latency;
+			janus_mutex_unlock(&backend_mutex);
+			if(res == CURLE_OK && code < 500) {
+				if(code >= 400)
+					JANUS_LOG(LOG_WARN, "Backend %s rejected %u message(s): %ld\n", post->url, post->count, code);
+				else
+					JANUS_LOG(LOG_DBG, "Event sent!\n");
+				janus_textroom_backend_post_done(post, code < 400);
+				continue;
+			}
+			if(res != CURLE_OK) {
+				JANUS_LOG(LOG_ERR, "Couldn't relay event to the backend: %s\n", curl_easy_strerror(res));
+			} else {
+				JANUS_LOG(LOG_ERR, "Couldn't relay event to the backend: %ld\n", code);
+			}
+			if(post->attempts > backend_retries) {
+				JANUS_LOG(LOG_ERR, "Giving up on %u message(s) for %s after %u attempts\n",
+					post->count, post->url, post->attempts);
+				janus_textroom_backend_post_done(post, FALSE);
+				continue;
+			}
+			/* Try again later, doubling the delay every time */
+			post->retry_at = now + ((gint64)JANUS_TEXTROOM_BACKEND_RETRY_DELAY << (post->attempts-1))*1000;
+			retries = g_list_append(retries, post);
+			janus_mutex_lock(&backend_mutex);
+			backend_stats.retries++;
+			janus_mutex_unlock(&backend_mutex);
+		}
+		if(running > 0) {
+			/* Don't wait too long, as new messages may be queued in the meanwhile */
+			int timeout = wait/1000;
+			if(timeout > 20)
+				timeout = 20;
+			curl_multi_wait(backend_multi, NULL, 0, timeout, NULL);
+		}
+	}
+	/* Get rid of whatever was still pending */
+	g_hash_table_iter_init(&iter, batches);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		post = (janus_textroom_backend_post *)value;
+		g_hash_table_iter_remove(&iter);
+		janus_textroom_backend_post_done(post, FALSE);
+	}
+	g_hash_table_destroy(batches);
+	for(l = retries; l != NULL; l = l->next)
+		janus_textroom_backend_post_done((janus_textroom_backend_post *)l->data, FALSE);
+	g_list_free(retries);
+	g_hash_table_iter_init(&iter, inflight);
+	while(g_hash_table_iter_next(&iter, &value, NULL)) {
+		post = (janus_textroom_backend_post *)value;
+		g_hash_table_iter_remove(&iter);
+		curl_multi_remove_handle(backend_multi, post->curl);
+		g_atomic_int_add(&backend_inflight, -1);
+		janus_textroom_backend_post_done(post, FALSE);
+	}
+	g_hash_table_destroy(inflight);
+	JANUS_LOG(LOG_VERB, "Leaving TextRoom backend thread\n");
+	return NULL;
+}
+#endif
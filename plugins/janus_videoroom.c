@@ -60,6 +60,8 @@ room-<unique room ID>: {
 				 conference or 1 for a webinar, default=3)
 	bitrate = <max video bitrate for senders> (e.g., 128000)
 	fir_freq = <send a FIR to publishers every fir_freq seconds> (0=disable)
+	fir_min_interval = <minimum time between keyframe requests sent to a publisher,
+				in milliseconds: requests in between are coalesced (0=no limit, default)>
 	audiocodec = opus|g722|pcmu|pcma|isac32|isac16 (audio codec to force on publishers, default=opus
 				can be a comma separated list in order of preference, e.g., opus,pcmu)
 	videocodec = vp8|vp9|h264 (video codec to force on publishers, default=vp8
@@ -84,6 +86,17 @@ room-<unique room ID>: {
 				new feeds (publishers), and enabling this may result extra notification
 				traffic. This flag is particularly useful when enabled with \c require_pvtid
 				for admin to manage listening only participants. default=false)
+	gop_cache = true|false (whether the plugin should keep the packets of the
+				latest video GOP of each publisher in memory, so that new subscribers
+				can start rendering right away without waiting for a new keyframe;
+				not available for rooms using VP9 SVC, default=false)
+	last_n = <number of active speaker slots subscribers can be attached to,
+				rather than to a specific publisher (see below); 0 disables
+				the feature, default=0)
+	notify_window = <time window in milliseconds in which changes to the list
+				of participants (e.g., new publishers, or participants leaving)
+				are merged in a single event, rather than notified one by one
+				(see below); 0 disables batching, default=0)
 }
 \endverbatim
  *
@@ -202,6 +215,7 @@ room-<unique room ID>: {
 	"new_require_pvtid" : <true|false, whether the room should require private_id from subscribers>,
 	"new_bitrate" : <new bitrate cap to force on all publishers (except those with custom overrides)>,
 	"new_fir_freq" : <new period for regular PLI keyframe requests to publishers>,
+	"new_fir_min_interval" : <new minimum time between keyframe requests to publishers, in milliseconds>,
 	"new_publishers" : <new cap on the number of concurrent active WebRTC publishers>,
 	"permanent" : <true|false, whether the room should be also removed from the config file, default=false>
 }
@@ -325,15 +339,19 @@ room-<unique room ID>: {
  *
 \verbatim
 {
-	"request" : "list"
+	"request" : "list",
+	"offset" : <number of rooms to skip, to paginate the list; optional, default=0>,
+	"limit" : <maximum number of rooms to return; optional, default=0 (no limit)>
 }
 \endverbatim
  *
- * A successful request will produce a list of rooms in a \c success response:
+ * A successful request will produce a list of rooms in a \c success response,
+ * sorted by room ID, where \c total is the number of public rooms available:
  *
 \verbatim
 {
 	"videoroom" : "success",
+	"total" : <number of public rooms>,
 	"rooms" : [		// Array of room objects
 		{	// Room #1
 			"room" : <unique numeric ID>,
@@ -343,6 +361,15 @@ room-<unique room ID>: {
 			"bitrate" : <bitrate cap that should be forced (via REMB) on all publishers by default>,
 			"bitrate_cap" : <true|false, whether the above cap should act as a limit to dynamic bitrate changes by publishers>,
 			"fir_freq" : <how often a keyframe request is sent via PLI/FIR to active publishers>,
+			"fir_min_interval" : <minimum time in milliseconds between keyframe requests to a publisher, 0 if no limit>,
+			"gop_cache" : <true|false, whether new subscribers are sent the latest cached GOP of publishers>,
+			"last_n" : <number of active speaker slots subscribers can be attached to, 0 if disabled>,
+			"notify_window" : <time window in milliseconds participant list changes are batched in, 0 if disabled>,
+			"queue_latency" : {
+				"average" : <average time in microseconds asynchronous requests for this room waited before being handled>,
+				"max" : <maximum time in microseconds asynchronous requests for this room waited before being handled>,
+				"requests" : <number of asynchronous requests handled for this room so far>
+			},
 			"audiocodec" : "<comma separated list of allowed audio codecs>",
 			"videocodec" : "<comma separated list of allowed video codecs>",
 			"record" : <true|false, whether the room is being recorded>,
@@ -361,17 +388,22 @@ room-<unique room ID>: {
 \verbatim
 {
 	"request" : "listparticipants",
-	"room" : <unique numeric ID of the room>
+	"room" : <unique numeric ID of the room>,
+	"publishers_only" : <true|false, whether only active publishers should be returned; optional, default=false>,
+	"offset" : <number of participants to skip, to paginate the list; optional, default=0>,
+	"limit" : <maximum number of participants to return; optional, default=0 (no limit)>
 }
 \endverbatim
  *
  * A successful request will produce a list of participants in a
- * \c participants response:
+ * \c participants response, sorted by participant ID, where \c total
+ * is the number of participants matching the request before pagination:
  *
 \verbatim
 {
 	"videoroom" : "participants",
 	"room" : <unique numeric ID of the room>,
+	"total" : <number of participants>,
 	"participants" : [		// Array of participant objects
 		{	// Participant #1
 			"id" : <unique numeric ID of the participant>,
@@ -778,7 +810,10 @@ room-<unique room ID>: {
 					"ssrc" : <SSRC this forwarder is using, if any>,
 					"pt" : <payload type this forwarder is using, if any>,
 					"substream" : <video substream this video forwarder is relaying, if any>,
-					"srtp" : <true|false, whether the RTP stream is encrypted>
+					"srtp" : <true|false, whether the RTP stream is encrypted>,
+					"packets" : <packets sent by this forwarder so far>,
+					"bytes" : <bytes sent by this forwarder so far>,
+					"errors" : <packets this forwarder failed to send so far>
 				},
 				// Other forwarders for this publisher
 			],
@@ -787,6 +822,69 @@ room-<unique room ID>: {
 	]
 }
 \endverbatim *
+ *
+ * When the component that needs the media of a publisher is another
+ * plugin in the same Janus instance (e.g., a Streaming mountpoint that
+ * broadcasts a publisher to a much larger audience), RTP forwarders are
+ * not needed at all. Each publisher is automatically made available on
+ * the core media bridge as \c videoroom/<room ID>/<publisher ID> , and
+ * packets are handed in-process to whoever is interested in them, with
+ * no sockets involved: check the \c bridge mountpoint type in the
+ * \ref streaming for an example. Keyframe requests coming from the
+ * bridge are turned into a PLI/FIR to the publisher.
+ *
+ * By default, new subscribers (and subscribers switching to a different
+ * publisher) trigger a PLI/FIR to the publisher, which means they have
+ * to wait for the publisher to send a new keyframe before they can
+ * render anything. Rooms created with \c gop_cache set to \c true keep
+ * the latest video GOP (all packets since the most recent keyframe) of
+ * each publisher in memory instead: when available, the cached GOP is
+ * sent to new subscribers right away, followed by the live stream, and
+ * no keyframe request is sent to the publisher. In case of simulcast, a
+ * separate GOP is kept for each substream.
+ *
+ * In large rooms, subscribing to each publisher means the traffic sent
+ * to each participant grows with the number of publishers. Rooms created
+ * with \c last_n set to a positive value provide an alternative: the
+ * plugin keeps track of the most recent active speakers (which means
+ * audio levels need to be negotiated by publishers, see \c audio_level_average
+ * and \c audio_active_packets ) and assigns them to \c last_n slots,
+ * where a new speaker always takes the slot of the speaker that has been
+ * silent for the longest time. Subscribers can then attach to a slot,
+ * rather than to a specific publisher, by adding a \c last_n_slot property
+ * to their \c join request: whenever the publisher assigned to that slot
+ * changes, the subscription is automatically switched to the new one,
+ * exactly as with a \c switch request (which means the same limitations
+ * apply, e.g., in terms of codecs), and a \c switched event with the
+ * \c last_n_slot property is sent to the subscriber. This way, the traffic
+ * each participant receives only depends on the number of slots they
+ * attached to, and not on the size of the room. Notice that subscriptions
+ * attached to a slot never close the PeerConnection automatically: when
+ * a slot is left empty, the subscription will simply be idle until a new
+ * publisher fills the slot.
+ *
+ * By default, each change in the list of participants (a new publisher,
+ * someone joining, unpublishing or leaving) is notified to all the other
+ * participants right away, which means that when many participants join
+ * a room at about the same time, the number of events grows quadratically.
+ * Rooms created with \c notify_window set to a positive value batch these
+ * changes instead: all the changes that happen within that many milliseconds
+ * are merged in a single event for each participant, where \c publishers
+ * and \c joining are arrays of participant objects, and \c unpublished ,
+ * \c leaving and \c kicked are arrays of participant IDs, e.g.:
+ *
+\verbatim
+{
+	"videoroom" : "event",
+	"room" : <room ID>,
+	"publishers" : [ <same format as in the "joined" event> ],
+	"leaving" : [ <ID of a participant that left>, ... ]
+}
+\endverbatim
+ *
+ * Only the properties for which there are changes are included. Changes
+ * participants know about already, because they happened before they
+ * joined, are never included in the events they receive.
  *
  * To conclude, you can leave a room you previously joined as publisher
  * using the \c leave request. This will also implicitly unpublish you
@@ -855,8 +953,10 @@ room-<unique room ID>: {
 	"offer_data" : <true|false; whether or not datachannels should be negotiated; true by default if the publisher has datachannels>,
 	"substream" : <substream to receive (0-2), in case simulcasting is enabled; optional>,
 	"temporal" : <temporal layers to receive (0-2), in case simulcasting is enabled; optional>,
+	"auto_simulcast" : <true|false, whether the substream and temporal layer should be picked automatically according to the estimated bandwidth, in case simulcasting is enabled; optional>,
 	"spatial_layer" : <spatial layer to receive (0-2), in case VP9-SVC is enabled; optional>,
-	"temporal_layer" : <temporal layers to receive (0-2), in case VP9-SVC is enabled; optional>
+	"temporal_layer" : <temporal layers to receive (0-2), in case VP9-SVC is enabled; optional>,
+	"last_n_slot" : <active speaker slot to attach to, in case the room has last_n enabled; if the slot is currently assigned to a publisher, feed is ignored; optional>
 }
 \endverbatim
  *
@@ -968,6 +1068,7 @@ room-<unique room ID>: {
 	"data" : <true|false, depending on whether datachannel messages should be relayed or not; optional>,
 	"substream" : <substream to receive (0-2), in case simulcasting is enabled; optional>,
 	"temporal" : <temporal layers to receive (0-2), in case simulcasting is enabled; optional>,
+	"auto_simulcast" : <true|false, whether the substream and temporal layer should be picked automatically according to the estimated bandwidth, in case simulcasting is enabled; optional>,
 	"spatial_layer" : <spatial layer to receive (0-2), in case VP9-SVC is enabled; optional>,
 	"temporal_layer" : <temporal layers to receive (0-2), in case VP9-SVC is enabled; optional>
 }
@@ -980,6 +1081,14 @@ room-<unique room ID>: {
  * when the mountpoint is configured with video simulcasting support, and
  * as such the viewer is interested in receiving a specific substream
  * or temporal layer, rather than any other of the available ones.
+ * Setting \c auto_simulcast to \c true (which can be done when subscribing
+ * too) lets the plugin pick the substream and temporal layer automatically
+ * instead: the bandwidth available to the subscriber is estimated out of
+ * the losses it reports in its RTCP receiver reports and the REMB feedback
+ * it sends, if any, and is compared to the bitrate of each substream, in
+ * order to always relay the highest quality that fits. In that case, the
+ * \c substream and \c temporal properties are considered as the highest
+ * substream and temporal layer the subscriber is willing to receive.
  * The \c spatial_layer and \c temporal_layer have exactly the same meaning,
  * but within the context of VP9-SVC publishers, and will have no effect
  * on subscriptions associated to regular publishers.
@@ -1061,6 +1170,7 @@ room-<unique room ID>: {
 #include "../sdp-utils.h"
 #include "../utils.h"
 #include "../ip-utils.h"
+#include "../media-bridge.h"
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -1147,6 +1257,7 @@ static struct janus_json_parameter create_parameters[] = {
 	{"bitrate", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"bitrate_cap", JANUS_JSON_BOOL, 0},
 	{"fir_freq", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"fir_min_interval", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"publishers", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"audiocodec", JSON_STRING, 0},
 	{"videocodec", JSON_STRING, 0},
@@ -1163,6 +1274,9 @@ static struct janus_json_parameter create_parameters[] = {
 	{"rec_dir", JSON_STRING, 0},
 	{"permanent", JANUS_JSON_BOOL, 0},
 	{"notify_joining", JANUS_JSON_BOOL, 0},
+	{"gop_cache", JANUS_JSON_BOOL, 0},
+	{"last_n", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"notify_window", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 };
 static struct janus_json_parameter edit_parameters[] = {
 	{"room", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
@@ -1174,12 +1288,23 @@ static struct janus_json_parameter edit_parameters[] = {
 	{"new_require_pvtid", JANUS_JSON_BOOL, 0},
 	{"new_bitrate", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"new_fir_freq", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"new_fir_min_interval", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"new_publishers", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"permanent", JANUS_JSON_BOOL, 0}
 };
 static struct janus_json_parameter room_parameters[] = {
 	{"room", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
 };
+static struct janus_json_parameter list_parameters[] = {
+	{"offset", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"limit", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
+static struct janus_json_parameter listparticipants_parameters[] = {
+	{"room", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
+	{"publishers_only", JANUS_JSON_BOOL, 0},
+	{"offset", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"limit", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
 static struct janus_json_parameter destroy_parameters[] = {
 	{"room", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
 	{"permanent", JANUS_JSON_BOOL, 0}
@@ -1261,6 +1386,7 @@ static struct janus_json_parameter configure_parameters[] = {
 	/* For VP8 (or H.264) simulcast */
 	{"substream", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"temporal", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"auto_simulcast", JANUS_JSON_BOOL, 0},
 	/* For VP9 SVC */
 	{"spatial_layer", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"temporal_layer", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
@@ -1280,9 +1406,12 @@ static struct janus_json_parameter subscriber_parameters[] = {
 	/* For VP8 (or H.264) simulcast */
 	{"substream", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"temporal", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"auto_simulcast", JANUS_JSON_BOOL, 0},
 	/* For VP9 SVC */
 	{"spatial_layer", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"temporal_layer", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	/* For last-N rooms */
+	{"last_n_slot", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 };
 
 /* Static configuration instance */
@@ -1294,7 +1423,6 @@ static janus_mutex config_mutex = JANUS_MUTEX_INITIALIZER;
 static volatile gint initialized = 0, stopping = 0;
 static gboolean notify_events = TRUE;
 static janus_callbacks *gateway = NULL;
-static GThread *handler_thread;
 static void *janus_videoroom_handler(void *data);
 static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data);
 static void janus_videoroom_relay_data_packet(gpointer data, gpointer user_data);
@@ -1311,10 +1439,23 @@ typedef struct janus_videoroom_message {
 	char *transaction;
 	json_t *message;
 	json_t *jsep;
+	guint64 room_id;	/* Room the request was dispatched for (0 if unknown) */
+	gint64 queued;		/* Monotonic time of when the request was queued */
 } janus_videoroom_message;
-static GAsyncQueue *messages = NULL;
 static janus_videoroom_message exit_message;
 
+/* Asynchronous requests are processed by a pool of handler threads, each with
+ * its own queue: requests are dispatched according to the room they address,
+ * so that a busy room can't delay the requests of all the others, while all
+ * the requests of a single session are still handled in order */
+typedef struct janus_videoroom_handler_thread {
+	GThread *thread;
+	GAsyncQueue *messages;
+} janus_videoroom_handler_thread;
+#define JANUS_VIDEOROOM_DEFAULT_HANDLERS	4
+static janus_videoroom_handler_thread *handlers = NULL;
+static guint handlers_num = JANUS_VIDEOROOM_DEFAULT_HANDLERS;
+
 
 typedef struct janus_videoroom {
 	guint64 room_id;			/* Unique room ID */
@@ -1327,6 +1468,7 @@ typedef struct janus_videoroom {
 	uint32_t bitrate;			/* Global bitrate limit */
 	gboolean bitrate_cap;		/* Whether the above limit is insormountable */
 	uint16_t fir_freq;			/* Regular FIR frequency (0=disabled) */
+	uint16_t fir_min_interval;	/* Minimum time between keyframe requests to a publisher, in ms (0=no limit) */
 	janus_audiocodec acodec[3];	/* Audio codec(s) to force on publishers */
 	janus_videocodec vcodec[3];	/* Video codec(s) to force on publishers */
 	gboolean do_opusfec;		/* Whether inband FEC must be negotiated (note: only available for Opus) */
@@ -1346,14 +1488,44 @@ typedef struct janus_videoroom {
 	gboolean check_allowed;		/* Whether to check tokens when participants join (see below) */
 	GHashTable *allowed;		/* Map of participants (as tokens) allowed to join */
 	gboolean notify_joining;	/* Whether an event is sent to notify all participants if a new participant joins the room */
+	gboolean gop_cache;			/* Whether publishers keep their latest video GOP around for new subscribers */
+	int last_n;					/* Number of active speaker slots subscribers can attach to (0 if disabled) */
+	guint64 *last_n_slots;		/* Publisher currently assigned to each slot (0 if none) */
+	GList *last_n_subscribers;	/* Subscribers attached to a slot, rather than to a specific publisher */
+	guint notify_window;		/* Time window (ms) participant list changes are batched in (0 if disabled) */
+	GList *notify_pending;		/* Participant list changes waiting to be notified, if batching */
+	guint64 notify_seq;			/* Sequence number of the latest participant list change */
+	GSource *notify_source;		/* Timer that will notify the pending changes, if any */
+	json_t *participants_list;	/* Cached listparticipants array, sorted by ID (protected by the room mutex) */
+	volatile gint participants_changed;	/* Whether the cached list of participants needs to be rebuilt */
+	gint64 queue_latency;		/* Average time asynchronous requests for this room waited in the queue (protected by rooms_mutex) */
+	gint64 queue_latency_max;	/* Maximum time asynchronous requests for this room waited in the queue (protected by rooms_mutex) */
+	guint64 queue_requests;		/* Number of asynchronous requests handled for this room (protected by rooms_mutex) */
 	janus_mutex mutex;			/* Mutex to lock this room instance */
 	janus_refcount ref;			/* Reference counter for this room */
 } janus_videoroom;
 static GHashTable *rooms;
 static janus_mutex rooms_mutex = JANUS_MUTEX_INITIALIZER;
+/* Cached list of public rooms (static properties only), sorted by ID: both are protected by rooms_mutex */
+static json_t *rooms_list = NULL;
+static gboolean rooms_list_changed = TRUE;
 static char *admin_key = NULL;
 static gboolean lock_rtpfwd = FALSE;
 
+/* Change in the list of participants, when notifications are batched */
+typedef struct janus_videoroom_notification {
+	guint64 seq;		/* Sequence number of this change */
+	guint64 id;			/* Participant this change is about */
+	const char *type;	/* Property this change goes in ("publishers", "joining", "unpublished", "leaving" or "kicked") */
+	json_t *info;		/* Participant object or ID, depending on the type */
+} janus_videoroom_notification;
+static void janus_videoroom_notification_free(janus_videoroom_notification *n) {
+	if(n == NULL)
+		return;
+	json_decref(n->info);
+	g_free(n);
+}
+
 typedef struct janus_videoroom_session {
 	janus_plugin_session *handle;
 	gint64 sdp_sessid;
@@ -1364,10 +1536,27 @@ typedef struct janus_videoroom_session {
 	gboolean stopping;
 	volatile gint hangingup;
 	volatile gint destroyed;
+	guint64 room_id;	/* Room this session last sent a request for, used to dispatch messages */
+	guint handler;		/* Handler thread the pending messages of this session have been queued to */
+	guint queued;		/* Number of messages still pending for this session */
 	janus_mutex mutex;
 	janus_refcount ref;
 } janus_videoroom_session;
 static GHashTable *sessions;
+
+/* Batched notification for a participant, prepared with the room mutex and sent without */
+typedef struct janus_videoroom_notification_event {
+	janus_videoroom_session *session;	/* Session to send the event to */
+	guint64 user_id;	/* Participant the session belongs to */
+	json_t *event;		/* Event to send */
+} janus_videoroom_notification_event;
+static void janus_videoroom_notification_event_free(janus_videoroom_notification_event *ne) {
+	if(ne == NULL)
+		return;
+	janus_refcount_decrease(&ne->session->ref);
+	json_decref(ne->event);
+	g_free(ne);
+}
 static janus_mutex sessions_mutex = JANUS_MUTEX_INITIALIZER;
 
 /* A host whose ports gets streamed RTP packets of the corresponding type */
@@ -1392,6 +1581,8 @@ typedef struct janus_videoroom_rtp_forwarder {
 	/* Only needed for SRTP forwarders */
 	gboolean is_srtp;
 	janus_videoroom_srtp_context *srtp_ctx;
+	/* Statistics (only updated with rtp_forwarders_mutex held) */
+	guint64 packets, bytes, errors;
 	/* Reference */
 	volatile gint destroyed;
 	janus_refcount ref;
@@ -1446,6 +1637,36 @@ static GMainLoop *rtcpfwd_loop = NULL;
 static GThread *rtcpfwd_thread = NULL;
 static void *janus_videoroom_rtp_forwarder_rtcp_thread(void *data);
 
+/* Immutable copy of the subscribers of a publisher, used for the media fan-out:
+ * it's rebuilt and swapped every time the list changes, so that the thread
+ * relaying media never needs to lock subscribers_mutex to forward a packet.
+ * Notice that it only contains references to the subscribers, and not a copy
+ * of their state: what the relay functions look at (paused, simulcast and SVC
+ * contexts, etc.) is updated by the relay itself or by requests at any time,
+ * and so can't be frozen in a copy. Each entry holds a reference to both the
+ * subscriber and its session, instead, so that it's always safe to use */
+typedef struct janus_videoroom_subscribers_snapshot {
+	guint count;		/* Number of subscribers in the array */
+	struct janus_videoroom_subscriber **subscribers;	/* Contiguous array of subscribers */
+	struct janus_videoroom_subscribers_snapshot *next;	/* Next retired snapshot, when waiting to be freed */
+} janus_videoroom_subscribers_snapshot;
+
+/* Packets for the RTP forwarders of a publisher are queued in a batch (each with
+ * its own copy of the RTP header, but all sharing the same payload) and then
+ * sent all at once, with a single sendmmsg() call when available */
+#define JANUS_VIDEOROOM_FORWARDERS_BATCH	16
+typedef struct janus_videoroom_forwarders_batch {
+	int fd;			/* Socket to send the packets on */
+	guint count;	/* Number of packets currently in the batch */
+	janus_videoroom_rtp_forwarder *forwarders[JANUS_VIDEOROOM_FORWARDERS_BATCH];
+	janus_rtp_header headers[JANUS_VIDEOROOM_FORWARDERS_BATCH];
+	struct iovec iov[JANUS_VIDEOROOM_FORWARDERS_BATCH][2];
+	size_t iovlen[JANUS_VIDEOROOM_FORWARDERS_BATCH];
+} janus_videoroom_forwarders_batch;
+static void janus_videoroom_forwarders_batch_add(janus_videoroom_forwarders_batch *batch,
+	janus_videoroom_rtp_forwarder *forward, janus_rtp_header *header, char *buf, int len);
+static void janus_videoroom_forwarders_batch_flush(janus_videoroom_forwarders_batch *batch);
+
 typedef struct janus_videoroom_publisher {
 	janus_videoroom_session *session;
 	janus_videoroom *room;	/* Room */
@@ -1475,6 +1696,8 @@ typedef struct janus_videoroom_publisher {
 	int audio_active_packets;	/* Participant's number of audio packets to accumulate */
 	int audio_dBov_sum;			/* Participant's accumulated dBov value for audio level*/
 	gboolean talking;			/* Whether this participant is currently talking (uses audio levels extension) */
+	gint64 last_n_talked;		/* When this participant last started talking, for last-N rooms */
+	guint64 notify_seq;			/* Latest participant list change in the room when this participant joined */
 	gboolean data_active;
 	gboolean firefox;	/* We send Firefox users a different kind of FIR */
 	uint32_t bitrate;
@@ -1482,6 +1705,12 @@ typedef struct janus_videoroom_publisher {
 	gint64 remb_latest;	/* Time of latest sent REMB (to avoid flooding) */
 	gint64 fir_latest;	/* Time of latest sent FIR (to avoid flooding) */
 	gint fir_seq;		/* FIR sequence number */
+	/* Keyframe requests aggregation (see janus_videoroom_keyframe_request_check) */
+	gint64 kf_requested;		/* Time of latest keyframe request we actually sent */
+	gboolean kf_pending[3];		/* Substreams we didn't get a keyframe on since then */
+	volatile gint kf_deferred;	/* Whether we owe the publisher a request when the interval expires */
+	volatile gint kf_forwarded, kf_suppressed;	/* Counters of sent vs. coalesced requests */
+	janus_mutex kf_mutex;
 	gboolean recording_active;	/* Whether this publisher has to be recorded or not */
 	gchar *recording_base;	/* Base name for the recording (e.g., /path/to/filename, will generate /path/to/filename-audio.mjr and/or /path/to/filename-video.mjr */
 	janus_recorder *arc;	/* The Janus recorder instance for this publisher's audio, if enabled */
@@ -1493,6 +1722,16 @@ typedef struct janus_videoroom_publisher {
 	GSList *subscribers;	/* Subscriptions to this publisher (who's watching this publisher)  */
 	GSList *subscriptions;	/* Subscriptions this publisher has created (who this publisher is watching) */
 	janus_mutex subscribers_mutex;
+	janus_videoroom_subscribers_snapshot *snapshot;	/* Lock-free copy of subscribers, only swapped with subscribers_mutex held */
+	janus_videoroom_subscribers_snapshot *retiring;	/* Snapshots that were just replaced (lock-free stack) */
+	janus_videoroom_subscribers_snapshot *retired[3];	/* Replaced snapshots, by number of grace periods they waited */
+	volatile gint snapshot_retired;		/* How many replaced snapshots still need to be freed */
+	volatile gint snapshot_reclaiming;	/* Whether someone is currently freeing replaced snapshots */
+	volatile gint snapshot_epoch;		/* Current grace period for readers of the snapshot */
+	volatile gint snapshot_readers[2];	/* Readers currently using the snapshot, per grace period */
+	janus_media_bridge_source *bridge;	/* In-process bridge to other plugins (e.g., Streaming mountpoints) */
+	janus_rtp_gop_cache gop[3];	/* Latest video GOP (one per simulcast substream), if the room has gop_cache enabled */
+	janus_rtp_simulcasting_bitrates sc_bitrates;	/* Bitrate of each simulcast substream, for subscribers doing auto_simulcast */
 	GHashTable *rtp_forwarders;
 	GHashTable *srtp_contexts;
 	janus_mutex rtp_forwarders_mutex;
@@ -1526,6 +1765,13 @@ typedef struct janus_videoroom_subscriber {
 	 * simulcast, which has similar info (substream/templayer) but in a completely different context */
 	int spatial_layer, target_spatial_layer;
 	int temporal_layer, target_temporal_layer;
+	volatile gint gop_pending;	/* Whether the publisher should send us its cached GOP before the next video packet */
+	/* The following are only relevant if the subscriber asked for auto_simulcast, in which case
+	 * the simulcast targets are picked automatically according to the estimated bandwidth */
+	gboolean bwe_enabled;
+	janus_rtcp_bwe_context bwe;
+	int bwe_max_substream, bwe_max_templayer;
+	int last_n_slot;	/* Active speaker slot this subscription is attached to, in last-N rooms (-1 if none) */
 	volatile gint destroyed;
 	janus_refcount ref;
 } janus_videoroom_subscriber;
@@ -1537,6 +1783,8 @@ typedef struct janus_videoroom_rtp_relay_packet {
 	uint32_t ssrc[3];
 	uint32_t timestamp;
 	uint16_t seq_number;
+	/* Simulcast info, parsed once per packet by the publisher (NULL if not simulcasting) */
+	janus_rtp_simulcasting_packet *simulcast;
 	/* The following are only relevant if we're doing VP9 SVC*/
 	gboolean svc;
 	int spatial_layer;
@@ -1551,6 +1799,10 @@ static void janus_videoroom_subscriber_destroy(janus_videoroom_subscriber *s) {
 		janus_refcount_decrease(&s->ref);
 }
 
+static void janus_videoroom_subscriber_dereference(janus_videoroom_subscriber *s) {
+	janus_refcount_decrease(&s->ref);
+}
+
 static void janus_videoroom_subscriber_free(const janus_refcount *s_ref) {
 	janus_videoroom_subscriber *s = janus_refcount_containerof(s_ref, janus_videoroom_subscriber, ref);
 	/* This subscriber can be destroyed, free all the resources */
@@ -1558,6 +1810,128 @@ static void janus_videoroom_subscriber_free(const janus_refcount *s_ref) {
 	g_free(s);
 }
 
+/* Subscribers snapshots: the publisher thread enters a read section tied to the
+ * current epoch and uses whatever snapshot is published at that point, while
+ * writers (holding subscribers_mutex) publish a new snapshot and retire the old
+ * one. Nobody ever waits for readers: retired snapshots are only freed after
+ * the readers of two full grace periods are gone, which is checked (and the
+ * epoch flipped) by writers and by readers leaving their read section. This
+ * means a few packets may still be relayed to a subscriber that was just
+ * removed, which is fine since the snapshot keeps it (and its session) alive */
+static void janus_videoroom_subscribers_snapshot_free(janus_videoroom_subscribers_snapshot *snapshot) {
+	while(snapshot != NULL) {
+		janus_videoroom_subscribers_snapshot *next = snapshot->next;
+		guint i = 0;
+		for(i=0; i<snapshot->count; i++) {
+			janus_videoroom_subscriber *s = snapshot->subscribers[i];
+			if(s->session != NULL)
+				janus_refcount_decrease(&s->session->ref);
+			janus_refcount_decrease(&s->ref);
+		}
+		g_free(snapshot->subscribers);
+		g_free(snapshot);
+		snapshot = next;
+	}
+}
+
+static guint janus_videoroom_subscribers_snapshot_count(janus_videoroom_subscribers_snapshot *snapshot) {
+	guint count = 0;
+	for(; snapshot != NULL; snapshot = snapshot->next)
+		count++;
+	return count;
+}
+
+static janus_videoroom_subscribers_snapshot *janus_videoroom_subscribers_snapshot_append(
+		janus_videoroom_subscribers_snapshot *list, janus_videoroom_subscribers_snapshot *other) {
+	if(list == NULL)
+		return other;
+	janus_videoroom_subscribers_snapshot *last = list;
+	while(last->next != NULL)
+		last = last->next;
+	last->next = other;
+	return list;
+}
+
+/* Frees the retired snapshots nobody can be using anymore, without ever waiting */
+static void janus_videoroom_subscribers_reclaim(janus_videoroom_publisher *p) {
+	if(!g_atomic_int_compare_and_exchange(&p->snapshot_reclaiming, 0, 1))
+		return;
+	/* Take the snapshots that were retired since the last time */
+	janus_videoroom_subscribers_snapshot *list = NULL;
+	do {
+		list = g_atomic_pointer_get(&p->retiring);
+	} while(list != NULL && !g_atomic_pointer_compare_and_exchange(&p->retiring, list, NULL));
+	p->retired[0] = janus_videoroom_subscribers_snapshot_append(p->retired[0], list);
+	/* Each step needs the readers of the previous epoch to be gone: a
+	 * retired snapshot is freed after it waited for two epoch flips */
+	int step = 0;
+	for(step=0; step<3; step++) {
+		if(p->retired[0] == NULL && p->retired[1] == NULL && p->retired[2] == NULL)
+			break;
+		gint epoch = g_atomic_int_get(&p->snapshot_epoch) & 1;
+		if(g_atomic_int_get(&p->snapshot_readers[epoch ^ 1]) > 0)
+			break;
+		if(p->retired[2] != NULL) {
+			g_atomic_int_add(&p->snapshot_retired, -(gint)janus_videoroom_subscribers_snapshot_count(p->retired[2]));
+			janus_videoroom_subscribers_snapshot_free(p->retired[2]);
+		}
+		p->retired[2] = p->retired[1];
+		p->retired[1] = p->retired[0];
+		p->retired[0] = NULL;
+		if(p->retired[1] != NULL || p->retired[2] != NULL)
+			g_atomic_int_set(&p->snapshot_epoch, epoch ^ 1);
+	}
+	g_atomic_int_set(&p->snapshot_reclaiming, 0);
+}
+
+static janus_videoroom_subscribers_snapshot *janus_videoroom_subscribers_read_lock(janus_videoroom_publisher *p, gint *epoch) {
+	*epoch = g_atomic_int_get(&p->snapshot_epoch) & 1;
+	g_atomic_int_inc(&p->snapshot_readers[*epoch]);
+	return (janus_videoroom_subscribers_snapshot *)g_atomic_pointer_get(&p->snapshot);
+}
+
+static void janus_videoroom_subscribers_read_unlock(janus_videoroom_publisher *p, gint epoch) {
+	(void)g_atomic_int_dec_and_test(&p->snapshot_readers[epoch]);
+	/* If there are old snapshots waiting, we may be the last reader they were waiting for */
+	if(g_atomic_int_get(&p->snapshot_retired) > 0)
+		janus_videoroom_subscribers_reclaim(p);
+}
+
+/* Must be called with subscribers_mutex held, after changing p->subscribers */
+static void janus_videoroom_subscribers_update(janus_videoroom_publisher *p) {
+	janus_videoroom_subscribers_snapshot *snapshot = NULL;
+	guint count = g_slist_length(p->subscribers);
+	if(count > 0) {
+		snapshot = g_malloc(sizeof(janus_videoroom_subscribers_snapshot));
+		snapshot->count = 0;
+		snapshot->subscribers = g_malloc(count * sizeof(janus_videoroom_subscriber *));
+		snapshot->next = NULL;
+		GSList *l = p->subscribers;
+		while(l) {
+			janus_videoroom_subscriber *s = (janus_videoroom_subscriber *)l->data;
+			if(s != NULL) {
+				janus_refcount_increase(&s->ref);
+				if(s->session != NULL)
+					janus_refcount_increase(&s->session->ref);
+				snapshot->subscribers[snapshot->count++] = s;
+			}
+			l = l->next;
+		}
+	}
+	janus_videoroom_subscribers_snapshot *old = g_atomic_pointer_get(&p->snapshot);
+	g_atomic_pointer_set(&p->snapshot, snapshot);
+	if(old != NULL) {
+		/* Retire the old snapshot: it will be freed when no reader can have it anymore */
+		g_atomic_int_inc(&p->snapshot_retired);
+		janus_videoroom_subscribers_snapshot *head = NULL;
+		do {
+			head = g_atomic_pointer_get(&p->retiring);
+			old->next = head;
+		} while(!g_atomic_pointer_compare_and_exchange(&p->retiring, head, old));
+	}
+	janus_videoroom_subscribers_reclaim(p);
+}
+
 static void janus_videoroom_publisher_dereference(janus_videoroom_publisher *p) {
 	/* This is used by g_pointer_clear and g_hash_table_new_full so that NULL is only possible if that was inserted into the hash table. */
 	janus_refcount_decrease(&p->ref);
@@ -1597,9 +1971,23 @@ static void janus_videoroom_publisher_free(const janus_refcount *p_ref) {
 	g_hash_table_destroy(p->srtp_contexts);
 	p->srtp_contexts = NULL;
 	g_slist_free(p->subscribers);
+	janus_videoroom_subscribers_snapshot_free(p->snapshot);
+	p->snapshot = NULL;
+	janus_videoroom_subscribers_snapshot_free(p->retiring);
+	p->retiring = NULL;
+	int i=0;
+	for(i=0; i<3; i++) {
+		janus_videoroom_subscribers_snapshot_free(p->retired[i]);
+		p->retired[i] = NULL;
+	}
+	janus_media_bridge_source_remove(p->bridge);
+	p->bridge = NULL;
+	for(i=0; i<3; i++)
+		janus_rtp_gop_cache_destroy(&p->gop[i]);
 
 	janus_mutex_destroy(&p->subscribers_mutex);
 	janus_mutex_destroy(&p->rtp_forwarders_mutex);
+	janus_mutex_destroy(&p->kf_mutex);
 	g_free(p);
 }
 
@@ -1621,6 +2009,12 @@ static void janus_videoroom_room_dereference(janus_videoroom *room) {
 	janus_refcount_decrease(&room->ref);
 }
 
+/* Flag the cached list of participants of a room as outdated */
+static void janus_videoroom_participants_changed(janus_videoroom *room) {
+	if(room != NULL)
+		g_atomic_int_set(&room->participants_changed, 1);
+}
+
 static void janus_videoroom_room_destroy(janus_videoroom *room) {
 	if(room && g_atomic_int_compare_and_exchange(&room->destroyed, 0, 1))
 		janus_refcount_decrease(&room->ref);
@@ -1636,6 +2030,11 @@ static void janus_videoroom_room_free(const janus_refcount *room_ref) {
 	g_hash_table_destroy(room->participants);
 	g_hash_table_destroy(room->private_ids);
 	g_hash_table_destroy(room->allowed);
+	g_free(room->last_n_slots);
+	g_list_free_full(room->last_n_subscribers, (GDestroyNotify)janus_videoroom_subscriber_dereference);
+	g_list_free_full(room->notify_pending, (GDestroyNotify)janus_videoroom_notification_free);
+	if(room->participants_list)
+		json_decref(room->participants_list);
 	g_free(room);
 }
 
@@ -1645,6 +2044,11 @@ static void janus_videoroom_message_free(janus_videoroom_message *msg) {
 
 	if(msg->handle && msg->handle->plugin_handle) {
 		janus_videoroom_session *session = (janus_videoroom_session *)msg->handle->plugin_handle;
+		if(msg->queued > 0) {
+			janus_mutex_lock(&session->mutex);
+			session->queued--;
+			janus_mutex_unlock(&session->mutex);
+		}
 		janus_refcount_decrease(&session->ref);
 	}
 	msg->handle = NULL;
@@ -1661,6 +2065,28 @@ static void janus_videoroom_message_free(janus_videoroom_message *msg) {
 	g_free(msg);
 }
 
+/* Helper to queue an asynchronous request: as long as a session has pending
+ * messages they all go to the same handler thread, so that they're processed
+ * in order; otherwise we pick the handler that takes care of the room */
+static void janus_videoroom_message_enqueue(janus_videoroom_session *session, janus_videoroom_message *msg) {
+	guint64 room_id = 0;
+	json_t *room = json_object_get(msg->message, "room");
+	if(room && json_is_integer(room))
+		room_id = json_integer_value(room);
+	janus_mutex_lock(&session->mutex);
+	if(room_id == 0)
+		room_id = session->room_id;
+	session->room_id = room_id;
+	if(session->queued == 0)
+		session->handler = room_id % handlers_num;
+	session->queued++;
+	msg->room_id = room_id;
+	msg->queued = janus_get_monotonic_time();
+	guint handler = session->handler;
+	janus_mutex_unlock(&session->mutex);
+	g_async_queue_push(handlers[handler].messages, msg);
+}
+
 static void janus_videoroom_codecstr(janus_videoroom *videoroom, char *audio_codecs, char *video_codecs, int str_len, const char *split) {
 	if (audio_codecs) {
 		audio_codecs[0] = 0;
@@ -1688,7 +2114,58 @@ static void janus_videoroom_codecstr(janus_videoroom *videoroom, char *audio_cod
 	}
 }
 
-static void janus_videoroom_reqfir(janus_videoroom_publisher *publisher, const char *reason) {
+/* Keyframe requests aggregator: when a room has fir_min_interval set, at most one
+ * keyframe request is sent to a publisher in each interval. Requests arriving in
+ * between are absorbed if the keyframe they need is already on its way (we asked
+ * for one and didn't get it on that substream yet), or deferred otherwise: deferred
+ * requests are sent as a single one by the publisher thread when the interval expires.
+ * A substream of -1 means any substream the publisher is sending. */
+static gboolean janus_videoroom_keyframe_request_check(janus_videoroom_publisher *publisher, int substream) {
+	uint16_t interval = publisher->room ? publisher->room->fir_min_interval : 0;
+	gint64 now = janus_get_monotonic_time();
+	gboolean forward = FALSE;
+	janus_mutex_lock(&publisher->kf_mutex);
+	if(interval == 0 || publisher->kf_requested == 0 || (now-publisher->kf_requested) >= (gint64)interval*1000) {
+		forward = TRUE;
+		publisher->kf_requested = now;
+		int i=0;
+		for(i=0; i<3; i++)
+			publisher->kf_pending[i] = TRUE;
+		g_atomic_int_set(&publisher->kf_deferred, 0);
+	} else {
+		gboolean pending = TRUE;
+		if(substream >= 0 && substream < 3) {
+			pending = publisher->kf_pending[substream];
+		} else {
+			int i=0;
+			for(i=0; i<3; i++) {
+				if((i == 0 || publisher->ssrc[i] != 0 || publisher->rid[i] != NULL) && !publisher->kf_pending[i])
+					pending = FALSE;
+			}
+		}
+		if(!pending)
+			g_atomic_int_set(&publisher->kf_deferred, 1);
+	}
+	janus_mutex_unlock(&publisher->kf_mutex);
+	g_atomic_int_inc(forward ? &publisher->kf_forwarded : &publisher->kf_suppressed);
+	return forward;
+}
+
+/* Must be called in the publisher thread, for each keyframe it receives */
+static void janus_videoroom_keyframe_received(janus_videoroom_publisher *publisher, int substream) {
+	if(substream < 0 || substream > 2)
+		return;
+	janus_mutex_lock(&publisher->kf_mutex);
+	publisher->kf_pending[substream] = FALSE;
+	janus_mutex_unlock(&publisher->kf_mutex);
+}
+
+static void janus_videoroom_reqfir_substream(janus_videoroom_publisher *publisher, int substream, const char *reason) {
+	if(!janus_videoroom_keyframe_request_check(publisher, substream)) {
+		JANUS_LOG(LOG_HUGE, "%s, but a keyframe request was sent to %"SCNu64" (%s) recently, coalescing\n",
+			reason, publisher->user_id, publisher->display ? publisher->display : "??");
+		return;
+	}
 	/* Send a FIR */
 	char buf[20];
 	janus_rtcp_fir((char *)&buf, 20, &publisher->fir_seq);
@@ -1702,6 +2179,443 @@ static void janus_videoroom_reqfir(janus_videoroom_publisher *publisher, const c
 	publisher->fir_latest = janus_get_monotonic_time();
 }
 
+static void janus_videoroom_reqfir(janus_videoroom_publisher *publisher, const char *reason) {
+	janus_videoroom_reqfir_substream(publisher, -1, reason);
+}
+
+/* Must be called in the publisher thread: sends the coalesced requests, if any, when allowed */
+static void janus_videoroom_reqfir_deferred(janus_videoroom_publisher *publisher) {
+	if(!g_atomic_int_get(&publisher->kf_deferred))
+		return;
+	uint16_t interval = publisher->room ? publisher->room->fir_min_interval : 0;
+	gint64 now = janus_get_monotonic_time();
+	janus_mutex_lock(&publisher->kf_mutex);
+	gboolean expired = (now-publisher->kf_requested) >= (gint64)interval*1000;
+	janus_mutex_unlock(&publisher->kf_mutex);
+	if(expired)
+		janus_videoroom_reqfir(publisher, "Coalesced keyframe requests");
+}
+
+/* Callback the media bridge invokes, in the publisher thread, when a sink needs a keyframe */
+static void janus_videoroom_bridge_keyframe(void *user_data) {
+	janus_videoroom_publisher *publisher = (janus_videoroom_publisher *)user_data;
+	janus_videoroom_reqfir(publisher, "Media bridge sink");
+}
+
+/* Substream a subscriber is currently receiving (0 if the publisher isn't simulcasting) */
+static int janus_videoroom_subscriber_substream(janus_videoroom_subscriber *s) {
+	janus_videoroom_publisher *p = s->feed;
+	if(p == NULL || (p->ssrc[0] == 0 && p->rid[0] == NULL))
+		return 0;
+	return s->sim_context.substream;
+}
+
+/* GOP cache helpers: when a room has gop_cache enabled, new subscribers are sent
+ * the latest GOP of the publisher, rather than waiting for a new keyframe */
+static janus_rtp_gop_cache *janus_videoroom_gop_pick(janus_videoroom_publisher *p, janus_videoroom_subscriber *s) {
+	if(p->ssrc[0] == 0 && p->rid[0] == NULL)
+		return janus_rtp_gop_cache_is_valid(&p->gop[0]) ? &p->gop[0] : NULL;
+	/* Simulcast: the cache must match the substream the subscriber is waiting for */
+	int target = s->sim_context.substream_target;
+	if(target < 0 || target > 2)
+		target = 0;
+	if(janus_rtp_gop_cache_is_valid(&p->gop[target]))
+		return &p->gop[target];
+	if(target == 2 && s->sim_context.substream < 1 && janus_rtp_gop_cache_is_valid(&p->gop[1]))
+		return &p->gop[1];
+	return NULL;
+}
+
+static gboolean janus_videoroom_gop_request(janus_videoroom_publisher *p, janus_videoroom_subscriber *s) {
+	if(p == NULL || s == NULL || p->room == NULL || !p->room->gop_cache)
+		return FALSE;
+	if(janus_videoroom_gop_pick(p, s) == NULL)
+		return FALSE;
+	/* The GOP will be sent by the publisher thread before the next video packet */
+	g_atomic_int_set(&s->gop_pending, 1);
+	return TRUE;
+}
+
+/* Must be called in the publisher thread */
+static void janus_videoroom_gop_replay(janus_videoroom_publisher *p, janus_videoroom_subscriber *s) {
+	janus_videoroom_session *session = s->session;
+	if(session == NULL || !session->started || s->paused || !s->video)
+		return;
+	if(!g_atomic_int_compare_and_exchange(&s->gop_pending, 1, 0))
+		return;
+	janus_rtp_gop_cache *cache = janus_videoroom_gop_pick(p, s);
+	guint count = 0;
+	janus_rtp_gop_packet **packets = cache ? janus_rtp_gop_cache_get(cache, &count) : NULL;
+	if(packets == NULL) {
+		/* The GOP we had isn't there anymore, fallback to a keyframe request */
+		janus_videoroom_reqfir(p, "New subscriber available");
+		return;
+	}
+	JANUS_LOG(LOG_VERB, "Sending cached GOP of %"SCNu64" (%u packets) to new subscriber\n", p->user_id, count);
+	gboolean simulcast = (p->ssrc[0] != 0 || p->rid[0] != NULL);
+	char buffer[1500];
+	guint i = 0;
+	for(i=0; i<count; i++) {
+		janus_rtp_gop_packet *gp = packets[i];
+		if(gp->length <= (int)sizeof(buffer)) {
+			/* Relaying may update the packet, so we work on a copy */
+			memcpy(buffer, gp->buffer, gp->length);
+			janus_videoroom_rtp_relay_packet packet;
+			memset(&packet, 0, sizeof(packet));
+			packet.data = (janus_rtp_header *)buffer;
+			packet.length = gp->length;
+			packet.is_video = TRUE;
+			janus_rtp_simulcasting_packet simulcast_packet;
+			if(simulcast && janus_rtp_simulcasting_packet_parse(&simulcast_packet, buffer, gp->length, p->ssrc, p->rid,
+					p->rid_extmap_id, p->framemarking_ext_id, p->vcodec) == 0) {
+				packet.simulcast = &simulcast_packet;
+				packet.ssrc[0] = p->ssrc[0];
+				packet.ssrc[1] = p->ssrc[1];
+				packet.ssrc[2] = p->ssrc[2];
+			}
+			packet.timestamp = ntohl(packet.data->timestamp);
+			packet.seq_number = ntohs(packet.data->seq_number);
+			janus_videoroom_relay_rtp_packet(s, &packet);
+		}
+		janus_rtp_gop_packet_unref(gp);
+	}
+	g_free(packets);
+}
+
+/* Helper to move a subscriber to a different publisher: the caller must have increased the
+ * references of the new publisher (and its session) already, as the subscriber takes them over */
+static gboolean janus_videoroom_subscriber_switch(janus_videoroom_subscriber *subscriber,
+		janus_videoroom_publisher *publisher, gboolean audio, gboolean video, gboolean data) {
+	gboolean paused = subscriber->paused;
+	subscriber->paused = TRUE;
+	/* Unsubscribe from the previous publisher */
+	janus_videoroom_publisher *prev_feed = subscriber->feed;
+	if(prev_feed) {
+		/* ... but make sure the codecs are compliant first */
+		if(publisher->acodec != prev_feed->acodec || publisher->vcodec != prev_feed->vcodec) {
+			janus_refcount_decrease(&publisher->session->ref);
+			janus_refcount_decrease(&publisher->ref);
+			subscriber->paused = paused;
+			return FALSE;
+		}
+		/* Go on */
+		janus_mutex_lock(&prev_feed->subscribers_mutex);
+		prev_feed->subscribers = g_slist_remove(prev_feed->subscribers, subscriber);
+		janus_videoroom_subscribers_update(prev_feed);
+		janus_mutex_unlock(&prev_feed->subscribers_mutex);
+		janus_refcount_decrease(&prev_feed->session->ref);
+		g_clear_pointer(&subscriber->feed, janus_videoroom_publisher_dereference);
+	}
+	/* Subscribe to the new one */
+	subscriber->audio = audio && publisher->audio;	/* Unless the publisher isn't sending any audio */
+	subscriber->video = video && publisher->video;	/* Unless the publisher isn't sending any video */
+	subscriber->data = data && publisher->data;		/* Unless the publisher isn't sending any data */
+	if(subscriber->room && subscriber->room->do_svc) {
+		/* This subscriber belongs to a room where VP9 SVC has been enabled,
+		 * let's assume we're interested in all layers for the time being */
+		subscriber->spatial_layer = -1;
+		subscriber->target_spatial_layer = 2;		/* FIXME Chrome sends 0, 1 and 2 (if using EnabledByFlag_3SL3TL) */
+		subscriber->temporal_layer = -1;
+		subscriber->target_temporal_layer = 2;	/* FIXME Chrome sends 0, 1 and 2 */
+	}
+	janus_mutex_lock(&publisher->subscribers_mutex);
+	publisher->subscribers = g_slist_append(publisher->subscribers, subscriber);
+	janus_videoroom_subscribers_update(publisher);
+	janus_mutex_unlock(&publisher->subscribers_mutex);
+	subscriber->feed = publisher;
+	/* Send a FIR to the new publisher, unless we can use its cached GOP */
+	if(!janus_videoroom_gop_request(publisher, subscriber))
+		janus_videoroom_reqfir(publisher, "Switching existing subscriber to new publisher");
+	/* Done */
+	subscriber->paused = paused;
+	return TRUE;
+}
+
+/* Last-N helpers: publishers are assigned to active speaker slots as they start
+ * talking, replacing whoever has been silent for the longest time, and all the
+ * subscribers attached to a slot are switched to its new publisher. All these
+ * helpers must be called with the room mutex held, which is also what the
+ * "switch" request holds when switching a subscriber, so that the two never
+ * race; they're never invoked from the media path either, where talk detection
+ * only schedules janus_videoroom_last_n_talking on the RTCP forwarders loop */
+static int janus_videoroom_last_n_find(janus_videoroom *room, janus_videoroom_publisher *p) {
+	int i = 0;
+	for(i=0; i<room->last_n; i++) {
+		if(room->last_n_slots[i] == p->user_id)
+			return i;
+	}
+	return -1;
+}
+
+static void janus_videoroom_last_n_assign(janus_videoroom *room, int slot, janus_videoroom_publisher *p) {
+	room->last_n_slots[slot] = p ? p->user_id : 0;
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Active speaker slot %d now assigned to %"SCNu64"\n",
+		room->room_id, slot, room->last_n_slots[slot]);
+	if(p == NULL)
+		return;
+	GList *l = room->last_n_subscribers;
+	while(l) {
+		janus_videoroom_subscriber *s = (janus_videoroom_subscriber *)l->data;
+		l = l->next;
+		if(s->last_n_slot != slot || s->feed == p || g_atomic_int_get(&s->destroyed) || s->session == NULL)
+			continue;
+		janus_refcount_increase(&p->ref);
+		janus_refcount_increase(&p->session->ref);
+		if(!janus_videoroom_subscriber_switch(s, p, s->audio_offered, s->video_offered, s->data_offered)) {
+			JANUS_LOG(LOG_WARN, "[%"SCNu64"] Can't switch slot %d subscriber to %"SCNu64", codecs don't match\n",
+				room->room_id, slot, p->user_id);
+			continue;
+		}
+		json_t *event = json_object();
+		json_object_set_new(event, "videoroom", json_string("event"));
+		json_object_set_new(event, "switched", json_string("ok"));
+		json_object_set_new(event, "room", json_integer(room->room_id));
+		json_object_set_new(event, "id", json_integer(p->user_id));
+		if(p->display)
+			json_object_set_new(event, "display", json_string(p->display));
+		json_object_set_new(event, "last_n_slot", json_integer(slot));
+		gateway->push_event(s->session->handle, &janus_videoroom_plugin, NULL, event, NULL);
+		json_decref(event);
+	}
+}
+
+/* Pick the most recent speaker that is publishing video and isn't in a slot already */
+static janus_videoroom_publisher *janus_videoroom_last_n_candidate(janus_videoroom *room, janus_videoroom_publisher *exclude) {
+	janus_videoroom_publisher *candidate = NULL;
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, room->participants);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_videoroom_publisher *p = value;
+		if(p == exclude || p->sdp == NULL || !p->video || p->session == NULL ||
+				g_atomic_int_get(&p->destroyed) || janus_videoroom_last_n_find(room, p) != -1)
+			continue;
+		if(candidate == NULL || p->last_n_talked > candidate->last_n_talked)
+			candidate = p;
+	}
+	return candidate;
+}
+
+static void janus_videoroom_last_n_talking(janus_videoroom *room, janus_videoroom_publisher *p) {
+	p->last_n_talked = janus_get_monotonic_time();
+	if(!p->video || janus_videoroom_last_n_find(room, p) != -1)
+		return;
+	/* Take an empty slot, or the one of who's been silent for the longest time */
+	int i = 0, slot = -1;
+	gint64 oldest = 0;
+	for(i=0; i<room->last_n; i++) {
+		if(room->last_n_slots[i] == 0) {
+			slot = i;
+			break;
+		}
+		janus_videoroom_publisher *sp = g_hash_table_lookup(room->participants, &room->last_n_slots[i]);
+		gint64 talked = sp ? sp->last_n_talked : 0;
+		if(slot == -1 || talked < oldest) {
+			slot = i;
+			oldest = talked;
+		}
+	}
+	if(slot != -1)
+		janus_videoroom_last_n_assign(room, slot, p);
+}
+
+/* Talk detection happens in the publisher thread, so the slots are updated in the RTCP forwarders loop */
+typedef struct janus_videoroom_last_n_update {
+	janus_videoroom *room;
+	janus_videoroom_publisher *publisher;
+} janus_videoroom_last_n_update;
+
+static gboolean janus_videoroom_last_n_update_cb(gpointer user_data) {
+	janus_videoroom_last_n_update *update = (janus_videoroom_last_n_update *)user_data;
+	janus_videoroom *room = update->room;
+	janus_videoroom_publisher *p = update->publisher;
+	janus_mutex_lock(&room->mutex);
+	if(!g_atomic_int_get(&room->destroyed) && !g_atomic_int_get(&p->destroyed) && p->room == room && p->talking)
+		janus_videoroom_last_n_talking(room, p);
+	janus_mutex_unlock(&room->mutex);
+	return G_SOURCE_REMOVE;
+}
+
+static void janus_videoroom_last_n_update_free(janus_videoroom_last_n_update *update) {
+	janus_refcount_decrease(&update->publisher->ref);
+	janus_refcount_decrease(&update->room->ref);
+	g_free(update);
+}
+
+static void janus_videoroom_last_n_schedule(janus_videoroom *room, janus_videoroom_publisher *p) {
+	janus_videoroom_last_n_update *update = g_malloc(sizeof(janus_videoroom_last_n_update));
+	janus_refcount_increase(&room->ref);
+	update->room = room;
+	janus_refcount_increase(&p->ref);
+	update->publisher = p;
+	GSource *source = g_idle_source_new();
+	g_source_set_callback(source, janus_videoroom_last_n_update_cb,
+		update, (GDestroyNotify)janus_videoroom_last_n_update_free);
+	g_source_attach(source, rtcpfwd_ctx);
+	g_source_unref(source);
+}
+
+static void janus_videoroom_last_n_published(janus_videoroom *room, janus_videoroom_publisher *p) {
+	if(!p->video || janus_videoroom_last_n_find(room, p) != -1)
+		return;
+	/* New publishers only get a slot if there's an empty one */
+	int i = 0;
+	for(i=0; i<room->last_n; i++) {
+		if(room->last_n_slots[i] == 0) {
+			janus_videoroom_last_n_assign(room, i, p);
+			return;
+		}
+	}
+}
+
+static void janus_videoroom_last_n_unpublished(janus_videoroom *room, janus_videoroom_publisher *p) {
+	int slot = janus_videoroom_last_n_find(room, p);
+	if(slot == -1)
+		return;
+	/* Replace this publisher with the most recent speaker that doesn't have a slot */
+	janus_videoroom_last_n_assign(room, slot, janus_videoroom_last_n_candidate(room, p));
+}
+
+/* Helpers to batch changes in the list of participants: all changes in the
+ * room notify_window are merged in a single event for each participant.
+ * Unless specified otherwise, all these helpers must be called with the room
+ * mutex held. The timers are handled by the same loop as RTCP forwarders */
+static json_t *janus_videoroom_notification_build(janus_videoroom *room, guint64 exclude, guint64 after) {
+	json_t *event = NULL;
+	GList *l = room->notify_pending;
+	while(l) {
+		janus_videoroom_notification *n = (janus_videoroom_notification *)l->data;
+		l = l->next;
+		/* Skip changes about the recipient itself, or that it knows about already */
+		if(n->id == exclude || n->seq <= after)
+			continue;
+		if(event == NULL) {
+			event = json_object();
+			json_object_set_new(event, "videoroom", json_string("event"));
+			json_object_set_new(event, "room", json_integer(room->room_id));
+		}
+		json_t *list = json_object_get(event, n->type);
+		if(list == NULL) {
+			list = json_array();
+			json_object_set_new(event, n->type, list);
+		}
+		json_array_append(list, n->info);
+	}
+	return event;
+}
+
+/* Must be called with the room mutex: returns the events to send, which
+ * the caller should only push after releasing the lock */
+static GList *janus_videoroom_notification_flush(janus_videoroom *room) {
+	if(room->notify_pending == NULL)
+		return NULL;
+	guint64 first = ((janus_videoroom_notification *)room->notify_pending->data)->seq;
+	/* Most participants will get the same event: only those the changes are
+	 * about, or that joined in the meanwhile, need one of their own */
+	GHashTable *ids = g_hash_table_new(g_int64_hash, g_int64_equal);
+	GList *l = room->notify_pending;
+	while(l) {
+		janus_videoroom_notification *n = (janus_videoroom_notification *)l->data;
+		g_hash_table_add(ids, &n->id);
+		l = l->next;
+	}
+	GList *events = NULL;
+	json_t *shared = NULL;
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, room->participants);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_videoroom_publisher *p = value;
+		if(p == NULL || p->session == NULL || g_atomic_int_get(&p->destroyed))
+			continue;
+		json_t *event = NULL;
+		if(p->notify_seq < first && !g_hash_table_contains(ids, &p->user_id)) {
+			if(shared == NULL)
+				shared = janus_videoroom_notification_build(room, 0, 0);
+			event = json_incref(shared);
+		} else {
+			event = janus_videoroom_notification_build(room, p->user_id, p->notify_seq);
+		}
+		if(event == NULL)
+			continue;
+		janus_videoroom_notification_event *ne = g_malloc(sizeof(janus_videoroom_notification_event));
+		janus_refcount_increase(&p->session->ref);
+		ne->session = p->session;
+		ne->user_id = p->user_id;
+		ne->event = event;
+		events = g_list_prepend(events, ne);
+	}
+	if(shared != NULL)
+		json_decref(shared);
+	g_hash_table_destroy(ids);
+	g_list_free_full(room->notify_pending, (GDestroyNotify)janus_videoroom_notification_free);
+	room->notify_pending = NULL;
+	return g_list_reverse(events);
+}
+
+/* Called by the timer, so without the room mutex */
+static gboolean janus_videoroom_notification_timeout(gpointer user_data) {
+	janus_videoroom *room = (janus_videoroom *)user_data;
+	GList *events = NULL;
+	janus_mutex_lock(&room->mutex);
+	if(!g_atomic_int_get(&room->destroyed))
+		events = janus_videoroom_notification_flush(room);
+	g_list_free_full(room->notify_pending, (GDestroyNotify)janus_videoroom_notification_free);
+	room->notify_pending = NULL;
+	g_source_unref(room->notify_source);
+	room->notify_source = NULL;
+	janus_mutex_unlock(&room->mutex);
+	/* Now that we don't hold the room mutex anymore, send the events */
+	GList *l = events;
+	while(l) {
+		janus_videoroom_notification_event *ne = (janus_videoroom_notification_event *)l->data;
+		if(!g_atomic_int_get(&ne->session->destroyed)) {
+			JANUS_LOG(LOG_VERB, "Notifying participant %"SCNu64"\n", ne->user_id);
+			int ret = gateway->push_event(ne->session->handle, &janus_videoroom_plugin, NULL, ne->event, NULL);
+			JANUS_LOG(LOG_VERB, "  >> %d (%s)\n", ret, janus_get_api_error(ret));
+		}
+		l = l->next;
+	}
+	g_list_free_full(events, (GDestroyNotify)janus_videoroom_notification_event_free);
+	return G_SOURCE_REMOVE;
+}
+
+/* Returns FALSE if the room doesn't batch notifications, in which case the caller should notify right away */
+static gboolean janus_videoroom_notification_add(janus_videoroom_publisher *participant, const char *type, json_t *info) {
+	janus_videoroom *room = participant->room;
+	janus_videoroom_participants_changed(room);
+	if(room == NULL || room->notify_window == 0 || rtcpfwd_thread == NULL || info == NULL)
+		return FALSE;
+	/* A new change supersedes the previous ones about the same participant,
+	 * except for the joining notification which only goes away when leaving */
+	gboolean gone = !strcasecmp(type, "leaving") || !strcasecmp(type, "kicked");
+	GList *l = room->notify_pending;
+	while(l) {
+		janus_videoroom_notification *n = (janus_videoroom_notification *)l->data;
+		GList *next = l->next;
+		if(n->id == participant->user_id && (gone || strcasecmp(n->type, "joining"))) {
+			room->notify_pending = g_list_delete_link(room->notify_pending, l);
+			janus_videoroom_notification_free(n);
+		}
+		l = next;
+	}
+	janus_videoroom_notification *n = g_malloc0(sizeof(janus_videoroom_notification));
+	n->seq = ++room->notify_seq;
+	n->id = participant->user_id;
+	n->type = type;
+	n->info = json_incref(info);
+	room->notify_pending = g_list_append(room->notify_pending, n);
+	if(room->notify_source == NULL) {
+		/* Start the timer for this batch */
+		room->notify_source = g_timeout_source_new(room->notify_window);
+		janus_refcount_increase(&room->ref);
+		g_source_set_callback(room->notify_source, janus_videoroom_notification_timeout,
+			room, (GDestroyNotify)janus_videoroom_room_dereference);
+		g_source_attach(room->notify_source, rtcpfwd_ctx);
+	}
+	return TRUE;
+}
+
 /* Error codes */
 #define JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR		499
 #define JANUS_VIDEOROOM_ERROR_NO_MESSAGE		421
@@ -1973,8 +2887,6 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 		(GDestroyNotify)g_free, (GDestroyNotify) janus_videoroom_room_destroy);
 	sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_videoroom_session_destroy);
 
-	messages = g_async_queue_new_full((GDestroyNotify) janus_videoroom_message_free);
-
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	gateway = callback;
 
@@ -1994,6 +2906,17 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 		if(!notify_events && callback->events_is_enabled()) {
 			JANUS_LOG(LOG_WARN, "Notification of events to handlers disabled for %s\n", JANUS_VIDEOROOM_NAME);
 		}
+		/* How many threads should handle asynchronous requests? */
+		janus_config_item *threads = janus_config_get(config, config_general, janus_config_type_item, "handler_threads");
+		if(threads != NULL && threads->value != NULL) {
+			int num = atoi(threads->value);
+			if(num < 1) {
+				JANUS_LOG(LOG_WARN, "Invalid number of handler threads (%s), falling back to default (%d)\n",
+					threads->value, JANUS_VIDEOROOM_DEFAULT_HANDLERS);
+			} else {
+				handlers_num = num;
+			}
+		}
 		/* Iterate on all rooms */
 		GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
 		while(cl != NULL) {
@@ -2012,6 +2935,7 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 			janus_config_item *bitrate_cap = janus_config_get(config, cat, janus_config_type_item, "bitrate_cap");
 			janus_config_item *maxp = janus_config_get(config, cat, janus_config_type_item, "publishers");
 			janus_config_item *firfreq = janus_config_get(config, cat, janus_config_type_item, "fir_freq");
+			janus_config_item *firmin = janus_config_get(config, cat, janus_config_type_item, "fir_min_interval");
 			janus_config_item *audiocodec = janus_config_get(config, cat, janus_config_type_item, "audiocodec");
 			janus_config_item *videocodec = janus_config_get(config, cat, janus_config_type_item, "videocodec");
 			janus_config_item *fec = janus_config_get(config, cat, janus_config_type_item, "opus_fec");
@@ -2024,6 +2948,9 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 			janus_config_item *playoutdelay_ext = janus_config_get(config, cat, janus_config_type_item, "playoutdelay_ext");
 			janus_config_item *transport_wide_cc_ext = janus_config_get(config, cat, janus_config_type_item, "transport_wide_cc_ext");
 			janus_config_item *notify_joining = janus_config_get(config, cat, janus_config_type_item, "notify_joining");
+			janus_config_item *gop_cache = janus_config_get(config, cat, janus_config_type_item, "gop_cache");
+			janus_config_item *last_n = janus_config_get(config, cat, janus_config_type_item, "last_n");
+			janus_config_item *notify_window = janus_config_get(config, cat, janus_config_type_item, "notify_window");
 			janus_config_item *record = janus_config_get(config, cat, janus_config_type_item, "record");
 			janus_config_item *rec_dir = janus_config_get(config, cat, janus_config_type_item, "rec_dir");
 			/* Create the video room */
@@ -2060,6 +2987,9 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 			videoroom->fir_freq = 0;
 			if(firfreq != NULL && firfreq->value != NULL)
 				videoroom->fir_freq = atol(firfreq->value);
+			videoroom->fir_min_interval = 0;
+			if(firmin != NULL && firmin->value != NULL)
+				videoroom->fir_min_interval = atol(firmin->value);
 			/* By default, we force Opus as the only audio codec */
 			videoroom->acodec[0] = JANUS_AUDIOCODEC_OPUS;
 			videoroom->acodec[1] = JANUS_AUDIOCODEC_NONE;
@@ -2168,6 +3098,19 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 			videoroom->notify_joining = FALSE;
 			if(notify_joining != NULL && notify_joining->value != NULL)
 				videoroom->notify_joining = janus_is_true(notify_joining->value);
+			videoroom->gop_cache = FALSE;
+			if(gop_cache != NULL && gop_cache->value != NULL)
+				videoroom->gop_cache = janus_is_true(gop_cache->value);
+			if(videoroom->gop_cache && videoroom->do_svc) {
+				JANUS_LOG(LOG_WARN, "GOP cache not supported with VP9 SVC, disabling it for room %"SCNu64"\n", videoroom->room_id);
+				videoroom->gop_cache = FALSE;
+			}
+			if(last_n != NULL && last_n->value != NULL && atoi(last_n->value) > 0) {
+				videoroom->last_n = atoi(last_n->value);
+				videoroom->last_n_slots = g_malloc0(videoroom->last_n * sizeof(guint64));
+			}
+			if(notify_window != NULL && notify_window->value != NULL && atoi(notify_window->value) > 0)
+				videoroom->notify_window = atoi(notify_window->value);
 			g_atomic_int_set(&videoroom->destroyed, 0);
 			janus_mutex_init(&videoroom->mutex);
 			janus_refcount_init(&videoroom->ref, janus_videoroom_room_free);
@@ -2177,6 +3120,7 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 			videoroom->allowed = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
 			janus_mutex_lock(&rooms_mutex);
 			g_hash_table_insert(rooms, janus_uint64_dup(videoroom->room_id), videoroom);
+			rooms_list_changed = TRUE;
 			janus_mutex_unlock(&rooms_mutex);
 			/* Compute a list of the supported codecs for the summary */
 			char audio_codecs[100], video_codecs[100];
@@ -2225,16 +3169,36 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 
 	g_atomic_int_set(&initialized, 1);
 
-	/* Launch the thread that will handle incoming messages */
-	error = NULL;
-	handler_thread = g_thread_try_new("videoroom handler", janus_videoroom_handler, NULL, &error);
-	if(error != NULL) {
-		g_atomic_int_set(&initialized, 0);
-		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the VideoRoom handler thread...\n",
-			error->code, error->message ? error->message : "??");
-		janus_config_destroy(config);
-		return -1;
+	/* Launch the threads that will handle incoming messages */
+	handlers = g_malloc0(handlers_num * sizeof(janus_videoroom_handler_thread));
+	guint i = 0;
+	for(i=0; i<handlers_num; i++)
+		handlers[i].messages = g_async_queue_new_full((GDestroyNotify) janus_videoroom_message_free);
+	for(i=0; i<handlers_num; i++) {
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "videoroom hnd %u", i);
+		error = NULL;
+		handlers[i].thread = g_thread_try_new(tname, janus_videoroom_handler, &handlers[i], &error);
+		if(error != NULL) {
+			g_atomic_int_set(&initialized, 0);
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the VideoRoom handler thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			/* Stop the threads we launched already */
+			guint j = 0;
+			for(j=0; j<i; j++) {
+				g_async_queue_push(handlers[j].messages, &exit_message);
+				g_thread_join(handlers[j].thread);
+			}
+			for(j=0; j<handlers_num; j++)
+				g_async_queue_unref(handlers[j].messages);
+			g_free(handlers);
+			handlers = NULL;
+			janus_config_destroy(config);
+			return -1;
+		}
 	}
+	JANUS_LOG(LOG_VERB, "Using %u threads to handle asynchronous requests\n", handlers_num);
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_VIDEOROOM_NAME);
 	return 0;
 }
@@ -2244,10 +3208,14 @@ void janus_videoroom_destroy(void) {
 		return;
 	g_atomic_int_set(&stopping, 1);
 
-	g_async_queue_push(messages, &exit_message);
-	if(handler_thread != NULL) {
-		g_thread_join(handler_thread);
-		handler_thread = NULL;
+	guint i = 0;
+	for(i=0; i<handlers_num; i++)
+		g_async_queue_push(handlers[i].messages, &exit_message);
+	for(i=0; i<handlers_num; i++) {
+		if(handlers[i].thread != NULL) {
+			g_thread_join(handlers[i].thread);
+			handlers[i].thread = NULL;
+		}
 	}
 	if(rtcpfwd_thread != NULL) {
 		if(g_main_loop_is_running(rtcpfwd_loop)) {
@@ -2267,10 +3235,16 @@ void janus_videoroom_destroy(void) {
 	janus_mutex_lock(&rooms_mutex);
 	g_hash_table_destroy(rooms);
 	rooms = NULL;
+	if(rooms_list)
+		json_decref(rooms_list);
+	rooms_list = NULL;
+	rooms_list_changed = TRUE;
 	janus_mutex_unlock(&rooms_mutex);
 
-	g_async_queue_unref(messages);
-	messages = NULL;
+	for(i=0; i<handlers_num; i++)
+		g_async_queue_unref(handlers[i].messages);
+	g_free(handlers);
+	handlers = NULL;
 
 	janus_config_destroy(config);
 	g_free(admin_key);
@@ -2357,10 +3331,93 @@ static janus_videoroom_publisher *janus_videoroom_session_get_publisher_nodebug(
 	return publisher;
 }
 
+/* Cached lists for the list and listparticipants requests: both are only
+ * rebuilt when something changed, and are sorted by ID so that they can be
+ * paginated. Entries are shared with whoever is using the cache, which means
+ * they must never be modified: a new list is created when needed instead */
+static gint janus_videoroom_compare_ids(gconstpointer a, gconstpointer b) {
+	guint64 first = *((const guint64 *)a), second = *((const guint64 *)b);
+	return first < second ? -1 : (first > second ? 1 : 0);
+}
+
+/* Must be called with the room mutex held: returns a new reference */
+static json_t *janus_videoroom_participants_list(janus_videoroom *room) {
+	if(room->participants_list == NULL || g_atomic_int_compare_and_exchange(&room->participants_changed, 1, 0)) {
+		if(room->participants_list)
+			json_decref(room->participants_list);
+		room->participants_list = json_array();
+		GList *ids = g_list_sort(g_hash_table_get_keys(room->participants), janus_videoroom_compare_ids), *l = ids;
+		while(l) {
+			janus_videoroom_publisher *p = g_hash_table_lookup(room->participants, l->data);
+			l = l->next;
+			json_t *pl = json_object();
+			json_object_set_new(pl, "id", json_integer(p->user_id));
+			if(p->display)
+				json_object_set_new(pl, "display", json_string(p->display));
+			json_object_set_new(pl, "publisher", (p->sdp && p->session->started) ? json_true() : json_false());
+			if((p->sdp && p->session->started)) {
+				if(p->audio_level_extmap_id > 0)
+					json_object_set_new(pl, "talking", p->talking ? json_true() : json_false());
+			}
+			json_array_append_new(room->participants_list, pl);
+		}
+		g_list_free(ids);
+	}
+	return json_incref(room->participants_list);
+}
+
+/* Must be called with rooms_mutex held: returns a new reference */
+static json_t *janus_videoroom_rooms_list(void) {
+	if(rooms_list == NULL || rooms_list_changed) {
+		if(rooms_list)
+			json_decref(rooms_list);
+		rooms_list = json_array();
+		rooms_list_changed = FALSE;
+		GList *ids = g_list_sort(g_hash_table_get_keys(rooms), janus_videoroom_compare_ids), *l = ids;
+		while(l) {
+			janus_videoroom *room = g_hash_table_lookup(rooms, l->data);
+			l = l->next;
+			if(room->is_private || g_atomic_int_get(&room->destroyed))
+				continue;
+			json_t *rl = json_object();
+			json_object_set_new(rl, "room", json_integer(room->room_id));
+			json_object_set_new(rl, "description", json_string(room->room_name));
+			json_object_set_new(rl, "pin_required", room->room_pin ? json_true() : json_false());
+			json_object_set_new(rl, "max_publishers", json_integer(room->max_publishers));
+			json_object_set_new(rl, "bitrate", json_integer(room->bitrate));
+			if(room->bitrate_cap)
+				json_object_set_new(rl, "bitrate_cap", json_true());
+			json_object_set_new(rl, "fir_freq", json_integer(room->fir_freq));
+			json_object_set_new(rl, "fir_min_interval", json_integer(room->fir_min_interval));
+			json_object_set_new(rl, "require_pvtid", room->require_pvtid ? json_true() : json_false());
+			json_object_set_new(rl, "notify_joining", room->notify_joining ? json_true() : json_false());
+			json_object_set_new(rl, "gop_cache", room->gop_cache ? json_true() : json_false());
+			json_object_set_new(rl, "last_n", json_integer(room->last_n));
+			json_object_set_new(rl, "notify_window", json_integer(room->notify_window));
+			char audio_codecs[100];
+			char video_codecs[100];
+			janus_videoroom_codecstr(room, audio_codecs, video_codecs, sizeof(audio_codecs), ",");
+			json_object_set_new(rl, "audiocodec", json_string(audio_codecs));
+			json_object_set_new(rl, "videocodec", json_string(video_codecs));
+			if(room->do_opusfec)
+				json_object_set_new(rl, "opus_fec", json_true());
+			if(room->do_svc)
+				json_object_set_new(rl, "video_svc", json_true());
+			json_object_set_new(rl, "record", room->record ? json_true() : json_false());
+			json_object_set_new(rl, "rec_dir", json_string(room->rec_dir));
+			json_array_append_new(rooms_list, rl);
+		}
+		g_list_free(ids);
+	}
+	return json_incref(rooms_list);
+}
+
 static void janus_videoroom_notify_participants(janus_videoroom_publisher *participant, json_t *msg) {
 	/* participant->room->mutex has to be locked. */
 	if(participant->room == NULL)
 		return;
+	/* Whatever we notify participants about affects the list of participants too */
+	janus_videoroom_participants_changed(participant->room);
 	GHashTableIter iter;
 	gpointer value;
 	g_hash_table_iter_init(&iter, participant->room->participants);
@@ -2388,7 +3445,8 @@ static void janus_videoroom_participant_joining(janus_videoroom_publisher *p) {
 		json_object_set_new(event, "videoroom", json_string("event"));
 		json_object_set_new(event, "room", json_integer(p->room_id));
 		json_object_set_new(event, "joining", user);
-		janus_videoroom_notify_participants(p, event);
+		if(!janus_videoroom_notification_add(p, "joining", user))
+			janus_videoroom_notify_participants(p, event);
 		/* user gets deref-ed by the owner event */
 		json_decref(event);
 	}
@@ -2418,9 +3476,10 @@ static void janus_videoroom_leave_or_unpublish(janus_videoroom_publisher *partic
 	json_t *event = json_object();
 	json_object_set_new(event, "videoroom", json_string("event"));
 	json_object_set_new(event, "room", json_integer(participant->room_id));
-	json_object_set_new(event, is_leaving ? (kicked ? "kicked" : "leaving") : "unpublished",
-		json_integer(participant->user_id));
-	janus_videoroom_notify_participants(participant, event);
+	const char *type = is_leaving ? (kicked ? "kicked" : "leaving") : "unpublished";
+	json_object_set_new(event, type, json_integer(participant->user_id));
+	if(!janus_videoroom_notification_add(participant, type, json_object_get(event, type)))
+		janus_videoroom_notify_participants(participant, event);
 	/* Also notify event handlers */
 	if(notify_events && gateway->events_is_enabled()) {
 		json_t *info = json_object();
@@ -2532,6 +3591,10 @@ json_t *janus_videoroom_query_session(janus_plugin_session *handle) {
 				json_object_set_new(info, "bitrate", json_integer(participant->bitrate));
 				if(participant->ssrc[0] != 0 || participant->rid[0] != NULL)
 					json_object_set_new(info, "simulcast", json_true());
+				json_t *kf = json_object();
+				json_object_set_new(kf, "forwarded", json_integer(g_atomic_int_get(&participant->kf_forwarded)));
+				json_object_set_new(kf, "suppressed", json_integer(g_atomic_int_get(&participant->kf_suppressed)));
+				json_object_set_new(info, "keyframe_requests", kf);
 				if(participant->arc || participant->vrc || participant->drc) {
 					json_t *recording = json_object();
 					if(participant->arc && participant->arc->filename)
@@ -2561,6 +3624,8 @@ json_t *janus_videoroom_query_session(janus_plugin_session *handle) {
 					if(feed->display)
 						json_object_set_new(info, "feed_display", json_string(feed->display));
 				}
+				if(participant->last_n_slot != -1)
+					json_object_set_new(info, "last_n_slot", json_integer(participant->last_n_slot));
 				json_t *media = json_object();
 				json_object_set_new(media, "audio", participant->audio ? json_true() : json_false());
 				json_object_set_new(media, "audio-offered", participant->audio_offered ? json_true() : json_false());
@@ -2575,6 +3640,14 @@ json_t *janus_videoroom_query_session(janus_plugin_session *handle) {
 					json_object_set_new(simulcast, "substream-target", json_integer(participant->sim_context.substream_target));
 					json_object_set_new(simulcast, "temporal-layer", json_integer(participant->sim_context.templayer));
 					json_object_set_new(simulcast, "temporal-layer-target", json_integer(participant->sim_context.templayer_target));
+					if(participant->bwe_enabled) {
+						json_t *bwe = json_object();
+						json_object_set_new(bwe, "estimate", json_integer(participant->bwe.estimate));
+						if(participant->bwe.remb > 0)
+							json_object_set_new(bwe, "remb", json_integer(participant->bwe.remb));
+						json_object_set_new(bwe, "fraction-lost", json_integer(participant->bwe.fraction_lost));
+						json_object_set_new(simulcast, "auto", bwe);
+					}
 					json_object_set_new(info, "simulcast", simulcast);
 				}
 				if(participant->room && participant->room->do_svc) {
@@ -2682,6 +3755,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		json_t *bitrate = json_object_get(root, "bitrate");
 		json_t *bitrate_cap = json_object_get(root, "bitrate_cap");
 		json_t *fir_freq = json_object_get(root, "fir_freq");
+		json_t *fir_min_interval = json_object_get(root, "fir_min_interval");
 		json_t *publishers = json_object_get(root, "publishers");
 		json_t *allowed = json_object_get(root, "allowed");
 		json_t *audiocodec = json_object_get(root, "audiocodec");
@@ -2740,6 +3814,9 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		json_t *playoutdelay_ext = json_object_get(root, "playoutdelay_ext");
 		json_t *transport_wide_cc_ext = json_object_get(root, "transport_wide_cc_ext");
 		json_t *notify_joining = json_object_get(root, "notify_joining");
+		json_t *gop_cache = json_object_get(root, "gop_cache");
+		json_t *last_n = json_object_get(root, "last_n");
+		json_t *notify_window = json_object_get(root, "notify_window");
 		json_t *record = json_object_get(root, "record");
 		json_t *rec_dir = json_object_get(root, "rec_dir");
 		json_t *permanent = json_object_get(root, "permanent");
@@ -2832,6 +3909,9 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		videoroom->fir_freq = 0;
 		if(fir_freq)
 			videoroom->fir_freq = json_integer_value(fir_freq);
+		videoroom->fir_min_interval = 0;
+		if(fir_min_interval)
+			videoroom->fir_min_interval = json_integer_value(fir_min_interval);
 		/* By default, we force Opus as the only audio codec */
 		videoroom->acodec[0] = JANUS_AUDIOCODEC_OPUS;
 		videoroom->acodec[1] = JANUS_AUDIOCODEC_NONE;
@@ -2920,6 +4000,16 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		/* By default, the videoroom plugin does not notify about participants simply joining the room.
 		   It only notifies when the participant actually starts publishing media. */
 		videoroom->notify_joining = notify_joining ? json_is_true(notify_joining) : FALSE;
+		videoroom->gop_cache = gop_cache ? json_is_true(gop_cache) : FALSE;
+		if(videoroom->gop_cache && videoroom->do_svc) {
+			JANUS_LOG(LOG_WARN, "GOP cache not supported with VP9 SVC, disabling it for room %"SCNu64"\n", videoroom->room_id);
+			videoroom->gop_cache = FALSE;
+		}
+		if(json_integer_value(last_n) > 0) {
+			videoroom->last_n = json_integer_value(last_n);
+			videoroom->last_n_slots = g_malloc0(videoroom->last_n * sizeof(guint64));
+		}
+		videoroom->notify_window = json_integer_value(notify_window);
 		if(record) {
 			videoroom->record = json_is_true(record);
 		}
@@ -2982,6 +4072,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				g_snprintf(value, BUFSIZ, "%"SCNu16, videoroom->fir_freq);
 				janus_config_add(config, c, janus_config_item_create("fir_freq", value));
 			}
+			if(videoroom->fir_min_interval) {
+				g_snprintf(value, BUFSIZ, "%"SCNu16, videoroom->fir_min_interval);
+				janus_config_add(config, c, janus_config_item_create("fir_min_interval", value));
+			}
 			char video_codecs[100];
 			char audio_codecs[100];
 			janus_videoroom_codecstr(videoroom, audio_codecs, video_codecs, sizeof(audio_codecs), ",");
@@ -3015,6 +4109,16 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			janus_config_add(config, c, janus_config_item_create("transport_wide_cc_ext", videoroom->transport_wide_cc_ext ? "yes" : "no"));
 			if(videoroom->notify_joining)
 				janus_config_add(config, c, janus_config_item_create("notify_joining", "yes"));
+			if(videoroom->gop_cache)
+				janus_config_add(config, c, janus_config_item_create("gop_cache", "yes"));
+			if(videoroom->last_n > 0) {
+				g_snprintf(value, BUFSIZ, "%d", videoroom->last_n);
+				janus_config_add(config, c, janus_config_item_create("last_n", value));
+			}
+			if(videoroom->notify_window > 0) {
+				g_snprintf(value, BUFSIZ, "%u", videoroom->notify_window);
+				janus_config_add(config, c, janus_config_item_create("notify_window", value));
+			}
 			if(videoroom->record)
 				janus_config_add(config, c, janus_config_item_create("record", "yes"));
 			if(videoroom->rec_dir)
@@ -3026,6 +4130,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		}
 
 		g_hash_table_insert(rooms, janus_uint64_dup(videoroom->room_id), videoroom);
+		rooms_list_changed = TRUE;
 		/* Show updated rooms list */
 		GHashTableIter iter;
 		gpointer value;
@@ -3064,6 +4169,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		json_t *pin = json_object_get(root, "new_pin");
 		json_t *bitrate = json_object_get(root, "new_bitrate");
 		json_t *fir_freq = json_object_get(root, "new_fir_freq");
+		json_t *fir_min_interval = json_object_get(root, "new_fir_min_interval");
 		json_t *publishers = json_object_get(root, "new_publishers");
 		json_t *permanent = json_object_get(root, "permanent");
 		gboolean save = permanent ? json_is_true(permanent) : FALSE;
@@ -3100,6 +4206,8 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		}
 		if(fir_freq)
 			videoroom->fir_freq = json_integer_value(fir_freq);
+		if(fir_min_interval)
+			videoroom->fir_min_interval = json_integer_value(fir_min_interval);
 		if(secret && strlen(json_string_value(secret)) > 0) {
 			char *old_secret = videoroom->room_secret;
 			char *new_secret = g_strdup(json_string_value(secret));
@@ -3139,6 +4247,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				g_snprintf(value, BUFSIZ, "%"SCNu16, videoroom->fir_freq);
 				janus_config_add(config, c, janus_config_item_create("fir_freq", value));
 			}
+			if(videoroom->fir_min_interval) {
+				g_snprintf(value, BUFSIZ, "%"SCNu16, videoroom->fir_min_interval);
+				janus_config_add(config, c, janus_config_item_create("fir_min_interval", value));
+			}
 			char audio_codecs[100];
 			char video_codecs[100];
 			janus_videoroom_codecstr(videoroom, audio_codecs, video_codecs, sizeof(audio_codecs), ",");
@@ -3172,6 +4284,16 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			janus_config_add(config, c, janus_config_item_create("transport_wide_cc_ext", videoroom->transport_wide_cc_ext ? "yes" : "no"));
 			if(videoroom->notify_joining)
 				janus_config_add(config, c, janus_config_item_create("notify_joining", "yes"));
+			if(videoroom->gop_cache)
+				janus_config_add(config, c, janus_config_item_create("gop_cache", "yes"));
+			if(videoroom->last_n > 0) {
+				g_snprintf(value, BUFSIZ, "%d", videoroom->last_n);
+				janus_config_add(config, c, janus_config_item_create("last_n", value));
+			}
+			if(videoroom->notify_window > 0) {
+				g_snprintf(value, BUFSIZ, "%u", videoroom->notify_window);
+				janus_config_add(config, c, janus_config_item_create("notify_window", value));
+			}
 			if(videoroom->record)
 				janus_config_add(config, c, janus_config_item_create("record", "yes"));
 			if(videoroom->rec_dir)
@@ -3181,6 +4303,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				save = FALSE;	/* This will notify the user the room changes are not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
+		rooms_list_changed = TRUE;
 		janus_mutex_unlock(&rooms_mutex);
 		/* Send info back */
 		response = json_object();
@@ -3222,6 +4345,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		/* Remove room, but add a reference until we're done */
 		janus_refcount_increase(&videoroom->ref);
 		g_hash_table_remove(rooms, &room_id);
+		rooms_list_changed = TRUE;
 		/* Notify all participants that the fun is over, and that they'll be kicked */
 		JANUS_LOG(LOG_VERB, "Notifying all participants\n");
 		json_t *destroyed = json_object();
@@ -3275,55 +4399,40 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "list")) {
 		/* List all rooms (but private ones) and their details (except for the secret, of course...) */
+		JANUS_VALIDATE_JSON_OBJECT(root, list_parameters,
+			error_code, error_cause, TRUE,
+			JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT);
+		if(error_code != 0)
+			goto prepare_response;
+		size_t offset = json_integer_value(json_object_get(root, "offset"));
+		size_t limit = json_integer_value(json_object_get(root, "limit"));
 		json_t *list = json_array();
 		JANUS_LOG(LOG_VERB, "Getting the list of video rooms\n");
 		janus_mutex_lock(&rooms_mutex);
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, rooms);
-		while(g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_videoroom *room = value;
-			if(!room)
-				continue;
-			janus_refcount_increase(&room->ref);
-			if(room->is_private) {
-				/* Skip private room */
-				JANUS_LOG(LOG_VERB, "Skipping private room '%s'\n", room->room_name);
-				janus_refcount_decrease(&room->ref);
+		/* The static properties come from the cached list, we only add the dynamic ones */
+		json_t *cached = janus_videoroom_rooms_list();
+		size_t i = 0, total = json_array_size(cached);
+		for(i=offset; i<total && (limit == 0 || json_array_size(list) < limit); i++) {
+			json_t *rl = json_array_get(cached, i);
+			guint64 room_id = json_integer_value(json_object_get(rl, "room"));
+			janus_videoroom *room = g_hash_table_lookup(rooms, &room_id);
+			if(room == NULL || g_atomic_int_get(&room->destroyed))
 				continue;
-			}
-			if(!g_atomic_int_get(&room->destroyed)) {
-				json_t *rl = json_object();
-				json_object_set_new(rl, "room", json_integer(room->room_id));
-				json_object_set_new(rl, "description", json_string(room->room_name));
-				json_object_set_new(rl, "pin_required", room->room_pin ? json_true() : json_false());
-				json_object_set_new(rl, "max_publishers", json_integer(room->max_publishers));
-				json_object_set_new(rl, "bitrate", json_integer(room->bitrate));
-				if(room->bitrate_cap)
-					json_object_set_new(rl, "bitrate_cap", json_true());
-				json_object_set_new(rl, "fir_freq", json_integer(room->fir_freq));
-				json_object_set_new(rl, "require_pvtid", room->require_pvtid ? json_true() : json_false());
-				json_object_set_new(rl, "notify_joining", room->notify_joining ? json_true() : json_false());
-				char audio_codecs[100];
-				char video_codecs[100];
-				janus_videoroom_codecstr(room, audio_codecs, video_codecs, sizeof(audio_codecs), ",");
-				json_object_set_new(rl, "audiocodec", json_string(audio_codecs));
-				json_object_set_new(rl, "videocodec", json_string(video_codecs));
-				if(room->do_opusfec)
-					json_object_set_new(rl, "opus_fec", json_true());
-				if(room->do_svc)
-					json_object_set_new(rl, "video_svc", json_true());
-				json_object_set_new(rl, "record", room->record ? json_true() : json_false());
-				json_object_set_new(rl, "rec_dir", json_string(room->rec_dir));
-				/* TODO: Should we list participants as well? or should there be a separate API call on a specific room for this? */
-				json_object_set_new(rl, "num_participants", json_integer(g_hash_table_size(room->participants)));
-				json_array_append_new(list, rl);
-			}
-			janus_refcount_decrease(&room->ref);
+			rl = json_copy(rl);
+			json_t *ql = json_object();
+			json_object_set_new(ql, "average", json_integer(room->queue_latency));
+			json_object_set_new(ql, "max", json_integer(room->queue_latency_max));
+			json_object_set_new(ql, "requests", json_integer(room->queue_requests));
+			json_object_set_new(rl, "queue_latency", ql);
+			/* TODO: Should we list participants as well? or should there be a separate API call on a specific room for this? */
+			json_object_set_new(rl, "num_participants", json_integer(g_hash_table_size(room->participants)));
+			json_array_append_new(list, rl);
 		}
 		janus_mutex_unlock(&rooms_mutex);
+		json_decref(cached);
 		response = json_object();
 		json_object_set_new(response, "videoroom", json_string("success"));
+		json_object_set_new(response, "total", json_integer(total));
 		json_object_set_new(response, "list", list);
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "rtp_forward")) {
@@ -3913,7 +5022,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "listparticipants")) {
 		/* List all participants in a room, specifying whether they're publishers or just attendees */
-		JANUS_VALIDATE_JSON_OBJECT(root, room_parameters,
+		JANUS_VALIDATE_JSON_OBJECT(root, listparticipants_parameters,
 			error_code, error_cause, TRUE,
 			JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT);
 		if(error_code != 0)
@@ -3927,30 +5036,30 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		if(error_code != 0)
 			goto prepare_response;
 		janus_refcount_increase(&videoroom->ref);
-		/* Return a list of all participants (whether they're publishing or not) */
-		json_t *list = json_array();
-		GHashTableIter iter;
-		gpointer value;
+		gboolean publishers_only = json_is_true(json_object_get(root, "publishers_only"));
+		size_t offset = json_integer_value(json_object_get(root, "offset"));
+		size_t limit = json_integer_value(json_object_get(root, "limit"));
+		/* Get the cached list of all participants (whether they're publishing or not):
+		 * we only hold the room mutex as long as needed to rebuild it, if anything changed */
 		janus_mutex_lock(&videoroom->mutex);
-		g_hash_table_iter_init(&iter, videoroom->participants);
-		while (!g_atomic_int_get(&videoroom->destroyed) && g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_videoroom_publisher *p = value;
-			json_t *pl = json_object();
-			json_object_set_new(pl, "id", json_integer(p->user_id));
-			if(p->display)
-				json_object_set_new(pl, "display", json_string(p->display));
-			json_object_set_new(pl, "publisher", (p->sdp && p->session->started) ? json_true() : json_false());
-			if((p->sdp && p->session->started)) {
-				if(p->audio_level_extmap_id > 0)
-					json_object_set_new(pl, "talking", p->talking ? json_true() : json_false());
-			}
-			json_array_append_new(list, pl);
-		}
+		json_t *cached = janus_videoroom_participants_list(videoroom);
 		janus_mutex_unlock(&videoroom->mutex);
 		janus_refcount_decrease(&videoroom->ref);
+		json_t *list = json_array();
+		size_t i = 0, total = 0;
+		for(i=0; i<json_array_size(cached); i++) {
+			json_t *pl = json_array_get(cached, i);
+			if(publishers_only && !json_is_true(json_object_get(pl, "publisher")))
+				continue;
+			if(total >= offset && (limit == 0 || json_array_size(list) < limit))
+				json_array_append(list, pl);
+			total++;
+		}
+		json_decref(cached);
 		response = json_object();
 		json_object_set_new(response, "videoroom", json_string("participants"));
 		json_object_set_new(response, "room", json_integer(room_id));
+		json_object_set_new(response, "total", json_integer(total));
 		json_object_set_new(response, "participants", list);
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "listforwarders")) {
@@ -4048,6 +5157,9 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				}
 				if(rpv->is_srtp)
 					json_object_set_new(fl, "srtp", json_true());
+				json_object_set_new(fl, "packets", json_integer(rpv->packets));
+				json_object_set_new(fl, "bytes", json_integer(rpv->bytes));
+				json_object_set_new(fl, "errors", json_integer(rpv->errors));
 				json_array_append_new(flist, fl);
 			}
 			janus_mutex_unlock(&p->rtp_forwarders_mutex);
@@ -4151,7 +5263,7 @@ struct janus_plugin_result *janus_videoroom_handle_message(janus_plugin_session
 		msg->transaction = transaction;
 		msg->message = root;
 		msg->jsep = jsep;
-		g_async_queue_push(messages, msg);
+		janus_videoroom_message_enqueue(session, msg);
 
 		return janus_plugin_result_new(JANUS_PLUGIN_OK_WAIT, NULL, NULL);
 	} else {
@@ -4268,7 +5380,10 @@ void janus_videoroom_setup_media(janus_plugin_session *handle) {
 			json_object_set_new(pub, "publishers", list);
 			if (participant->room) {
 				janus_mutex_lock(&participant->room->mutex);
-				janus_videoroom_notify_participants(participant, pub);
+				if(!janus_videoroom_notification_add(participant, "publishers", pl))
+					janus_videoroom_notify_participants(participant, pub);
+				if(participant->room->last_n > 0)
+					janus_videoroom_last_n_published(participant->room, participant);
 				janus_mutex_unlock(&participant->room->mutex);
 			}
 			json_decref(pub);
@@ -4286,7 +5401,8 @@ void janus_videoroom_setup_media(janus_plugin_session *handle) {
 			if(s && s->feed) {
 				janus_videoroom_publisher *p = s->feed;
 				if(p && p->session) {
-					janus_videoroom_reqfir(p, "New subscriber available");
+					if(!janus_videoroom_gop_request(p, s))
+						janus_videoroom_reqfir(p, "New subscriber available");
 					/* Also notify event handlers */
 					if(notify_events && gateway->events_is_enabled()) {
 						json_t *info = json_object();
@@ -4318,7 +5434,7 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 	janus_videoroom *videoroom = participant->room;
 
 	/* In case this is an audio packet and we're doing talk detection, check the audio level extension */
-	if(!video && videoroom->audiolevel_event && participant->audio_active) {
+	if(!video && (videoroom->audiolevel_event || videoroom->last_n > 0) && participant->audio_active) {
 		int level = 0;
 		if(janus_rtp_header_extension_parse_audio_level(buf, len, participant->audio_level_extmap_id, &level) == 0) {
 			participant->audio_dBov_sum += level;
@@ -4341,7 +5457,14 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 				participant->audio_active_packets = 0;
 				participant->audio_dBov_sum = 0;
 				/* Only notify in case of state changes */
-				if(notify_talk_event) {
+				if(notify_talk_event && !videoroom->audiolevel_event) {
+					/* We're only doing talk detection for the active speaker slots */
+					janus_videoroom_participants_changed(videoroom);
+					if(participant->talking)
+						janus_videoroom_last_n_schedule(videoroom, participant);
+				} else if(notify_talk_event) {
+					if(videoroom->last_n > 0 && participant->talking)
+						janus_videoroom_last_n_schedule(videoroom, participant);
 					janus_mutex_lock(&videoroom->mutex);
 					json_t *event = json_object();
 					json_object_set_new(event, "videoroom", json_string(participant->talking ? "talking" : "stopped-talking"));
@@ -4368,30 +5491,16 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 	if((!video && participant->audio_active) || (video && participant->video_active)) {
 		janus_rtp_header *rtp = (janus_rtp_header *)buf;
 		int sc = video ? 0 : -1;
-		/* Check if we're simulcasting, and if so, keep track of the "layer" */
+		/* Check if we're simulcasting, and if so, keep track of the "layer": we parse
+		 * all the simulcast related info here once, so that forwarders, recorder and
+		 * subscribers only need to take their decisions on the result */
+		janus_rtp_simulcasting_packet simulcast_packet, *simulcast = NULL;
 		if(video && (participant->ssrc[0] != 0 || participant->rid[0] != NULL)) {
-			uint32_t ssrc = ntohl(rtp->ssrc);
-			if(ssrc == participant->ssrc[0])
-				sc = 0;
-			else if(ssrc == participant->ssrc[1])
-				sc = 1;
-			else if(ssrc == participant->ssrc[2])
-				sc = 2;
-			else if(participant->rid_extmap_id > 0) {
-				/* We may not know the SSRC yet, try the rid RTP extension */
-				char sdes_item[16];
-				if(janus_rtp_header_extension_parse_rid(buf, len, participant->rid_extmap_id, sdes_item, sizeof(sdes_item)) == 0) {
-					if(participant->rid[2] != NULL && !strcmp(participant->rid[2], sdes_item)) {
-						participant->ssrc[0] = ssrc;
-						sc = 0;
-					} else if(participant->rid[1] != NULL && !strcmp(participant->rid[1], sdes_item)) {
-						participant->ssrc[1] = ssrc;
-						sc = 1;
-					} else if(participant->rid[0] != NULL && !strcmp(participant->rid[0], sdes_item)) {
-						participant->ssrc[2] = ssrc;
-						sc = 2;
-					}
-				}
+			if(janus_rtp_simulcasting_packet_parse(&simulcast_packet, buf, len, participant->ssrc, participant->rid,
+					participant->rid_extmap_id, participant->framemarking_ext_id, participant->vcodec) == 0) {
+				simulcast = &simulcast_packet;
+				sc = simulcast->substream;
+				janus_rtp_simulcasting_bitrates_update(&participant->sc_bitrates, sc, len);
 			}
 		}
 		/* Forward RTP to the appropriate port for the rtp_forwarders associated with this publisher, if there are any */
@@ -4405,6 +5514,9 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 				srtp_ctx->slen = 0;
 			}
 		}
+		janus_videoroom_forwarders_batch batch;
+		batch.fd = participant->udp_sock;
+		batch.count = 0;
 		GHashTableIter iter;
 		gpointer value;
 		g_hash_table_iter_init(&iter, participant->rtp_forwarders);
@@ -4422,8 +5534,8 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 				continue;
 			} else if(video && rtp_forward->simulcast) {
 				/* This is video and we're simulcasting, check if we need to forward this frame */
-				if(!janus_rtp_simulcasting_context_process_rtp(&rtp_forward->sim_context,
-						buf, len, participant->ssrc, participant->rid, participant->vcodec, &rtp_forward->context))
+				if(!janus_rtp_simulcasting_context_process_packet(&rtp_forward->sim_context,
+						simulcast, &rtp_forward->context))
 					continue;
 				janus_rtp_header_update(rtp, &rtp_forward->context, TRUE, 4500);
 				/* By default we use a fixed SSRC (it may be overwritten later) */
@@ -4436,14 +5548,8 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 				rtp->ssrc = htonl(rtp_forward->ssrc);
 			/* Check if this is an RTP or SRTP forwarder */
 			if(!rtp_forward->is_srtp) {
-				/* Plain RTP */
-				struct sockaddr *address = (rtp_forward->serv_addr.sin_family == AF_INET ?
-					(struct sockaddr *)&rtp_forward->serv_addr : (struct sockaddr *)&rtp_forward->serv_addr6);
-				size_t addrlen = (rtp_forward->serv_addr.sin_family == AF_INET ? sizeof(rtp_forward->serv_addr) : sizeof(rtp_forward->serv_addr6));
-				if(sendto(participant->udp_sock, buf, len, 0, address, addrlen) < 0) {
-					JANUS_LOG(LOG_HUGE, "Error forwarding RTP %s packet for %s... %s (len=%d)...\n",
-						(video ? "video" : "audio"), participant->display, strerror(errno), len);
-				}
+				/* Plain RTP: queue a copy of the updated header, the payload is shared */
+				janus_videoroom_forwarders_batch_add(&batch, rtp_forward, rtp, buf, len);
 			} else {
 				/* SRTP: check if we already encrypted the packet before */
 				if(rtp_forward->srtp_ctx->slen == 0) {
@@ -4461,13 +5567,11 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 					}
 				}
 				if(rtp_forward->srtp_ctx->slen > 0) {
-					struct sockaddr *address = (rtp_forward->serv_addr.sin_family == AF_INET ?
-						(struct sockaddr *)&rtp_forward->serv_addr : (struct sockaddr *)&rtp_forward->serv_addr6);
-					size_t addrlen = (rtp_forward->serv_addr.sin_family == AF_INET ? sizeof(rtp_forward->serv_addr) : sizeof(rtp_forward->serv_addr6));
-					if(sendto(participant->udp_sock, rtp_forward->srtp_ctx->sbuf, rtp_forward->srtp_ctx->slen, 0, address, addrlen) < 0) {
-						JANUS_LOG(LOG_HUGE, "Error forwarding SRTP %s packet for %s... %s (len=%d)...\n",
-							(video ? "video" : "audio"), participant->display, strerror(errno), rtp_forward->srtp_ctx->slen);
-					}
+					/* The encrypted packet stays available until the next one, so we can queue it as it is */
+					janus_videoroom_forwarders_batch_add(&batch, rtp_forward, NULL,
+						rtp_forward->srtp_ctx->sbuf, rtp_forward->srtp_ctx->slen);
+				} else {
+					rtp_forward->errors++;
 				}
 			}
 			/* Restore original values of payload type and SSRC before going on */
@@ -4476,6 +5580,8 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 			rtp->timestamp = htonl(timestamp);
 			rtp->seq_number = htons(seq_number);
 		}
+		/* Send whatever we queued for the forwarders */
+		janus_videoroom_forwarders_batch_flush(&batch);
 		janus_mutex_unlock(&participant->rtp_forwarders_mutex);
 		/* Set the payload type of the publisher */
 		rtp->type = video ? participant->video_pt : participant->audio_pt;
@@ -4484,8 +5590,8 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 			janus_recorder_save_frame(video ? participant->vrc : participant->arc, buf, len);
 		} else {
 			/* We're simulcasting, save the best video quality */
-			gboolean save = janus_rtp_simulcasting_context_process_rtp(&participant->rec_simctx,
-				buf, len, participant->ssrc, participant->rid, participant->vcodec, &participant->rec_ctx);
+			gboolean save = janus_rtp_simulcasting_context_process_packet(&participant->rec_simctx,
+				simulcast, &participant->rec_ctx);
 			if(save) {
 				uint32_t seq_number = ntohs(rtp->seq_number);
 				uint32_t timestamp = ntohl(rtp->timestamp);
@@ -4505,6 +5611,7 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 		packet.data = rtp;
 		packet.length = len;
 		packet.is_video = video;
+		packet.simulcast = simulcast;
 		packet.svc = FALSE;
 		if(video && videoroom->do_svc) {
 			/* We're doing SVC: let's parse this packet to see which layers are there */
@@ -4533,10 +5640,60 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 		/* Backup the actual timestamp and sequence number set by the publisher, in case switching is involved */
 		packet.timestamp = ntohl(packet.data->timestamp);
 		packet.seq_number = ntohs(packet.data->seq_number);
+		/* Check if this is a keyframe, in case the GOP cache or the media bridge need to know */
+		gboolean gop_cache = (video && videoroom->gop_cache && sc >= 0 && sc < 3);
+		gboolean bridge = janus_media_bridge_source_has_sinks(participant->bridge);
+		gboolean keyframe = FALSE;
+		if(simulcast != NULL) {
+			keyframe = simulcast->keyframe;
+		} else if(video && (gop_cache || bridge || videoroom->fir_min_interval > 0)) {
+			int plen = 0;
+			char *payload = janus_rtp_payload(buf, len, &plen);
+			if(payload != NULL) {
+				if(participant->vcodec == JANUS_VIDEOCODEC_VP8)
+					keyframe = janus_vp8_is_keyframe(payload, plen);
+				else if(participant->vcodec == JANUS_VIDEOCODEC_VP9)
+					keyframe = janus_vp9_is_keyframe(payload, plen);
+				else if(participant->vcodec == JANUS_VIDEOCODEC_H264)
+					keyframe = janus_h264_is_keyframe(payload, plen);
+			}
+		}
 		/* Go: some viewers may decide to drop the packet, but that's up to them */
-		janus_mutex_lock_nodebug(&participant->subscribers_mutex);
-		g_slist_foreach(participant->subscribers, janus_videoroom_relay_rtp_packet, &packet);
-		janus_mutex_unlock_nodebug(&participant->subscribers_mutex);
+		gint epoch = 0;
+		janus_videoroom_subscribers_snapshot *snapshot = janus_videoroom_subscribers_read_lock(participant, &epoch);
+		if(snapshot != NULL) {
+			guint i = 0;
+			for(i=0; i<snapshot->count; i++) {
+				janus_videoroom_subscriber *s = snapshot->subscribers[i];
+				/* Skip subscribers that left or switched to another feed in the meanwhile */
+				if(s->feed != participant)
+					continue;
+				/* New subscribers waiting for the cached GOP get it before this packet */
+				if(video && g_atomic_int_get(&s->gop_pending))
+					janus_videoroom_gop_replay(participant, s);
+				janus_videoroom_relay_rtp_packet(s, &packet);
+			}
+		}
+		janus_videoroom_subscribers_read_unlock(participant, epoch);
+		/* Any plugin receiving this publisher via the media bridge? */
+		if(bridge) {
+			janus_media_bridge_packet bpkt;
+			bpkt.buffer = buf;
+			bpkt.length = len;
+			bpkt.video = video;
+			bpkt.substream = (sc != -1 ? sc : 0);
+			bpkt.keyframe = keyframe;
+			janus_media_bridge_source_relay(participant->bridge, &bpkt);
+		}
+		/* Update the GOP cache, now that subscribers got the packet */
+		if(gop_cache)
+			janus_rtp_gop_cache_add(&participant->gop[sc], buf, len, keyframe);
+		/* Keep track of the keyframes we get, and send any keyframe request we coalesced */
+		if(video && videoroom->fir_min_interval > 0) {
+			if(keyframe)
+				janus_videoroom_keyframe_received(participant, sc);
+			janus_videoroom_reqfir_deferred(participant);
+		}
 
 		/* Check if we need to send any REMB, FIR or PLI back to this publisher */
 		if(video && participant->video_active) {
@@ -4614,7 +5771,7 @@ void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, int video, char
 			/* We got a FIR, forward it to the publisher */
 			if(s->feed) {
 				janus_videoroom_publisher *p = s->feed;
-				if(p && p->session) {
+				if(p && p->session && janus_videoroom_keyframe_request_check(p, janus_videoroom_subscriber_substream(s))) {
 					char rtcpbuf[20];
 					janus_rtcp_fir((char *)&rtcpbuf, 20, &p->fir_seq);
 					JANUS_LOG(LOG_VERB, "Got a FIR from a subscriber, forwarding it to %"SCNu64" (%s)\n", p->user_id, p->display ? p->display : "??");
@@ -4628,7 +5785,7 @@ void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, int video, char
 			/* We got a PLI, forward it to the publisher */
 			if(s->feed) {
 				janus_videoroom_publisher *p = s->feed;
-				if(p && p->session) {
+				if(p && p->session && janus_videoroom_keyframe_request_check(p, janus_videoroom_subscriber_substream(s))) {
 					char rtcpbuf[12];
 					janus_rtcp_pli((char *)&rtcpbuf, 12);
 					JANUS_LOG(LOG_VERB, "Got a PLI from a subscriber, forwarding it to %"SCNu64" (%s)\n", p->user_id, p->display ? p->display : "??");
@@ -4638,9 +5795,23 @@ void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, int video, char
 				}
 			}
 		}
-		uint32_t bitrate = janus_rtcp_get_remb(buf, len);
-		if(bitrate > 0) {
-			/* FIXME We got a REMB from this subscriber, should we do something about it? */
+		if(video && s->bwe_enabled && s->feed) {
+			/* Update the bandwidth estimation for this subscriber, and check
+			 * if we need to move it to a different substream or temporal layer */
+			janus_videoroom_publisher *p = s->feed;
+			if(p && p->session && (p->ssrc[0] != 0 || p->rid[0] != NULL) &&
+					janus_rtcp_bwe_context_process(&s->bwe, buf, len)) {
+				int substream_target = s->sim_context.substream_target;
+				if(janus_rtp_simulcasting_context_bwe_update(&s->sim_context, s->bwe.estimate,
+						p->sc_bitrates.bitrate, s->bwe_max_substream, s->bwe_max_templayer)) {
+					JANUS_LOG(LOG_VERB, "Bandwidth estimate for subscriber is %"SCNu32" bps, targets now: substream %d, temporal layer %d\n",
+						s->bwe.estimate, s->sim_context.substream_target, s->sim_context.templayer_target);
+					if(s->sim_context.substream_target != substream_target &&
+							s->sim_context.substream_target != s->sim_context.substream) {
+						janus_videoroom_reqfir_substream(p, s->sim_context.substream_target, "Bandwidth estimation");
+					}
+				}
+			}
 		}
 	}
 }
@@ -4675,6 +5846,10 @@ void janus_videoroom_incoming_data(janus_plugin_session *handle, char *label, ch
 			if(sendto(participant->udp_sock, buf, len, 0, address, addrlen) < 0) {
 				JANUS_LOG(LOG_HUGE, "Error forwarding data packet for %s... %s (len=%d)...\n",
 					participant->display, strerror(errno), len);
+				rtp_forward->errors++;
+			} else {
+				rtp_forward->packets++;
+				rtp_forward->bytes += len;
 			}
 		}
 	}
@@ -4687,9 +5862,17 @@ void janus_videoroom_incoming_data(janus_plugin_session *handle, char *label, ch
 	/* Save the message if we're recording */
 	janus_recorder_save_frame(participant->drc, text, strlen(text));
 	/* Relay to all subscribers */
-	janus_mutex_lock_nodebug(&participant->subscribers_mutex);
-	g_slist_foreach(participant->subscribers, janus_videoroom_relay_data_packet, text);
-	janus_mutex_unlock_nodebug(&participant->subscribers_mutex);
+	gint epoch = 0;
+	janus_videoroom_subscribers_snapshot *snapshot = janus_videoroom_subscribers_read_lock(participant, &epoch);
+	if(snapshot != NULL) {
+		guint i = 0;
+		for(i=0; i<snapshot->count; i++) {
+			janus_videoroom_subscriber *s = snapshot->subscribers[i];
+			if(s->feed == participant)
+				janus_videoroom_relay_data_packet(s, text);
+		}
+	}
+	janus_videoroom_subscribers_read_unlock(participant, epoch);
 	g_free(text);
 	janus_videoroom_publisher_dereference_nodebug(participant);
 }
@@ -4899,6 +6082,13 @@ static void janus_videoroom_hangup_media_internal(janus_plugin_session *handle)
 	if(session->participant_type == janus_videoroom_p_type_publisher) {
 		/* This publisher just 'unpublished' */
 		janus_videoroom_publisher *participant = janus_videoroom_session_get_publisher(session);
+		janus_videoroom *room = participant->room;
+		if(room != NULL && room->last_n > 0) {
+			/* If this publisher was in an active speaker slot, move its subscribers to someone else */
+			janus_mutex_lock(&room->mutex);
+			janus_videoroom_last_n_unpublished(room, participant);
+			janus_mutex_unlock(&room->mutex);
+		}
 		/* Get rid of the recorders, if available */
 		janus_mutex_lock(&participant->rec_mutex);
 		g_free(participant->recording_base);
@@ -4926,9 +6116,11 @@ static void janus_videoroom_hangup_media_internal(janus_plugin_session *handle)
 			participant->ssrc[i] = 0;
 			g_free(participant->rid[i]);
 			participant->rid[i] = NULL;
+			janus_rtp_gop_cache_reset(&participant->gop[i]);
 		}
 		GSList *subscribers = participant->subscribers;
 		participant->subscribers = NULL;
+		janus_videoroom_subscribers_update(participant);
 		janus_mutex_unlock(&participant->subscribers_mutex);
 		/* Hangup all subscribers */
 		while(subscribers) {
@@ -4943,6 +6135,18 @@ static void janus_videoroom_hangup_media_internal(janus_plugin_session *handle)
 	} else if(session->participant_type == janus_videoroom_p_type_subscriber) {
 		/* Get rid of subscriber */
 		janus_videoroom_subscriber *subscriber = (janus_videoroom_subscriber *)session->participant;
+		if(subscriber && subscriber->last_n_slot != -1 && subscriber->room) {
+			/* Detach from the active speaker slot */
+			janus_videoroom *room = subscriber->room;
+			janus_mutex_lock(&room->mutex);
+			GList *sl = g_list_find(room->last_n_subscribers, subscriber);
+			if(sl != NULL) {
+				room->last_n_subscribers = g_list_delete_link(room->last_n_subscribers, sl);
+				janus_refcount_decrease(&subscriber->ref);
+			}
+			subscriber->last_n_slot = -1;
+			janus_mutex_unlock(&room->mutex);
+		}
 		if(subscriber) {
 			subscriber->paused = TRUE;
 			janus_videoroom_publisher *publisher = subscriber->feed;
@@ -4960,6 +6164,7 @@ static void janus_videoroom_hangup_media_internal(janus_plugin_session *handle)
 				}
 				janus_mutex_lock(&publisher->subscribers_mutex);
 				publisher->subscribers = g_slist_remove(publisher->subscribers, subscriber);
+				janus_videoroom_subscribers_update(publisher);
 				janus_mutex_unlock(&publisher->subscribers_mutex);
 				janus_videoroom_hangup_subscriber(subscriber);
 			}
@@ -4971,19 +6176,35 @@ static void janus_videoroom_hangup_media_internal(janus_plugin_session *handle)
 
 /* Thread to handle incoming messages */
 static void *janus_videoroom_handler(void *data) {
-	JANUS_LOG(LOG_VERB, "Joining VideoRoom handler thread\n");
+	janus_videoroom_handler_thread *handler = (janus_videoroom_handler_thread *)data;
+	JANUS_LOG(LOG_VERB, "Joining VideoRoom handler thread %u\n", (guint)(handler - handlers));
 	janus_videoroom_message *msg = NULL;
 	int error_code = 0;
 	char error_cause[512];
 	json_t *root = NULL;
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
-		msg = g_async_queue_pop(messages);
+		msg = g_async_queue_pop(handler->messages);
 		if(msg == &exit_message)
 			break;
 		if(msg->handle == NULL) {
 			janus_videoroom_message_free(msg);
 			continue;
 		}
+		if(msg->room_id > 0) {
+			/* Keep track of how long requests for this room wait in the queue */
+			gint64 latency = janus_get_monotonic_time() - msg->queued;
+			janus_mutex_lock(&rooms_mutex);
+			janus_videoroom *room = g_hash_table_lookup(rooms, &msg->room_id);
+			if(room != NULL) {
+				room->queue_latency = room->queue_requests ? (room->queue_latency*7 + latency)/8 : latency;
+				if(latency > room->queue_latency_max)
+					room->queue_latency_max = latency;
+				room->queue_requests++;
+			}
+			janus_mutex_unlock(&rooms_mutex);
+			if(latency > G_USEC_PER_SEC)
+				JANUS_LOG(LOG_WARN, "[%"SCNu64"] Request waited %"SCNi64"ms in the queue\n", msg->room_id, latency/1000);
+		}
 		janus_videoroom *videoroom = NULL;
 		janus_videoroom_publisher *participant = NULL;
 		janus_mutex_lock(&sessions_mutex);
@@ -5138,6 +6359,16 @@ static void *janus_videoroom_handler(void *data) {
 				publisher->subscribers = NULL;
 				publisher->subscriptions = NULL;
 				janus_mutex_init(&publisher->subscribers_mutex);
+				publisher->snapshot = NULL;
+				publisher->retiring = NULL;
+				publisher->retired[0] = NULL;
+				publisher->retired[1] = NULL;
+				publisher->retired[2] = NULL;
+				publisher->snapshot_retired = 0;
+				publisher->snapshot_reclaiming = 0;
+				publisher->snapshot_epoch = 0;
+				publisher->snapshot_readers[0] = 0;
+				publisher->snapshot_readers[1] = 0;
 				publisher->audio_pt = -1;	/* We'll deal with this later */
 				publisher->video_pt = -1;	/* We'll deal with this later */
 				publisher->audio_level_extmap_id = 0;
@@ -5147,10 +6378,14 @@ static void *janus_videoroom_handler(void *data) {
 				publisher->remb_latest = 0;
 				publisher->fir_latest = 0;
 				publisher->fir_seq = 0;
+				janus_mutex_init(&publisher->kf_mutex);
 				janus_mutex_init(&publisher->rtp_forwarders_mutex);
 				publisher->rtp_forwarders = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_videoroom_rtp_forwarder_destroy);
 				publisher->srtp_contexts = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)janus_videoroom_srtp_context_free);
 				publisher->udp_sock = -1;
+				int i=0;
+				for(i=0; i<3; i++)
+					janus_rtp_gop_cache_init(&publisher->gop[i], publisher->room->gop_cache ? JANUS_RTP_GOP_CACHE_DEFAULT_SIZE : 0);
 				/* Finally, generate a private ID: this is only needed in case the participant
 				 * wants to allow the plugin to know which subscriptions belong to them */
 				publisher->pvt_id = 0;
@@ -5164,6 +6399,10 @@ static void *janus_videoroom_handler(void *data) {
 				g_hash_table_insert(publisher->room->private_ids, GUINT_TO_POINTER(publisher->pvt_id), publisher);
 				g_atomic_int_set(&publisher->destroyed, 0);
 				janus_refcount_init(&publisher->ref, janus_videoroom_publisher_free);
+				/* Make the media of this publisher available to other plugins too */
+				char bridge_name[64];
+				g_snprintf(bridge_name, sizeof(bridge_name), "videoroom/%"SCNu64"/%"SCNu64, publisher->room_id, publisher->user_id);
+				publisher->bridge = janus_media_bridge_source_add(bridge_name, janus_videoroom_bridge_keyframe, publisher);
 				/* In case we also wanted to configure */
 				if(audio) {
 					publisher->audio_active = json_is_true(audio);
@@ -5202,6 +6441,9 @@ static void *janus_videoroom_handler(void *data) {
 				gpointer value;
 				janus_refcount_increase(&publisher->ref);
 				g_hash_table_insert(publisher->room->participants, janus_uint64_dup(publisher->user_id), publisher);
+				/* Any pending participant list change up to now is reflected in the response already */
+				publisher->notify_seq = publisher->room->notify_seq;
+				janus_videoroom_participants_changed(publisher->room);
 				g_hash_table_iter_init(&iter, publisher->room->participants);
 				while (!g_atomic_int_get(&publisher->room->destroyed) && g_hash_table_iter_next(&iter, NULL, &value)) {
 					janus_videoroom_publisher *p = value;
@@ -5300,6 +6542,20 @@ static void *janus_videoroom_handler(void *data) {
 					janus_mutex_unlock(&videoroom->mutex);
 					goto error;
 				}
+				json_t *auto_simulcast = json_object_get(root, "auto_simulcast");
+				json_t *slot = json_object_get(root, "last_n_slot");
+				int last_n_slot = slot ? json_integer_value(slot) : -1;
+				if(slot && last_n_slot >= videoroom->last_n) {
+					JANUS_LOG(LOG_ERR, "Invalid element (last_n_slot should be lower than %d)\n", videoroom->last_n);
+					error_code = JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT;
+					g_snprintf(error_cause, 512, "Invalid value (last_n_slot should be lower than %d)", videoroom->last_n);
+					janus_mutex_unlock(&videoroom->mutex);
+					goto error;
+				}
+				if(last_n_slot != -1 && videoroom->last_n_slots[last_n_slot] != 0) {
+					/* The slot has a publisher already, subscribe to that one */
+					feed_id = videoroom->last_n_slots[last_n_slot];
+				}
 				janus_videoroom_publisher *owner = NULL;
 				janus_videoroom_publisher *publisher = g_hash_table_lookup(videoroom->participants, &feed_id);
 				if(publisher == NULL || g_atomic_int_get(&publisher->destroyed) || publisher->sdp == NULL) {
@@ -5335,6 +6591,7 @@ static void *janus_videoroom_handler(void *data) {
 					subscriber->feed = publisher;
 					subscriber->pvt_id = pvt_id;
 					subscriber->close_pc = close_pc;
+					subscriber->last_n_slot = -1;
 					/* Initialize the subscriber context */
 					janus_rtp_switching_context_reset(&subscriber->context);
 					subscriber->audio_offered = offer_audio ? json_is_true(offer_audio) : TRUE;	/* True by default */
@@ -5373,6 +6630,10 @@ static void *janus_videoroom_handler(void *data) {
 					subscriber->sim_context.rid_ext_id = publisher->rid_extmap_id;
 					subscriber->sim_context.substream_target = sc_substream ? json_integer_value(sc_substream) : 2;
 					subscriber->sim_context.templayer_target = sc_temporal ? json_integer_value(sc_temporal) : 2;
+					subscriber->bwe_enabled = auto_simulcast ? json_is_true(auto_simulcast) : FALSE;
+					subscriber->bwe_max_substream = subscriber->sim_context.substream_target;
+					subscriber->bwe_max_templayer = subscriber->sim_context.templayer_target;
+					janus_rtcp_bwe_context_init(&subscriber->bwe, 0, 0);
 					janus_vp8_simulcast_context_reset(&subscriber->vp8_context);
 					/* Check if a VP9 SVC-related request is involved */
 					if(subscriber->room->do_svc) {
@@ -5384,7 +6645,24 @@ static void *janus_videoroom_handler(void *data) {
 					session->participant = subscriber;
 					janus_mutex_lock(&publisher->subscribers_mutex);
 					publisher->subscribers = g_slist_append(publisher->subscribers, subscriber);
+					janus_videoroom_subscribers_update(publisher);
 					janus_mutex_unlock(&publisher->subscribers_mutex);
+					if(last_n_slot != -1) {
+						/* Attach to the active speaker slot: we never close the PeerConnection
+						 * automatically in this case, as the slot may be filled again later */
+						janus_videoroom *room = subscriber->room;
+						janus_mutex_lock(&room->mutex);
+						subscriber->close_pc = FALSE;
+						subscriber->last_n_slot = last_n_slot;
+						janus_refcount_increase(&subscriber->ref);
+						room->last_n_subscribers = g_list_append(room->last_n_subscribers, subscriber);
+						/* The slot may have been assigned to someone else in the meanwhile */
+						if(room->last_n_slots[last_n_slot] != 0 && room->last_n_slots[last_n_slot] != publisher->user_id) {
+							janus_videoroom_last_n_assign(room, last_n_slot,
+								g_hash_table_lookup(room->participants, &room->last_n_slots[last_n_slot]));
+						}
+						janus_mutex_unlock(&room->mutex);
+					}
 					if(owner != NULL) {
 						/* Note: we should refcount these subscription-publisher mappings as well */
 						janus_mutex_lock(&owner->subscribers_mutex);
@@ -5398,6 +6676,8 @@ static void *janus_videoroom_handler(void *data) {
 					json_object_set_new(event, "videoroom", json_string("attached"));
 					json_object_set_new(event, "room", json_integer(subscriber->room_id));
 					json_object_set_new(event, "id", json_integer(feed_id));
+					if(subscriber->last_n_slot != -1)
+						json_object_set_new(event, "last_n_slot", json_integer(subscriber->last_n_slot));
 					if(publisher->display)
 						json_object_set_new(event, "display", json_string(publisher->display));
 					if(legacy)
@@ -5783,6 +7063,7 @@ static void *janus_videoroom_handler(void *data) {
 					g_snprintf(error_cause, 512, "Invalid value (temporal/temporal_layer should be 0, 1 or 2)");
 					goto error;
 				}
+				json_t *auto_simulcast = json_object_get(root, "auto_simulcast");
 				/* Update the audio/video/data flags, if set */
 				janus_videoroom_publisher *publisher = subscriber->feed;
 				if(publisher) {
@@ -5804,13 +7085,24 @@ static void *janus_videoroom_handler(void *data) {
 						}
 						subscriber->video = newvideo;
 						if(subscriber->video) {
-							/* Send a FIR */
-							janus_videoroom_reqfir(publisher, "Restoring video for subscriber");
+							/* Send a FIR, unless video just resumed and we can start from the cached GOP */
+							if(oldvideo || !janus_videoroom_gop_request(publisher, subscriber))
+								janus_videoroom_reqfir(publisher, "Restoring video for subscriber");
 						}
 					}
 					if(data && publisher->data && subscriber->data_offered)
 						subscriber->data = json_is_true(data);
 					/* Check if a simulcasting-related request is involved */
+					if(sc_substream)
+						subscriber->bwe_max_substream = json_integer_value(sc_substream);
+					if(sc_temporal)
+						subscriber->bwe_max_templayer = json_integer_value(sc_temporal);
+					if(auto_simulcast) {
+						gboolean bwe_enabled = json_is_true(auto_simulcast);
+						if(bwe_enabled && !subscriber->bwe_enabled)
+							janus_rtcp_bwe_context_init(&subscriber->bwe, 0, 0);
+						subscriber->bwe_enabled = bwe_enabled;
+					}
 					if(sc_substream && (publisher->ssrc[0] != 0 || publisher->rid[0] != NULL)) {
 						subscriber->sim_context.substream_target = json_integer_value(sc_substream);
 						JANUS_LOG(LOG_VERB, "Setting video SSRC to let through (simulcast): %"SCNu32" (index %d, was %d)\n",
@@ -5827,7 +7119,8 @@ static void *janus_videoroom_handler(void *data) {
 							json_decref(event);
 						} else {
 							/* Send a FIR */
-							janus_videoroom_reqfir(publisher, "Simulcasting substream change");
+							janus_videoroom_reqfir_substream(publisher, subscriber->sim_context.substream_target,
+								"Simulcasting substream change");
 						}
 					}
 					if(subscriber->feed && subscriber->feed->vcodec == JANUS_VIDEOCODEC_VP8 &&
@@ -6029,55 +7322,17 @@ static void *janus_videoroom_handler(void *data) {
 				}
 				janus_refcount_increase(&publisher->ref);
 				janus_refcount_increase(&publisher->session->ref);
+				/* Unsubscribe from the previous publisher and subscribe to the new one (all media is relayed by default):
+				 * we keep the room mutex while doing that, as active speaker slots may be switching this subscriber too */
+				gboolean switched = janus_videoroom_subscriber_switch(subscriber, publisher,
+					audio ? json_is_true(audio) : TRUE, video ? json_is_true(video) : TRUE, data ? json_is_true(data) : TRUE);
 				janus_mutex_unlock(&subscriber->room->mutex);
-				gboolean paused = subscriber->paused;
-				subscriber->paused = TRUE;
-				/* Unsubscribe from the previous publisher */
-				janus_videoroom_publisher *prev_feed = subscriber->feed;
-				if(prev_feed) {
-					/* ... but make sure the codecs are compliant first */
-					if(publisher->acodec != prev_feed->acodec || publisher->vcodec != prev_feed->vcodec) {
-						janus_refcount_decrease(&publisher->session->ref);
-						janus_refcount_decrease(&publisher->ref);
-						subscriber->paused = paused;
-						JANUS_LOG(LOG_ERR, "The two publishers are not using the same codecs, can't switch\n");
-						error_code = JANUS_VIDEOROOM_ERROR_INVALID_SDP;
-						g_snprintf(error_cause, 512, "The two publishers are not using the same codecs, can't switch");
-						goto error;
-					}
-					/* Go on */
-					janus_mutex_lock(&prev_feed->subscribers_mutex);
-					prev_feed->subscribers = g_slist_remove(prev_feed->subscribers, subscriber);
-					janus_mutex_unlock(&prev_feed->subscribers_mutex);
-					janus_refcount_decrease(&prev_feed->session->ref);
-					g_clear_pointer(&subscriber->feed, janus_videoroom_publisher_dereference);
-				}
-				/* Subscribe to the new one */
-				subscriber->audio = audio ? json_is_true(audio) : TRUE;	/* True by default */
-				if(!publisher->audio)
-					subscriber->audio = FALSE;	/* ... unless the publisher isn't sending any audio */
-				subscriber->video = video ? json_is_true(video) : TRUE;	/* True by default */
-				if(!publisher->video)
-					subscriber->video = FALSE;	/* ... unless the publisher isn't sending any video */
-				subscriber->data = data ? json_is_true(data) : TRUE;	/* True by default */
-				if(!publisher->data)
-					subscriber->data = FALSE;	/* ... unless the publisher isn't sending any data */
-				if(subscriber->room && subscriber->room->do_svc) {
-					/* This subscriber belongs to a room where VP9 SVC has been enabled,
-					 * let's assume we're interested in all layers for the time being */
-					subscriber->spatial_layer = -1;
-					subscriber->target_spatial_layer = 2;		/* FIXME Chrome sends 0, 1 and 2 (if using EnabledByFlag_3SL3TL) */
-					subscriber->temporal_layer = -1;
-					subscriber->target_temporal_layer = 2;	/* FIXME Chrome sends 0, 1 and 2 */
+				if(!switched) {
+					JANUS_LOG(LOG_ERR, "The two publishers are not using the same codecs, can't switch\n");
+					error_code = JANUS_VIDEOROOM_ERROR_INVALID_SDP;
+					g_snprintf(error_cause, 512, "The two publishers are not using the same codecs, can't switch");
+					goto error;
 				}
-				janus_mutex_lock(&publisher->subscribers_mutex);
-				publisher->subscribers = g_slist_append(publisher->subscribers, subscriber);
-				janus_mutex_unlock(&publisher->subscribers_mutex);
-				subscriber->feed = publisher;
-				/* Send a FIR to the new publisher */
-				janus_videoroom_reqfir(publisher, "Switching existing subscriber to new publisher");
-				/* Done */
-				subscriber->paused = paused;
 				event = json_object();
 				json_object_set_new(event, "videoroom", json_string("event"));
 				json_object_set_new(event, "switched", json_string("ok"));
@@ -6437,7 +7692,7 @@ static void *janus_videoroom_handler(void *data) {
 							msg->transaction = NULL;
 							msg->jsep = NULL;
 							json_incref(update);
-							g_async_queue_push(messages, msg);
+							janus_videoroom_message_enqueue(subscriber->session, msg);
 						}
 						s = s->next;
 					}
@@ -6609,16 +7864,17 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			packet->data->timestamp = htonl(packet->timestamp);
 			packet->data->seq_number = htons(packet->seq_number);
 		} else if(packet->ssrc[0] != 0) {
-			/* Handle simulcast: make sure we have a payload to work with */
-			int plen = 0;
-			char *payload = janus_rtp_payload((char *)packet->data, packet->length, &plen);
-			if(payload == NULL)
+			/* Handle simulcast: make sure the publisher could parse the packet */
+			if(packet->simulcast == NULL)
 				return;
+			char *payload = packet->simulcast->payload;
+			int plen = packet->simulcast->plen;
 			/* Process this packet: don't relay if it's not the SSRC/layer we wanted to handle */
-			gboolean relay = janus_rtp_simulcasting_context_process_rtp(&subscriber->sim_context,
-				(char *)packet->data, packet->length, packet->ssrc, NULL, subscriber->feed->vcodec, &subscriber->context);
+			gboolean relay = janus_rtp_simulcasting_context_process_packet(&subscriber->sim_context,
+				packet->simulcast, &subscriber->context);
 			if(subscriber->sim_context.need_pli && subscriber->feed && subscriber->feed->session &&
-					subscriber->feed->session->handle) {
+					subscriber->feed->session->handle &&
+					janus_videoroom_keyframe_request_check(subscriber->feed, subscriber->sim_context.substream_target)) {
 				/* Send a PLI */
 				JANUS_LOG(LOG_VERB, "We need a PLI for the simulcast context\n");
 				char rtcpbuf[12];
@@ -6651,11 +7907,12 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			/* If we got here, update the RTP header and send the packet */
 			janus_rtp_header_update(packet->data, &subscriber->context, TRUE, 4500);
 			char vp8pd[6];
-			if(subscriber->feed && subscriber->feed->vcodec == JANUS_VIDEOCODEC_VP8) {
+			if(packet->simulcast->vp8_descriptor) {
 				/* For VP8, we save the original payload descriptor, to restore it after */
 				memcpy(vp8pd, payload, sizeof(vp8pd));
-				janus_vp8_simulcast_descriptor_update(payload, plen, &subscriber->vp8_context,
-					subscriber->sim_context.changed_substream);
+				janus_vp8_simulcast_descriptor_update_parsed(payload, plen,
+					packet->simulcast->picid, packet->simulcast->tl0picidx,
+					&subscriber->vp8_context, subscriber->sim_context.changed_substream);
 			}
 			/* Send the packet */
 			if(gateway != NULL)
@@ -6663,7 +7920,7 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			/* Restore the timestamp and sequence number to what the publisher set them to */
 			packet->data->timestamp = htonl(packet->timestamp);
 			packet->data->seq_number = htons(packet->seq_number);
-			if(subscriber->feed && subscriber->feed->vcodec == JANUS_VIDEOCODEC_VP8) {
+			if(packet->simulcast->vp8_descriptor) {
 				/* Restore the original payload descriptor as well, as it will be needed by the next viewer */
 				memcpy(payload, vp8pd, sizeof(vp8pd));
 			}
@@ -6716,6 +7973,89 @@ static void janus_videoroom_relay_data_packet(gpointer data, gpointer user_data)
 	return;
 }
 
+/* Helpers to batch packets for RTP forwarders */
+static void janus_videoroom_forwarders_batch_add(janus_videoroom_forwarders_batch *batch,
+		janus_videoroom_rtp_forwarder *forward, janus_rtp_header *header, char *buf, int len) {
+	if(batch->count == JANUS_VIDEOROOM_FORWARDERS_BATCH)
+		janus_videoroom_forwarders_batch_flush(batch);
+	guint i = batch->count++;
+	batch->forwarders[i] = forward;
+	if(header != NULL && len >= (int)sizeof(janus_rtp_header)) {
+		/* Take a copy of the RTP header as it is now, and point to the rest of the packet */
+		memcpy(&batch->headers[i], header, sizeof(janus_rtp_header));
+		batch->iov[i][0].iov_base = &batch->headers[i];
+		batch->iov[i][0].iov_len = sizeof(janus_rtp_header);
+		batch->iov[i][1].iov_base = buf + sizeof(janus_rtp_header);
+		batch->iov[i][1].iov_len = len - sizeof(janus_rtp_header);
+		batch->iovlen[i] = 2;
+	} else {
+		batch->iov[i][0].iov_base = buf;
+		batch->iov[i][0].iov_len = len;
+		batch->iovlen[i] = 1;
+	}
+}
+
+static void janus_videoroom_forwarders_batch_message(janus_videoroom_forwarders_batch *batch, guint i, struct msghdr *msg) {
+	janus_videoroom_rtp_forwarder *forward = batch->forwarders[i];
+	memset(msg, 0, sizeof(*msg));
+	if(forward->serv_addr.sin_family == AF_INET) {
+		msg->msg_name = &forward->serv_addr;
+		msg->msg_namelen = sizeof(forward->serv_addr);
+	} else {
+		msg->msg_name = &forward->serv_addr6;
+		msg->msg_namelen = sizeof(forward->serv_addr6);
+	}
+	msg->msg_iov = batch->iov[i];
+	msg->msg_iovlen = batch->iovlen[i];
+}
+
+static void janus_videoroom_forwarders_batch_flush(janus_videoroom_forwarders_batch *batch) {
+	if(batch->count == 0)
+		return;
+	guint i = 0;
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[JANUS_VIDEOROOM_FORWARDERS_BATCH];
+	for(i=0; i<batch->count; i++) {
+		janus_videoroom_forwarders_batch_message(batch, i, &msgs[i].msg_hdr);
+		msgs[i].msg_len = 0;
+	}
+	guint sent = 0;
+	while(sent < batch->count) {
+		int res = sendmmsg(batch->fd, &msgs[sent], batch->count-sent, 0);
+		if(res < 1) {
+			/* The first packet we tried to send failed: skip it and go on with the others */
+			janus_videoroom_rtp_forwarder *forward = batch->forwarders[sent];
+			JANUS_LOG(LOG_HUGE, "Error forwarding %s packet... %s\n",
+				forward->is_video ? "video" : "audio", strerror(errno));
+			forward->errors++;
+			sent++;
+			continue;
+		}
+		for(i=sent; i<sent+res; i++) {
+			batch->forwarders[i]->packets++;
+			batch->forwarders[i]->bytes += msgs[i].msg_len;
+		}
+		sent += res;
+	}
+#else
+	struct msghdr msg;
+	for(i=0; i<batch->count; i++) {
+		janus_videoroom_rtp_forwarder *forward = batch->forwarders[i];
+		janus_videoroom_forwarders_batch_message(batch, i, &msg);
+		ssize_t res = sendmsg(batch->fd, &msg, 0);
+		if(res < 0) {
+			JANUS_LOG(LOG_HUGE, "Error forwarding %s packet... %s\n",
+				forward->is_video ? "video" : "audio", strerror(errno));
+			forward->errors++;
+		} else {
+			forward->packets++;
+			forward->bytes += res;
+		}
+	}
+#endif
+	batch->count = 0;
+}
+
 /* The following methods are only relevant if RTCP is used for RTP forwarders */
 static void janus_videoroom_rtp_forwarder_rtcp_receive(janus_videoroom_rtp_forwarder *forward) {
 	char buffer[1500];
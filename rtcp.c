@@ -887,6 +887,42 @@ int janus_rtcp_fix_report_data(char *packet, int len, uint32_t base_ts, uint32_t
 	return status;
 }
 
+gboolean janus_rtcp_parse_lost_info(char *packet, int len, uint32_t *lost, int *fraction) {
+	if(packet == NULL || len == 0)
+		return FALSE;
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	int total = len;
+	while(rtcp) {
+		if (!janus_rtcp_check_len(rtcp, total))
+			break;
+		if(rtcp->version != 2)
+			break;
+		janus_report_block *rb = NULL;
+		if(rtcp->type == RTCP_SR && rtcp->rc > 0 && janus_rtcp_check_sr(rtcp, total)) {
+			rb = &((janus_rtcp_sr *)rtcp)->rb[0];
+		} else if(rtcp->type == RTCP_RR && rtcp->rc > 0 && janus_rtcp_check_rr(rtcp, total)) {
+			rb = &((janus_rtcp_rr *)rtcp)->rb[0];
+		}
+		if(rb != NULL) {
+			uint32_t flcnpl = ntohl(rb->flcnpl);
+			if(lost)
+				*lost = flcnpl & 0x00FFFFFF;
+			if(fraction)
+				*fraction = flcnpl >> 24;
+			return TRUE;
+		}
+		/* Is this a compound packet? */
+		int length = ntohs(rtcp->length);
+		if(length == 0)
+			break;
+		total -= length*4+4;
+		if(total <= 0)
+			break;
+		rtcp = (janus_rtcp_header *)((uint32_t*)rtcp + length + 1);
+	}
+	return FALSE;
+}
+
 gboolean janus_rtcp_has_bye(char *packet, int len) {
 	/* Parse RTCP compound packet */
 	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
@@ -1692,3 +1728,53 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 	/* Done */
 	return len;
 }
+
+/* Bandwidth estimation */
+void janus_rtcp_bwe_context_init(janus_rtcp_bwe_context *ctx, uint32_t start, uint32_t max) {
+	if(ctx == NULL)
+		return;
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->max = max > 0 ? max : JANUS_RTCP_BWE_MAX_BITRATE;
+	ctx->estimate = start > 0 ? start : JANUS_RTCP_BWE_START_BITRATE;
+	if(ctx->estimate > ctx->max)
+		ctx->estimate = ctx->max;
+}
+
+gboolean janus_rtcp_bwe_context_process(janus_rtcp_bwe_context *ctx, char *packet, int len) {
+	if(ctx == NULL || packet == NULL || len < 1)
+		return FALSE;
+	uint32_t estimate = ctx->estimate;
+	gint64 now = janus_get_monotonic_time();
+	/* If the receiver sent a REMB, that's an upper bound to what we can send */
+	uint32_t remb = janus_rtcp_get_remb(packet, len);
+	if(remb > 0)
+		ctx->remb = remb;
+	/* Loss based estimation, as in the sender side of Google Congestion Control:
+	 * decrease when losses are above 10%, increase when they're below 2% */
+	uint32_t lost = 0;
+	int fraction = 0;
+	if(janus_rtcp_parse_lost_info(packet, len, &lost, &fraction)) {
+		ctx->fraction_lost = fraction;
+		if(fraction > 26) {
+			/* More than 10% lost: decrease by half the loss ratio */
+			estimate = (uint32_t)((double)estimate * (1.0 - 0.5*((double)fraction/256.0)));
+			ctx->last_increase = now;
+		} else if(fraction < 5 && (now-ctx->last_increase) >= JANUS_RTCP_BWE_INCREASE_INTERVAL) {
+			/* Less than 2% lost: probe for more */
+			estimate = (uint32_t)((double)estimate * 1.08) + 1000;
+			ctx->last_increase = now;
+		}
+	}
+	if(ctx->remb > 0 && estimate > ctx->remb)
+		estimate = ctx->remb;
+	if(estimate > ctx->max)
+		estimate = ctx->max;
+	if(estimate < JANUS_RTCP_BWE_MIN_BITRATE)
+		estimate = JANUS_RTCP_BWE_MIN_BITRATE;
+	if(estimate == ctx->estimate)
+		return FALSE;
+	JANUS_LOG(LOG_HUGE, "Bandwidth estimate updated: %"SCNu32" --> %"SCNu32" (REMB %"SCNu32", fraction lost %d/256)\n",
+		ctx->estimate, estimate, ctx->remb, ctx->fraction_lost);
+	ctx->estimate = estimate;
+	return TRUE;
+}
@@ -535,4 +535,43 @@ int janus_rtcp_nacks(char *packet, int len, GSList *nacks);
  * @returns The message data length in bytes, if successful, -1 on errors */
 int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t len, guint32 ssrc, guint32 media, guint8 feedback_packet_count, GQueue *transport_wide_cc_stats);
 
+/*! \brief Default bitrate a bandwidth estimation context starts from */
+#define JANUS_RTCP_BWE_START_BITRATE	300000
+/*! \brief Minimum bitrate a bandwidth estimation context will ever report */
+#define JANUS_RTCP_BWE_MIN_BITRATE		30000
+/*! \brief Default maximum bitrate a bandwidth estimation context will report */
+#define JANUS_RTCP_BWE_MAX_BITRATE		10000000
+/*! \brief How often a bandwidth estimation context can increase its estimate (microseconds) */
+#define JANUS_RTCP_BWE_INCREASE_INTERVAL	G_USEC_PER_SEC
+
+/*! \brief Send side bandwidth estimation context for a single receiver:
+ * the estimate is based on the losses the receiver reports in its RR
+ * (increased when there are no significant losses, decreased otherwise)
+ * and capped by the REMB feedback it sends, if any. Plugins can use it
+ * to decide, e.g., which simulcast substream a subscriber should get */
+typedef struct janus_rtcp_bwe_context {
+	/*! \brief Current estimate, in bits per second */
+	uint32_t estimate;
+	/*! \brief Maximum estimate */
+	uint32_t max;
+	/*! \brief Latest REMB the receiver sent, if any */
+	uint32_t remb;
+	/*! \brief Latest fraction of lost packets the receiver reported (out of 256) */
+	int fraction_lost;
+	/*! \brief When the estimate was last increased (or decreased) */
+	gint64 last_increase;
+} janus_rtcp_bwe_context;
+
+/*! \brief Method to initialize a bandwidth estimation context
+ * @param[in] ctx The context to initialize
+ * @param[in] start The bitrate to start from (0 for the default)
+ * @param[in] max The maximum estimate (0 for the default) */
+void janus_rtcp_bwe_context_init(janus_rtcp_bwe_context *ctx, uint32_t start, uint32_t max);
+/*! \brief Method to update a bandwidth estimation context with some RTCP feedback from the receiver
+ * @param[in] ctx The context to update
+ * @param[in] packet The RTCP message sent by the receiver
+ * @param[in] len The message data length in bytes
+ * @returns TRUE if the estimate changed, FALSE otherwise */
+gboolean janus_rtcp_bwe_context_process(janus_rtcp_bwe_context *ctx, char *packet, int len);
+
 #endif
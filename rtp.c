@@ -922,138 +922,356 @@ void janus_rtp_simulcasting_prepare(json_t *simulcast, int *rid_ext_id, int *fra
 		*framemarking_ext_id = json_integer_value(fm_ext);
 }
 
-gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_context *context,
-		char *buf, int len, uint32_t *ssrcs, char **rids,
-		janus_videocodec vcodec, janus_rtp_switching_context *sc) {
-	if(!context || !buf || len < 1)
-		return FALSE;
+int janus_rtp_simulcasting_packet_parse(janus_rtp_simulcasting_packet *packet,
+		char *buf, int len, uint32_t *ssrcs, char **rids, int rid_ext_id, int framemarking_ext_id,
+		janus_videocodec vcodec) {
+	if(!packet || !buf || len < 1 || !ssrcs)
+		return -1;
+	memset(packet, 0, sizeof(*packet));
+	packet->substream = -1;
+	packet->temporal_layer = -1;
 	janus_rtp_header *header = (janus_rtp_header *)buf;
 	uint32_t ssrc = ntohl(header->ssrc);
-	if(ssrc != ssrcs[0] && ssrc != ssrcs[1] && ssrc != ssrcs[2]) {
+	packet->ssrc = ssrc;
+	if(ssrc == ssrcs[0]) {
+		packet->substream = 0;
+	} else if(ssrc == ssrcs[1]) {
+		packet->substream = 1;
+	} else if(ssrc == ssrcs[2]) {
+		packet->substream = 2;
+	} else {
 		/* We don't recognize this SSRC, check if rid can help us */
-		if(context->rid_ext_id < 1 || rids == NULL)
-			return FALSE;
+		if(rid_ext_id < 1 || rids == NULL)
+			return -1;
 		char sdes_item[16];
-		if(janus_rtp_header_extension_parse_rid(buf, len, context->rid_ext_id, sdes_item, sizeof(sdes_item)) != 0)
-			return FALSE;
+		if(janus_rtp_header_extension_parse_rid(buf, len, rid_ext_id, sdes_item, sizeof(sdes_item)) != 0)
+			return -1;
 		if(rids[2] != NULL && !strcmp(rids[2], sdes_item)) {
 			JANUS_LOG(LOG_VERB, "Simulcasting: rid=%s --> ssrc=%"SCNu32"\n", sdes_item, ssrc);
 			*(ssrcs) = ssrc;
+			packet->substream = 0;
 		} else if(rids[1] != NULL && !strcmp(rids[1], sdes_item)) {
 			JANUS_LOG(LOG_VERB, "Simulcasting: rid=%s --> ssrc=%"SCNu32"\n", sdes_item, ssrc);
 			*(ssrcs+1) = ssrc;
+			packet->substream = 1;
 		} else if(rids[0] != NULL && !strcmp(rids[0], sdes_item)) {
 			JANUS_LOG(LOG_VERB, "Simulcasting: rid=%s --> ssrc=%"SCNu32"\n", sdes_item, ssrc);
 			*(ssrcs+2) = ssrc;
+			packet->substream = 2;
 		} else {
 			JANUS_LOG(LOG_WARN, "Simulcasting: unknown rid '%s'...\n", sdes_item);
-			return FALSE;
+			return -1;
 		}
 	}
+	/* Access the packet payload */
+	packet->payload = janus_rtp_payload(buf, len, &packet->plen);
+	if(packet->payload == NULL)
+		return -1;
+	/* Temporal layers are only available for VP8 and (partially) H.264 */
+	if(vcodec == JANUS_VIDEOCODEC_VP8) {
+		packet->keyframe = janus_vp8_is_keyframe(packet->payload, packet->plen);
+		uint8_t tid = 0, ybit = 0, keyidx = 0;
+		if(janus_vp8_parse_descriptor(packet->payload, packet->plen,
+				&packet->picid, &packet->tl0picidx, &tid, &ybit, &keyidx) == 0) {
+			packet->vp8_descriptor = TRUE;
+			packet->temporal_layer = tid;
+		}
+	} else if(vcodec == JANUS_VIDEOCODEC_H264) {
+		packet->keyframe = janus_h264_is_keyframe(packet->payload, packet->plen);
+		/* Use the frame-marking extension to account for temporal scalability */
+		uint8_t tid = 0;
+		if(janus_rtp_header_extension_parse_framemarking(buf, len,
+				framemarking_ext_id, JANUS_VIDEOCODEC_H264, &tid) == 0) {
+			JANUS_LOG(LOG_HUGE, "Frame marking extension found: tid=%d\n", tid);
+			packet->temporal_layer = tid;
+		}
+	}
+	return 0;
+}
+
+gboolean janus_rtp_simulcasting_context_process_packet(janus_rtp_simulcasting_context *context,
+		janus_rtp_simulcasting_packet *packet, janus_rtp_switching_context *sc) {
+	if(!context || !packet || packet->substream < 0)
+		return FALSE;
 	/* Reset the flags */
 	context->changed_substream = FALSE;
 	context->changed_temporal = FALSE;
 	context->need_pli = FALSE;
-	/* Access the packet payload */
-	int plen = 0;
-	char *payload = janus_rtp_payload(buf, len, &plen);
-	if(payload == NULL)
-		return FALSE;
 	if(context->substream != context->substream_target) {
 		/* There has been a change: let's wait for a keyframe on the target */
 		int step = (context->substream < 1 && context->substream_target == 2);
-		if((ssrc == *(ssrcs + context->substream_target)) || (step && ssrc == *(ssrcs + step))) {
-			if((vcodec == JANUS_VIDEOCODEC_VP8 && janus_vp8_is_keyframe(payload, plen)) ||
-					(vcodec == JANUS_VIDEOCODEC_H264 && janus_h264_is_keyframe(payload, plen))) {
-				uint32_t ssrc_old = 0;
-				if(context->substream != -1)
-					ssrc_old = *(ssrcs + context->substream);
-				JANUS_LOG(LOG_VERB, "Received keyframe on SSRC %"SCNu32", switching (was %"SCNu32")\n", ssrc, ssrc_old);
-				context->substream = (ssrc == *(ssrcs + context->substream_target) ? context->substream_target : step);
+		if(packet->substream == context->substream_target || (step && packet->substream == step)) {
+			if(packet->keyframe) {
+				JANUS_LOG(LOG_VERB, "Received keyframe on SSRC %"SCNu32", switching substream (%d --> %d)\n",
+					packet->ssrc, context->substream, packet->substream);
+				context->substream = packet->substream;
 				/* Notify the caller that the substream changed */
 				context->changed_substream = TRUE;
-			//~ } else {
-				//~ JANUS_LOG(LOG_WARN, "Not a keyframe on SSRC %"SCNu32" yet, waiting before switching\n", ssrc);
 			}
 		}
 	}
 	/* If we haven't received our desired substream yet, let's drop temporarily */
+	gint64 now = janus_get_monotonic_time();
 	if(context->last_relayed == 0) {
 		/* Let's start slow */
-		context->last_relayed = janus_get_monotonic_time();
-	} else {
-		/* Check if 250ms went by with no packet relayed */
-		gint64 now = janus_get_monotonic_time();
-		if(now-context->last_relayed >= 250000) {
-			context->last_relayed = now;
-			int substream = context->substream-1;
-			if(substream < 0)
-				substream = 0;
-			if(context->substream != substream) {
-				if(context->substream_target != substream) {
-					JANUS_LOG(LOG_WARN, "No packet received on substream %d for a while, falling back to %d\n",
-						context->substream, substream);
-					context->substream_target = substream;
-				}
-				/* Notify the caller that we (still) need a PLI */
-				context->need_pli = TRUE;
+		context->last_relayed = now;
+	} else if(now-context->last_relayed >= 250000) {
+		/* 250ms went by with no packet relayed */
+		context->last_relayed = now;
+		int substream = context->substream-1;
+		if(substream < 0)
+			substream = 0;
+		if(context->substream != substream) {
+			if(context->substream_target != substream) {
+				JANUS_LOG(LOG_WARN, "No packet received on substream %d for a while, falling back to %d\n",
+					context->substream, substream);
+				context->substream_target = substream;
 			}
+			/* Notify the caller that we (still) need a PLI */
+			context->need_pli = TRUE;
 		}
 	}
 	/* Do we need to drop this? */
-	if(ssrc != *(ssrcs + context->substream)) {
-		JANUS_LOG(LOG_HUGE, "Dropping packet (it's from SSRC %"SCNu32", but we're only relaying SSRC %"SCNu32" now\n",
-			ssrc, *(ssrcs + context->substream));
+	if(packet->substream != context->substream) {
+		JANUS_LOG(LOG_HUGE, "Dropping packet (it's from substream %d, but we're only relaying substream %d now\n",
+			packet->substream, context->substream);
 		return FALSE;
 	}
-	context->last_relayed = janus_get_monotonic_time();
-	/* Temporal layers are only available for VP8 and (partially) H.264, so don't do anything else for other codecs */
-	if(vcodec == JANUS_VIDEOCODEC_VP8) {
-		/* Check if there's any temporal scalability to take into account */
-		uint16_t picid = 0;
-		uint8_t tlzi = 0;
-		uint8_t tid = 0;
-		uint8_t ybit = 0;
-		uint8_t keyidx = 0;
-		if(janus_vp8_parse_descriptor(payload, plen, &picid, &tlzi, &tid, &ybit, &keyidx) == 0) {
-			//~ JANUS_LOG(LOG_WARN, "%"SCNu16", %u, %u, %u, %u\n", picid, tlzi, tid, ybit, keyidx);
-			if(context->templayer != context->templayer_target && tid == context->templayer_target) {
-				/* FIXME We should be smarter in deciding when to switch */
-				context->templayer = context->templayer_target;
-				/* Notify the caller that the temporal layer changed */
-				context->changed_temporal = TRUE;
-			}
-			if(context->templayer != -1 && tid > context->templayer) {
-				JANUS_LOG(LOG_HUGE, "Dropping packet (it's temporal layer %d, but we're capping at %d)\n",
-					tid, context->templayer);
-				/* We increase the base sequence number, or there will be gaps when delivering later */
-				if(sc)
-					sc->v_base_seq++;
-				return FALSE;
-			}
+	context->last_relayed = now;
+	/* Check if there's any temporal scalability to take into account */
+	if(packet->temporal_layer != -1) {
+		if(context->templayer != context->templayer_target && packet->temporal_layer == context->templayer_target) {
+			/* FIXME We should be smarter in deciding when to switch */
+			context->templayer = context->templayer_target;
+			/* Notify the caller that the temporal layer changed */
+			context->changed_temporal = TRUE;
 		}
-	} else if(vcodec == JANUS_VIDEOCODEC_H264) {
-		/* Use the frame-marking extension to account for temporal scalability */
-		uint8_t tid = 0;
-		if(janus_rtp_header_extension_parse_framemarking(buf, len,
-				context->framemarking_ext_id, JANUS_VIDEOCODEC_H264, &tid) == 0) {
-			JANUS_LOG(LOG_HUGE, "Frame marking extension found: tid=%d\n", tid);
-			if(context->templayer != context->templayer_target && tid == context->templayer_target) {
-				/* FIXME We should be smarter in deciding when to switch */
-				context->templayer = context->templayer_target;
-				/* Notify the caller that the temporal layer changed */
-				context->changed_temporal = TRUE;
-			}
-			if(context->templayer != -1 && tid > context->templayer) {
-				JANUS_LOG(LOG_HUGE, "Dropping packet (it's temporal layer %d, but we're capping at %d)\n",
-					tid, context->templayer);
-				/* We increase the base sequence number, or there will be gaps when delivering later */
-				if(sc)
-					sc->v_base_seq++;
-				return FALSE;
-			}
+		if(context->templayer != -1 && packet->temporal_layer > context->templayer) {
+			JANUS_LOG(LOG_HUGE, "Dropping packet (it's temporal layer %d, but we're capping at %d)\n",
+				packet->temporal_layer, context->templayer);
+			/* We increase the base sequence number, or there will be gaps when delivering later */
+			if(sc)
+				sc->v_base_seq++;
+			return FALSE;
 		}
 	}
 	/* If we got here, the packet can be relayed */
 	return TRUE;
 }
+
+gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_context *context,
+		char *buf, int len, uint32_t *ssrcs, char **rids,
+		janus_videocodec vcodec, janus_rtp_switching_context *sc) {
+	if(!context || !buf || len < 1)
+		return FALSE;
+	janus_rtp_simulcasting_packet packet;
+	if(janus_rtp_simulcasting_packet_parse(&packet, buf, len, ssrcs, rids,
+			context->rid_ext_id, context->framemarking_ext_id, vcodec) < 0)
+		return FALSE;
+	return janus_rtp_simulcasting_context_process_packet(context, &packet, sc);
+}
+
+void janus_rtp_simulcasting_bitrates_update(janus_rtp_simulcasting_bitrates *bitrates, int substream, int len) {
+	if(bitrates == NULL || substream < 0 || substream > 2 || len < 1)
+		return;
+	gint64 now = janus_get_monotonic_time();
+	if(bitrates->window == 0)
+		bitrates->window = now;
+	bitrates->bytes[substream] += len;
+	if(now-bitrates->window >= G_USEC_PER_SEC) {
+		int i=0;
+		for(i=0; i<3; i++) {
+			bitrates->bitrate[i] = (uint32_t)(bitrates->bytes[i]*8*G_USEC_PER_SEC/(now-bitrates->window));
+			bitrates->bytes[i] = 0;
+		}
+		bitrates->window = now;
+	}
+}
+
+gboolean janus_rtp_simulcasting_context_bwe_update(janus_rtp_simulcasting_context *context,
+		uint32_t estimate, uint32_t *bitrates, int max_substream, int max_templayer) {
+	if(context == NULL || bitrates == NULL || estimate == 0)
+		return FALSE;
+	if(max_substream > 2)
+		max_substream = 2;
+	if(max_templayer > 2)
+		max_templayer = 2;
+	int current = context->substream_target;
+	/* Find the highest substream that fits, with some hysteresis */
+	int substream = -1, i = 0;
+	for(i=0; i<=max_substream; i++) {
+		if(bitrates[i] == 0)
+			continue;
+		/* Moving up requires some headroom, staying tolerates a small overshoot */
+		uint64_t needed = (uint64_t)bitrates[i] * (i > current ? 12 : (i == current ? 9 : 10)) / 10;
+		if(substream == -1 || (uint64_t)estimate >= needed)
+			substream = i;
+	}
+	if(substream == -1) {
+		/* We don't know anything about the substreams yet */
+		return FALSE;
+	}
+	/* If even this substream doesn't fit, drop temporal layers as well */
+	int templayer = max_templayer;
+	if(estimate < bitrates[substream])
+		templayer = MIN(max_templayer, (estimate < bitrates[substream]/2) ? 0 : 1);
+	if(substream == context->substream_target && templayer == context->templayer_target)
+		return FALSE;
+	gint64 now = janus_get_monotonic_time();
+	gboolean up = (substream > context->substream_target ||
+		(substream == context->substream_target && templayer > context->templayer_target));
+	if(now-context->bwe_changed < (up ? JANUS_RTP_SIMULCASTING_BWE_UP_INTERVAL : JANUS_RTP_SIMULCASTING_BWE_DOWN_INTERVAL))
+		return FALSE;
+	JANUS_LOG(LOG_VERB, "Bandwidth estimate %"SCNu32": switching targets (substream %d --> %d, temporal layer %d --> %d)\n",
+		estimate, context->substream_target, substream, context->templayer_target, templayer);
+	context->substream_target = substream;
+	context->templayer_target = templayer;
+	context->bwe_changed = now;
+	return TRUE;
+}
+
+/* GOP cache */
+static void janus_rtp_gop_packet_free(const janus_refcount *packet_ref) {
+	janus_rtp_gop_packet *packet = janus_refcount_containerof(packet_ref, janus_rtp_gop_packet, ref);
+	g_free(packet->buffer);
+	g_free(packet);
+}
+
+void janus_rtp_gop_packet_unref(janus_rtp_gop_packet *packet) {
+	if(packet)
+		janus_refcount_decrease(&packet->ref);
+}
+
+/* Must be called with the cache mutex locked */
+static void janus_rtp_gop_cache_empty(janus_rtp_gop_cache *cache) {
+	guint i = 0;
+	for(i=0; i<cache->count; i++) {
+		janus_rtp_gop_packet_unref(cache->packets[i]);
+		cache->packets[i] = NULL;
+	}
+	cache->count = 0;
+	cache->timestamp = 0;
+	cache->valid = FALSE;
+	cache->keyframe_only = FALSE;
+}
+
+void janus_rtp_gop_cache_init(janus_rtp_gop_cache *cache, guint size) {
+	if(cache == NULL)
+		return;
+	cache->packets = size > 0 ? g_malloc0(size * sizeof(janus_rtp_gop_packet *)) : NULL;
+	cache->size = size;
+	cache->count = 0;
+	cache->timestamp = 0;
+	cache->valid = FALSE;
+	cache->keyframe_only = FALSE;
+	janus_mutex_init(&cache->mutex);
+}
+
+void janus_rtp_gop_cache_add(janus_rtp_gop_cache *cache, char *buf, int len, gboolean keyframe) {
+	if(cache == NULL || cache->size == 0 || buf == NULL || len < RTP_HEADER_SIZE)
+		return;
+	janus_rtp_header *rtp = (janus_rtp_header *)buf;
+	guint32 timestamp = ntohl(rtp->timestamp);
+	janus_mutex_lock(&cache->mutex);
+	if(keyframe && (!cache->valid || timestamp != cache->timestamp)) {
+		/* New keyframe, start a new GOP */
+		janus_rtp_gop_cache_empty(cache);
+		cache->timestamp = timestamp;
+		cache->valid = TRUE;
+	}
+	if(!cache->valid) {
+		/* Still waiting for a keyframe */
+		janus_mutex_unlock(&cache->mutex);
+		return;
+	}
+	if(cache->keyframe_only && timestamp != cache->timestamp) {
+		/* The GOP was too large and we're only keeping its keyframe */
+		janus_mutex_unlock(&cache->mutex);
+		return;
+	}
+	if(cache->count == cache->size) {
+		/* This GOP is too large: only keep the packets of its keyframe (which
+		 * all come first, as they share its timestamp), if they fit at all */
+		guint keep = 0;
+		while(keep < cache->count && ntohl(((janus_rtp_header *)cache->packets[keep]->buffer)->timestamp) == cache->timestamp)
+			keep++;
+		if(keep == 0 || timestamp == cache->timestamp) {
+			/* Not even the keyframe fits, wait for the next one */
+			JANUS_LOG(LOG_HUGE, "GOP cache full (%u packets) with a keyframe only, invalidating until the next keyframe\n", cache->size);
+			janus_rtp_gop_cache_empty(cache);
+			janus_mutex_unlock(&cache->mutex);
+			return;
+		}
+		JANUS_LOG(LOG_HUGE, "GOP cache full (%u packets), keeping the keyframe only (%u packets) until the next one\n",
+			cache->size, keep);
+		guint i = 0;
+		for(i=keep; i<cache->count; i++) {
+			janus_rtp_gop_packet_unref(cache->packets[i]);
+			cache->packets[i] = NULL;
+		}
+		cache->count = keep;
+		cache->keyframe_only = TRUE;
+		janus_mutex_unlock(&cache->mutex);
+		return;
+	}
+	janus_rtp_gop_packet *packet = g_malloc(sizeof(janus_rtp_gop_packet));
+	packet->buffer = g_malloc(len);
+	memcpy(packet->buffer, buf, len);
+	packet->length = len;
+	janus_refcount_init(&packet->ref, janus_rtp_gop_packet_free);
+	cache->packets[cache->count] = packet;
+	cache->count++;
+	janus_mutex_unlock(&cache->mutex);
+}
+
+janus_rtp_gop_packet **janus_rtp_gop_cache_get(janus_rtp_gop_cache *cache, guint *count) {
+	if(count)
+		*count = 0;
+	if(cache == NULL || cache->size == 0 || count == NULL)
+		return NULL;
+	janus_mutex_lock(&cache->mutex);
+	if(!cache->valid || cache->count == 0) {
+		janus_mutex_unlock(&cache->mutex);
+		return NULL;
+	}
+	janus_rtp_gop_packet **packets = g_malloc(cache->count * sizeof(janus_rtp_gop_packet *));
+	guint i = 0;
+	for(i=0; i<cache->count; i++) {
+		packets[i] = cache->packets[i];
+		janus_refcount_increase(&packets[i]->ref);
+	}
+	*count = cache->count;
+	janus_mutex_unlock(&cache->mutex);
+	return packets;
+}
+
+gboolean janus_rtp_gop_cache_is_valid(janus_rtp_gop_cache *cache) {
+	if(cache == NULL || cache->size == 0)
+		return FALSE;
+	janus_mutex_lock(&cache->mutex);
+	gboolean valid = cache->valid && cache->count > 0;
+	janus_mutex_unlock(&cache->mutex);
+	return valid;
+}
+
+void janus_rtp_gop_cache_reset(janus_rtp_gop_cache *cache) {
+	if(cache == NULL || cache->size == 0)
+		return;
+	janus_mutex_lock(&cache->mutex);
+	janus_rtp_gop_cache_empty(cache);
+	janus_mutex_unlock(&cache->mutex);
+}
+
+void janus_rtp_gop_cache_destroy(janus_rtp_gop_cache *cache) {
+	if(cache == NULL)
+		return;
+	if(cache->size > 0) {
+		janus_mutex_lock(&cache->mutex);
+		janus_rtp_gop_cache_empty(cache);
+		janus_mutex_unlock(&cache->mutex);
+	}
+	g_free(cache->packets);
+	cache->packets = NULL;
+	cache->size = 0;
+	janus_mutex_destroy(&cache->mutex);
+}
@@ -27,6 +27,9 @@
 #include <glib.h>
 #include <jansson.h>
 
+#include "mutex.h"
+#include "refcount.h"
+
 #define RTP_HEADER_SIZE	12
 
 /*! \brief RTP Header (http://tools.ietf.org/html/rfc3550#section-5.1) */
@@ -286,6 +289,8 @@ typedef struct janus_rtp_simulcasting_context {
 	gboolean changed_temporal;
 	/*! \brief Whether we need to send the user a keyframe request (PLI) */
 	gboolean need_pli;
+	/*! \brief When the targets were last changed because of bandwidth estimation */
+	gint64 bwe_changed;
 } janus_rtp_simulcasting_context;
 
 /*! \brief Set (or reset) the context fields to their default values
@@ -301,6 +306,56 @@ void janus_rtp_simulcasting_context_reset(janus_rtp_simulcasting_context *contex
  * @param[in] rids The list of rids to update, if any (items will be allocated) */
 void janus_rtp_simulcasting_prepare(json_t *simulcast, int *rid_ext_id, int *framemarking_ext_id, uint32_t *ssrcs, char **rids);
 
+/*! \brief Helper struct describing a packet coming from a simulcast source: it
+ * contains all the info simulcasting contexts need to take their decisions, and
+ * can be parsed once per packet and shared by all the contexts that need it */
+typedef struct janus_rtp_simulcasting_packet {
+	/*! \brief SSRC of the packet */
+	uint32_t ssrc;
+	/*! \brief Simulcast substream the packet belongs to */
+	int substream;
+	/*! \brief Whether the packet contains a keyframe */
+	gboolean keyframe;
+	/*! \brief Temporal layer of the packet, or -1 if not available */
+	int temporal_layer;
+	/*! \brief Whether the VP8 payload descriptor info below is available */
+	gboolean vp8_descriptor;
+	/*! \brief VP8 Picture ID */
+	uint16_t picid;
+	/*! \brief VP8 temporal level zero index */
+	uint8_t tl0picidx;
+	/*! \brief Pointer to the RTP payload in the original packet */
+	char *payload;
+	/*! \brief Length of the RTP payload */
+	int plen;
+} janus_rtp_simulcasting_packet;
+
+/*! \brief Parse an RTP packet from a simulcast source, so that the result can
+ * be processed by any number of simulcasting contexts later on
+ * @param[out] packet The packet descriptor to fill in
+ * @param[in] buf The RTP packet to parse
+ * @param[in] len The length of the RTP packet (header, extension and payload)
+ * @param[in] ssrcs The simulcast SSRCs to refer to (may be updated if rids are involved)
+ * @param[in] rids The simulcast rids to refer to, if any
+ * @param[in] rid_ext_id The rid RTP extension id to check, if any
+ * @param[in] framemarking_ext_id The frame marking RTP extension id to check, if any
+ * @param[in] vcodec Video codec of the RTP payload
+ * @returns 0 if the packet belongs to a known substream, -1 otherwise */
+int janus_rtp_simulcasting_packet_parse(janus_rtp_simulcasting_packet *packet,
+	char *buf, int len, uint32_t *ssrcs, char **rids, int rid_ext_id, int framemarking_ext_id,
+	janus_videocodec vcodec);
+
+/*! \brief Decide whether a packet parsed with janus_rtp_simulcasting_packet_parse
+ * should be relayed or not, updating the context accordingly
+ * \note Calling this method resets the \c changed_substream , \c changed_temporal and \c need_pli
+ * properties, and updates them according to the decisions made after processing the packet
+ * @param[in] context The simulcasting context to use
+ * @param[in] packet The parsed packet descriptor
+ * @param[in] sc RTP switching context to refer to, if any (only needed for VP8 and dropping temporal layers)
+ * @returns TRUE if the packet should be relayed, FALSE if it should be dropped instead */
+gboolean janus_rtp_simulcasting_context_process_packet(janus_rtp_simulcasting_context *context,
+	janus_rtp_simulcasting_packet *packet, janus_rtp_switching_context *sc);
+
 /*! \brief Process an RTP packet, and decide whether this should be relayed or not, updating the context accordingly
  * \note Calling this method resets the \c changed_substream , \c changed_temporal and \c need_pli
  * properties, and updates them according to the decisions made after processinf the packet
@@ -317,4 +372,110 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 	char *buf, int len, uint32_t *ssrcs, char **rids,
 	janus_videocodec vcodec, janus_rtp_switching_context *sc);
 
+/*! \brief How long to wait before moving a subscriber to a higher layer again (microseconds) */
+#define JANUS_RTP_SIMULCASTING_BWE_UP_INTERVAL		(5*G_USEC_PER_SEC)
+/*! \brief How long to wait before moving a subscriber to a lower layer again (microseconds) */
+#define JANUS_RTP_SIMULCASTING_BWE_DOWN_INTERVAL	G_USEC_PER_SEC
+
+/*! \brief Helper struct to keep track of the bitrate of each substream of a simulcast source */
+typedef struct janus_rtp_simulcasting_bitrates {
+	/*! \brief Bytes received on each substream in the current window */
+	guint64 bytes[3];
+	/*! \brief Bitrate of each substream in the previous window (0 if not available) */
+	uint32_t bitrate[3];
+	/*! \brief When the current window started */
+	gint64 window;
+} janus_rtp_simulcasting_bitrates;
+/*! \brief Update the bitrate of a substream with a new packet
+ * \note This must always be called from the same thread: readers only
+ * look at the \c bitrate property, which is updated once per second
+ * @param[in] bitrates The janus_rtp_simulcasting_bitrates instance to update
+ * @param[in] substream The substream the packet belongs to
+ * @param[in] len The length of the packet */
+void janus_rtp_simulcasting_bitrates_update(janus_rtp_simulcasting_bitrates *bitrates, int substream, int len);
+
+/*! \brief Update the substream and temporal layer targets of a simulcasting context,
+ * according to how much bandwidth is available for the receiver. To avoid
+ * oscillations, moving to a higher substream requires some headroom (20%)
+ * and can only happen every JANUS_RTP_SIMULCASTING_BWE_UP_INTERVAL, while
+ * moving down is allowed every JANUS_RTP_SIMULCASTING_BWE_DOWN_INTERVAL.
+ * When even the lowest substream doesn't fit, lower temporal layers are used.
+ * @param[in] context The simulcasting context to update
+ * @param[in] estimate The bandwidth estimate for the receiver, in bits per second
+ * @param[in] bitrates The current bitrate of each substream (0 if not available)
+ * @param[in] max_substream The highest substream the receiver is allowed to get
+ * @param[in] max_templayer The highest temporal layer the receiver is allowed to get
+ * @returns TRUE if the targets changed, FALSE otherwise */
+gboolean janus_rtp_simulcasting_context_bwe_update(janus_rtp_simulcasting_context *context,
+	uint32_t estimate, uint32_t *bitrates, int max_substream, int max_templayer);
+
+/*! \brief Default maximum number of packets a GOP cache can hold */
+#define JANUS_RTP_GOP_CACHE_DEFAULT_SIZE	1024
+
+/*! \brief Packet stored in a GOP cache: instances are shared by all the
+ * users that get a copy of the cache, and so are reference counted */
+typedef struct janus_rtp_gop_packet {
+	/*! \brief RTP packet */
+	char *buffer;
+	/*! \brief Length of the RTP packet */
+	int length;
+	/*! \brief Reference counter for this instance */
+	janus_refcount ref;
+} janus_rtp_gop_packet;
+/*! \brief Release a reference to a GOP packet obtained via janus_rtp_gop_cache_get
+ * @param[in] packet The janus_rtp_gop_packet instance to release */
+void janus_rtp_gop_packet_unref(janus_rtp_gop_packet *packet);
+
+/*! \brief Helper struct to keep all the video packets since the most recent
+ * keyframe (a Group Of Pictures) from a source, so that new viewers can be
+ * sent a decodable stream right away, without asking the source for a new
+ * keyframe. The cache is bounded: if a GOP gets larger than the configured
+ * size, only the packets of its keyframe are kept until the next keyframe,
+ * rather than dropping older packets, as a partial GOP would not be decodable */
+typedef struct janus_rtp_gop_cache {
+	/*! \brief Packets in the cache */
+	janus_rtp_gop_packet **packets;
+	/*! \brief Maximum number of packets in the cache, 0 if the cache is disabled */
+	guint size;
+	/*! \brief Number of packets currently in the cache */
+	guint count;
+	/*! \brief RTP timestamp of the keyframe the cache started from */
+	guint32 timestamp;
+	/*! \brief Whether the cache currently contains a full GOP (or its keyframe) */
+	gboolean valid;
+	/*! \brief Whether the GOP was too large, and so only its keyframe is kept */
+	gboolean keyframe_only;
+	/*! \brief Mutex to lock the cache */
+	janus_mutex mutex;
+} janus_rtp_gop_cache;
+
+/*! \brief Initialize a GOP cache
+ * @param[in] cache The janus_rtp_gop_cache instance to initialize
+ * @param[in] size Maximum number of packets the cache can hold (0 disables the cache) */
+void janus_rtp_gop_cache_init(janus_rtp_gop_cache *cache, guint size);
+/*! \brief Add a video packet to a GOP cache: a keyframe with a new timestamp
+ * resets the cache, while packets received before the first keyframe are ignored
+ * @param[in] cache The janus_rtp_gop_cache instance to update
+ * @param[in] buf The RTP packet to add (a copy will be made)
+ * @param[in] len The length of the RTP packet
+ * @param[in] keyframe Whether the packet is (part of) a keyframe */
+void janus_rtp_gop_cache_add(janus_rtp_gop_cache *cache, char *buf, int len, gboolean keyframe);
+/*! \brief Get the packets currently in a GOP cache
+ * \note Each packet in the returned array must be released with
+ * janus_rtp_gop_packet_unref, and the array itself freed with g_free
+ * @param[in] cache The janus_rtp_gop_cache instance to query
+ * @param[out] count Number of packets in the returned array
+ * @returns An array of packets in case the cache is valid, NULL otherwise */
+janus_rtp_gop_packet **janus_rtp_gop_cache_get(janus_rtp_gop_cache *cache, guint *count);
+/*! \brief Quick check to figure out whether a GOP cache contains a full GOP
+ * @param[in] cache The janus_rtp_gop_cache instance to check
+ * @returns TRUE if the cache can be used, FALSE otherwise */
+gboolean janus_rtp_gop_cache_is_valid(janus_rtp_gop_cache *cache);
+/*! \brief Empty a GOP cache (e.g., because the source changed)
+ * @param[in] cache The janus_rtp_gop_cache instance to reset */
+void janus_rtp_gop_cache_reset(janus_rtp_gop_cache *cache);
+/*! \brief Empty a GOP cache and free its resources
+ * @param[in] cache The janus_rtp_gop_cache instance to destroy */
+void janus_rtp_gop_cache_destroy(janus_rtp_gop_cache *cache);
+
 #endif
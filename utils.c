@@ -19,6 +19,10 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <inttypes.h>
+#include <time.h>
+#ifdef HAVE_TIMERFD
+#include <sys/timerfd.h>
+#endif
 
 #include "utils.h"
 #include "debug.h"
@@ -813,6 +817,13 @@ void janus_vp8_simulcast_descriptor_update(char *buffer, int len, janus_vp8_simu
 	/* Parse the identifiers in the VP8 payload descriptor */
 	if(janus_vp8_parse_descriptor(buffer, len, &picid, &tlzi, &tid, &ybit, &keyidx) < 0)
 		return;
+	janus_vp8_simulcast_descriptor_update_parsed(buffer, len, picid, tlzi, context, switched);
+}
+
+void janus_vp8_simulcast_descriptor_update_parsed(char *buffer, int len, uint16_t picid, uint8_t tlzi,
+		janus_vp8_simulcast_context *context, gboolean switched) {
+	if(!buffer || len < 0 || !context)
+		return;
 	if(switched) {
 		context->base_picid_prev = context->last_picid;
 		context->base_picid = picid;
@@ -974,6 +985,107 @@ int janus_vp9_parse_svc(char *buffer, int len, int *found,
 	return 0;
 }
 
+janus_media_clock *janus_media_clock_create(gint64 period) {
+	if(period <= 0)
+		return NULL;
+	janus_media_clock *clock = g_malloc0(sizeof(janus_media_clock));
+	clock->fd = -1;
+	clock->period = period;
+	clock->next = janus_get_monotonic_time() + period;
+#ifdef HAVE_TIMERFD
+	clock->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if(clock->fd < 0) {
+		JANUS_LOG(LOG_WARN, "Error creating timerfd for media clock, falling back to sleeping: %d (%s)\n", errno, strerror(errno));
+	} else {
+		/* The timer uses the same clock as janus_get_monotonic_time, so we can set absolute deadlines */
+		struct itimerspec spec;
+		spec.it_value.tv_sec = clock->next / G_USEC_PER_SEC;
+		spec.it_value.tv_nsec = (clock->next % G_USEC_PER_SEC) * 1000;
+		spec.it_interval.tv_sec = period / G_USEC_PER_SEC;
+		spec.it_interval.tv_nsec = (period % G_USEC_PER_SEC) * 1000;
+		if(timerfd_settime(clock->fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+			JANUS_LOG(LOG_WARN, "Error arming timerfd for media clock, falling back to sleeping: %d (%s)\n", errno, strerror(errno));
+			close(clock->fd);
+			clock->fd = -1;
+		}
+	}
+#endif
+	return clock;
+}
+
+int janus_media_clock_wait(janus_media_clock *clock) {
+	if(clock == NULL)
+		return -1;
+	if(clock->pending == 0) {
+#ifdef HAVE_TIMERFD
+		if(clock->fd > -1) {
+			uint64_t expirations = 0;
+			ssize_t res = 0;
+			do {
+				res = read(clock->fd, &expirations, sizeof(expirations));
+			} while(res < 0 && errno == EINTR);
+			if(res != sizeof(expirations) || expirations == 0)
+				return -1;
+			clock->pending = expirations;
+		}
+#endif
+		if(clock->pending == 0) {
+			/* No timerfd, sleep until the deadline (unless we're late already) */
+			gint64 now = janus_get_monotonic_time();
+			if(now < clock->next) {
+#ifdef HAVE_CLOCK_NANOSLEEP
+				struct timespec deadline;
+				deadline.tv_sec = clock->next / G_USEC_PER_SEC;
+				deadline.tv_nsec = (clock->next % G_USEC_PER_SEC) * 1000;
+				while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+#else
+				g_usleep(clock->next - now);
+#endif
+			}
+			clock->pending = 1;
+		}
+	}
+	/* Keep track of how late we are, compared to when this tick was due */
+	gint64 late = janus_get_monotonic_time() - clock->next;
+	if(late < 0)
+		late = 0;
+	clock->jitter_last = late;
+	clock->jitter_avg = clock->ticks ? (clock->jitter_avg*15 + late)/16 : late;
+	if(late > clock->jitter_max)
+		clock->jitter_max = late;
+	clock->ticks++;
+	clock->pending--;
+	clock->next += clock->period;
+	return 0;
+}
+
+json_t *janus_media_clock_stats(janus_media_clock *clock) {
+	if(clock == NULL)
+		return NULL;
+	json_t *stats = json_object();
+	json_object_set_new(stats, "timer", json_string(clock->fd > -1 ? "timerfd" :
+#ifdef HAVE_CLOCK_NANOSLEEP
+		"clock_nanosleep"
+#else
+		"sleep"
+#endif
+	));
+	json_object_set_new(stats, "period", json_integer(clock->period));
+	json_object_set_new(stats, "ticks", json_integer(clock->ticks));
+	json_object_set_new(stats, "jitter_last", json_integer(clock->jitter_last));
+	json_object_set_new(stats, "jitter_avg", json_integer(clock->jitter_avg));
+	json_object_set_new(stats, "jitter_max", json_integer(clock->jitter_max));
+	return stats;
+}
+
+void janus_media_clock_destroy(janus_media_clock *clock) {
+	if(clock == NULL)
+		return;
+	if(clock->fd > -1)
+		close(clock->fd);
+	g_free(clock);
+}
+
 inline guint32 janus_push_bits(guint32 word, size_t num, guint32 val) {
 	return (word << num) | (val & (0xFFFFFFFF>>(32-num)));
 }
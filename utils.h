@@ -270,6 +270,17 @@ int janus_vp8_parse_descriptor(char *buffer, int len,
  * @param[in] switched Whether there has been a source switch or not (important to compute offsets) */
 void janus_vp8_simulcast_descriptor_update(char *buffer, int len, janus_vp8_simulcast_context *context, gboolean switched);
 
+/*! \brief As janus_vp8_simulcast_descriptor_update, but using identifiers that were already
+ * parsed (e.g., once per packet when the same payload is sent to multiple recipients)
+ * @param[in] buffer The RTP payload to process
+ * @param[in] len The length of the RTP payload
+ * @param[in] picid The Picture ID in the original payload descriptor
+ * @param[in] tl0picidx The temporal level zero index in the original payload descriptor
+ * @param[in] context The context to use as a reference
+ * @param[in] switched Whether there has been a source switch or not (important to compute offsets) */
+void janus_vp8_simulcast_descriptor_update_parsed(char *buffer, int len, uint16_t picid, uint8_t tl0picidx,
+	janus_vp8_simulcast_context *context, gboolean switched);
+
 /*! \brief Helper method to parse a VP9 payload descriptor for SVC-related info (e.g., when SVC is enabled)
  * @param[in] buffer The RTP payload to process
  * @param[in] len The length of the RTP payload
@@ -286,6 +297,49 @@ int janus_vp9_parse_svc(char *buffer, int len, int *found,
 		int *spatial_layer, int *temporal_layer,
 		uint8_t *p, uint8_t *d, uint8_t *u, uint8_t *b, uint8_t *e);
 
+/*! \brief Periodic clock that media threads (e.g., mixers or file sources) can use to pace themselves
+ * \note Whenever possible (Linux), ticks are driven by a timerfd on CLOCK_MONOTONIC, otherwise we
+ * sleep until the next absolute deadline: either way, the schedule never drifts, and if a
+ * thread falls behind, the next calls to janus_media_clock_wait return immediately until
+ * it catches up. The clock also keeps track of how late the thread was woken up (jitter). */
+typedef struct janus_media_clock {
+	/*! \brief Timer file descriptor, if timerfd is available */
+	int fd;
+	/*! \brief Period of the clock, in microseconds */
+	gint64 period;
+	/*! \brief Monotonic time of the next tick, in microseconds */
+	gint64 next;
+	/*! \brief Ticks that are due already, but weren't consumed yet */
+	guint64 pending;
+	/*! \brief Number of ticks so far */
+	guint64 ticks;
+	/*! \brief How late the last tick was handled, in microseconds */
+	gint64 jitter_last;
+	/*! \brief Moving average of how late ticks are handled, in microseconds */
+	gint64 jitter_avg;
+	/*! \brief Maximum lateness so far, in microseconds */
+	gint64 jitter_max;
+} janus_media_clock;
+
+/*! \brief Create a new media clock, whose first tick will be one period from now
+ * @param[in] period Period of the clock, in microseconds
+ * @returns A pointer to a new janus_media_clock instance, or NULL in case of errors */
+janus_media_clock *janus_media_clock_create(gint64 period);
+
+/*! \brief Wait for the next tick of a media clock
+ * @param[in] clock The janus_media_clock instance to wait on
+ * @returns 0 when the tick is due, a negative integer in case of errors */
+int janus_media_clock_wait(janus_media_clock *clock);
+
+/*! \brief Get a JSON representation of the statistics of a media clock
+ * @param[in] clock The janus_media_clock instance to query
+ * @returns A JSON object with the clock statistics */
+json_t *janus_media_clock_stats(janus_media_clock *clock);
+
+/*! \brief Destroy a media clock
+ * @param[in] clock The janus_media_clock instance to destroy */
+void janus_media_clock_destroy(janus_media_clock *clock);
+
 /*! \brief Helper method to push individual bits at the end of a word
  * @param[in] word Initial value of word
  * @param[in] num Number of bits to push